@@ -95,6 +95,15 @@ if (NOT ${USE_CUDA})
       message(WARNING "Could not find NNPACK, disable it")
     endif ()
   endif ()
+  if (${USE_OpenMP})
+    find_package(OpenMP QUIET)
+    if (OPENMP_FOUND)
+      message(STATUS "Found OpenMP: ${OpenMP_CXX_FLAGS}")
+    else ()
+      set(USE_OpenMP OFF)
+      message(WARNING "Could not find OpenMP, disable it")
+    endif ()
+  endif ()
 endif ()
 
 find_package(Protobuf QUIET)
@@ -126,6 +135,19 @@ if (NOT ${USE_Protobuf} AND ${USE_JSON})
   endif ()
 endif ()
 
+if (${USE_Zstd})
+  find_package(Zstd QUIET)
+  if (Zstd_FOUND)
+    include_directories(SYSTEM ${Zstd_INCLUDE_DIRS})
+    list(APPEND Shadow_LINKER_LIBS ${Zstd_LIBRARIES})
+    message(STATUS "Found zstd: ${Zstd_INCLUDE_DIRS}, ${Zstd_LIBRARIES}")
+    add_definitions(-DUSE_Zstd)
+  else ()
+    set(USE_Zstd OFF)
+    message(WARNING "Could not find zstd, disable it")
+  endif ()
+endif ()
+
 if (${USE_OpenCV})
   find_package(OpenCV PATHS ${OpenCV_DIR} NO_DEFAULT_PATH QUIET COMPONENTS core highgui imgproc imgcodecs videoio)
   if (NOT OpenCV_FOUND) # if not OpenCV 3.x, then try to find OpenCV 2.x in default path
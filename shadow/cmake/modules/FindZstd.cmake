@@ -0,0 +1,32 @@
+include(FindPackageHandleStandardArgs)
+
+set(Zstd_ROOT_DIR ${PROJECT_SOURCE_DIR}/third_party/zstd CACHE PATH "Folder contains zstd")
+
+set(Zstd_DIR ${Zstd_ROOT_DIR} /usr /usr/local)
+
+find_path(Zstd_INCLUDE_DIRS
+          NAMES zstd.h
+          PATHS ${Zstd_DIR}
+          PATH_SUFFIXES include include/x86_64 include/x64
+          DOC "zstd include header zstd.h"
+          NO_DEFAULT_PATH)
+
+find_library(Zstd_LIBRARIES
+             NAMES zstd libzstd
+             PATHS ${Zstd_DIR}
+             PATH_SUFFIXES lib lib64 lib/x86_64 lib/x64 lib/x86 lib/x86_64-linux-gnu
+             DOC "zstd library"
+             NO_DEFAULT_PATH)
+
+find_package_handle_standard_args(Zstd DEFAULT_MSG Zstd_INCLUDE_DIRS Zstd_LIBRARIES)
+
+if (Zstd_FOUND)
+  if (NOT Zstd_FIND_QUIETLY)
+    message(STATUS "Found zstd: ${Zstd_INCLUDE_DIRS}, ${Zstd_LIBRARIES}")
+  endif ()
+  mark_as_advanced(Zstd_ROOT_DIR Zstd_INCLUDE_DIRS Zstd_LIBRARIES)
+else ()
+  if (Zstd_FIND_REQUIRED)
+    message(FATAL_ERROR "Could not find zstd")
+  endif ()
+endif ()
@@ -0,0 +1,263 @@
+#include "allocator.hpp"
+
+#include "util/log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace Shadow {
+
+namespace Allocator {
+
+// The header sits in front of the memory handed out and keeps it aligned
+static const size_t kHeaderSize = 64;
+
+static const int kMinClassShift = 8;
+
+static const size_t kHugeSize = 2 << 20;
+
+struct BlockHeader {
+  void *base;
+  size_t map_size, block_size, size_class;
+  bool mapped, huge;
+};
+
+struct Pool {
+  std::mutex mutex;
+  std::vector<std::vector<void *>> free_blocks;
+  size_t cache_limit = size_t(64) << 20;
+  Stats stats;
+  uint64_t last_allocs = 0;
+  std::chrono::steady_clock::time_point last_time =
+      std::chrono::steady_clock::now();
+};
+
+// Never destroyed, blobs of static objects may be freed after it would be
+static Pool &GetPool() {
+  static auto *pool = new Pool();
+  return *pool;
+}
+
+static std::atomic<int> &HugePagesSlot() {
+  static std::atomic<int> huge_pages([]() {
+    const char *env = std::getenv("SHADOW_HUGE_PAGES");
+    if (env == nullptr || *env == '\0') {
+      return static_cast<int>(kHugeTransparent);
+    }
+    std::string name(env);
+    if (name == "off") return static_cast<int>(kHugeOff);
+    if (name == "explicit") return static_cast<int>(kHugeExplicit);
+    if (name != "transparent") {
+      LOG(WARNING) << "Unknown SHADOW_HUGE_PAGES " << name
+                   << ", using transparent";
+    }
+    return static_cast<int>(kHugeTransparent);
+  }());
+  return huge_pages;
+}
+
+HugePages GetHugePages() {
+  return static_cast<HugePages>(
+      HugePagesSlot().load(std::memory_order_relaxed));
+}
+
+void SetHugePages(HugePages huge_pages) {
+  HugePagesSlot().store(static_cast<int>(huge_pages),
+                        std::memory_order_relaxed);
+}
+
+// Classes split each power of two in four, 2^k < size <= 2^(k + 1) goes to
+// the first of 2^k + n * 2^(k - 2) holding it, wasting at most a quarter.
+// From 2MB on the steps are at least 2MB, so classes fill whole huge pages
+// and the mapping holds no more than the class, which wastes less than one
+// huge page for sizes under 8MB. Classes do not depend on the huge page
+// mode, cached blocks stay valid when it changes
+static size_t SizeClass(size_t size, size_t *class_size) {
+  if (size <= (size_t(1) << kMinClassShift)) {
+    *class_size = size_t(1) << kMinClassShift;
+    return 0;
+  }
+  int k = kMinClassShift;
+  while ((size_t(2) << k) < size) ++k;
+  size_t step = size_t(1) << (k - 2);
+  if ((size_t(1) << k) >= kHugeSize) step = std::max(step, kHugeSize);
+  size_t n = (size - 1 - (size_t(1) << k)) / step + 1;
+  *class_size = (size_t(1) << k) + n * step;
+  return (k - kMinClassShift) * 4 + n;
+}
+
+// Fresh mappings are zero already, heap blocks are not
+static BlockHeader *SystemAlloc(size_t block_size, bool *zeroed) {
+  void *base = nullptr;
+  size_t map_size = 0;
+  bool mapped = false, huge = false;
+#if defined(__linux__)
+  auto huge_pages = GetHugePages();
+  if (block_size >= kHugeSize && huge_pages != kHugeOff) {
+    map_size = (block_size + kHugeSize - 1) / kHugeSize * kHugeSize;
+    if (huge_pages == kHugeExplicit) {
+      base = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (base == MAP_FAILED) base = nullptr;
+    }
+    if (base == nullptr) {
+      // Over map by a huge page and trim both ends to a 2MB aligned range
+      size_t over_size = map_size + kHugeSize;
+      void *over_base = mmap(nullptr, over_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (over_base != MAP_FAILED) {
+        auto *over = static_cast<char *>(over_base);
+        auto addr = reinterpret_cast<uintptr_t>(over);
+        auto *aligned = over + ((kHugeSize - addr % kHugeSize) % kHugeSize);
+        size_t head = aligned - over, tail = over_size - head - map_size;
+        if (head > 0) munmap(over, head);
+        if (tail > 0) munmap(aligned + map_size, tail);
+        madvise(aligned, map_size, MADV_HUGEPAGE);
+        base = aligned;
+      }
+    }
+    mapped = huge = base != nullptr;
+  }
+#endif
+  if (base == nullptr) {
+    map_size = block_size + 2 * kHeaderSize;
+    base = new unsigned char[map_size];
+  }
+  auto addr = reinterpret_cast<uintptr_t>(base);
+  auto *header = reinterpret_cast<BlockHeader *>(
+      static_cast<char *>(base) + (kHeaderSize - addr % kHeaderSize) %
+                                      kHeaderSize);
+  header->base = base, header->map_size = map_size;
+  header->mapped = mapped, header->huge = huge;
+  *zeroed = mapped;
+  return header;
+}
+
+static void SystemFree(BlockHeader *header) {
+#if defined(__linux__)
+  if (header->mapped) {
+    munmap(header->base, header->map_size);
+    return;
+  }
+#endif
+  delete[] static_cast<unsigned char *>(header->base);
+}
+
+void *Malloc(size_t size, int align) {
+  CHECK_LE(align, static_cast<int>(kHeaderSize))
+      << "Alignment " << align << " is not supported";
+  size_t block_size = 0;
+  size_t size_class = SizeClass(size + kHeaderSize, &block_size);
+  block_size -= kHeaderSize;
+
+  auto &pool = GetPool();
+  BlockHeader *header = nullptr;
+  bool zeroed = false;
+  {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    auto &stats = pool.stats;
+    stats.num_allocs++;
+    if (size_class < pool.free_blocks.size() &&
+        !pool.free_blocks[size_class].empty()) {
+      header = static_cast<BlockHeader *>(pool.free_blocks[size_class].back());
+      pool.free_blocks[size_class].pop_back();
+      stats.cached_bytes -= block_size;
+      stats.num_reuses++;
+    }
+    stats.live_bytes += block_size;
+    if (stats.live_bytes > stats.peak_bytes) {
+      stats.peak_bytes = stats.live_bytes;
+    }
+  }
+  if (header == nullptr) {
+    header = SystemAlloc(block_size, &zeroed);
+    header->block_size = block_size, header->size_class = size_class;
+    if (header->huge) {
+      std::lock_guard<std::mutex> lock(pool.mutex);
+      pool.stats.huge_bytes += header->map_size;
+    }
+  }
+  auto *ptr = reinterpret_cast<char *>(header) + kHeaderSize;
+  if (!zeroed) memset(ptr, 0, size);
+  return ptr;
+}
+
+void Free(void *ptr) {
+  if (ptr == nullptr) return;
+  auto *header = reinterpret_cast<BlockHeader *>(static_cast<char *>(ptr) -
+                                                 kHeaderSize);
+  auto &pool = GetPool();
+  {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    auto &stats = pool.stats;
+    stats.live_bytes -= header->block_size;
+    if (stats.cached_bytes + header->block_size <= pool.cache_limit) {
+      if (header->size_class >= pool.free_blocks.size()) {
+        pool.free_blocks.resize(header->size_class + 1);
+      }
+      pool.free_blocks[header->size_class].push_back(header);
+      stats.cached_bytes += header->block_size;
+      return;
+    }
+    if (header->huge) stats.huge_bytes -= header->map_size;
+  }
+  SystemFree(header);
+}
+
+void Trim() {
+  auto &pool = GetPool();
+  std::vector<void *> blocks;
+  {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    for (auto &free_blocks : pool.free_blocks) {
+      blocks.insert(blocks.end(), free_blocks.begin(), free_blocks.end());
+      free_blocks.clear();
+    }
+    for (const auto *block : blocks) {
+      const auto *header = static_cast<const BlockHeader *>(block);
+      if (header->huge) pool.stats.huge_bytes -= header->map_size;
+    }
+    pool.stats.cached_bytes = 0;
+  }
+  for (auto *block : blocks) {
+    SystemFree(static_cast<BlockHeader *>(block));
+  }
+}
+
+void SetCacheLimit(size_t bytes) {
+  {
+    auto &pool = GetPool();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.cache_limit = bytes;
+    if (pool.stats.cached_bytes <= bytes) return;
+  }
+  Trim();
+}
+
+Stats GetStats() {
+  auto &pool = GetPool();
+  std::lock_guard<std::mutex> lock(pool.mutex);
+  auto now = std::chrono::steady_clock::now();
+  double seconds =
+      std::chrono::duration<double>(now - pool.last_time).count();
+  auto stats = pool.stats;
+  if (seconds > 0) {
+    stats.allocs_per_second = (stats.num_allocs - pool.last_allocs) / seconds;
+  }
+  pool.last_allocs = stats.num_allocs, pool.last_time = now;
+  return stats;
+}
+
+}  // namespace Allocator
+
+}  // namespace Shadow
@@ -0,0 +1,55 @@
+#ifndef SHADOW_CORE_ALLOCATOR_HPP
+#define SHADOW_CORE_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Shadow {
+
+namespace Allocator {
+
+// Host memory of the blobs. Sizes are rounded up to classes four per power
+// of two, freed blocks are cached by class and handed out again to the next
+// blob of the same class, across reshapes and networks. Blocks of 2MB and
+// more are mapped on their own and backed by huge pages when enabled.
+// Memory is returned zeroed and aligned to 64 bytes
+void *Malloc(size_t size, int align = 64);
+void Free(void *ptr);
+
+// Releases all cached blocks
+void Trim();
+
+// Bytes kept cached for reuse at most, shared by all networks of the
+// process for its whole lifetime. 64MB by default, raise it when large
+// blobs are freed and allocated again often, e.g. for inputs of changing
+// shapes. Blocks freed past the limit go back to the system, lowering it
+// below the bytes cached trims
+void SetCacheLimit(size_t bytes);
+
+// Transparent asks the kernel to back large blocks with huge pages,
+// explicit maps them from the reserved huge page pool and falls back to
+// transparent when the pool is empty. Transparent unless changed by
+// SetHugePages or the SHADOW_HUGE_PAGES environment variable (off,
+// transparent or explicit), only applies on Linux
+enum HugePages { kHugeOff = 0, kHugeTransparent = 1, kHugeExplicit = 2 };
+
+HugePages GetHugePages();
+void SetHugePages(HugePages huge_pages);
+
+struct Stats {
+  // Bytes of the blocks handed out, their peak, bytes cached for reuse and
+  // bytes mapped for huge pages, handed out or cached
+  size_t live_bytes = 0, peak_bytes = 0, cached_bytes = 0, huge_bytes = 0;
+  // Allocations in total and those served from the cache
+  uint64_t num_allocs = 0, num_reuses = 0;
+  // Allocations per second since the previous call to GetStats
+  double allocs_per_second = 0;
+};
+
+Stats GetStats();
+
+}  // namespace Allocator
+
+}  // namespace Shadow
+
+#endif  // SHADOW_CORE_ALLOCATOR_HPP
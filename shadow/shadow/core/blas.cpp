@@ -1,6 +1,9 @@
 #include "blas.hpp"
 #include "common.hpp"
+#include "cpu_features.hpp"
 #include "kernel.hpp"
+#include "sgemm.hpp"
+#include "vmath.hpp"
 
 #if defined(USE_OpenBLAS)
 #include "cblas.h"
@@ -8,9 +11,14 @@
 #include "mkl_cblas.h"
 #endif
 
+#if defined(USE_OpenMP)
+#include <omp.h>
+#endif
+
 #include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <vector>
 
 namespace Shadow {
 
@@ -78,6 +86,76 @@ void Set(int n, float val, T *y, int offy) {
 #endif
 }
 
+// Element wise loops vectorize in the build for each instruction set
+#define BLAS_BINARY_FUNC(name, operation)                             \
+  struct name##Kernel {                                               \
+    template <typename T>                                             \
+    static CPU_KERNEL void Run(int n, const T *a, const T *b, T *y) { \
+      for (int i = 0; i < n; ++i) {                                   \
+        operation;                                                    \
+      }                                                               \
+    }                                                                 \
+  };                                                                  \
+  template <typename T>                                               \
+  void name(int n, const T *a, int offa, const T *b, int offb, T *y,  \
+            int offy) {                                               \
+    CPU::Dispatch<name##Kernel>(n, a + offa, b + offb, y + offy);     \
+  }                                                                   \
+  template void name(int n, const float *a, int offa, const float *b, \
+                     int offb, float *y, int offy);
+
+#define BLAS_BINARY_SCALAR_FUNC(name, operation)                             \
+  struct name##ScalarKernel {                                                \
+    template <typename T>                                                    \
+    static CPU_KERNEL void Run(int n, const T *a, float alpha, T *y) {       \
+      for (int i = 0; i < n; ++i) {                                          \
+        operation;                                                           \
+      }                                                                      \
+    }                                                                        \
+  };                                                                         \
+  template <typename T>                                                      \
+  void name(int n, const T *a, int offa, float alpha, T *y, int offy) {      \
+    CPU::Dispatch<name##ScalarKernel>(n, a + offa, alpha, y + offy);         \
+  }                                                                          \
+  template void name(int n, const float *a, int offa, float alpha, float *y, \
+                     int offy);
+
+#define BLAS_UNARY_FUNC(name, operation)                   \
+  struct name##Kernel {                                    \
+    template <typename T>                                  \
+    static CPU_KERNEL void Run(int n, const T *a, T *y) {  \
+      for (int i = 0; i < n; ++i) {                        \
+        operation;                                         \
+      }                                                    \
+    }                                                      \
+  };                                                       \
+  template <typename T>                                    \
+  void name(int n, const T *a, int offa, T *y, int offy) { \
+    CPU::Dispatch<name##Kernel>(n, a + offa, y + offy);    \
+  }                                                        \
+  template void name(int n, const float *a, int offa, float *y, int offy);
+
+BLAS_BINARY_FUNC(Add, y[i] = a[i] + b[i]);
+BLAS_BINARY_FUNC(Sub, y[i] = a[i] - b[i]);
+BLAS_BINARY_FUNC(Mul, y[i] = a[i] * b[i]);
+BLAS_BINARY_FUNC(Div, y[i] = a[i] / b[i]);
+BLAS_BINARY_FUNC(Max, y[i] = std::max(a[i], b[i]));
+BLAS_BINARY_FUNC(Min, y[i] = std::min(a[i], b[i]));
+
+BLAS_BINARY_SCALAR_FUNC(Add, y[i] = a[i] + alpha);
+BLAS_BINARY_SCALAR_FUNC(Sub, y[i] = a[i] - alpha);
+BLAS_BINARY_SCALAR_FUNC(Mul, y[i] = a[i] * alpha);
+BLAS_BINARY_SCALAR_FUNC(Div, y[i] = a[i] / alpha);
+BLAS_BINARY_SCALAR_FUNC(Max, y[i] = std::max(a[i], alpha));
+BLAS_BINARY_SCALAR_FUNC(Min, y[i] = std::min(a[i], alpha));
+
+BLAS_UNARY_FUNC(Abs, y[i] = std::abs(a[i]));
+BLAS_UNARY_FUNC(Square, y[i] = a[i] * a[i]);
+BLAS_UNARY_FUNC(Sqrt, y[i] = std::sqrt(a[i]));
+BLAS_UNARY_FUNC(Floor, y[i] = std::floor(a[i]));
+BLAS_UNARY_FUNC(Ceil, y[i] = std::ceil(a[i]));
+
+// Functions calling into libm per element stay on Eigen when it is enabled
 #if defined(USE_Eigen)
 #define BLAS_BINARY_FUNC_EIGEN(name, operation)                       \
   template <typename T>                                               \
@@ -110,25 +188,9 @@ void Set(int n, float val, T *y, int offy) {
   }                                                                   \
   template void name(int n, const float *a, int offa, float *y, int offy);
 
-BLAS_BINARY_FUNC_EIGEN(Add, y_eigen = a_eigen.array() + b_eigen.array());
-BLAS_BINARY_FUNC_EIGEN(Sub, y_eigen = a_eigen.array() - b_eigen.array());
-BLAS_BINARY_FUNC_EIGEN(Mul, y_eigen = a_eigen.array() * b_eigen.array());
-BLAS_BINARY_FUNC_EIGEN(Div, y_eigen = a_eigen.array() / b_eigen.array());
 BLAS_BINARY_FUNC_EIGEN(Pow, y_eigen = a_eigen.array().pow(b_eigen.array()));
-BLAS_BINARY_FUNC_EIGEN(Max, y_eigen = a_eigen.cwiseMax(b_eigen));
-BLAS_BINARY_FUNC_EIGEN(Min, y_eigen = a_eigen.cwiseMin(b_eigen));
-
-BLAS_BINARY_SCALAR_FUNC_EIGEN(Add, y_eigen = a_eigen.array() + alpha);
-BLAS_BINARY_SCALAR_FUNC_EIGEN(Sub, y_eigen = a_eigen.array() - alpha);
-BLAS_BINARY_SCALAR_FUNC_EIGEN(Mul, y_eigen = a_eigen.array() * alpha);
-BLAS_BINARY_SCALAR_FUNC_EIGEN(Div, y_eigen = a_eigen.array() / alpha);
 BLAS_BINARY_SCALAR_FUNC_EIGEN(Pow, y_eigen = a_eigen.array().pow(alpha));
-BLAS_BINARY_SCALAR_FUNC_EIGEN(Max, y_eigen = a_eigen.cwiseMax(alpha));
-BLAS_BINARY_SCALAR_FUNC_EIGEN(Min, y_eigen = a_eigen.cwiseMin(alpha));
 
-BLAS_UNARY_FUNC_EIGEN(Abs, y_eigen = a_eigen.array().abs());
-BLAS_UNARY_FUNC_EIGEN(Square, y_eigen = a_eigen.array().square());
-BLAS_UNARY_FUNC_EIGEN(Sqrt, y_eigen = a_eigen.array().sqrt());
 BLAS_UNARY_FUNC_EIGEN(Log, y_eigen = a_eigen.array().log());
 BLAS_UNARY_FUNC_EIGEN(Exp, y_eigen = a_eigen.array().exp());
 BLAS_UNARY_FUNC_EIGEN(Sin, y_eigen = a_eigen.array().sin());
@@ -137,72 +199,29 @@ BLAS_UNARY_FUNC_EIGEN(Tan, y_eigen = a_eigen.array().tan());
 BLAS_UNARY_FUNC_EIGEN(Asin, y_eigen = a_eigen.array().asin());
 BLAS_UNARY_FUNC_EIGEN(Acos, y_eigen = a_eigen.array().acos());
 BLAS_UNARY_FUNC_EIGEN(Atan, y_eigen = a_eigen.array().atan());
-BLAS_UNARY_FUNC_EIGEN(Floor, y_eigen = a_eigen.array().floor());
-BLAS_UNARY_FUNC_EIGEN(Ceil, y_eigen = a_eigen.array().ceil());
 
 #else
-#define BLAS_BINARY_FUNC(name, operation)                             \
-  template <typename T>                                               \
-  void name(int n, const T *a, int offa, const T *b, int offb, T *y,  \
-            int offy) {                                               \
-    a += offa, b += offb, y += offy;                                  \
-    for (int i = 0; i < n; ++i) {                                     \
-      operation;                                                      \
-    }                                                                 \
-  }                                                                   \
-  template void name(int n, const float *a, int offa, const float *b, \
-                     int offb, float *y, int offy);
-
-#define BLAS_BINARY_SCALAR_FUNC(name, operation)                             \
-  template <typename T>                                                      \
-  void name(int n, const T *a, int offa, float alpha, T *y, int offy) {      \
-    a += offa, y += offy;                                                    \
-    for (int i = 0; i < n; ++i) {                                            \
-      operation;                                                             \
-    }                                                                        \
-  }                                                                          \
-  template void name(int n, const float *a, int offa, float alpha, float *y, \
-                     int offy);
-
-#define BLAS_UNARY_FUNC(name, operation)                   \
-  template <typename T>                                    \
-  void name(int n, const T *a, int offa, T *y, int offy) { \
-    a += offa, y += offy;                                  \
-    for (int i = 0; i < n; ++i) {                          \
-      operation;                                           \
-    }                                                      \
-  }                                                        \
-  template void name(int n, const float *a, int offa, float *y, int offy);
-
-BLAS_BINARY_FUNC(Add, y[i] = a[i] + b[i]);
-BLAS_BINARY_FUNC(Sub, y[i] = a[i] - b[i]);
-BLAS_BINARY_FUNC(Mul, y[i] = a[i] * b[i]);
-BLAS_BINARY_FUNC(Div, y[i] = a[i] / b[i]);
 BLAS_BINARY_FUNC(Pow, y[i] = std::pow(a[i], b[i]));
-BLAS_BINARY_FUNC(Max, y[i] = std::max(a[i], b[i]));
-BLAS_BINARY_FUNC(Min, y[i] = std::min(a[i], b[i]));
-
-BLAS_BINARY_SCALAR_FUNC(Add, y[i] = a[i] + alpha);
-BLAS_BINARY_SCALAR_FUNC(Sub, y[i] = a[i] - alpha);
-BLAS_BINARY_SCALAR_FUNC(Mul, y[i] = a[i] * alpha);
-BLAS_BINARY_SCALAR_FUNC(Div, y[i] = a[i] / alpha);
 BLAS_BINARY_SCALAR_FUNC(Pow, y[i] = std::pow(a[i], alpha));
-BLAS_BINARY_SCALAR_FUNC(Max, y[i] = std::max(a[i], alpha));
-BLAS_BINARY_SCALAR_FUNC(Min, y[i] = std::min(a[i], alpha));
 
-BLAS_UNARY_FUNC(Abs, y[i] = std::abs(a[i]));
-BLAS_UNARY_FUNC(Square, y[i] = a[i] * a[i]);
-BLAS_UNARY_FUNC(Sqrt, y[i] = std::sqrt(a[i]));
-BLAS_UNARY_FUNC(Log, y[i] = std::log(a[i]));
-BLAS_UNARY_FUNC(Exp, y[i] = std::exp(a[i]));
 BLAS_UNARY_FUNC(Sin, y[i] = std::sin(a[i]));
 BLAS_UNARY_FUNC(Cos, y[i] = std::cos(a[i]));
 BLAS_UNARY_FUNC(Tan, y[i] = std::tan(a[i]));
 BLAS_UNARY_FUNC(Asin, y[i] = std::asin(a[i]));
 BLAS_UNARY_FUNC(Acos, y[i] = std::acos(a[i]));
 BLAS_UNARY_FUNC(Atan, y[i] = std::atan(a[i]));
-BLAS_UNARY_FUNC(Floor, y[i] = std::floor(a[i]));
-BLAS_UNARY_FUNC(Ceil, y[i] = std::ceil(a[i]));
+
+// Vectorized and following the precision mode of VMath
+template <typename T>
+void Log(int n, const T *a, int offa, T *y, int offy) {
+  VMath::Log(n, a + offa, y + offy);
+}
+template <typename T>
+void Exp(int n, const T *a, int offa, T *y, int offy) {
+  VMath::Exp(n, a + offa, y + offy);
+}
+template void Log(int n, const float *a, int offa, float *y, int offy);
+template void Exp(int n, const float *a, int offa, float *y, int offy);
 #endif
 
 // Level 1
@@ -381,7 +400,14 @@ void BlasSgemm(int TA, int TB, int M, int N, int K, float alpha, const T *A,
   auto transB = TB ? CblasTrans : CblasNoTrans;
   cblas_sgemm(CblasRowMajor, transA, transB, M, N, K, alpha, A + offA, lda,
               B + offB, ldb, beta, C + offC, N);
-#elif defined(USE_Eigen)
+#else
+  // Kernels bound to the instruction set of the running cpu take the shapes
+  // they are fast for, the portable implementations below handle the rest
+  if (SgemmDispatch(CPU::ActiveISA(), TA, TB, M, N, K, alpha, A + offA,
+                    B + offB, beta, C + offC)) {
+    return;
+  }
+#if defined(USE_Eigen)
   auto C_eigen = MapMatrix<T>(C + offC, N, M);
   if (!TA && !TB) {
     const auto &A_eigen = MapMatrix<T>(const_cast<T *>(A + offA), K, M);
@@ -417,6 +443,60 @@ void BlasSgemm(int TA, int TB, int M, int N, int K, float alpha, const T *A,
     SgemmTT(M, N, K, alpha, A + offA, B + offB, C + offC);
   }
 #endif
+#endif
+}
+
+template <typename T>
+void BlasSgemmBatched(int TA, int TB, int M, int N, int K, float alpha,
+                      const T *A, int offA, int strideA, const T *B, int offB,
+                      int strideB, float beta, T *C, int offC, int strideC,
+                      int batch, void *ctx, const SgemmPackedA *packed_A) {
+  // Matrix i from A packed ahead when it was packed for this call and the
+  // running kernel, false leaves it to the gemm below
+  auto gemm_packed = [&](int i) {
+#if !defined(USE_OpenBLAS) && !defined(USE_MKL)
+    return packed_A != nullptr && packed_A->TA == TA && packed_A->M == M &&
+           packed_A->K == K && packed_A->batch == batch &&
+           SgemmDispatch(CPU::ActiveISA(), *packed_A, i, TB, N, alpha,
+                         B + offB + i * strideB, beta, C + offC + i * strideC);
+#else
+    return false;
+#endif
+  };
+  if (batch == 1) {
+    if (!gemm_packed(0)) {
+      BlasSgemm(TA, TB, M, N, K, alpha, A, offA, B, offB, beta, C, offC, ctx);
+    }
+    return;
+  }
+#if defined(USE_MKL)
+  MKL_INT m = M, n = N, k = K, lda = TA ? M : K, ldb = TB ? K : N, ldc = N,
+          group_size = batch;
+  auto transA = TA ? CblasTrans : CblasNoTrans;
+  auto transB = TB ? CblasTrans : CblasNoTrans;
+  std::vector<const T *> A_array(batch), B_array(batch);
+  std::vector<T *> C_array(batch);
+  for (int i = 0; i < batch; ++i) {
+    A_array[i] = A + offA + i * strideA;
+    B_array[i] = B + offB + i * strideB;
+    C_array[i] = C + offC + i * strideC;
+  }
+  cblas_sgemm_batch(CblasRowMajor, &transA, &transB, &m, &n, &k, &alpha,
+                    A_array.data(), &lda, B_array.data(), &ldb, &beta,
+                    C_array.data(), &ldc, 1, &group_size);
+#else
+  // Parallel over the matrices when there are enough to occupy the threads,
+  // otherwise each gemm runs its own parallel loop
+#if defined(USE_OpenMP)
+#pragma omp parallel for if (batch >= omp_get_max_threads())
+#endif
+  for (int i = 0; i < batch; ++i) {
+    if (!gemm_packed(i)) {
+      BlasSgemm(TA, TB, M, N, K, alpha, A, offA + i * strideA, B,
+                offB + i * strideB, beta, C, offC + i * strideC, ctx);
+    }
+  }
+#endif
 }
 
 // Explicit instantiation
@@ -448,6 +528,12 @@ template void BlasSgemv(int TA, int M, int N, float alpha, const float *A,
 template void BlasSgemm(int TA, int TB, int M, int N, int K, float alpha,
                         const float *A, int offA, const float *B, int offB,
                         float beta, float *C, int offC, void *ctx);
+template void BlasSgemmBatched(int TA, int TB, int M, int N, int K,
+                               float alpha, const float *A, int offA,
+                               int strideA, const float *B, int offB,
+                               int strideB, float beta, float *C, int offC,
+                               int strideC, int batch, void *ctx,
+                               const SgemmPackedA *packed_A);
 #endif
 
 }  // namespace Blas
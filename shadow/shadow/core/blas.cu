@@ -225,6 +225,19 @@ void BlasSgemm(int TA, int TB, int M, int N, int K, float alpha, const T *A,
                            B + offB, ldb, A + offA, lda, &beta, C + offC, N));
 }
 
+template <typename T>
+void BlasSgemmBatched(int TA, int TB, int M, int N, int K, float alpha,
+                      const T *A, int offA, int strideA, const T *B, int offB,
+                      int strideB, float beta, T *C, int offC, int strideC,
+                      int batch, void *ctx, const SgemmPackedA *) {
+  int lda = TA ? M : K, ldb = TB ? K : N;
+  auto transA = TA ? CUBLAS_OP_T : CUBLAS_OP_N;
+  auto transB = TB ? CUBLAS_OP_T : CUBLAS_OP_N;
+  CUBLAS_CHECK(cublasSgemmStridedBatched(
+      cublasHandle_t(ctx), transB, transA, N, M, K, &alpha, B + offB, ldb,
+      strideB, A + offA, lda, strideA, &beta, C + offC, N, strideC, batch));
+}
+
 // Explicit instantiation
 template void ChannelMax(int num, int channels, int spatial_dim,
                          const float *data, float *val_max);
@@ -254,6 +267,12 @@ template void BlasSgemv(int TA, int M, int N, float alpha, const float *A,
 template void BlasSgemm(int TA, int TB, int M, int N, int K, float alpha,
                         const float *A, int offA, const float *B, int offB,
                         float beta, float *C, int offC, void *ctx);
+template void BlasSgemmBatched(int TA, int TB, int M, int N, int K,
+                               float alpha, const float *A, int offA,
+                               int strideA, const float *B, int offB,
+                               int strideB, float beta, float *C, int offC,
+                               int strideC, int batch, void *ctx,
+                               const SgemmPackedA *packed_A);
 #endif
 
 }  // namespace Blas
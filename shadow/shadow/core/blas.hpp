@@ -5,6 +5,8 @@ namespace Shadow {
 
 namespace Blas {
 
+struct SgemmPackedA;
+
 template <typename T>
 void ChannelMax(int num, int channels, int spatial_dim, const T *data,
                 T *val_max);
@@ -103,6 +105,15 @@ void BlasSgemm(int TA, int TB, int M, int N, int K, float alpha, const T *A,
                int offA, const T *B, int offB, float beta, T *C, int offC,
                void *ctx);
 
+// batch independent gemms, matrix i starts at off + i * stride of each operand,
+// packed_A holds A packed ahead by SgemmPackA and is ignored on gpu
+template <typename T>
+void BlasSgemmBatched(int TA, int TB, int M, int N, int K, float alpha,
+                      const T *A, int offA, int strideA, const T *B, int offB,
+                      int strideB, float beta, T *C, int offC, int strideC,
+                      int batch, void *ctx,
+                      const SgemmPackedA *packed_A = nullptr);
+
 }  // namespace Blas
 
 }  // namespace Shadow
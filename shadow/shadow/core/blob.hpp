@@ -1,6 +1,7 @@
 #ifndef SHADOW_CORE_BLOB_HPP
 #define SHADOW_CORE_BLOB_HPP
 
+#include "allocator.hpp"
 #include "common.hpp"
 #include "kernel.hpp"
 
@@ -23,7 +24,10 @@ class Blob {
   ~Blob() { clear(); }
 
   const Dtype *data() const { return data_; }
-  Dtype *mutable_data() { return data_; }
+  Dtype *mutable_data() {
+    ++version_;
+    return data_;
+  }
 
   const Dtype *cpu_data() {
 #if defined(USE_CUDA)
@@ -40,11 +44,12 @@ class Blob {
   void set_data(const Dtype *data, int set_count) {
     CHECK_NOTNULL(data);
     CHECK_EQ(set_count, count());
+    ++version_;
 #if defined(USE_CUDA)
     Kernel::WriteBuffer(count(), data, data_);
 
 #else
-    if (!shared_) {
+    if (!shared_ || view_) {
       memcpy(data_, data, count() * sizeof(Dtype));
     } else {
       data_ = const_cast<Dtype *>(data);
@@ -73,11 +78,26 @@ class Blob {
     }
     data_ = const_cast<Dtype *>(data);
     shared_ = true;
+    ++version_;
   }
   void share_data(const Blob<Dtype> &from) {
     share_data(from.data_, from.shape_);
   }
 
+  // Make this blob a window into memory owned by another blob, it keeps the
+  // window as long as later reshapes fit in it and never releases the memory
+  void set_view(const Dtype *data, const VecInt &shape) {
+    CHECK_NOTNULL(data);
+    auto view_shape = shape;
+    clear();
+    set_shape(view_shape);
+    data_ = const_cast<Dtype *>(data);
+    capacity_ = count();
+    shared_ = true;
+    view_ = true;
+    ++version_;
+  }
+
   void reshape(const VecInt &shape, bool shared = false, int align = 1) {
     size_t cou = 1;
     for (const auto dim : shape) cou *= dim;
@@ -107,6 +127,10 @@ class Blob {
   size_t cstep() const { return cstep_; }
   size_t capacity() const { return capacity_; }
   bool shared() const { return shared_; }
+  bool is_view() const { return view_; }
+  // Changes whenever the data may have been written, for ops that cache
+  // something derived from a blob they only read
+  size_t version() const { return version_; }
 
   void set_name(const std::string &name) { name_ = name; }
   void set_device(Device device) { device_ = device; }
@@ -154,7 +178,7 @@ class Blob {
       Kernel::ReleaseBuffer(data_);
 
 #else
-      fast_free(data_);
+      Allocator::Free(data_);
 #endif
     }
     data_ = nullptr;
@@ -163,6 +187,7 @@ class Blob {
     cstep_ = 0;
     capacity_ = 0;
     shared_ = false;
+    view_ = false;
   }
 
  private:
@@ -173,7 +198,8 @@ class Blob {
 
 #else
     if (!shared) {
-      data_ = static_cast<Dtype *>(fast_malloc(count * sizeof(Dtype), align));
+      data_ = static_cast<Dtype *>(
+          Allocator::Malloc(count * sizeof(Dtype), align));
     }
     shared_ = shared;
 #endif
@@ -195,7 +221,8 @@ class Blob {
   VecInt shape_{};
   Device device_ = kCPU;
   size_t cstep_ = 0, capacity_ = 0;
-  bool shared_ = false;
+  bool shared_ = false, view_ = false;
+  size_t version_ = 0;
 
   DISABLE_COPY_AND_ASSIGN(Blob<Dtype>);
 };
@@ -30,20 +30,6 @@ static inline T* align_ptr(T* ptr, int n = sizeof(T)) {
   return (T*)(((size_t)ptr + n - 1) & -n);
 }
 
-static inline void* fast_malloc(size_t size, int align) {
-  auto* u_data = new unsigned char[size + sizeof(void*) + align]();
-  unsigned char** a_data = align_ptr((unsigned char**)u_data + 1, align);
-  a_data[-1] = u_data;
-  return a_data;
-}
-
-static inline void fast_free(void* ptr) {
-  if (ptr != nullptr) {
-    unsigned char* u_data = ((unsigned char**)ptr)[-1];
-    delete[] u_data;
-  }
-}
-
 #ifndef DISABLE_COPY_AND_ASSIGN
 #define DISABLE_COPY_AND_ASSIGN(classname) \
  private:                                  \
@@ -0,0 +1,102 @@
+#include "cpu_features.hpp"
+
+#include "util/log.hpp"
+
+#include <atomic>
+#include <cstdlib>
+
+namespace Shadow {
+
+namespace CPU {
+
+static ISA ProbeISA() {
+#if defined(__aarch64__) || defined(__ARM_NEON)
+  return kNEON;
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+  // __builtin_cpu_supports also checks the os saves the wide registers
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return kAVX512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return kAVX2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) return kSSE4;
+  return kGeneric;
+#else
+  return kGeneric;
+#endif
+}
+
+static ISA ClampISA(ISA isa) {
+  const auto detected = DetectISA();
+  if (detected == kNEON || isa == kNEON) {
+    return isa == detected ? isa : kGeneric;
+  }
+  return isa < detected ? isa : detected;
+}
+
+static bool ParseISA(const std::string &name, ISA *isa) {
+  for (const auto candidate : {kGeneric, kSSE4, kAVX2, kAVX512, kNEON}) {
+    if (name == ISAName(candidate)) {
+      *isa = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+static std::atomic<int> &ActiveSlot() {
+  static std::atomic<int> active([]() {
+    auto isa = DetectISA();
+    const char *env = std::getenv("SHADOW_CPU_ISA");
+    if (env != nullptr && *env != '\0') {
+      ISA override_isa;
+      if (ParseISA(env, &override_isa)) {
+        isa = ClampISA(override_isa);
+      } else {
+        LOG(WARNING) << "Unknown SHADOW_CPU_ISA " << env << ", using "
+                     << ISAName(isa);
+      }
+    }
+    return static_cast<int>(isa);
+  }());
+  return active;
+}
+
+ISA DetectISA() {
+  static const ISA detected = ProbeISA();
+  return detected;
+}
+
+ISA ActiveISA() {
+  return static_cast<ISA>(ActiveSlot().load(std::memory_order_relaxed));
+}
+
+void SetISA(ISA isa) {
+  ActiveSlot().store(static_cast<int>(ClampISA(isa)),
+                     std::memory_order_relaxed);
+}
+
+void SetISA(const std::string &name) {
+  ISA isa;
+  CHECK(ParseISA(name, &isa)) << "Unknown instruction set " << name;
+  SetISA(isa);
+}
+
+std::string ISAName(ISA isa) {
+  switch (isa) {
+    case kSSE4:
+      return "sse4";
+    case kAVX2:
+      return "avx2";
+    case kAVX512:
+      return "avx512";
+    case kNEON:
+      return "neon";
+    default:
+      return "generic";
+  }
+}
+
+}  // namespace CPU
+
+}  // namespace Shadow
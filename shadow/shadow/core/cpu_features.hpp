@@ -0,0 +1,86 @@
+#ifndef SHADOW_CORE_CPU_FEATURES_HPP
+#define SHADOW_CORE_CPU_FEATURES_HPP
+
+#include <string>
+#include <utility>
+
+namespace Shadow {
+
+namespace CPU {
+
+// Instruction sets kernels are specialized for, ordered so that a larger
+// value on x86 implies every smaller one
+enum ISA { kGeneric = 0, kSSE4 = 1, kAVX2 = 2, kAVX512 = 3, kNEON = 4 };
+
+// Best instruction set supported by the running cpu and os, probed once
+ISA DetectISA();
+
+// Instruction set the kernels are bound to: the detected one, unless lowered
+// by SetISA or the SHADOW_CPU_ISA environment variable (generic, sse4, avx2,
+// avx512 or neon), which is useful for benchmarking the fallbacks
+ISA ActiveISA();
+
+// Overrides above the detected instruction set are clamped to it
+void SetISA(ISA isa);
+void SetISA(const std::string &name);
+
+std::string ISAName(ISA isa);
+
+// Kernels are built once per instruction set from a struct whose static Run
+// holds the loops and is always inlined into each build, so the compiler
+// vectorizes them for that set. Dispatch binds a call to the build of the
+// active instruction set. OpenMP regions belong around Dispatch, not in Run,
+// as their bodies are outlined before Run gets inlined
+#if defined(__GNUC__)
+#define CPU_KERNEL inline __attribute__((always_inline))
+#else
+#define CPU_KERNEL inline
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CPU_KERNEL_X86
+template <typename Kernel, typename... Args>
+__attribute__((target("sse4.1"))) void RunSSE4(Args &&... args) {
+  Kernel::Run(std::forward<Args>(args)...);
+}
+template <typename Kernel, typename... Args>
+__attribute__((target("avx2,fma"))) void RunAVX2(Args &&... args) {
+  Kernel::Run(std::forward<Args>(args)...);
+}
+template <typename Kernel, typename... Args>
+__attribute__((target("avx512f"))) void RunAVX512(Args &&... args) {
+  Kernel::Run(std::forward<Args>(args)...);
+}
+#elif defined(__arm__) && !defined(__ARM_NEON) && defined(__GNUC__)
+#define CPU_KERNEL_ARM
+template <typename Kernel, typename... Args>
+__attribute__((target("fpu=neon"))) void RunNEON(Args &&... args) {
+  Kernel::Run(std::forward<Args>(args)...);
+}
+#endif
+
+template <typename Kernel, typename... Args>
+inline void Dispatch(Args &&... args) {
+  switch (ActiveISA()) {
+#if defined(CPU_KERNEL_X86)
+    case kAVX512:
+      return RunAVX512<Kernel>(std::forward<Args>(args)...);
+    case kAVX2:
+      return RunAVX2<Kernel>(std::forward<Args>(args)...);
+    case kSSE4:
+      return RunSSE4<Kernel>(std::forward<Args>(args)...);
+#elif defined(CPU_KERNEL_ARM)
+    case kNEON:
+      return RunNEON<Kernel>(std::forward<Args>(args)...);
+#endif
+    default:
+      // Also NEON where the baseline of the build already includes it
+      return Kernel::Run(std::forward<Args>(args)...);
+  }
+}
+
+}  // namespace CPU
+
+}  // namespace Shadow
+
+#endif  // SHADOW_CORE_CPU_FEATURES_HPP
@@ -39,6 +39,31 @@ void Network::Forward(
   engine_->Forward(data_map, shape_map);
 }
 
+void Network::Forward(
+    const std::map<std::string, unsigned char *> &data_map,
+    const std::map<std::string, std::vector<int>> &shape_map) {
+  engine_->Forward(data_map, shape_map);
+}
+
+void Network::EnableTuning(const std::string &cache_file) {
+  engine_->EnableTuning(cache_file);
+}
+
+Network::MemoryInfo Network::QueryMemory(
+    const std::map<std::string, std::vector<int>> &shape_map) {
+  return engine_->QueryMemory(shape_map);
+}
+
+void Network::SetMemoryBudget(size_t bytes) {
+  engine_->SetMemoryBudget(bytes);
+}
+
+void Network::EnableProfiling(bool enable) { engine_->EnableProfiling(enable); }
+
+const std::vector<Network::OpProfile> Network::GetProfile() const {
+  return engine_->GetProfile();
+}
+
 #define INSTANTIATE_GET_BLOB(T)                                          \
   template <>                                                            \
   const T *Network::GetBlobDataByName<T>(const std::string &blob_name) { \
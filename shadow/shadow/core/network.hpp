@@ -17,6 +17,8 @@ class Network {
   void Setup(int device_id = 0);
 
   void LoadModel(const shadow::NetParam &net_param);
+  // proto_data and proto_bin may also hold a model pack written by
+  // IO::WriteModelPack, its weights are then decoded in parallel
   void LoadModel(const void *proto_data, int proto_size);
   void LoadModel(const std::string &proto_bin);
   void LoadModel(const std::string &proto_str,
@@ -25,6 +27,60 @@ class Network {
 
   void Forward(const std::map<std::string, float *> &data_map,
                const std::map<std::string, std::vector<int>> &shape_map = {});
+  // For inputs declared as unsigned char, e.g. packed images handed to a
+  // Preprocess op
+  void Forward(const std::map<std::string, unsigned char *> &data_map,
+               const std::map<std::string, std::vector<int>> &shape_map = {});
+
+  // Let operators benchmark their algorithms on the first forward of each
+  // input shape, the choices are kept in cache_file if it is not empty
+  void EnableTuning(const std::string &cache_file = "");
+
+  // Bytes of the model blobs an op reads, of the blobs it writes and of the
+  // temporaries it stacks. Totals count every blob once, with the memory of
+  // views and aliases left out, and the temp buffer shared by all ops
+  struct OpMemory {
+    std::string name, type;
+    size_t weight_bytes = 0, activation_bytes = 0, temp_bytes = 0;
+  };
+  struct MemoryInfo {
+    size_t weight_bytes = 0, activation_bytes = 0, temp_bytes = 0;
+    std::vector<OpMemory> ops;
+
+    size_t total_bytes() const {
+      return weight_bytes + activation_bytes + temp_bytes;
+    }
+  };
+
+  // Reports the memory a forward over inputs of the shapes in shape_map, or
+  // of their current shapes, would take. The blob shapes and the temporaries
+  // of the ops are inferred without allocating or running anything, so the
+  // net is left as it was
+  MemoryInfo QueryMemory(
+      const std::map<std::string, std::vector<int>> &shape_map = {});
+
+  // Keeps weights, activations and temporaries within bytes where ops have
+  // a choice, conv picks its algorithm and tile size by the temp memory
+  // left over. Settles over the first forward of a new input shape, 0 lifts
+  // the limit
+  void SetMemoryBudget(size_t bytes);
+
+  // Wall time of each op and its hardware counters, summed over the
+  // forwards since profiling was enabled, next to the work it did. Ops with
+  // many flops per byte and instructions per cycle are compute bound, many
+  // cache misses per byte point to memory bound ones. Counters are read
+  // through perf_event_open and stay at zero where it is not permitted
+  struct OpProfile {
+    std::string name, type;
+    int forwards = 0;
+    double milliseconds = 0, flops = 0, bytes = 0;
+    uint64_t cycles = 0, instructions = 0, cache_misses = 0,
+             branch_misses = 0;
+  };
+
+  // Enabling starts over from zero
+  void EnableProfiling(bool enable = true);
+  const std::vector<OpProfile> GetProfile() const;
 
   template <typename T>
   const T *GetBlobDataByName(const std::string &blob_name);
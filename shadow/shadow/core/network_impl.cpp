@@ -2,6 +2,8 @@
 
 #include "util/io.hpp"
 
+#include <set>
+
 namespace Shadow {
 
 void Network::NetworkImpl::Setup(int device_id) { ws_.CreateCtx(device_id); }
@@ -9,16 +11,37 @@ void Network::NetworkImpl::Setup(int device_id) { ws_.CreateCtx(device_id); }
 void Network::NetworkImpl::LoadModel(const shadow::NetParam &net_param) {
   net_param_ = net_param;
   Initial();
+  DryRun();
 }
 
 void Network::NetworkImpl::LoadModel(const void *proto_data, int proto_size) {
-  LoadProtoData(proto_data, proto_size, &net_param_);
-  Initial();
+  if (IO::IsModelPack(proto_data, proto_size)) {
+    IO::ModelPack pack;
+    CHECK(pack.Open(proto_data, proto_size))
+        << "Error when loading model pack data";
+    net_param_ = pack.net_param();
+    Initial();
+    CopyWeights(pack);
+  } else {
+    LoadProtoData(proto_data, proto_size, &net_param_);
+    Initial();
+  }
+  DryRun();
 }
 
 void Network::NetworkImpl::LoadModel(const std::string &proto_bin) {
-  LoadProtoBin(proto_bin, &net_param_);
-  Initial();
+  if (IO::IsModelPackFile(proto_bin)) {
+    IO::ModelPack pack;
+    CHECK(pack.Open(proto_bin))
+        << "Error when loading model pack file: " << proto_bin;
+    net_param_ = pack.net_param();
+    Initial();
+    CopyWeights(pack);
+  } else {
+    LoadProtoBin(proto_bin, &net_param_);
+    Initial();
+  }
+  DryRun();
 }
 
 void Network::NetworkImpl::LoadModel(const std::string &proto_str,
@@ -26,6 +49,7 @@ void Network::NetworkImpl::LoadModel(const std::string &proto_str,
   LoadProtoStrOrText(proto_str, &net_param_);
   Initial();
   CopyWeights(weights);
+  DryRun();
 }
 
 void Network::NetworkImpl::LoadModel(const std::string &proto_str,
@@ -33,6 +57,7 @@ void Network::NetworkImpl::LoadModel(const std::string &proto_str,
   LoadProtoStrOrText(proto_str, &net_param_);
   Initial();
   CopyWeights(weights_data);
+  DryRun();
 }
 
 void Network::NetworkImpl::Forward(
@@ -42,11 +67,30 @@ void Network::NetworkImpl::Forward(
 
   if (ops_.empty()) return;
 
+  FeedInputs(data_map, shape_map);
+  RunOps();
+}
+
+void Network::NetworkImpl::Forward(
+    const std::map<std::string, unsigned char *> &data_map,
+    const std::map<std::string, std::vector<int>> &shape_map) {
+  ws_.Ctx()->SwitchDevice();
+
+  if (ops_.empty()) return;
+
+  FeedInputs(data_map, shape_map);
+  RunOps();
+}
+
+template <typename T>
+void Network::NetworkImpl::FeedInputs(
+    const std::map<std::string, T *> &data_map,
+    const std::map<std::string, std::vector<int>> &shape_map) {
   for (const auto &in_map : data_map) {
     const auto &blob_name = in_map.first;
     const auto *blob_data = in_map.second;
     CHECK_NOTNULL(blob_data) << blob_name << " has null data";
-    auto *in_blob = ws_.GetBlob<float>(blob_name);
+    auto *in_blob = ws_.GetBlob<T>(blob_name);
     if (in_blob != nullptr) {
       if (shape_map.count(blob_name)) {
         const auto &blob_shape = shape_map.at(blob_name);
@@ -57,12 +101,54 @@ void Network::NetworkImpl::Forward(
       LOG(FATAL) << "Can not find blob " << blob_name;
     }
   }
+}
 
-  for (auto &op : ops_) {
-    op->Forward();
-    DLOG(INFO) << op->debug_log();
+void Network::NetworkImpl::RunOps() {
+  if (views_planned_) {
+    for (const auto &blob_name : in_blob_) {
+      if (ws_.GetBlobShape(blob_name) != view_shapes_[blob_name]) {
+        ReleaseBlobViews();
+        ops_folded_ = false;
+        break;
+      }
+    }
+  }
+
+  if (memory_budget_ > 0) {
+    // Blobs first sized by this forward only count from the next one on
+    size_t weight_bytes = 0, activation_bytes = 0;
+    MeasureBlobs(&weight_bytes, &activation_bytes);
+    auto used_bytes = weight_bytes + activation_bytes;
+    ws_.SetTempBudget(memory_budget_ > used_bytes ? memory_budget_ - used_bytes
+                                                  : 0);
   }
 
+  for (int i = 0; i < static_cast<int>(ops_.size()); ++i) {
+    if (ops_folded_ && folded_ops_[i]) continue;
+    TempScope temp_scope(&ws_);
+    if (profiling_) {
+      Timer timer;
+      auto perf_start = perf_counters_.Read();
+      ops_[i]->Forward();
+      ProfileOp(i, &timer, perf_start);
+    } else {
+      ops_[i]->Forward();
+    }
+    DLOG(INFO) << ops_[i]->debug_log() << ", temp " << temp_scope.peak()
+               << " bytes";
+  }
+
+  if (!ops_folded_) {
+    FoldConstantOps();
+  }
+
+  if (!views_planned_) {
+    PlanBlobViews();
+  }
+
+  // Choices tuned by this forward are saved in one go
+  ws_.GetTuner()->Flush();
+
 #if defined(USE_CUDA)
   Kernel::Synchronize();
 #endif
@@ -70,14 +156,194 @@ void Network::NetworkImpl::Forward(
   DLOG(INFO) << "Forward Network!";
 }
 
+void Network::NetworkImpl::EnableTuning(const std::string &cache_file) {
+  tuning_ = true;
+  tuning_cache_ = cache_file;
+  if (!ops_.empty()) {
+    ws_.GetTuner()->Setup(tuning_cache_, ModelHash());
+  }
+}
+
+Network::MemoryInfo Network::NetworkImpl::QueryMemory(
+    const std::map<std::string, std::vector<int>> &shape_map) {
+  MemoryInfo memory_info;
+  if (ops_.empty()) return memory_info;
+
+  std::map<std::string, VecInt> blob_shapes;
+  for (const auto &blob_name : ws_.GetBlobNames()) {
+    blob_shapes[blob_name] = ws_.GetBlobShape(blob_name);
+  }
+  for (const auto &shape_it : shape_map) {
+    CHECK(blob_shapes.count(shape_it.first))
+        << "Can not find input blob " << shape_it.first;
+    blob_shapes[shape_it.first] = shape_it.second;
+  }
+  for (const auto &blob_name : in_blob_) {
+    CHECK(!blob_shapes.at(blob_name).empty())
+        << "Shape of input blob " << blob_name << " is unknown";
+  }
+
+  // Nothing is stacked, the budget and the peak are put back afterwards
+  auto temp_budget = ws_.TempBudget(), temp_peak = ws_.TempPeak();
+  std::vector<size_t> temp_peaks;
+  InferBlobShapes(&blob_shapes, &temp_peaks);
+  MeasureBlobs(blob_shapes, &memory_info.weight_bytes,
+               &memory_info.activation_bytes);
+  if (memory_budget_ > 0) {
+    // Once more with the activations of this shape counted in the budget
+    auto used_bytes = memory_info.weight_bytes + memory_info.activation_bytes;
+    ws_.SetTempBudget(memory_budget_ > used_bytes ? memory_budget_ - used_bytes
+                                                  : 0);
+    InferBlobShapes(&blob_shapes, &temp_peaks);
+  }
+  ws_.SetTempBudget(temp_budget);
+  ws_.ResetTempPeak(temp_peak);
+
+  for (int i = 0; i < static_cast<int>(ops_.size()); ++i) {
+    const auto &op_param = net_param_.op(i);
+    OpMemory op_memory;
+    op_memory.name = op_param.name();
+    op_memory.type = op_param.type();
+    for (const auto &bottom : op_param.bottom()) {
+      if (weight_blobs_.count(bottom)) {
+        op_memory.weight_bytes += ws_.GetBlobSize(bottom);
+      }
+    }
+    for (const auto &top : op_param.top()) {
+      op_memory.activation_bytes +=
+          ws_.GetBlobOwnedSize(top, blob_shapes.at(top));
+    }
+    op_memory.temp_bytes = temp_peaks[i];
+    memory_info.temp_bytes = std::max(memory_info.temp_bytes, temp_peaks[i]);
+    memory_info.ops.push_back(op_memory);
+  }
+  return memory_info;
+}
+
+// Shapes the tops of every op from the shapes of its bottoms in blob_shapes
+// without reshaping a blob or running an op, and measures the temporaries
+// each op plans on the way
+void Network::NetworkImpl::InferBlobShapes(
+    std::map<std::string, VecInt> *blob_shapes,
+    std::vector<size_t> *temp_peaks) {
+  temp_peaks->assign(ops_.size(), 0);
+  for (int i = 0; i < static_cast<int>(ops_.size()); ++i) {
+    if (ops_folded_ && folded_ops_[i]) continue;
+    const auto *op = ops_[i];
+    std::vector<VecInt> bottom_shapes, top_shapes;
+    for (int n = 0; n < op->bottoms_size(); ++n) {
+      bottom_shapes.push_back(blob_shapes->at(op->bottoms_name(n)));
+    }
+    for (int n = 0; n < op->tops_size(); ++n) {
+      top_shapes.push_back(blob_shapes->at(op->tops_name(n)));
+    }
+    TempScope temp_scope(&ws_);
+    op->InferShapes(bottom_shapes, &top_shapes);
+    (*temp_peaks)[i] = temp_scope.peak();
+    for (int n = 0; n < op->tops_size(); ++n) {
+      (*blob_shapes)[op->tops_name(n)] = top_shapes[n];
+    }
+  }
+}
+
+void Network::NetworkImpl::SetMemoryBudget(size_t bytes) {
+  memory_budget_ = bytes;
+  if (bytes == 0) {
+    ws_.SetTempBudget(SIZE_MAX);
+  }
+  // The buffer may have grown past the budget, it is sized again by the
+  // forwards under it
+  ws_.ReleaseTempBuffer();
+}
+
+// Weights are counted at their full size wherever their data lives, other
+// blobs by the memory they own
+void Network::NetworkImpl::MeasureBlobs(size_t *weight_bytes,
+                                        size_t *activation_bytes) const {
+  *weight_bytes = 0, *activation_bytes = 0;
+  for (const auto &blob_name : ws_.GetBlobNames()) {
+    if (weight_blobs_.count(blob_name)) {
+      *weight_bytes += ws_.GetBlobSize(blob_name);
+    } else {
+      *activation_bytes += ws_.GetBlobOwnedSize(blob_name);
+    }
+  }
+}
+
+// Like MeasureBlobs, with the other blobs at their shapes in blob_shapes
+void Network::NetworkImpl::MeasureBlobs(
+    const std::map<std::string, VecInt> &blob_shapes, size_t *weight_bytes,
+    size_t *activation_bytes) const {
+  *weight_bytes = 0, *activation_bytes = 0;
+  for (const auto &shape_it : blob_shapes) {
+    const auto &blob_name = shape_it.first;
+    if (weight_blobs_.count(blob_name)) {
+      *weight_bytes += ws_.GetBlobSize(blob_name);
+    } else {
+      *activation_bytes += ws_.GetBlobOwnedSize(blob_name, shape_it.second);
+    }
+  }
+}
+
+void Network::NetworkImpl::EnableProfiling(bool enable) {
+  profiling_ = enable;
+  perf_counters_.Close();
+  op_profiles_.clear();
+  if (!enable) return;
+  ResetProfile();
+  if (!perf_counters_.Open()) {
+    LOG(WARNING) << "Hardware counters are not available, only timing ops";
+  }
+}
+
+void Network::NetworkImpl::ResetProfile() {
+  op_profiles_.clear();
+  for (const auto *op : ops_) {
+    OpProfile op_profile;
+    op_profile.name = op->name();
+    op_profile.type = op->type();
+    op_profiles_.push_back(op_profile);
+  }
+}
+
+void Network::NetworkImpl::ProfileOp(int n, Timer *timer,
+                                     const PerfSample &perf_start) {
+#if defined(USE_CUDA)
+  Kernel::Synchronize();
+#endif
+  auto perf_end = perf_counters_.Read();
+  auto &op_profile = op_profiles_[n];
+  op_profile.forwards++;
+  op_profile.milliseconds += timer->get_millisecond();
+  op_profile.flops += ops_[n]->flops();
+  op_profile.bytes += ops_[n]->bytes();
+  op_profile.cycles += perf_end.cycles - perf_start.cycles;
+  op_profile.instructions += perf_end.instructions - perf_start.instructions;
+  op_profile.cache_misses += perf_end.cache_misses - perf_start.cache_misses;
+  op_profile.branch_misses +=
+      perf_end.branch_misses - perf_start.branch_misses;
+}
+
 void Network::NetworkImpl::Release() {
   net_param_.Clear();
 
+  view_blobs_.clear();
+  view_shapes_.clear();
+  views_planned_ = false;
+
+  folded_ops_.clear();
+  ops_folded_ = false;
+
   for (auto &op : ops_) {
     delete op;
     op = nullptr;
   }
   ops_.clear();
+  weight_blobs_.clear();
+  op_profiles_.clear();
+
+  ws_.ReleaseTempBlobs();
+  ws_.ReleaseTempBuffer();
 
   DLOG(INFO) << "Release Network!";
 }
@@ -120,6 +386,7 @@ void Network::NetworkImpl::LoadProtoStrOrText(
 }
 
 void Network::NetworkImpl::Initial() {
+  weight_blobs_.clear();
   for (const auto &blob : net_param_.blob()) {
     VecInt shape;
     int cc = 1;
@@ -129,6 +396,7 @@ void Network::NetworkImpl::Initial() {
     }
     const auto &blob_name = blob.name();
     const auto blob_type = blob.has_type() ? blob.type() : "float";
+    weight_blobs_.insert(blob_name);
     if (blob_type == "float") {
       auto *blob_ptr = ws_.CreateBlob<float>(shape, blob_name, true);
       CHECK_NOTNULL(blob_ptr) << "Failed to create float blob " << blob_name;
@@ -170,9 +438,15 @@ void Network::NetworkImpl::Initial() {
   }
 
   ops_.clear();
-  for (const auto &op_param : net_param_.op()) {
-    auto *op = CreateOperator(op_param, &ws_);
-    ops_.push_back(op);
+  const auto slice_views = PlanSliceViews();
+  for (int i = 0; i < net_param_.op_size(); ++i) {
+    if (slice_views.count(i)) {
+      auto op_param = net_param_.op(i);
+      set_s_i(&op_param, "view", true);
+      ops_.push_back(CreateOperator(op_param, &ws_));
+    } else {
+      ops_.push_back(CreateOperator(net_param_.op(i), &ws_));
+    }
   }
 
   arg_helper_ = ArgumentHelper(net_param_);
@@ -185,9 +459,74 @@ void Network::NetworkImpl::Initial() {
   CHECK(has_argument("out_blob")) << "Network must have out_blob argument";
   out_blob_ = get_repeated_argument<std::string>("out_blob");
 
+  if (tuning_) {
+    ws_.GetTuner()->Setup(tuning_cache_, ModelHash());
+  }
+
+  if (profiling_) {
+    ResetProfile();
+  }
+
   DLOG(INFO) << "Initial Network!";
 }
 
+// One forward over the zero filled inputs when the Input op gives all of
+// their shapes. The temp buffer ends up at the peak of all ops so the
+// forwards that follow do not grow it, and folding and views are planned
+// before the first real forward. Runs once the weights are in place, ops
+// derive state from them on their first forward
+void Network::NetworkImpl::DryRun() {
+  if (ops_.empty()) return;
+  for (const auto &blob_name : in_blob_) {
+    const auto &shape = ws_.GetBlobShape(blob_name);
+    if (shape.empty()) return;
+    for (const auto dim : shape) {
+      if (dim <= 0) return;
+    }
+  }
+  // Profiles only cover forwards over real inputs
+  auto profiling = profiling_;
+  profiling_ = false;
+  RunOps();
+  profiling_ = profiling;
+  DLOG(INFO) << "Dry run sized the temp buffer to "
+             << ws_.GetWorkspaceTempSize() << " bytes!";
+}
+
+// FNV-1a over the graph structure: op types, names, bottoms, tops and
+// arguments, blob names and shapes. Weight values do not take part
+std::string Network::NetworkImpl::ModelHash() const {
+  uint64_t hash = 14695981039346656037ull;
+  auto update = [&hash](const std::string &str) {
+    for (const auto c : str) {
+      hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    hash = (hash ^ 0xff) * 1099511628211ull;
+  };
+  for (const auto &blob : net_param_.blob()) {
+    update(blob.name());
+    for (const auto dim : blob.shape()) update(Util::to_string(dim));
+  }
+  for (const auto &op_param : net_param_.op()) {
+    update(op_param.type());
+    update(op_param.name());
+    for (const auto &bottom : op_param.bottom()) update(bottom);
+    for (const auto &top : op_param.top()) update(top);
+    for (const auto &arg : op_param.arg()) {
+      update(arg.name());
+      if (arg.has_s_f()) update(Util::to_string(arg.s_f()));
+      if (arg.has_s_i()) update(Util::to_string(arg.s_i()));
+      if (arg.has_s_s()) update(arg.s_s());
+      for (const auto v : arg.v_f()) update(Util::to_string(v));
+      for (const auto v : arg.v_i()) update(Util::to_string(v));
+      for (const auto &v : arg.v_s()) update(v);
+    }
+  }
+  std::stringstream ss;
+  ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return ss.str();
+}
+
 void Network::NetworkImpl::CopyWeights(
     const std::vector<const void *> &weights) {
   int weights_count = 0;
@@ -243,4 +582,316 @@ void Network::NetworkImpl::CopyWeights(const void *weights_data) {
   }
 }
 
+// Host memory a packed tensor is decoded into: weight blobs are created as
+// shared and own nothing yet on CPU, they get their own memory here
+template <typename T>
+static void *PackedWeightMemory(Blob<T> *blob, int64_t count,
+                                std::vector<char> *staging) {
+  CHECK_EQ(blob->count(), count)
+      << "Packed tensor " << blob->name() << " and blob shape are mismatch";
+#if defined(USE_CUDA)
+  staging->resize(count * sizeof(T));
+  return staging->data();
+
+#else
+  (void)staging;
+  if (blob->shared()) {
+    auto shape = blob->shape();
+    blob->clear();
+    blob->reshape(shape);
+  }
+  return blob->mutable_data();
+#endif
+}
+
+// The chunks of all tensors are decoded in parallel. Blobs are resolved
+// first, the decoding threads never touch the workspace
+void Network::NetworkImpl::CopyWeights(const IO::ModelPack &pack) {
+  const auto &tensors = pack.tensors();
+  std::vector<void *> dsts(tensors.size(), nullptr);
+  std::vector<std::vector<char>> staging(tensors.size());
+  std::vector<std::pair<int, int>> chunk_ids;
+  int num_tensors = static_cast<int>(tensors.size());
+  for (int t = 0; t < num_tensors; ++t) {
+    const auto &tensor = tensors[t];
+    CHECK(ws_.HasBlob(tensor.name)) << "Unknown packed tensor " << tensor.name;
+    const auto &blob_type = ws_.GetBlobType(tensor.name);
+    if (blob_type == int_id) {
+      CHECK_EQ(tensor.elem_size, sizeof(int));
+      dsts[t] = PackedWeightMemory(ws_.GetBlob<int>(tensor.name), tensor.count,
+                                   &staging[t]);
+    } else if (blob_type == float_id) {
+      CHECK_EQ(tensor.elem_size, sizeof(float));
+      dsts[t] = PackedWeightMemory(ws_.GetBlob<float>(tensor.name),
+                                   tensor.count, &staging[t]);
+    } else if (blob_type == uchar_id) {
+      CHECK_EQ(tensor.elem_size, sizeof(unsigned char));
+      dsts[t] = PackedWeightMemory(ws_.GetBlob<unsigned char>(tensor.name),
+                                   tensor.count, &staging[t]);
+    } else {
+      LOG(FATAL) << "Unknown blob type " << blob_type;
+    }
+    for (int c = 0; c < static_cast<int>(tensor.chunks.size()); ++c) {
+      chunk_ids.emplace_back(t, c);
+    }
+  }
+
+  int num_chunks = static_cast<int>(chunk_ids.size());
+#if defined(USE_OpenMP)
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i = 0; i < num_chunks; ++i) {
+    int t = chunk_ids[i].first;
+    pack.DecodeChunk(t, chunk_ids[i].second, dsts[t]);
+  }
+
+#if defined(USE_CUDA)
+  for (int t = 0; t < num_tensors; ++t) {
+    const auto &tensor = tensors[t];
+    const auto &blob_type = ws_.GetBlobType(tensor.name);
+    int count = static_cast<int>(tensor.count);
+    if (blob_type == int_id) {
+      ws_.GetBlob<int>(tensor.name)
+          ->set_data(static_cast<const int *>(dsts[t]), count);
+    } else if (blob_type == float_id) {
+      ws_.GetBlob<float>(tensor.name)
+          ->set_data(static_cast<const float *>(dsts[t]), count);
+    } else {
+      ws_.GetBlob<unsigned char>(tensor.name)
+          ->set_data(static_cast<const unsigned char *>(dsts[t]), count);
+    }
+  }
+#endif
+
+  DLOG(INFO) << "Decoded " << num_chunks << " weight chunks!";
+}
+
+// Ops which only see the shapes of their bottoms (PriorBox), or only move
+// constant data around (Reshape, Permute, Concat ... over weights or other
+// folded outputs), produce the same tops as long as the input shapes stay the
+// same. Their tops were just computed by a full forward, so they are kept and
+// the ops are skipped until the input shapes change
+void Network::NetworkImpl::FoldConstantOps() {
+  ops_folded_ = true;
+  folded_ops_.assign(ops_.size(), false);
+
+  auto is_shape_op = [](const Operator *op) {
+    return op->type() == "PriorBox";
+  };
+  auto is_data_op = [](const Operator *op) {
+    const auto &type = op->type();
+    return type == "Reshape" || type == "Flatten" || type == "Permute" ||
+           type == "Concat" || type == "Slice" || type == "Stack";
+  };
+
+  std::map<std::string, int> num_writers;
+  for (const auto *op : ops_) {
+    for (int n = 0; n < op->tops_size(); ++n) {
+      num_writers[op->tops_name(n)]++;
+    }
+  }
+
+  // Weights nobody writes are constants, inputs and data dependent shapes
+  // (everything downstream of a Proposal) are not
+  std::set<std::string> const_blobs, dynamic_blobs;
+  for (const auto &blob : net_param_.blob()) {
+    if (!num_writers.count(blob.name())) const_blobs.insert(blob.name());
+  }
+  for (const auto &blob_name : in_blob_) {
+    const_blobs.erase(blob_name);
+  }
+
+  int num_folded = 0;
+  for (int i = 0; i < static_cast<int>(ops_.size()); ++i) {
+    const auto *op = ops_[i];
+    bool dynamic = op->type() == "Proposal", all_const = true;
+    for (int n = 0; n < op->bottoms_size(); ++n) {
+      dynamic |= dynamic_blobs.count(op->bottoms_name(n)) > 0;
+      all_const &= const_blobs.count(op->bottoms_name(n)) > 0;
+    }
+    bool single_writer = true;
+    for (int n = 0; n < op->tops_size(); ++n) {
+      single_writer &= num_writers[op->tops_name(n)] == 1;
+    }
+    bool fold = (is_shape_op(op) && !dynamic) || (is_data_op(op) && all_const);
+    fold &= single_writer && op->bottoms_size() > 0;
+    for (int n = 0; n < op->tops_size(); ++n) {
+      if (fold) {
+        const_blobs.insert(op->tops_name(n));
+      } else if (dynamic) {
+        dynamic_blobs.insert(op->tops_name(n));
+      }
+    }
+    folded_ops_[i] = fold;
+    num_folded += fold;
+  }
+
+  DLOG(INFO) << "Folded " << num_folded << " constant ops!";
+}
+
+// Slice tops may be views into the bottom only when nothing writes the
+// bottom, the tops or their aliases after the slice, otherwise an in place
+// consumer of one top changes the data its other readers see
+std::set<int> Network::NetworkImpl::PlanSliceViews() const {
+  auto is_alias_op = [](const shadow::OpParam &op_param) {
+    const auto &type = op_param.type();
+    return type == "Reshape" || type == "Flatten" || type == "Slice" ||
+           (type == "Concat" && op_param.bottom_size() == 1);
+  };
+
+  std::map<std::string, std::string> alias_map;
+  for (const auto &op_param : net_param_.op()) {
+    if (!is_alias_op(op_param) || op_param.bottom_size() != 1) continue;
+    for (const auto &top : op_param.top()) {
+      if (top != op_param.bottom(0)) alias_map[top] = op_param.bottom(0);
+    }
+  }
+  auto find_root = [&alias_map](std::string name) {
+    while (alias_map.count(name)) name = alias_map.at(name);
+    return name;
+  };
+
+  std::map<std::string, int> last_writers;
+  for (int i = 0; i < net_param_.op_size(); ++i) {
+    const auto &op_param = net_param_.op(i);
+    if (is_alias_op(op_param)) continue;
+    for (const auto &top : op_param.top()) {
+      last_writers[find_root(top)] = i;
+    }
+  }
+
+  std::set<int> slice_views;
+  for (int i = 0; i < net_param_.op_size(); ++i) {
+    const auto &op_param = net_param_.op(i);
+    if (op_param.type() != "Slice" || op_param.bottom_size() != 1) continue;
+    const auto &root = find_root(op_param.bottom(0));
+    if (!last_writers.count(root) || last_writers.at(root) < i) {
+      slice_views.insert(i);
+    }
+  }
+  return slice_views;
+}
+
+// Concat outputs whose bottoms are contiguous ranges (nothing before the
+// concat axis) let the producers write in place: the storage blob behind each
+// bottom, looking through Reshape/Flatten style aliases, is rehomed as a view
+// into its range of the concat output, so the concat becomes a no-op. Planned
+// after a forward when every shape is known, released when input shapes change.
+void Network::NetworkImpl::PlanBlobViews() {
+  views_planned_ = true;
+  view_blobs_.clear();
+  view_shapes_.clear();
+  for (const auto &blob_name : in_blob_) {
+    view_shapes_[blob_name] = ws_.GetBlobShape(blob_name);
+  }
+
+  // Slices only alias their bottom when their tops were made views of it
+  auto is_alias_op = [this](const Operator *op) {
+    const auto &type = op->type();
+    if (type == "Slice") {
+      return op->tops_size() > 1 && op->tops_type(0) == float_id &&
+             ws_.GetBlob<float>(op->tops_name(0))->is_view();
+    }
+    return type == "Reshape" || type == "Flatten" ||
+           (type == "Concat" && op->bottoms_size() == 1);
+  };
+
+  std::map<std::string, std::string> alias_map;
+  for (const auto *op : ops_) {
+    if (!is_alias_op(op) || op->bottoms_size() != 1) continue;
+    for (int n = 0; n < op->tops_size(); ++n) {
+      if (op->tops_name(n) != op->bottoms_name(0)) {
+        alias_map[op->tops_name(n)] = op->bottoms_name(0);
+      }
+    }
+  }
+  auto find_root = [&alias_map](std::string name) {
+    while (alias_map.count(name)) name = alias_map.at(name);
+    return name;
+  };
+
+  // Blobs which must keep their own memory: inputs, weights and everything
+  // whose shape depends on data rather than on the input shapes
+  std::set<std::string> fixed_roots, dynamic_roots;
+  for (const auto &blob_name : in_blob_) {
+    fixed_roots.insert(find_root(blob_name));
+  }
+  for (const auto &blob : net_param_.blob()) {
+    fixed_roots.insert(find_root(blob.name()));
+  }
+  std::map<std::string, VecInt> writers;
+  for (int i = 0; i < static_cast<int>(ops_.size()); ++i) {
+    const auto *op = ops_[i];
+    bool dynamic = op->type() == "Proposal";
+    for (int n = 0; n < op->bottoms_size(); ++n) {
+      dynamic |= dynamic_roots.count(find_root(op->bottoms_name(n))) > 0;
+    }
+    for (int n = 0; n < op->tops_size(); ++n) {
+      const auto &root = find_root(op->tops_name(n));
+      if (dynamic) dynamic_roots.insert(root);
+      if (!is_alias_op(op)) writers[root].push_back(i);
+    }
+  }
+  auto written_after = [&writers](const std::string &root, int index) {
+    for (const auto writer : writers[root]) {
+      if (writer > index) return true;
+    }
+    return false;
+  };
+
+  std::set<std::string> claimed_roots;
+  for (int i = static_cast<int>(ops_.size()) - 1; i >= 0; --i) {
+    const auto *op = ops_[i];
+    if (op->type() != "Concat" || op->bottoms_size() < 2) continue;
+    if (op->tops_type(0) != float_id) continue;
+    auto *top = ws_.GetBlob<float>(op->tops_name(0));
+    int concat_axis = op->get_single_argument<int>("axis", 1);
+    if (top->count(0, concat_axis) != 1) continue;
+    const auto &top_root = find_root(op->tops_name(0));
+    if (dynamic_roots.count(top_root) || written_after(top_root, i)) continue;
+
+    int offset = 0;
+    for (int n = 0; n < op->bottoms_size(); ++n) {
+      const auto *bottom = ws_.GetBlob<float>(op->bottoms_name(n));
+      const auto &root = find_root(op->bottoms_name(n));
+      int count = bottom->count();
+      auto *storage = ws_.GetBlob<float>(root);
+      bool can_view = root != top_root && !claimed_roots.count(root) &&
+                      !fixed_roots.count(root) && !dynamic_roots.count(root) &&
+                      ws_.GetBlobType(root) == float_id && !storage->shared() &&
+                      storage->count() == count && !writers[root].empty() &&
+                      !written_after(root, i);
+      if (can_view) {
+        const auto *old_data = storage->data();
+        auto *new_data = top->data() + offset;
+        // Repoint the aliases first, the storage releases its memory below
+        for (const auto &alias : alias_map) {
+          if (find_root(alias.first) != root) continue;
+          auto *alias_blob = ws_.GetBlob<float>(alias.first);
+          const auto *alias_data = alias_blob->data();
+          if (alias_data >= old_data && alias_data < old_data + count) {
+            alias_blob->set_view(new_data + (alias_data - old_data),
+                                 alias_blob->shape());
+          }
+        }
+        storage->set_view(new_data, storage->shape());
+        claimed_roots.insert(root);
+        view_blobs_.push_back(root);
+      }
+      offset += count;
+    }
+  }
+
+  DLOG(INFO) << "Planned " << view_blobs_.size() << " blob views!";
+}
+
+void Network::NetworkImpl::ReleaseBlobViews() {
+  for (const auto &blob_name : view_blobs_) {
+    ws_.GetBlob<float>(blob_name)->clear();
+  }
+  view_blobs_.clear();
+  view_shapes_.clear();
+  views_planned_ = false;
+}
+
 }  // namespace Shadow
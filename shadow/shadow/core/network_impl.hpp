@@ -4,8 +4,13 @@
 #include "network.hpp"
 
 #include "operator.hpp"
+#include "perf_counters.hpp"
 #include "workspace.hpp"
 
+#include "util/model_pack.hpp"
+
+#include <set>
+
 namespace Shadow {
 
 class Network::NetworkImpl {
@@ -24,8 +29,19 @@ class Network::NetworkImpl {
 
   void Forward(const std::map<std::string, float *> &data_map,
                const std::map<std::string, std::vector<int>> &shape_map = {});
+  void Forward(const std::map<std::string, unsigned char *> &data_map,
+               const std::map<std::string, std::vector<int>> &shape_map = {});
   void Release();
 
+  void EnableTuning(const std::string &cache_file);
+
+  MemoryInfo QueryMemory(
+      const std::map<std::string, std::vector<int>> &shape_map);
+  void SetMemoryBudget(size_t bytes);
+
+  void EnableProfiling(bool enable);
+  const std::vector<OpProfile> GetProfile() const { return op_profiles_; }
+
   template <typename T>
   const T *GetBlobDataByName(const std::string &blob_name) {
     auto *blob = ws_.GetBlob<T>(blob_name);
@@ -73,8 +89,33 @@ class Network::NetworkImpl {
 
   void Initial();
 
+  template <typename T>
+  void FeedInputs(const std::map<std::string, T *> &data_map,
+                  const std::map<std::string, std::vector<int>> &shape_map);
+  void RunOps();
+  void DryRun();
+
+  void InferBlobShapes(std::map<std::string, VecInt> *blob_shapes,
+                       std::vector<size_t> *temp_peaks);
+
+  void MeasureBlobs(size_t *weight_bytes, size_t *activation_bytes) const;
+  void MeasureBlobs(const std::map<std::string, VecInt> &blob_shapes,
+                    size_t *weight_bytes, size_t *activation_bytes) const;
+
+  void ResetProfile();
+  void ProfileOp(int n, Timer *timer, const PerfSample &perf_start);
+
+  std::string ModelHash() const;
+
   void CopyWeights(const std::vector<const void *> &weights);
   void CopyWeights(const void *weights_data);
+  void CopyWeights(const IO::ModelPack &pack);
+
+  std::set<int> PlanSliceViews() const;
+  void PlanBlobViews();
+  void ReleaseBlobViews();
+
+  void FoldConstantOps();
 
   shadow::NetParam net_param_;
   ArgumentHelper arg_helper_;
@@ -82,7 +123,29 @@ class Network::NetworkImpl {
   std::vector<Operator *> ops_;
   Workspace ws_;
 
+  // Blobs of the model, and the bytes all blobs and the temp buffer may
+  // take, 0 for no limit
+  std::set<std::string> weight_blobs_;
+  size_t memory_budget_ = 0;
+
+  bool profiling_ = false;
+  PerfCounters perf_counters_;
+  std::vector<OpProfile> op_profiles_;
+
   std::vector<std::string> in_blob_, out_blob_;
+
+  bool tuning_ = false;
+  std::string tuning_cache_;
+
+  // Blobs rehomed into their concat output, planned for the input shapes
+  std::vector<std::string> view_blobs_;
+  std::map<std::string, VecInt> view_shapes_;
+  bool views_planned_ = false;
+
+  // Ops whose outputs only depend on the input shapes, skipped by Forward
+  // until the input shapes change
+  std::vector<bool> folded_ops_;
+  bool ops_folded_ = false;
 };
 
 }  // namespace Shadow
@@ -34,18 +34,29 @@ Operator::Operator(const shadow::OpParam &op_param, Workspace *ws)
 
 Operator::~Operator() { op_param_.Clear(); }
 
+void Operator::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                           std::vector<VecInt> *top_shapes) const {
+  if (bottom_shapes.empty()) return;
+  for (auto &top_shape : *top_shapes) {
+    top_shape = bottom_shapes[0];
+  }
+}
+
+double Operator::bytes() const {
+  double bytes = 0;
+  for (const auto &name : bottom_names_) bytes += op_ws_->GetBlobSize(name);
+  for (const auto &name : top_names_) bytes += op_ws_->GetBlobSize(name);
+  return bytes;
+}
+
 const std::string Operator::debug_log() const {
   VecString bottom_str, top_str;
-  for (int n = 0; n < bottoms_size(); ++n) {
-    const auto *bottom = bottoms<float>(n);
-    const auto &shape = bottom->shape();
-    const auto &name = bottom->name();
+  for (const auto &name : bottom_names_) {
+    const auto &shape = op_ws_->GetBlobShape(name);
     bottom_str.push_back(Util::format_vector(shape, ",", name + "(", ")"));
   }
-  for (int n = 0; n < tops_size(); ++n) {
-    const auto *top = tops<float>(n);
-    const auto &shape = top->shape();
-    const auto &name = top->name();
+  for (const auto &name : top_names_) {
+    const auto &shape = op_ws_->GetBlobShape(name);
     top_str.push_back(Util::format_vector(shape, ",", name + "(", ")"));
   }
   std::stringstream ss;
@@ -20,6 +20,13 @@ class Operator {
 
   virtual void Forward() = 0;
 
+  // Shapes of the tops for bottoms of bottom_shapes without allocating or
+  // running anything, top_shapes holds their current shapes on entry. The
+  // temporaries Forward would stack are planned on the workspace. Tops take
+  // the shape of the first bottom unless the op overrides it
+  virtual void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                           std::vector<VecInt> *top_shapes) const;
+
   bool has_argument(const std::string &name) const {
     return arg_helper_.HasArgument(name);
   }
@@ -96,9 +103,25 @@ class Operator {
   }
   int tops_size() const { return static_cast<int>(top_names_.size()); }
 
+  // Floating point operations of the last Forward, none unless the op does
+  // arithmetic and counts it, and bytes of the bottoms and tops it read and
+  // wrote
+  virtual double flops() const { return 0; }
+  double bytes() const;
+
   const std::string debug_log() const;
 
  protected:
+  // Blob::count for a shape held outside a blob
+  static int count_of(const VecInt &shape, int start_axis, int end_axis) {
+    int count = 1;
+    for (int i = start_axis; i < end_axis; ++i) count *= shape[i];
+    return count;
+  }
+  static int count_of(const VecInt &shape, int start_axis = 0) {
+    return count_of(shape, start_axis, static_cast<int>(shape.size()));
+  }
+
   std::string op_name_, op_type_;
   Workspace *op_ws_ = nullptr;
 
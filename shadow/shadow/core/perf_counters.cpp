@@ -0,0 +1,110 @@
+#include "perf_counters.hpp"
+
+#include "util/log.hpp"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#endif
+
+#if defined(USE_OpenMP)
+#include <omp.h>
+#endif
+
+namespace Shadow {
+
+#if defined(__linux__)
+static uint64_t PerfSample::*const kPerfFields[] = {
+    &PerfSample::cycles, &PerfSample::instructions, &PerfSample::cache_misses,
+    &PerfSample::branch_misses};
+
+static const uint64_t kPerfConfigs[] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+static int OpenEvent(uint64_t config, int group_fd) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  // pid 0 and cpu -1 count the calling thread on any cpu
+  return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1,
+                                  group_fd, PERF_FLAG_FD_CLOEXEC));
+}
+#endif
+
+bool PerfCounters::Open() {
+  Close();
+#if defined(__linux__)
+  auto open_group = []() {
+    Group group;
+    for (int n = 0; n < 4; ++n) {
+      int fd = OpenEvent(kPerfConfigs[n], group.leader);
+      if (fd < 0) {
+        // Without the cycles there is no group to read the others from
+        if (n == 0) break;
+        continue;
+      }
+      if (group.leader < 0) group.leader = fd;
+      group.fields.push_back(n);
+      group.fds.push_back(fd);
+    }
+    return group;
+  };
+#if defined(USE_OpenMP)
+  std::vector<Group> groups(omp_get_max_threads());
+#pragma omp parallel num_threads(static_cast<int>(groups.size()))
+  groups[omp_get_thread_num()] = open_group();
+#else
+  std::vector<Group> groups(1, open_group());
+#endif
+  for (const auto &group : groups) {
+    if (group.leader >= 0) groups_.push_back(group);
+  }
+  if (!groups_.empty() && groups_.size() < groups.size()) {
+    LOG(WARNING) << "Opened hardware counters on " << groups_.size() << " of "
+                 << groups.size() << " threads";
+  }
+#endif
+  return opened();
+}
+
+void PerfCounters::Close() {
+#if defined(__linux__)
+  for (const auto &group : groups_) {
+    for (const auto fd : group.fds) close(fd);
+  }
+#endif
+  groups_.clear();
+}
+
+PerfSample PerfCounters::Read() const {
+  PerfSample sample;
+#if defined(__linux__)
+  for (const auto &group : groups_) {
+    // nr, time enabled, time running and the values of the members
+    std::vector<uint64_t> buffer(3 + group.fields.size(), 0);
+    auto size = static_cast<ssize_t>(buffer.size() * sizeof(uint64_t));
+    if (read(group.leader, buffer.data(), size) != size) continue;
+    double scale = 1;
+    if (buffer[2] > 0 && buffer[2] < buffer[1]) {
+      scale = static_cast<double>(buffer[1]) / buffer[2];
+    }
+    for (int n = 0; n < static_cast<int>(group.fields.size()); ++n) {
+      sample.*kPerfFields[group.fields[n]] +=
+          static_cast<uint64_t>(buffer[3 + n] * scale);
+    }
+  }
+#endif
+  return sample;
+}
+
+}  // namespace Shadow
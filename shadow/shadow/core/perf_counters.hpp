@@ -0,0 +1,51 @@
+#ifndef SHADOW_CORE_PERF_COUNTERS_HPP
+#define SHADOW_CORE_PERF_COUNTERS_HPP
+
+#include "common.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace Shadow {
+
+struct PerfSample {
+  uint64_t cycles = 0, instructions = 0, cache_misses = 0, branch_misses = 0;
+};
+
+// Hardware counters of the user space work of the calling thread and of the
+// OpenMP threads, read through perf_event_open on Linux. Each thread counts
+// in a group of its own, opened from a parallel region so the pool threads
+// are the ones measured, and a read sums the groups. Counters the cpu or
+// the kernel do not provide stay at zero
+class PerfCounters {
+ public:
+  PerfCounters() = default;
+  ~PerfCounters() { Close(); }
+
+  // False when no counter could be opened, e.g. outside Linux or when
+  // kernel.perf_event_paranoid is above 2
+  bool Open();
+  void Close();
+
+  bool opened() const { return !groups_.empty(); }
+
+  // Counts since Open, scaled up for the time the kernel had them
+  // multiplexed out
+  PerfSample Read() const;
+
+ private:
+  struct Group {
+    int leader = -1;
+    // Fields of PerfSample the group members count, in read order
+    std::vector<int> fields;
+    std::vector<int> fds;
+  };
+
+  std::vector<Group> groups_;
+
+  DISABLE_COPY_AND_ASSIGN(PerfCounters);
+};
+
+}  // namespace Shadow
+
+#endif  // SHADOW_CORE_PERF_COUNTERS_HPP
@@ -0,0 +1,300 @@
+#include "sgemm.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SGEMM_X86
+#include <immintrin.h>
+#endif
+
+#if defined(USE_OpenMP)
+#include <omp.h>
+#endif
+
+namespace Shadow {
+
+namespace Blas {
+
+#if !defined(USE_CUDA) && defined(SGEMM_X86)
+// Depth of the packed panels and width of the packed block of B, sized so a
+// panel of B stays in L1 and the packed A in L2 while tiles are swept
+static const int kBlockK = 256;
+static const int kBlockN = 4096;
+
+// Kernels compute a MR x NR tile C = alpha * a * b + beta * C from a panel
+// of a (kc x MR, row of MR per depth) and a panel of b (kc x NR, rows ldb
+// apart), the beta term is skipped when it is zero so C may hold garbage.
+// Accumulators are named variables rather than arrays, which compilers keep
+// on the stack
+#define SGEMM_ROWS(F) F(0) F(1) F(2) F(3) F(4) F(5)
+#define SGEMM_ROWS8(F) SGEMM_ROWS(F) F(6) F(7)
+
+struct KernelAVX2 {
+  static const int MR = 6, NR = 16;
+
+  __attribute__((target("avx2,fma"))) static void Run(
+      int kc, const float *a, const float *b, int ldb, float *c, int ldc,
+      float alpha, float beta) {
+#define ZERO(r) auto c##r##0 = _mm256_setzero_ps(), c##r##1 = c##r##0;
+#define FMA(r)                                 \
+  a_r = _mm256_broadcast_ss(a + r);            \
+  c##r##0 = _mm256_fmadd_ps(a_r, b0, c##r##0); \
+  c##r##1 = _mm256_fmadd_ps(a_r, b1, c##r##1);
+#define STORE(r)                                                        \
+  c##r##0 = _mm256_mul_ps(c##r##0, alpha_v);                            \
+  c##r##1 = _mm256_mul_ps(c##r##1, alpha_v);                            \
+  if (beta != 0) {                                                      \
+    c##r##0 = _mm256_fmadd_ps(_mm256_loadu_ps(c), beta_v, c##r##0);     \
+    c##r##1 = _mm256_fmadd_ps(_mm256_loadu_ps(c + 8), beta_v, c##r##1); \
+  }                                                                     \
+  _mm256_storeu_ps(c, c##r##0), _mm256_storeu_ps(c + 8, c##r##1);       \
+  c += ldc;
+    SGEMM_ROWS(ZERO)
+    for (int k = 0; k < kc; ++k, a += MR, b += ldb) {
+      const auto b0 = _mm256_loadu_ps(b), b1 = _mm256_loadu_ps(b + 8);
+      __m256 a_r;
+      SGEMM_ROWS(FMA)
+    }
+    const auto alpha_v = _mm256_set1_ps(alpha), beta_v = _mm256_set1_ps(beta);
+    SGEMM_ROWS(STORE)
+#undef ZERO
+#undef FMA
+#undef STORE
+  }
+};
+
+struct KernelAVX512 {
+  static const int MR = 8, NR = 32;
+
+  __attribute__((target("avx512f"))) static void Run(
+      int kc, const float *a, const float *b, int ldb, float *c, int ldc,
+      float alpha, float beta) {
+#define ZERO(r) auto c##r##0 = _mm512_setzero_ps(), c##r##1 = c##r##0;
+#define FMA(r)                                 \
+  a_r = _mm512_set1_ps(a[r]);                  \
+  c##r##0 = _mm512_fmadd_ps(a_r, b0, c##r##0); \
+  c##r##1 = _mm512_fmadd_ps(a_r, b1, c##r##1);
+#define STORE(r)                                                         \
+  c##r##0 = _mm512_mul_ps(c##r##0, alpha_v);                             \
+  c##r##1 = _mm512_mul_ps(c##r##1, alpha_v);                             \
+  if (beta != 0) {                                                       \
+    c##r##0 = _mm512_fmadd_ps(_mm512_loadu_ps(c), beta_v, c##r##0);      \
+    c##r##1 = _mm512_fmadd_ps(_mm512_loadu_ps(c + 16), beta_v, c##r##1); \
+  }                                                                      \
+  _mm512_storeu_ps(c, c##r##0), _mm512_storeu_ps(c + 16, c##r##1);       \
+  c += ldc;
+    SGEMM_ROWS8(ZERO)
+    for (int k = 0; k < kc; ++k, a += MR, b += ldb) {
+      const auto b0 = _mm512_loadu_ps(b), b1 = _mm512_loadu_ps(b + 16);
+      __m512 a_r;
+      SGEMM_ROWS8(FMA)
+    }
+    const auto alpha_v = _mm512_set1_ps(alpha), beta_v = _mm512_set1_ps(beta);
+    SGEMM_ROWS8(STORE)
+#undef ZERO
+#undef FMA
+#undef STORE
+  }
+};
+
+#undef SGEMM_ROWS
+#undef SGEMM_ROWS8
+
+// Rows [row, row + rows) of op(A) over depth [k0, k0 + kc), padded with zeros
+// to whole panels of MR rows
+template <int MR>
+static void PackA(int TA, int M, int K, const float *A, int row, int rows,
+                  int k0, int kc, float *packed) {
+  for (int p = 0; p < rows; p += MR, packed += kc * MR) {
+    int valid = std::min(MR, rows - p);
+    for (int k = 0; k < kc; ++k) {
+      auto *dst = packed + k * MR;
+      for (int r = 0; r < valid; ++r) {
+        int i = row + p + r;
+        dst[r] = TA ? A[(k0 + k) * M + i] : A[i * K + k0 + k];
+      }
+      for (int r = valid; r < MR; ++r) dst[r] = 0;
+    }
+  }
+}
+
+// Columns [col, col + cols) of op(B) over depth [k0, k0 + kc), padded with
+// zeros to whole panels of NR columns
+template <int NR>
+static void PackB(int TB, int N, int K, const float *B, int col, int cols,
+                  int k0, int kc, float *packed) {
+  for (int q = 0; q < cols; q += NR, packed += kc * NR) {
+    int valid = std::min(NR, cols - q);
+    for (int k = 0; k < kc; ++k) {
+      auto *dst = packed + k * NR;
+      if (!TB) {
+        memcpy(dst, B + (k0 + k) * N + col + q, valid * sizeof(float));
+      } else {
+        for (int c = 0; c < valid; ++c) {
+          dst[c] = B[(col + q + c) * K + k0 + k];
+        }
+      }
+      for (int c = valid; c < NR; ++c) dst[c] = 0;
+    }
+  }
+}
+
+// All depth blocks of op(A), block pc starts at m_panels * MR * pc
+template <int MR>
+static void PackAll(int TA, int M, int K, const float *A, float *packed) {
+  int m_panels = (M + MR - 1) / MR;
+  for (int pc = 0; pc < K; pc += kBlockK) {
+    PackA<MR>(TA, M, K, A, 0, M, pc, std::min(kBlockK, K - pc),
+              packed + static_cast<size_t>(m_panels) * MR * pc);
+  }
+}
+
+// A is packed per depth block unless packed_A holds it packed by PackAll
+template <typename Kernel>
+static void SgemmPacked(int TA, int TB, int M, int N, int K, float alpha,
+                        const float *A, const float *packed_A, const float *B,
+                        float beta, float *C) {
+  const int MR = Kernel::MR, NR = Kernel::NR;
+  int m_panels = (M + MR - 1) / MR;
+
+  // Per thread, BlasSgemmBatched calls this from its own parallel region
+  static thread_local std::vector<float> packed_a, packed_b;
+  if (packed_A == nullptr) {
+    packed_a.resize(static_cast<size_t>(m_panels) * MR * kBlockK);
+  }
+  int b_cols = TB ? std::min(N, kBlockN) + NR : NR;
+  packed_b.resize(static_cast<size_t>(b_cols) * kBlockK);
+
+  for (int jc = 0; jc < N; jc += kBlockN) {
+    int nc = std::min(kBlockN, N - jc), n_panels = (nc + NR - 1) / NR;
+    for (int pc = 0; pc < K; pc += kBlockK) {
+      int kc = std::min(kBlockK, K - pc);
+      // The first depth block applies beta, the others accumulate
+      float beta_block = pc == 0 ? beta : 1.f;
+      const float *a_data = packed_A + static_cast<size_t>(m_panels) * MR * pc;
+      if (packed_A == nullptr) {
+        PackA<MR>(TA, M, K, A, 0, M, pc, kc, packed_a.data());
+        a_data = packed_a.data();
+      }
+      auto *b_data = packed_b.data();
+      // Rows of a plain B are read in place, only its ragged last panel is
+      // copied to be padded with zeros
+      int tail = TB ? nc : nc % NR;
+      PackB<NR>(TB, N, K, B, jc + nc - tail, tail, pc, kc, b_data);
+
+      // Serial when a batched call already runs the matrices in parallel
+#if defined(USE_OpenMP)
+#pragma omp parallel for if (!omp_in_parallel())
+#endif
+      for (int jp = 0; jp < n_panels; ++jp) {
+        int col = jc + jp * NR, cols = std::min(NR, N - col), ldb = NR;
+        const float *b_panel = b_data + (TB ? jp * kc * NR : 0);
+        if (!TB && cols == NR) {
+          b_panel = B + pc * N + col, ldb = N;
+        }
+        for (int ip = 0; ip < m_panels; ++ip) {
+          int row = ip * MR, rows = std::min(MR, M - row);
+          const auto *a_panel = a_data + ip * kc * MR;
+          auto *c_tile = C + row * N + col;
+          if (rows == MR && cols == NR) {
+            Kernel::Run(kc, a_panel, b_panel, ldb, c_tile, N, alpha,
+                        beta_block);
+          } else {
+            float tile[MR * NR];
+            Kernel::Run(kc, a_panel, b_panel, ldb, tile, NR, alpha, 0);
+            for (int r = 0; r < rows; ++r) {
+              for (int c = 0; c < cols; ++c) {
+                float val = tile[r * NR + c];
+                auto &dst = c_tile[r * N + c];
+                dst = beta_block != 0 ? val + beta_block * dst : val;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Kernel>
+static bool Worthwhile(int M, int N, int K) {
+  return M >= Kernel::MR && N >= Kernel::NR && K >= 16 &&
+         static_cast<int64_t>(M) * N * K >= 64 * 64 * 16;
+}
+#endif
+
+bool SgemmDispatch(CPU::ISA isa, int TA, int TB, int M, int N, int K,
+                   float alpha, const float *A, const float *B, float beta,
+                   float *C) {
+#if !defined(USE_CUDA) && defined(SGEMM_X86)
+  if (isa == CPU::kAVX512 && Worthwhile<KernelAVX512>(M, N, K)) {
+    SgemmPacked<KernelAVX512>(TA, TB, M, N, K, alpha, A, nullptr, B, beta,
+                              C);
+    return true;
+  }
+  if (isa >= CPU::kAVX2 && isa != CPU::kNEON &&
+      Worthwhile<KernelAVX2>(M, N, K)) {
+    SgemmPacked<KernelAVX2>(TA, TB, M, N, K, alpha, A, nullptr, B, beta, C);
+    return true;
+  }
+#endif
+  return false;
+}
+
+void SgemmPackA(CPU::ISA isa, int TA, int M, int K, const float *A,
+                int strideA, int batch, SgemmPackedA *packed) {
+  packed->isa = isa;
+  packed->TA = TA, packed->M = M, packed->K = K, packed->batch = batch;
+  packed->data.clear();
+#if !defined(USE_CUDA) && defined(SGEMM_X86)
+  // The rest of Worthwhile is checked per call once N is known
+  if (K < 16) return;
+  int MR = 0;
+  if (isa == CPU::kAVX512 && M >= KernelAVX512::MR) {
+    MR = KernelAVX512::MR;
+  } else if (isa >= CPU::kAVX2 && isa != CPU::kNEON &&
+             M >= KernelAVX2::MR) {
+    MR = KernelAVX2::MR;
+  }
+  if (MR == 0) return;
+  size_t size = static_cast<size_t>((M + MR - 1) / MR) * MR * K;
+  packed->data.resize(size * batch);
+  for (int i = 0; i < batch; ++i) {
+    auto *data = packed->data.data() + size * i;
+    if (MR == KernelAVX512::MR) {
+      PackAll<KernelAVX512::MR>(TA, M, K, A + i * strideA, data);
+    } else {
+      PackAll<KernelAVX2::MR>(TA, M, K, A + i * strideA, data);
+    }
+  }
+#endif
+}
+
+bool SgemmDispatch(CPU::ISA isa, const SgemmPackedA &packed, int i, int TB,
+                   int N, float alpha, const float *B, float beta, float *C) {
+#if !defined(USE_CUDA) && defined(SGEMM_X86)
+  if (packed.data.empty() || packed.isa != isa) return false;
+  int TA = packed.TA, M = packed.M, K = packed.K;
+  const auto *packed_A =
+      packed.data.data() + packed.data.size() / packed.batch * i;
+  if (isa == CPU::kAVX512 && M >= KernelAVX512::MR) {
+    if (!Worthwhile<KernelAVX512>(M, N, K)) return false;
+    SgemmPacked<KernelAVX512>(TA, TB, M, N, K, alpha, nullptr, packed_A, B,
+                              beta, C);
+  } else {
+    if (!Worthwhile<KernelAVX2>(M, N, K)) return false;
+    SgemmPacked<KernelAVX2>(TA, TB, M, N, K, alpha, nullptr, packed_A, B,
+                            beta, C);
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+}  // namespace Blas
+
+}  // namespace Shadow
@@ -0,0 +1,42 @@
+#ifndef SHADOW_CORE_SGEMM_HPP
+#define SHADOW_CORE_SGEMM_HPP
+
+#include "cpu_features.hpp"
+
+#include <vector>
+
+namespace Shadow {
+
+namespace Blas {
+
+// The batch matrices op(A) of a BlasSgemmBatched call packed once into the
+// panels of the kernel for isa, for a constant A such as a weight. Stays
+// empty when there is no kernel for isa or the shape is too small for it
+struct SgemmPackedA {
+  CPU::ISA isa = CPU::kGeneric;
+  int TA = 0, M = 0, K = 0, batch = 0;
+  std::vector<float> data;
+};
+
+// Packs matrix i of A starting at A + i * strideA
+void SgemmPackA(CPU::ISA isa, int TA, int M, int K, const float *A,
+                int strideA, int batch, SgemmPackedA *packed);
+
+// Row major C = alpha * op(A) * op(B) + beta * C with packed panels and a
+// register blocked micro kernel written for the given instruction set.
+// Returns false when there is no kernel for the instruction set or the
+// shape is too small to amortize the packing, the caller falls back then
+bool SgemmDispatch(CPU::ISA isa, int TA, int TB, int M, int N, int K,
+                   float alpha, const float *A, const float *B, float beta,
+                   float *C);
+
+// SgemmDispatch with A read from matrix i of packed, false when packed is
+// empty, was packed for another instruction set or the shape is too small
+bool SgemmDispatch(CPU::ISA isa, const SgemmPackedA &packed, int i, int TB,
+                   int N, float alpha, const float *B, float beta, float *C);
+
+}  // namespace Blas
+
+}  // namespace Shadow
+
+#endif  // SHADOW_CORE_SGEMM_HPP
@@ -0,0 +1,231 @@
+#include "sparse.hpp"
+#include "cpu_features.hpp"
+
+#include <algorithm>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SPARSE_X86
+#include <immintrin.h>
+#endif
+
+namespace Shadow {
+
+namespace Blas {
+
+float Density(int count, const float *data) {
+  if (count <= 0) return 1;
+  int nnz = 0;
+  for (int i = 0; i < count; ++i) nnz += data[i] != 0;
+  return static_cast<float>(nnz) / count;
+}
+
+// Depth of the column blocks, a block of B rows for one strip of columns
+// then stays in L1 while it is reused by the rows of A
+static const int kSparseBlockK = 64;
+
+// Rows of A sharing the B block before the next block is loaded
+static const int kSparseBlockM = 32;
+
+void DenseToSparse(int TA, int rows, int cols, const float *A,
+                   SparseMatrix *sparse) {
+  sparse->rows = rows, sparse->cols = cols;
+  sparse->block_cols = kSparseBlockK;
+  sparse->row_ptr.assign(1, 0);
+  sparse->col_idx.clear(), sparse->values.clear();
+  for (int k0 = 0; k0 < cols; k0 += kSparseBlockK) {
+    int k1 = std::min(k0 + kSparseBlockK, cols);
+    for (int r = 0; r < rows; ++r) {
+      for (int c = k0; c < k1; ++c) {
+        float val = TA ? A[c * rows + r] : A[r * cols + c];
+        if (val != 0) {
+          sparse->col_idx.push_back(c);
+          sparse->values.push_back(val);
+        }
+      }
+      sparse->row_ptr.push_back(sparse->nnz());
+    }
+  }
+}
+
+// One output row over a strip of columns: C[0, n) (+)= sum over the
+// nonzeros of the A row of value * B row, starting from C when accumulate
+// is set
+static void SparseRow(int begin, int end, const int *col_idx,
+                      const float *values, const float *B, int ldb, int n,
+                      bool accumulate, float *c) {
+  if (!accumulate) {
+    for (int j = 0; j < n; ++j) c[j] = 0;
+  }
+  for (int p = begin; p < end; ++p) {
+    const float *b = B + col_idx[p] * ldb;
+    float v = values[p];
+    for (int j = 0; j < n; ++j) c[j] += v * b[j];
+  }
+}
+
+#if defined(SPARSE_X86)
+// A strip of NV vectors stays in accumulators while the nonzeros stream by,
+// so each multiply add costs one load of B and nothing on C. Accumulators
+// are named variables rather than arrays, which compilers keep on the
+// stack, the ones past NV are dropped as dead code
+#define SPARSE_LANES(F) F(0) F(1) F(2) F(3) F(4) F(5) F(6) F(7)
+
+struct SparseAVX2 {
+  static const int kVL = 8;
+
+  template <int NV>
+  __attribute__((target("avx2,fma"))) static void Run(
+      int begin, int end, const int *col_idx, const float *values,
+      const float *B, int ldb, bool accumulate, float *c) {
+#define ZERO(i)                    \
+  auto c##i = _mm256_setzero_ps(); \
+  if (NV > i && accumulate) c##i = _mm256_loadu_ps(c + 8 * i);
+#define FMA(i) \
+  if (NV > i) c##i = _mm256_fmadd_ps(v, _mm256_loadu_ps(b + 8 * i), c##i);
+#define STORE(i) \
+  if (NV > i) _mm256_storeu_ps(c + 8 * i, c##i);
+    SPARSE_LANES(ZERO)
+    for (int p = begin; p < end; ++p) {
+      const float *b = B + col_idx[p] * ldb;
+      const auto v = _mm256_set1_ps(values[p]);
+      SPARSE_LANES(FMA)
+    }
+    SPARSE_LANES(STORE)
+#undef ZERO
+#undef FMA
+#undef STORE
+  }
+};
+
+struct SparseAVX512 {
+  static const int kVL = 16;
+
+  template <int NV>
+  __attribute__((target("avx512f"))) static void Run(
+      int begin, int end, const int *col_idx, const float *values,
+      const float *B, int ldb, bool accumulate, float *c) {
+#define ZERO(i)                    \
+  auto c##i = _mm512_setzero_ps(); \
+  if (NV > i && accumulate) c##i = _mm512_loadu_ps(c + 16 * i);
+#define FMA(i) \
+  if (NV > i) c##i = _mm512_fmadd_ps(v, _mm512_loadu_ps(b + 16 * i), c##i);
+#define STORE(i) \
+  if (NV > i) _mm512_storeu_ps(c + 16 * i, c##i);
+    SPARSE_LANES(ZERO)
+    for (int p = begin; p < end; ++p) {
+      const float *b = B + col_idx[p] * ldb;
+      const auto v = _mm512_set1_ps(values[p]);
+      SPARSE_LANES(FMA)
+    }
+    SPARSE_LANES(STORE)
+#undef ZERO
+#undef FMA
+#undef STORE
+  }
+};
+
+#undef SPARSE_LANES
+#endif
+
+// Baseline build, vectorized by the compiler as far as it goes
+struct SparsePlain {
+  static const int kVL = 4;
+  template <int NV>
+  static void Run(int begin, int end, const int *col_idx, const float *values,
+                  const float *B, int ldb, bool accumulate, float *c) {
+    SparseRow(begin, end, col_idx, values, B, ldb, kVL * NV, accumulate, c);
+  }
+};
+
+// Strips of eight vectors by blocks of rows, each block of B rows is swept
+// by all rows of the block before the next one. The ragged last strip runs
+// on four, two and one vectors and the plain loop for what is left
+template <typename Kernel>
+static void SparseStrips(const SparseMatrix &A, int row_begin, int M, int N,
+                         const float *B, float *C) {
+  const int VL = Kernel::kVL, NR = 8 * VL;
+  const auto *col_idx = A.col_idx.data();
+  const auto *values = A.values.data();
+  int num_strips = (N + NR - 1) / NR;
+  int num_row_blocks = (M + kSparseBlockM - 1) / kSparseBlockM;
+#if defined(USE_OpenMP)
+#pragma omp parallel for collapse(2)
+#endif
+  for (int js = 0; js < num_strips; ++js) {
+    for (int mb = 0; mb < num_row_blocks; ++mb) {
+      int m_end = std::min(M, (mb + 1) * kSparseBlockM);
+      for (int kb = 0; kb < A.num_blocks(); ++kb) {
+        const auto *row_ptr = A.row_ptr.data() + kb * A.rows + row_begin;
+        for (int m = mb * kSparseBlockM; m < m_end; ++m) {
+          int begin = row_ptr[m], end = row_ptr[m + 1];
+          if (kb > 0 && begin == end) continue;
+          int col = js * NR, col_end = std::min(N, col + NR);
+          const auto *b = B + col;
+          auto *c = C + m * N + col;
+          bool accumulate = kb > 0;
+#define SPARSE_RUN(NV)                                                   \
+  for (; col + NV * VL <= col_end; col += NV * VL) {                     \
+    Kernel::template Run<NV>(begin, end, col_idx, values, b, N,          \
+                             accumulate, c);                             \
+    b += NV * VL, c += NV * VL;                                          \
+  }
+          SPARSE_RUN(8)
+          SPARSE_RUN(4)
+          SPARSE_RUN(2)
+          SPARSE_RUN(1)
+#undef SPARSE_RUN
+          if (col < col_end) {
+            SparseRow(begin, end, col_idx, values, b, N, col_end - col,
+                      accumulate, c);
+          }
+        }
+      }
+    }
+  }
+}
+
+void SparseSgemm(const SparseMatrix &A, int row_begin, int M, int N,
+                 const float *B, float *C) {
+#if defined(SPARSE_X86)
+  switch (CPU::ActiveISA()) {
+    case CPU::kAVX512:
+      return SparseStrips<SparseAVX512>(A, row_begin, M, N, B, C);
+    case CPU::kAVX2:
+      return SparseStrips<SparseAVX2>(A, row_begin, M, N, B, C);
+    default:
+      break;
+  }
+#endif
+  SparseStrips<SparsePlain>(A, row_begin, M, N, B, C);
+}
+
+static float SparseDot(int begin, int end, const int *col_idx,
+                       const float *values, const float *x) {
+  float sum = 0;
+  for (int p = begin; p < end; ++p) sum += values[p] * x[col_idx[p]];
+  return sum;
+}
+
+void SparseSgemv(const SparseMatrix &A, int batch, const float *x,
+                 float *y) {
+  const auto *col_idx = A.col_idx.data();
+  const auto *values = A.values.data();
+#if defined(USE_OpenMP)
+#pragma omp parallel for collapse(2)
+#endif
+  for (int b = 0; b < batch; ++b) {
+    for (int r = 0; r < A.rows; ++r) {
+      float sum = 0;
+      for (int kb = 0; kb < A.num_blocks(); ++kb) {
+        const auto *row_ptr = A.row_ptr.data() + kb * A.rows + r;
+        sum += SparseDot(row_ptr[0], row_ptr[1], col_idx, values,
+                         x + b * A.cols);
+      }
+      y[b * A.rows + r] = sum;
+    }
+  }
+}
+
+}  // namespace Blas
+
+}  // namespace Shadow
@@ -0,0 +1,51 @@
+#ifndef SHADOW_CORE_SPARSE_HPP
+#define SHADOW_CORE_SPARSE_HPP
+
+#include <vector>
+
+namespace Shadow {
+
+namespace Blas {
+
+// Compressed sparse rows of a rows x cols matrix, cut into blocks of
+// block_cols columns so a product only needs the matching block of rows of
+// the dense operand at a time. The nonzeros of row r within column block kb
+// are [row_ptr[kb * rows + r], row_ptr[kb * rows + r + 1]) in col_idx and
+// values
+struct SparseMatrix {
+  int rows = 0, cols = 0, block_cols = 0;
+  std::vector<int> row_ptr, col_idx;
+  std::vector<float> values;
+
+  int nnz() const { return static_cast<int>(values.size()); }
+  int num_blocks() const {
+    return block_cols > 0 ? (cols + block_cols - 1) / block_cols : 0;
+  }
+};
+
+// Weights at or below this density are worth benchmarking the sparse
+// kernels for, above it the dense ones always win
+const float kSparseDensity = 0.5f;
+
+// Fraction of nonzeros in count values
+float Density(int count, const float *data);
+
+// Row major A (rows x cols), read transposed when TA is set (A is then
+// stored as cols x rows)
+void DenseToSparse(int TA, int rows, int cols, const float *A,
+                   SparseMatrix *sparse);
+
+// C = A[row_begin, row_begin + M) * B for a row major B (A.cols x N) and C
+// (M x N), only the nonzeros of A are visited
+void SparseSgemm(const SparseMatrix &A, int row_begin, int M, int N,
+                 const float *B, float *C);
+
+// y[b * A.rows + r] = dot(A row r, x[b * A.cols, (b + 1) * A.cols)) for
+// each of the batch rows of x
+void SparseSgemv(const SparseMatrix &A, int batch, const float *x, float *y);
+
+}  // namespace Blas
+
+}  // namespace Shadow
+
+#endif  // SHADOW_CORE_SPARSE_HPP
@@ -0,0 +1,125 @@
+#include "tuner.hpp"
+#include "cpu_features.hpp"
+
+#include "util/log.hpp"
+
+#include <cstdio>
+#include <thread>
+
+#if defined(USE_OpenMP)
+#include <omp.h>
+#endif
+
+namespace Shadow {
+
+void Tuner::Setup(const std::string &cache_file,
+                  const std::string &model_hash) {
+  Flush();
+  enabled_ = true;
+  cache_file_ = cache_file;
+  prefix_ = model_hash + " " + HostKey() + " ";
+  choices_.clear();
+  Load();
+}
+
+bool Tuner::Lookup(const std::string &key, int *choice) const {
+  const auto &it = choices_.find(prefix_ + key);
+  if (it == choices_.end()) return false;
+  *choice = it->second;
+  return true;
+}
+
+void Tuner::Insert(const std::string &key, int choice) {
+  choices_[prefix_ + key] = choice;
+  dirty_ = true;
+}
+
+void Tuner::Flush() {
+  if (!dirty_) return;
+  dirty_ = false;
+  Save();
+}
+
+// The cpu model, the number of worker threads and the instruction set the
+// kernels are bound to, with spaces removed so the key stays a single token
+// of the cache file
+std::string Tuner::HostKey() {
+  std::string model_name = "unknown";
+  std::ifstream cpu_info("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpu_info, line)) {
+    if (line.find("model name") == 0 || line.find("Processor") == 0) {
+      auto pos = line.find(':');
+      if (pos != std::string::npos) {
+        model_name = Util::trim(line.substr(pos + 1));
+        break;
+      }
+    }
+  }
+#if defined(USE_OpenMP)
+  int num_threads = omp_get_max_threads();
+#else
+  auto num_threads = static_cast<int>(std::thread::hardware_concurrency());
+#endif
+  auto host_key = model_name + "@" + Util::to_string(num_threads) + "@" +
+                  CPU::ISAName(CPU::ActiveISA());
+  std::replace(host_key.begin(), host_key.end(), ' ', '_');
+  return host_key;
+}
+
+// One choice per line: model_hash host_key op_key choice
+void Tuner::Load() {
+  if (cache_file_.empty()) return;
+  std::ifstream file(cache_file_);
+  std::string model_hash, host_key, op_key;
+  int choice;
+  while (file >> model_hash >> host_key >> op_key >> choice) {
+    choices_[model_hash + " " + host_key + " " + op_key] = choice;
+  }
+  DLOG(INFO) << "Loaded " << choices_.size() << " tuned choices from "
+             << cache_file_;
+}
+
+// Entries other processes saved since Load are merged in, and the file is
+// replaced by renaming a complete copy written next to it, so readers never
+// see a partly written cache
+void Tuner::Save() const {
+  if (cache_file_.empty()) return;
+  std::map<std::string, int> choices;
+  std::ifstream in_file(cache_file_);
+  std::string model_hash, host_key, op_key;
+  int choice;
+  while (in_file >> model_hash >> host_key >> op_key >> choice) {
+    choices[model_hash + " " + host_key + " " + op_key] = choice;
+  }
+  in_file.close();
+  for (const auto &it : choices_) {
+    choices[it.first] = it.second;
+  }
+
+  auto temp_file = cache_file_ + ".tmp";
+#if defined(__linux__) || defined(__APPLE__)
+  temp_file += "." + Util::to_string(getpid());
+#endif
+  {
+    std::ofstream file(temp_file);
+    if (!file.is_open()) {
+      LOG(WARNING) << "Can not write tuning cache " << temp_file;
+      return;
+    }
+    for (const auto &it : choices) {
+      file << it.first << " " << it.second << std::endl;
+    }
+    if (!file.good()) {
+      LOG(WARNING) << "Failed to write tuning cache " << temp_file;
+      std::remove(temp_file.c_str());
+      return;
+    }
+  }
+  if (std::rename(temp_file.c_str(), cache_file_.c_str()) != 0) {
+    LOG(WARNING) << "Can not replace tuning cache " << cache_file_;
+    std::remove(temp_file.c_str());
+  }
+}
+
+}  // namespace Shadow
@@ -0,0 +1,42 @@
+#ifndef SHADOW_CORE_TUNER_HPP
+#define SHADOW_CORE_TUNER_HPP
+
+#include "util/util.hpp"
+
+#include <map>
+#include <string>
+
+namespace Shadow {
+
+// Algorithm choices benchmarked by operators, keyed by model hash, host cpu
+// and the operator's own key (its name and shapes). Entries of other models
+// and hosts found in the cache file are kept when it is rewritten
+class Tuner {
+ public:
+  Tuner() = default;
+  ~Tuner() { Flush(); }
+
+  void Setup(const std::string &cache_file, const std::string &model_hash);
+
+  bool enabled() const { return enabled_; }
+
+  bool Lookup(const std::string &key, int *choice) const;
+  void Insert(const std::string &key, int choice);
+
+  // Writes the choices inserted since the last flush to the cache file
+  void Flush();
+
+  static std::string HostKey();
+
+ private:
+  void Load();
+  void Save() const;
+
+  bool enabled_ = false, dirty_ = false;
+  std::string cache_file_, prefix_;
+  std::map<std::string, int> choices_;
+};
+
+}  // namespace Shadow
+
+#endif  // SHADOW_CORE_TUNER_HPP
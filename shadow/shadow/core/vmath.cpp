@@ -0,0 +1,95 @@
+#include "vmath.hpp"
+#include "cpu_features.hpp"
+
+#include "util/log.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+namespace Shadow {
+
+namespace VMath {
+
+static std::atomic<int> &PrecisionSlot() {
+  static std::atomic<int> precision([]() {
+    const char *env = std::getenv("SHADOW_MATH_PRECISION");
+    if (env == nullptr || *env == '\0') return static_cast<int>(kPrecise);
+    std::string name(env);
+    if (name == "fast") return static_cast<int>(kFast);
+    if (name != "precise") {
+      LOG(WARNING) << "Unknown SHADOW_MATH_PRECISION " << name
+                   << ", using precise";
+    }
+    return static_cast<int>(kPrecise);
+  }());
+  return precision;
+}
+
+Precision GetPrecision() {
+  return static_cast<Precision>(
+      PrecisionSlot().load(std::memory_order_relaxed));
+}
+
+void SetPrecision(Precision precision) {
+  PrecisionSlot().store(static_cast<int>(precision),
+                        std::memory_order_relaxed);
+}
+
+// The inline approximations are branch free, so each loop vectorizes in the
+// build for every instruction set
+#define VMATH_LOOP(name, func)                                    \
+  struct name##Kernel {                                           \
+    static CPU_KERNEL void Run(int n, const float *x, float *y) { \
+      for (int i = 0; i < n; ++i) y[i] = func(x[i]);              \
+    }                                                             \
+  };                                                              \
+  static void name##Fast(int n, const float *x, float *y) {       \
+    CPU::Dispatch<name##Kernel>(n, x, y);                         \
+  }
+
+VMATH_LOOP(Exp, FastExp);
+VMATH_LOOP(Log, FastLog);
+VMATH_LOOP(Sigmoid, FastSigmoid);
+VMATH_LOOP(Tanh, FastTanh);
+VMATH_LOOP(SoftPlus, FastSoftPlus);
+
+#undef VMATH_LOOP
+
+void Exp(int n, const float *x, float *y) {
+  if (GetPrecision() == kFast) return ExpFast(n, x, y);
+  for (int i = 0; i < n; ++i) y[i] = std::exp(x[i]);
+}
+
+void Log(int n, const float *x, float *y) {
+  if (GetPrecision() == kFast) return LogFast(n, x, y);
+  for (int i = 0; i < n; ++i) y[i] = std::log(x[i]);
+}
+
+void Sigmoid(int n, const float *x, float *y) {
+  if (GetPrecision() == kFast) return SigmoidFast(n, x, y);
+  for (int i = 0; i < n; ++i) y[i] = 1 / (1 + std::exp(-x[i]));
+}
+
+void Tanh(int n, const float *x, float *y) {
+  if (GetPrecision() == kFast) return TanhFast(n, x, y);
+  for (int i = 0; i < n; ++i) y[i] = std::tanh(x[i]);
+}
+
+void SoftPlus(int n, const float *x, float *y) {
+  if (GetPrecision() == kFast) return SoftPlusFast(n, x, y);
+  for (int i = 0; i < n; ++i) y[i] = std::log(1 + std::exp(x[i]));
+}
+
+float Exp(float x) {
+  return GetPrecision() == kFast ? FastExp(x) : std::exp(x);
+}
+
+float Sigmoid(float x) {
+  return GetPrecision() == kFast ? FastSigmoid(x) : 1 / (1 + std::exp(-x));
+}
+
+}  // namespace VMath
+
+}  // namespace Shadow
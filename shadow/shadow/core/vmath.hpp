@@ -0,0 +1,133 @@
+#ifndef SHADOW_CORE_VMATH_HPP
+#define SHADOW_CORE_VMATH_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace Shadow {
+
+namespace VMath {
+
+// Precise calls libm per element. Fast uses branch free polynomial
+// approximations which vectorize: exp and log stay within 1e-7 relative
+// error, sigmoid within 1.5e-7 (1.47e-7 measured near -16.64) and tanh
+// within 1e-7 absolute error, over the normal float range (denormal inputs
+// to log are not handled, sigmoid results below it flush to zero)
+enum Precision { kPrecise = 0, kFast = 1 };
+
+// Precise unless callers opt in to fast by SetPrecision or the
+// SHADOW_MATH_PRECISION environment variable (precise or fast)
+Precision GetPrecision();
+void SetPrecision(Precision precision);
+
+// Element wise over n values bound to the active instruction set, y may
+// alias x
+void Exp(int n, const float *x, float *y);
+void Log(int n, const float *x, float *y);
+void Sigmoid(int n, const float *x, float *y);
+void Tanh(int n, const float *x, float *y);
+void SoftPlus(int n, const float *x, float *y);
+
+// Single values following the precision mode, for scalar decoding code
+float Exp(float x);
+float Sigmoid(float x);
+
+inline float AsFloat(int32_t i) {
+  float f;
+  memcpy(&f, &i, sizeof(f));
+  return f;
+}
+
+inline int32_t AsInt(float f) {
+  int32_t i;
+  memcpy(&i, &f, sizeof(i));
+  return i;
+}
+
+// Branch free choice between two computed values, with a plain conditional
+// the compiler sinks the computation of one side into a branch and stops
+// vectorizing the loop, since the moved float operations may trap. This
+// holds for std::min and std::max followed by arithmetic as well
+inline float Select(bool cond, float a, float b) {
+  int32_t mask = -static_cast<int32_t>(cond);
+  return AsFloat((AsInt(a) & mask) | (AsInt(b) & ~mask));
+}
+
+// Cephes expf: x = n * ln2 + r with |r| <= ln2 / 2, exp(r) by a degree 6
+// polynomial and 2^n assembled in the exponent bits of two factors, so n up
+// to 128 does not overflow on the way
+inline float FastExp(float x) {
+  const float kMax = 88.72283f, kMin = -87.33654f;
+  float c = Select(x < kMin, kMin, Select(x > kMax, kMax, x));
+  // Adding 1.5 * 2^23 rounds to an integer held in the low mantissa bits
+  float shifted = c * 1.44269504f + 12582912.f;
+  float n = shifted - 12582912.f;
+  int32_t e = AsInt(shifted) - AsInt(12582912.f), e_half = e >> 1;
+  float r = c - n * 0.693359375f + n * 2.12194440e-4f;
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.f;
+  float y = p * AsFloat((e_half + 127) << 23) *
+            AsFloat((e - e_half + 127) << 23);
+  y = Select(x < kMin, 0.f, y);
+  return Select(x > kMax, std::numeric_limits<float>::infinity(), y);
+}
+
+// Cephes logf: x = m * 2^e with sqrt(0.5) <= m < sqrt(2), log(m) by a
+// degree 9 polynomial of m - 1
+inline float FastLog(float x) {
+  int32_t bits = AsInt(x);
+  float e = static_cast<float>(((bits >> 23) & 0xff) - 126);
+  float m = AsFloat((bits & 0x807fffff) | 0x3f000000);
+  float small = Select(m < 0.707106781f, 1.f, 0.f);
+  e = e - small;
+  m = m - 1.f + small * m;
+  float z = m * m;
+  float p = 7.0376836292e-2f;
+  p = p * m - 1.1514610310e-1f;
+  p = p * m + 1.1676998740e-1f;
+  p = p * m - 1.2420140846e-1f;
+  p = p * m + 1.4249322787e-1f;
+  p = p * m - 1.6668057665e-1f;
+  p = p * m + 2.0000714765e-1f;
+  p = p * m - 2.4999993993e-1f;
+  p = p * m + 3.3333331174e-1f;
+  float y = p * m * z - 2.12194440e-4f * e - 0.5f * z;
+  y = m + y + 0.693359375f * e;
+  y = Select(x == std::numeric_limits<float>::infinity(), x, y);
+  y = Select(x == 0.f, -std::numeric_limits<float>::infinity(), y);
+  // Negative and NaN inputs give NaN
+  return Select(!(x >= 0.f), std::numeric_limits<float>::quiet_NaN(), y);
+}
+
+inline float FastSigmoid(float x) { return 1.f / (1.f + FastExp(-x)); }
+
+// Odd polynomial near zero where 1 - 2 / (exp(2x) + 1) cancels
+inline float FastTanh(float x) {
+  float a = std::abs(x), z = x * x;
+  float p = -5.70498872745e-3f;
+  p = p * z + 2.06390887954e-2f;
+  p = p * z - 5.37397155531e-2f;
+  p = p * z + 1.33314422036e-1f;
+  p = p * z - 3.33332819422e-1f;
+  float near = x + x * z * p;
+  float far = 1.f - 2.f / (FastExp(a + a) + 1.f);
+  far = std::copysign(far, x);
+  return Select(a < 0.625f, near, far);
+}
+
+inline float FastSoftPlus(float x) {
+  return Select(x > 0.f, x, 0.f) + FastLog(1.f + FastExp(-std::abs(x)));
+}
+
+}  // namespace VMath
+
+}  // namespace Shadow
+
+#endif  // SHADOW_CORE_VMATH_HPP
@@ -1,11 +1,24 @@
 #include "workspace.hpp"
 
+#include <climits>
+
 namespace Shadow {
 
+// Temp blobs start on cache lines
+static const size_t kTempAlign = 64;
+
 bool Workspace::HasBlob(const std::string &name) const {
   return static_cast<bool>(blob_map_.count(name));
 }
 
+const std::vector<std::string> Workspace::GetBlobNames() const {
+  std::vector<std::string> names;
+  for (const auto &blob_it : blob_map_) {
+    names.push_back(blob_it.first);
+  }
+  return names;
+}
+
 const std::string Workspace::GetBlobType(const std::string &name) const {
   if (blob_map_.count(name)) {
     return blob_map_.at(name).first;
@@ -14,17 +27,102 @@ const std::string Workspace::GetBlobType(const std::string &name) const {
   return std::string();
 }
 
+const VecInt Workspace::GetBlobShape(const std::string &name) const {
+  const auto &blob_type = GetBlobType(name);
+  if (blob_type == int_id) {
+    return GetBlob<int>(name)->shape();
+  } else if (blob_type == float_id) {
+    return GetBlob<float>(name)->shape();
+  } else if (blob_type == uchar_id) {
+    return GetBlob<unsigned char>(name)->shape();
+  }
+  return VecInt();
+}
+
+template <typename T>
+static size_t BlobSize(const Blob<T> *blob, bool owned) {
+  if (owned) {
+    return blob->shared() ? 0 : blob->mem_count();
+  }
+  return blob->count() * sizeof(T);
+}
+
+static size_t BlobSize(const std::string &blob_type, const void *blob,
+                       bool owned) {
+  if (blob_type == int_id) {
+    return BlobSize(static_cast<const BlobI *>(blob), owned);
+  } else if (blob_type == float_id) {
+    return BlobSize(static_cast<const BlobF *>(blob), owned);
+  } else if (blob_type == uchar_id) {
+    return BlobSize(static_cast<const BlobUC *>(blob), owned);
+  }
+  LOG(FATAL) << "Unknown blob type " << blob_type;
+  return 0;
+}
+
+template <typename T>
+static size_t BlobSize(const Blob<T> *blob, const VecInt &shape) {
+  if (blob->shared()) return 0;
+  size_t count = 1;
+  for (const auto dim : shape) count *= dim;
+  return count * sizeof(T);
+}
+
+size_t Workspace::GetBlobSize(const std::string &name) const {
+  CHECK(HasBlob(name)) << "Blob " << name << " not in the workspace";
+  const auto &blob_it = blob_map_.at(name);
+  return BlobSize(blob_it.first, blob_it.second, false);
+}
+
+size_t Workspace::GetBlobOwnedSize(const std::string &name) const {
+  CHECK(HasBlob(name)) << "Blob " << name << " not in the workspace";
+  const auto &blob_it = blob_map_.at(name);
+  return BlobSize(blob_it.first, blob_it.second, true);
+}
+
+size_t Workspace::GetBlobOwnedSize(const std::string &name,
+                                   const VecInt &shape) const {
+  CHECK(HasBlob(name)) << "Blob " << name << " not in the workspace";
+  const auto &blob_type = GetBlobType(name);
+  if (blob_type == int_id) {
+    return BlobSize(GetBlob<int>(name), shape);
+  } else if (blob_type == float_id) {
+    return BlobSize(GetBlob<float>(name), shape);
+  } else if (blob_type == uchar_id) {
+    return BlobSize(GetBlob<unsigned char>(name), shape);
+  }
+  LOG(FATAL) << "Unknown blob type " << blob_type;
+  return 0;
+}
+
 void Workspace::GrowTempBuffer(int count, int elem_size) {
-  if (blob_temp_ == nullptr) {
-    blob_temp_ =
-        std::make_shared<Blob<unsigned char>>(VecInt{count, elem_size});
-  } else {
-    auto required = static_cast<size_t>(count) * elem_size;
-    if (required > blob_temp_->mem_count()) {
-      blob_temp_->reshape({count, elem_size});
-    }
+  // Slack for the alignment of a few temp blobs
+  ReserveTemp(temp_offset_ + static_cast<size_t>(count) * elem_size +
+              4 * kTempAlign);
+}
+
+void Workspace::PlanTemp(size_t count, int elem_size) {
+  temp_offset_ = (temp_offset_ + count * elem_size + kTempAlign - 1) /
+                 kTempAlign * kTempAlign;
+  temp_peak_ = std::max(temp_peak_, temp_offset_);
+}
+
+void Workspace::TempRelease(size_t mark) {
+  CHECK_LE(mark, temp_offset_);
+  temp_offset_ = mark;
+  if (temp_offset_ == 0) retired_temps_.clear();
+}
+
+void Workspace::ReleaseTempBuffer() {
+  if (temp_offset_ == 0) {
+    blob_temp_ = nullptr;
+  }
+}
+
+void Workspace::ReleaseTempBlobs() {
+  if (temp_offset_ == 0) {
+    temp_blobs_.clear();
   }
-  temp_offset_ = 0;
 }
 
 size_t Workspace::GetWorkspaceSize() const {
@@ -48,7 +146,7 @@ size_t Workspace::GetWorkspaceSize() const {
 }
 
 size_t Workspace::GetWorkspaceTempSize() const {
-  return blob_temp_->mem_count();
+  return blob_temp_ != nullptr ? blob_temp_->mem_count() : 0;
 }
 
 void Workspace::CreateCtx(int device_id) {
@@ -79,11 +177,25 @@ void Workspace::ClearBlob(const std::string &blob_type, void *blob) {
   }
 }
 
+void Workspace::ReserveTemp(size_t size) {
+  if (blob_temp_ != nullptr && size <= blob_temp_->mem_count()) return;
+  CHECK_LE(size, static_cast<size_t>(INT_MAX));
+  if (blob_temp_ != nullptr && temp_offset_ > 0) {
+    retired_temps_.push_back(blob_temp_);
+    blob_temp_ = nullptr;
+  }
+  if (blob_temp_ == nullptr) {
+    blob_temp_ = std::make_shared<BlobUC>(VecInt{static_cast<int>(size)});
+  } else {
+    blob_temp_->reshape({static_cast<int>(size)});
+  }
+}
+
 void *Workspace::GetTempPtr(size_t count, int elem_size) {
   auto required = count * elem_size;
-  CHECK_LE(temp_offset_ + required, blob_temp_->mem_count());
+  ReserveTemp(temp_offset_ + required);
   auto *ptr = blob_temp_->mutable_data() + temp_offset_;
-  temp_offset_ += required;
+  PlanTemp(count, elem_size);
   return ptr;
 }
 
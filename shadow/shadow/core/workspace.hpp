@@ -3,11 +3,15 @@
 
 #include "blob.hpp"
 #include "context.hpp"
+#include "tuner.hpp"
 
+#include <algorithm>
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <string>
 #include <typeinfo>
+#include <vector>
 
 namespace Shadow {
 
@@ -28,8 +32,17 @@ class Workspace {
   }
 
   bool HasBlob(const std::string &name) const;
+  const std::vector<std::string> GetBlobNames() const;
 
   const std::string GetBlobType(const std::string &name) const;
+  const VecInt GetBlobShape(const std::string &name) const;
+
+  // Bytes of the data of blob name, and of the memory it owns, which is
+  // nothing for views and blobs sharing the data of others, or would own
+  // if it were reshaped to shape
+  size_t GetBlobSize(const std::string &name) const;
+  size_t GetBlobOwnedSize(const std::string &name) const;
+  size_t GetBlobOwnedSize(const std::string &name, const VecInt &shape) const;
 
   template <typename T>
   const Blob<T> *GetBlob(const std::string &name) const {
@@ -72,47 +85,108 @@ class Workspace {
     return GetBlob<T>(name);
   }
 
+  // Operator temporaries are stacked in one buffer: TempMark gives the top
+  // of the stack and TempRelease pops everything placed after it. A temp
+  // blob is a view of its range, made by the workspace on the first call
+  // for the slot *blob held by the op and repointed on later calls
   template <typename Dtype>
-  Blob<Dtype> *CreateTempBlob(const VecInt &shape, const std::string &name) {
-    Blob<Dtype> *blob = nullptr;
-    if (!HasBlob(name)) {
-      blob_map_[name].first = typeid(Dtype).name();
-      blob_map_[name].second = new Blob<Dtype>(name);
-    }
-    blob = GetBlob<Dtype>(name);
+  Blob<Dtype> *CreateTempBlob(const VecInt &shape, Blob<Dtype> **blob) {
     CHECK_NOTNULL(blob);
-    blob->clear();
-    blob->set_shape(shape);
+    if (*blob == nullptr) {
+      auto temp_blob = std::make_shared<Blob<Dtype>>();
+      temp_blobs_.push_back(temp_blob);
+      *blob = temp_blob.get();
+    }
     size_t cou = 1;
     for (const auto dim : shape) cou *= dim;
     CHECK_GT(cou, 0);
-    int size = sizeof(Dtype) / sizeof(unsigned char);
-    blob->share_data(reinterpret_cast<Dtype *>(GetTempPtr(cou, size)), shape);
-    return blob;
+    (*blob)->set_view(static_cast<Dtype *>(GetTempPtr(cou, sizeof(Dtype))),
+                      shape);
+    return *blob;
   }
 
+  // Makes room for count elements on top of the stack, the buffer is
+  // otherwise grown by the temp blobs which do not fit. Growing while
+  // temporaries are live keeps the old buffer until they are released
   void GrowTempBuffer(int count, int elem_size);
 
+  // Stacks count elements the way a temp blob would without touching the
+  // buffer, for passes that only measure the temporaries
+  void PlanTemp(size_t count, int elem_size);
+
+  size_t TempMark() const { return temp_offset_; }
+  void TempRelease(size_t mark);
+
+  // Highest top of the stack since the last ResetTempPeak, which starts
+  // over from peak or the current top
+  size_t TempPeak() const { return temp_peak_; }
+  void ResetTempPeak(size_t peak = 0) {
+    temp_peak_ = std::max(peak, temp_offset_);
+  }
+
+  // Bytes an op may stack at most, ops with a choice of algorithms keep
+  // their temporaries within it. Unlimited unless set
+  size_t TempBudget() const { return temp_budget_; }
+  void SetTempBudget(size_t budget) { temp_budget_ = budget; }
+
+  // Drops the temp buffer when nothing is stacked, the next temporaries
+  // grow it again to what they need
+  void ReleaseTempBuffer();
+  // Drops the temp blobs of the ops when nothing is stacked, the slots the
+  // ops hold must not be used afterwards
+  void ReleaseTempBlobs();
+
   size_t GetWorkspaceSize() const;
   size_t GetWorkspaceTempSize() const;
 
   void CreateCtx(int device_id);
   Context *Ctx();
 
+  Tuner *GetTuner() { return &tuner_; }
+
  private:
   void ClearBlob(const std::string &blob_type, void *blob);
 
+  void ReserveTemp(size_t size);
   void *GetTempPtr(size_t count, int elem_size);
 
   std::map<std::string, std::pair<std::string, void *>> blob_map_;
   std::shared_ptr<BlobUC> blob_temp_ = nullptr;
-  size_t temp_offset_ = 0;
+  std::vector<std::shared_ptr<BlobUC>> retired_temps_;
+  std::vector<std::shared_ptr<void>> temp_blobs_;
+  size_t temp_offset_ = 0, temp_peak_ = 0, temp_budget_ = SIZE_MAX;
 
   std::shared_ptr<Context> context_ = nullptr;
 
+  Tuner tuner_;
+
   DISABLE_COPY_AND_ASSIGN(Workspace);
 };
 
+// Releases the temporaries created during its lifetime and measures their
+// peak, scopes nest
+class TempScope {
+ public:
+  explicit TempScope(Workspace *ws)
+      : ws_(ws), mark_(ws->TempMark()), outer_peak_(ws->TempPeak()) {
+    ws_->ResetTempPeak();
+  }
+  ~TempScope() {
+    auto peak = ws_->TempPeak();
+    ws_->TempRelease(mark_);
+    ws_->ResetTempPeak(std::max(peak, outer_peak_));
+  }
+
+  // Bytes stacked over the mark at most so far
+  size_t peak() const { return ws_->TempPeak() - mark_; }
+
+ private:
+  Workspace *ws_;
+  size_t mark_, outer_peak_;
+
+  DISABLE_COPY_AND_ASSIGN(TempScope);
+};
+
 }  // namespace Shadow
 
 #endif  // SHADOW_CORE_WORKSPACE_HPP
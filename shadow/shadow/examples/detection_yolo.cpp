@@ -1,5 +1,7 @@
 #include "detection_yolo.hpp"
 
+#include "core/vmath.hpp"
+
 namespace Shadow {
 
 void DetectionYOLO::Setup(const std::string &model_file) {
@@ -106,7 +108,7 @@ void DetectionYOLO::Process(const VecFloat &in_data,
   }
 }
 
-inline float logistic_activate(float x) { return 1.f / (1 + std::exp(-x)); }
+inline float logistic_activate(float x) { return VMath::Sigmoid(x); }
 
 inline void Softmax(float *scores, int n) {
   float largest = -FLT_MAX;
@@ -115,9 +117,11 @@ inline void Softmax(float *scores, int n) {
     if (scores[i] > largest) largest = scores[i];
   }
   for (int i = 0; i < n; ++i) {
-    float e = std::exp(scores[i] - largest);
-    sum += e;
-    scores[i] = e;
+    scores[i] -= largest;
+  }
+  VMath::Exp(n, scores, scores);
+  for (int i = 0; i < n; ++i) {
+    sum += scores[i];
   }
   for (int i = 0; i < n; ++i) {
     scores[i] /= sum;
@@ -148,8 +152,8 @@ inline void ConvertRegionBoxes(const float *data, const float *biases,
       float x, y, w, h;
       x = (logistic_activate(data[box_index + 0]) + col) / side;
       y = (logistic_activate(data[box_index + 1]) + row) / side;
-      w = std::exp(data[box_index + 2]) * biases[2 * n] / side;
-      h = std::exp(data[box_index + 3]) * biases[2 * n + 1] / side;
+      w = VMath::Exp(data[box_index + 2]) * biases[2 * n] / side;
+      h = VMath::Exp(data[box_index + 3]) * biases[2 * n + 1] / side;
 
       x = x - w / 2;
       y = y - h / 2;
@@ -0,0 +1,66 @@
+#include "core/network.hpp"
+#include "util/log.hpp"
+#include "util/util.hpp"
+
+// Written by tools/convert --aot, Shadow_AOT_DIR and Shadow_AOT_MODEL pick
+// the files and the classes, see the root CMakeLists.txt
+#include AOT_MODEL_HPP
+#include AOT_FORWARD_HPP
+
+#include <cmath>
+
+using namespace Shadow;
+
+// Runs the ahead of time forward of a single input net next to a Network
+// loaded from the same written model, checks that their outputs agree and
+// reports the time of both
+int main() {
+  Network network;
+  network.Setup();
+#if defined(USE_Protobuf)
+  network.LoadModel(AOT_MODEL::proto_model(), AOT_MODEL::weights());
+#elif defined(USE_JSON)
+  network.LoadModel(AOT_MODEL::json_model(), AOT_MODEL::weights());
+#else
+  network.LoadModel(AOT_MODEL::custom_model(), AOT_MODEL::weights());
+#endif
+
+  const auto in_name = network.in_blob()[0];
+  const auto &in_shape = network.GetBlobShapeByName<float>(in_name);
+  int in_count = 1;
+  for (const auto dim : in_shape) in_count *= dim;
+  CHECK_EQ(in_count, AOT_FORWARD::input_count(0));
+
+  std::vector<float> in_data(in_count);
+  for (int i = 0; i < in_count; ++i) {
+    in_data[i] = std::sin(0.01f * i);
+  }
+  std::map<std::string, float *> data_map{{in_name, in_data.data()}};
+
+  AOT_FORWARD model;
+  network.Forward(data_map);
+  model.Forward(in_data.data());
+
+  const auto &out_blob = network.out_blob();
+  CHECK_EQ(static_cast<int>(out_blob.size()), AOT_FORWARD::num_outputs());
+  for (int n = 0; n < AOT_FORWARD::num_outputs(); ++n) {
+    const auto *net_data = network.GetBlobDataByName<float>(out_blob[n]);
+    const auto *aot_data = model.output(n);
+    float max_diff = 0;
+    for (int i = 0; i < AOT_FORWARD::output_count(n); ++i) {
+      max_diff = std::max(max_diff, std::abs(net_data[i] - aot_data[i]));
+    }
+    LOG(INFO) << out_blob[n] << " max difference: " << max_diff;
+  }
+
+  const int iters = 100;
+  Timer timer;
+  for (int i = 0; i < iters; ++i) network.Forward(data_map);
+  LOG(INFO) << "Network forward: " << timer.get_millisecond() / iters
+            << " ms";
+  timer.start();
+  for (int i = 0; i < iters; ++i) model.Forward(in_data.data());
+  LOG(INFO) << "AOT forward: " << timer.get_millisecond() / iters << " ms";
+
+  return 0;
+}
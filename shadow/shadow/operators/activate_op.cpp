@@ -1,5 +1,8 @@
 #include "activate_op.hpp"
 
+#include "core/cpu_features.hpp"
+#include "core/vmath.hpp"
+
 namespace Shadow {
 
 void ActivateOp::Forward() {
@@ -37,67 +40,43 @@ namespace Vision {
 
 #if !defined(USE_CUDA)
 template <typename T>
-inline T Activate(T x, int type, float slope) {
-  switch (type) {
-    case 1:
-      return x * (x > 0);
-    case 2:
-      return x > 0 ? x : T(slope * x);
-    case 3:
-      return 1 / (1 + std::exp(-x));
-    case 4:
-      return std::log(1 + std::exp(x));
-    case 5: {
-      T exp_2x = std::exp(2 * x);
-      return (exp_2x - 1) / (exp_2x + 1);
+struct ActivateKernel {
+  static CPU_KERNEL void Run(T *data, int count, int type, float slope) {
+    if (type == 1) {
+      for (int i = 0; i < count; ++i) {
+        data[i] = std::max(data[i], T(0));
+      }
+    } else if (type == 0 || type == 2) {
+      // Branch free, so it vectorizes
+      for (int i = 0; i < count; ++i) {
+        data[i] = std::max(data[i], T(0)) + T(slope) * std::min(data[i], T(0));
+      }
     }
-    default:
-      return x;
   }
-}
+};
 
 template <typename T>
 void Activate(T *data, int count, int type, float slope) {
-// PRelu: 0, Relu: 1, Leaky: 2, Sigmoid: 3, SoftPlus: 4, Tanh: 5
-#if defined(USE_Eigen)
-  auto data_eigen = MapVector<T>(data, count);
+  // PRelu: 0, Relu: 1, Leaky: 2, Sigmoid: 3, SoftPlus: 4, Tanh: 5
   switch (type) {
-    case 1:
-      data_eigen = data_eigen.cwiseMax(T(0));
-      break;
-    case 2:
-      data_eigen = data_eigen.unaryExpr(
-          [slope](T x) { return x > 0 ? x : T(slope * x); });
-      break;
     case 3:
-      data_eigen =
-          data_eigen.unaryExpr([](T x) { return 1 / (1 + std::exp(-x)); });
-      break;
+      return VMath::Sigmoid(count, data, data);
     case 4:
-      data_eigen =
-          data_eigen.unaryExpr([](T x) { return std::log(1 + std::exp(x)); });
-      break;
+      return VMath::SoftPlus(count, data, data);
     case 5:
-      data_eigen = data_eigen.unaryExpr([](T x) {
-        T exp_2x = std::exp(2 * x);
-        return (exp_2x - 1) / (exp_2x + 1);
-      });
-      break;
+      return VMath::Tanh(count, data, data);
     default:
-      return;
-  }
-#else
-  for (int i = 0; i < count; ++i) {
-    data[i] = Activate(data[i], type, slope);
+      return CPU::Dispatch<ActivateKernel<T>>(data, count, type, slope);
   }
-#endif
 }
 
 template <typename T>
 void PRelu(T *data, const VecInt &in_shape, bool channel_shared,
            const T *slope_data) {
   int channels = in_shape[1], dim = 1;
-  for (int i = 2; i < in_shape.size(); ++i) dim *= in_shape[i];
+  for (int i = 2; i < static_cast<int>(in_shape.size()); ++i) {
+    dim *= in_shape[i];
+  }
   int count = in_shape[0] * channels * dim;
   int div_factor = channel_shared ? channels : 1;
   for (int i = 0; i < count; ++i) {
@@ -106,9 +85,59 @@ void PRelu(T *data, const VecInt &in_shape, bool channel_shared,
   }
 }
 
+template <typename T>
+struct EpilogueKernel {
+  static CPU_KERNEL void Run(T *data, int batch, int channel, int spatial_dim,
+                             const T *scale_data, const T *bias_data,
+                             const T *residual_data, int type, float slope,
+                             const T *slope_data, bool channel_shared) {
+    // The activation runs over each finished row while it is in cache,
+    // transcendental ones with VMath
+    bool row_activate = type == 3 || type == 4 || type == 5;
+    for (int b = 0; b < batch; ++b) {
+      for (int c = 0; c < channel; ++c) {
+        auto scale = scale_data != nullptr ? scale_data[c] : T(1);
+        auto bias = bias_data != nullptr ? bias_data[c] : T(0);
+        float c_slope = type == 0 ? slope_data[channel_shared ? 0 : c] : slope;
+        if (residual_data != nullptr) {
+          for (int s = 0; s < spatial_dim; ++s) {
+            data[s] = data[s] * scale + bias + residual_data[s];
+          }
+        } else {
+          for (int s = 0; s < spatial_dim; ++s) {
+            data[s] = data[s] * scale + bias;
+          }
+        }
+        if (row_activate) {
+          Activate(data, spatial_dim, type);
+        } else {
+          ActivateKernel<T>::Run(data, spatial_dim, type, c_slope);
+        }
+        data += spatial_dim;
+        if (residual_data != nullptr) {
+          residual_data += spatial_dim;
+        }
+      }
+    }
+  }
+};
+
+template <typename T>
+void Epilogue(T *data, int batch, int channel, int spatial_dim,
+              const T *scale_data, const T *bias_data, const T *residual_data,
+              int type, float slope, const T *slope_data, bool channel_shared) {
+  CPU::Dispatch<EpilogueKernel<T>>(data, batch, channel, spatial_dim,
+                                   scale_data, bias_data, residual_data, type,
+                                   slope, slope_data, channel_shared);
+}
+
 template void Activate(float *data, int count, int type, float slope);
 template void PRelu(float *data, const VecInt &in_shape, bool channel_shared,
                     const float *slope_data);
+template void Epilogue(float *data, int batch, int channel, int spatial_dim,
+                       const float *scale_data, const float *bias_data,
+                       const float *residual_data, int type, float slope,
+                       const float *slope_data, bool channel_shared);
 #endif
 
 }  // namespace Vision
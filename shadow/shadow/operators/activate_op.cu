@@ -11,6 +11,7 @@ __device__ float ActivateValue(T x, int type, float slope) {
   switch (type) {
     case 1:
       return x * (x > 0);
+    case 0:
     case 2:
       return x > 0 ? x : T(slope * x);
     case 3:
@@ -61,9 +62,41 @@ void PRelu(T *data, const VecInt &in_shape, bool channel_shared,
   CUDA_CHECK(cudaPeekAtLastError());
 }
 
+template <typename T>
+__global__ void KernelEpilogue(T *data, int count, int channel,
+                               int spatial_dim, const T *scale_data,
+                               const T *bias_data, const T *residual_data,
+                               int type, float slope, const T *slope_data,
+                               bool channel_shared) {
+  CUDA_KERNEL_LOOP(globalid, count) {
+    int c = (globalid / spatial_dim) % channel;
+    T value = data[globalid];
+    if (scale_data != nullptr) value *= scale_data[c];
+    if (bias_data != nullptr) value += bias_data[c];
+    if (residual_data != nullptr) value += residual_data[globalid];
+    if (type == 0) slope = slope_data[channel_shared ? 0 : c];
+    data[globalid] = ActivateValue(value, type, slope);
+  }
+}
+
+template <typename T>
+void Epilogue(T *data, int batch, int channel, int spatial_dim,
+              const T *scale_data, const T *bias_data, const T *residual_data,
+              int type, float slope, const T *slope_data, bool channel_shared) {
+  int count = batch * channel * spatial_dim;
+  KernelEpilogue<T><<<GetBlocks(count), NumThreads>>>(
+      data, count, channel, spatial_dim, scale_data, bias_data, residual_data,
+      type, slope, slope_data, channel_shared);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
 template void Activate(float *data, int count, int type, float slope);
 template void PRelu(float *data, const VecInt &in_shape, bool channel_shared,
                     const float *slope_data);
+template void Epilogue(float *data, int batch, int channel, int spatial_dim,
+                       const float *scale_data, const float *bias_data,
+                       const float *residual_data, int type, float slope,
+                       const float *slope_data, bool channel_shared);
 #endif
 
 }  // namespace Vision
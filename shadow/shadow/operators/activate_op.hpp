@@ -18,6 +18,10 @@ class ActivateOp : public Operator {
 
   void Forward() override;
 
+  double flops() const override {
+    return tops<float>(0)->count();
+  }
+
  private:
   enum {
     kPRelu = 0,
@@ -42,6 +46,38 @@ template <typename T>
 void PRelu(T *data, const VecInt &in_shape, bool channel_shared,
            const T *slope_data);
 
+// Output stage fused into the gemm based ops, for each channel c:
+// y = act(x * scale[c] + bias[c] + residual), null pointers are skipped and
+// PRelu reads its slope from slope_data
+template <typename T>
+void Epilogue(T *data, int batch, int channel, int spatial_dim,
+              const T *scale_data, const T *bias_data, const T *residual_data,
+              int type, float slope, const T *slope_data, bool channel_shared);
+
+#if !defined(USE_CUDA)
+template <typename T>
+inline T ActivateValue(T x, int type, float slope) {
+  // PRelu: 0, Relu: 1, Leaky: 2, Sigmoid: 3, SoftPlus: 4, Tanh: 5
+  switch (type) {
+    case 0:
+    case 2:
+      return x > 0 ? x : T(slope * x);
+    case 1:
+      return x * (x > 0);
+    case 3:
+      return 1 / (1 + std::exp(-x));
+    case 4:
+      return std::log(1 + std::exp(x));
+    case 5: {
+      T exp_2x = std::exp(2 * x);
+      return (exp_2x - 1) / (exp_2x + 1);
+    }
+    default:
+      return x;
+  }
+}
+#endif
+
 }  // namespace Vision
 
 }  // namespace Shadow
@@ -25,6 +25,12 @@ void AxpyOp::Forward() {
                top->mutable_data());
 }
 
+void AxpyOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                         std::vector<VecInt> *top_shapes) const {
+  CHECK_EQ(static_cast<int>(bottom_shapes.size()), 3);
+  (*top_shapes)[0] = bottom_shapes[1];
+}
+
 REGISTER_OPERATOR(Axpy, AxpyOp);
 
 namespace Vision {
@@ -20,6 +20,12 @@ class AxpyOp : public Operator {
       : Operator(op_param, ws) {}
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
+
+  double flops() const override {
+    return 2.0 * tops<float>(0)->count();
+  }
 };
 
 namespace Vision {
@@ -30,16 +30,12 @@ void BatchNormOp::Forward() {
       2 * channels + bottom->count() + batch * channels + batch + spatial_dim;
   op_ws_->GrowTempBuffer(temp_count, sizeof(float));
 
-  mean_ = op_ws_->CreateTempBlob<float>({1, channels}, op_name_ + "_mean");
-  variance_ =
-      op_ws_->CreateTempBlob<float>({1, channels}, op_name_ + "_variance");
-  temp_ = op_ws_->CreateTempBlob<float>(bottom->shape(), op_name_ + "_temp");
-  batch_by_channel_ = op_ws_->CreateTempBlob<float>(
-      {batch, channels}, op_name_ + "_batch_by_channel");
-  sum_batch_multiplier_ = op_ws_->CreateTempBlob<float>(
-      {batch}, op_name_ + "_sum_batch_multiplier");
-  sum_spatial_multiplier_ = op_ws_->CreateTempBlob<float>(
-      {1, 1, spatial_dim}, op_name_ + "_sum_spatial_multiplier");
+  op_ws_->CreateTempBlob<float>({1, channels}, &mean_);
+  op_ws_->CreateTempBlob<float>({1, channels}, &variance_);
+  op_ws_->CreateTempBlob<float>(bottom->shape(), &temp_);
+  op_ws_->CreateTempBlob<float>({batch, channels}, &batch_by_channel_);
+  op_ws_->CreateTempBlob<float>({batch}, &sum_batch_multiplier_);
+  op_ws_->CreateTempBlob<float>({1, 1, spatial_dim}, &sum_spatial_multiplier_);
 
   Blas::Set(batch, 1, sum_batch_multiplier_->mutable_data(), 0);
   Blas::Set(spatial_dim, 1, sum_spatial_multiplier_->mutable_data(), 0);
@@ -97,6 +93,19 @@ void BatchNormOp::Forward() {
             0);
 }
 
+void BatchNormOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                              std::vector<VecInt> *top_shapes) const {
+  const auto &in_shape = bottom_shapes[0];
+  (*top_shapes)[0] = in_shape;
+
+  int batch = in_shape[0], spatial_dim = count_of(in_shape, 2);
+  int channels = in_shape.size() == 1 ? 1 : in_shape[1];
+  for (const auto count : {channels, channels, count_of(in_shape),
+                           batch * channels, batch, spatial_dim}) {
+    op_ws_->PlanTemp(count, sizeof(float));
+  }
+}
+
 REGISTER_OPERATOR(BatchNorm, BatchNormOp);
 
 }  // namespace Shadow
@@ -14,6 +14,12 @@ class BatchNormOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
+
+  double flops() const override {
+    return 2.0 * tops<float>(0)->count();
+  }
 
  private:
   bool use_global_stats_;
@@ -6,13 +6,35 @@ void BinaryOp::Forward() {
   const auto *bottom = bottoms<float>(0);
   auto *top = mutable_tops<float>(0);
 
-  if (!has_scalar_arg_) {
+  if (has_scalar_arg_) {
+    if (bottom != top) {
+      top->reshape(bottom->shape());
+    }
+  } else {
     CHECK_EQ(bottoms_size(), 2);
     scalar_ = const_cast<BlobF *>(bottoms<float>(1));
-  }
 
-  if (bottom != top && scalar_ != top) {
-    top->reshape(bottom->shape());
+    if (bottom->shape() != bottom_shape_ || scalar_->shape() != scalar_shape_) {
+      SetupBroadcast(bottom->shape(), scalar_->shape());
+      bottom_shape_ = bottom->shape();
+      scalar_shape_ = scalar_->shape();
+    }
+
+    if (bottom == top || scalar_ == top) {
+      CHECK(top->shape() == top_shape_)
+          << op_name_ << ": can not broadcast in place to "
+          << Util::format_vector(top_shape_, ",", "(", ")");
+    } else {
+      top->reshape(top_shape_);
+    }
+
+    if (num_broadcast_axes_ > 0) {
+      return Vision::BroadcastBinary(bottom->data(), scalar_->data(),
+                                     top->count(), operation_,
+                                     num_broadcast_axes_,
+                                     broadcast_steps_->data(),
+                                     top->mutable_data());
+    }
   }
 
   int count = top->count();
@@ -79,6 +101,190 @@ void BinaryOp::Forward() {
   }
 }
 
+void BinaryOp::SetupBroadcast(const VecInt &bottom_shape,
+                              const VecInt &scalar_shape) {
+  // Align the trailing axes like numpy
+  int num_axes = static_cast<int>(
+      std::max(bottom_shape.size(), scalar_shape.size()));
+  VecInt a_shape(num_axes, 1), b_shape(num_axes, 1);
+  std::copy(bottom_shape.begin(), bottom_shape.end(),
+            a_shape.end() - bottom_shape.size());
+  std::copy(scalar_shape.begin(), scalar_shape.end(),
+            b_shape.end() - scalar_shape.size());
+
+  top_shape_.assign(num_axes, 1);
+  VecInt dims, a_broadcast, b_broadcast;
+  for (int d = 0; d < num_axes; ++d) {
+    CHECK(a_shape[d] == b_shape[d] || a_shape[d] == 1 || b_shape[d] == 1)
+        << op_name_ << ": can not broadcast "
+        << Util::format_vector(bottom_shape, ",", "(", ")") << " with "
+        << Util::format_vector(scalar_shape, ",", "(", ")");
+    top_shape_[d] = a_shape[d] == 1 ? b_shape[d] : a_shape[d];
+    if (top_shape_[d] == 1) continue;
+    int a_axis = a_shape[d] == 1, b_axis = b_shape[d] == 1;
+    if (!dims.empty() && a_axis == a_broadcast.back() &&
+        b_axis == b_broadcast.back()) {
+      dims.back() *= top_shape_[d];
+    } else {
+      dims.push_back(top_shape_[d]);
+      a_broadcast.push_back(a_axis);
+      b_broadcast.push_back(b_axis);
+    }
+  }
+
+  // Identical shapes, left to the plain element wise functions
+  num_broadcast_axes_ = static_cast<int>(dims.size());
+  if (num_broadcast_axes_ == 0 ||
+      (num_broadcast_axes_ == 1 && !a_broadcast[0] && !b_broadcast[0])) {
+    num_broadcast_axes_ = 0;
+    return;
+  }
+
+  VecInt steps(3 * num_broadcast_axes_);
+  int a_step = 1, b_step = 1;
+  for (int d = num_broadcast_axes_ - 1; d >= 0; --d) {
+    steps[d] = dims[d];
+    steps[num_broadcast_axes_ + d] = a_broadcast[d] ? 0 : a_step;
+    steps[2 * num_broadcast_axes_ + d] = b_broadcast[d] ? 0 : b_step;
+    a_step *= a_broadcast[d] ? 1 : dims[d];
+    b_step *= b_broadcast[d] ? 1 : dims[d];
+  }
+
+  broadcast_steps_ = op_ws_->CreateBlob<int>(op_name_ + "_broadcast_steps");
+  broadcast_steps_->reshape({3 * num_broadcast_axes_});
+  broadcast_steps_->set_data(steps.data(), 3 * num_broadcast_axes_);
+}
+
+// The trailing axes broadcast like numpy, see SetupBroadcast
+void BinaryOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                           std::vector<VecInt> *top_shapes) const {
+  if (has_scalar_arg_) {
+    (*top_shapes)[0] = bottom_shapes[0];
+    return;
+  }
+  CHECK_EQ(static_cast<int>(bottom_shapes.size()), 2);
+  const auto &a_shape = bottom_shapes[0], &b_shape = bottom_shapes[1];
+  auto top_shape = a_shape.size() >= b_shape.size() ? a_shape : b_shape;
+  const auto &other = a_shape.size() >= b_shape.size() ? b_shape : a_shape;
+  int offset = static_cast<int>(top_shape.size() - other.size());
+  for (int d = 0; d < static_cast<int>(other.size()); ++d) {
+    if (top_shape[offset + d] == 1) top_shape[offset + d] = other[d];
+  }
+  (*top_shapes)[0] = top_shape;
+}
+
 REGISTER_OPERATOR(Binary, BinaryOp);
 
+namespace Vision {
+
+#if !defined(USE_CUDA)
+struct BinaryAdd {
+  template <typename T>
+  T operator()(T a, T b) const { return a + b; }
+};
+struct BinarySub {
+  template <typename T>
+  T operator()(T a, T b) const { return a - b; }
+};
+struct BinaryMul {
+  template <typename T>
+  T operator()(T a, T b) const { return a * b; }
+};
+struct BinaryDiv {
+  template <typename T>
+  T operator()(T a, T b) const { return a / b; }
+};
+struct BinaryPow {
+  template <typename T>
+  T operator()(T a, T b) const { return std::pow(a, b); }
+};
+struct BinaryMax {
+  template <typename T>
+  T operator()(T a, T b) const { return std::max(a, b); }
+};
+struct BinaryMin {
+  template <typename T>
+  T operator()(T a, T b) const { return std::min(a, b); }
+};
+
+// The offsets are resolved once per row of the innermost reduced axis, which
+// is then a vector loop against a vector or against a single broadcast value
+template <typename T, typename Operation>
+void BroadcastRows(const T *a_data, const T *b_data, int count, int num_axes,
+                   const int *steps, T *out_data) {
+  const int *shape = steps, *a_steps = steps + num_axes,
+            *b_steps = steps + 2 * num_axes;
+  int inner_num = shape[num_axes - 1], num_rows = count / inner_num;
+  bool a_inner = a_steps[num_axes - 1] != 0,
+       b_inner = b_steps[num_axes - 1] != 0;
+  Operation operation;
+#if defined(USE_OpenMP)
+#pragma omp parallel for
+#endif
+  for (int r = 0; r < num_rows; ++r) {
+    int a_idx = 0, b_idx = 0, idx = r;
+    for (int d = num_axes - 2; d >= 0; --d) {
+      int i = idx % shape[d];
+      idx /= shape[d];
+      a_idx += i * a_steps[d], b_idx += i * b_steps[d];
+    }
+    const T *a_row = a_data + a_idx, *b_row = b_data + b_idx;
+    T *out_row = out_data + r * inner_num;
+    if (a_inner && b_inner) {
+      for (int k = 0; k < inner_num; ++k) {
+        out_row[k] = operation(a_row[k], b_row[k]);
+      }
+    } else if (a_inner) {
+      T b_val = *b_row;
+      for (int k = 0; k < inner_num; ++k) {
+        out_row[k] = operation(a_row[k], b_val);
+      }
+    } else {
+      T a_val = *a_row;
+      for (int k = 0; k < inner_num; ++k) {
+        out_row[k] = operation(a_val, b_row[k]);
+      }
+    }
+  }
+}
+
+template <typename T>
+void BroadcastBinary(const T *a_data, const T *b_data, int count,
+                     int operation, int num_axes, const int *steps,
+                     T *out_data) {
+  // Add: 0, Sub: 1, Mul: 2, Div: 3, Pow: 4, Max: 5, Min: 6
+  switch (operation) {
+    case 0:
+      return BroadcastRows<T, BinaryAdd>(a_data, b_data, count, num_axes,
+                                         steps, out_data);
+    case 1:
+      return BroadcastRows<T, BinarySub>(a_data, b_data, count, num_axes,
+                                         steps, out_data);
+    case 2:
+      return BroadcastRows<T, BinaryMul>(a_data, b_data, count, num_axes,
+                                         steps, out_data);
+    case 3:
+      return BroadcastRows<T, BinaryDiv>(a_data, b_data, count, num_axes,
+                                         steps, out_data);
+    case 4:
+      return BroadcastRows<T, BinaryPow>(a_data, b_data, count, num_axes,
+                                         steps, out_data);
+    case 5:
+      return BroadcastRows<T, BinaryMax>(a_data, b_data, count, num_axes,
+                                         steps, out_data);
+    case 6:
+      return BroadcastRows<T, BinaryMin>(a_data, b_data, count, num_axes,
+                                         steps, out_data);
+    default:
+      LOG(FATAL) << "Unknown binary operation " << operation;
+  }
+}
+
+template void BroadcastBinary(const float *a_data, const float *b_data,
+                              int count, int operation, int num_axes,
+                              const int *steps, float *out_data);
+#endif
+
+}  // namespace Vision
+
 }  // namespace Shadow
@@ -0,0 +1,67 @@
+#include "binary_op.hpp"
+
+namespace Shadow {
+
+namespace Vision {
+
+#if defined(USE_CUDA)
+template <typename T>
+__global__ void KernelBroadcastBinary(const T *a_data, const T *b_data,
+                                      int count, int operation, int num_axes,
+                                      const int *steps, T *out_data) {
+  const int *shape = steps, *a_steps = steps + num_axes,
+            *b_steps = steps + 2 * num_axes;
+  CUDA_KERNEL_LOOP(globalid, count) {
+    int a_idx = 0, b_idx = 0, idx = globalid;
+    for (int d = num_axes - 1; d >= 0; --d) {
+      int i = idx % shape[d];
+      idx /= shape[d];
+      a_idx += i * a_steps[d], b_idx += i * b_steps[d];
+    }
+    T a = a_data[a_idx], b = b_data[b_idx];
+    // Add: 0, Sub: 1, Mul: 2, Div: 3, Pow: 4, Max: 5, Min: 6
+    switch (operation) {
+      case 0:
+        out_data[globalid] = a + b;
+        break;
+      case 1:
+        out_data[globalid] = a - b;
+        break;
+      case 2:
+        out_data[globalid] = a * b;
+        break;
+      case 3:
+        out_data[globalid] = a / b;
+        break;
+      case 4:
+        out_data[globalid] = pow(a, b);
+        break;
+      case 5:
+        out_data[globalid] = max(a, b);
+        break;
+      case 6:
+        out_data[globalid] = min(a, b);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+template <typename T>
+void BroadcastBinary(const T *a_data, const T *b_data, int count,
+                     int operation, int num_axes, const int *steps,
+                     T *out_data) {
+  KernelBroadcastBinary<T><<<GetBlocks(count), NumThreads>>>(
+      a_data, b_data, count, operation, num_axes, steps, out_data);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+template void BroadcastBinary(const float *a_data, const float *b_data,
+                              int count, int operation, int num_axes,
+                              const int *steps, float *out_data);
+#endif
+
+}  // namespace Vision
+
+}  // namespace Shadow
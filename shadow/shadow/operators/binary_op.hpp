@@ -19,17 +19,44 @@ class BinaryOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
+
+  double flops() const override {
+    return tops<float>(0)->count();
+  }
 
  private:
   enum { kAdd = 0, kSub = 1, kMul = 2, kDiv = 3, kPow = 4, kMax = 5, kMin = 6 };
 
+  void SetupBroadcast(const VecInt &bottom_shape, const VecInt &scalar_shape);
+
   int operation_;
   float scalar_data_;
   bool has_scalar_arg_ = false;
 
+  VecInt bottom_shape_, scalar_shape_, top_shape_;
+
+  // Broadcast after dropping unit axes and merging neighbours broadcast the
+  // same way, so the common patterns (scalar, per channel, per row) end up
+  // as a few rows of a vector op against a vector or a single value. Holds
+  // the reduced top shape, then the steps of bottom and of scalar, which
+  // are zero along their broadcast axes
+  int num_broadcast_axes_ = 0;
+  BlobI *broadcast_steps_ = nullptr;
+
   BlobF *scalar_ = nullptr;
 };
 
+namespace Vision {
+
+template <typename T>
+void BroadcastBinary(const T *a_data, const T *b_data, int count,
+                     int operation, int num_axes, const int *steps,
+                     T *out_data);
+
+}  // namespace Vision
+
 }  // namespace Shadow
 
 #endif  // SHADOW_OPERATORS_BINARY_OP_HPP
@@ -31,17 +31,31 @@ void ConcatOp::Forward() {
     for (int n = 0; n < bottoms_size(); ++n) {
       const auto *bottom = bottoms<float>(n);
       int bottom_concat_axis = bottom->shape(concat_axis_);
-      Vision::Concat(bottom->data(), bottom->count(), num_concats, concat_size,
-                     top_concat_axis, bottom_concat_axis, offset_concat_axis,
-                     top->mutable_data());
+      // Bottoms planned as views into the top are already in place
+      if (num_concats > 1 ||
+          bottom->data() != top->data() + offset_concat_axis * concat_size) {
+        Vision::Concat(bottom->data(), bottom->count(), num_concats,
+                       concat_size, top_concat_axis, bottom_concat_axis,
+                       offset_concat_axis, top->mutable_data());
+      }
       offset_concat_axis += bottom_concat_axis;
     }
   } else {
+    top->clear();
     top->set_shape(top_shape);
     top->share_data(*bottom_0);
   }
 }
 
+void ConcatOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                           std::vector<VecInt> *top_shapes) const {
+  auto top_shape = bottom_shapes[0];
+  for (int n = 1; n < static_cast<int>(bottom_shapes.size()); ++n) {
+    top_shape[concat_axis_] += bottom_shapes[n][concat_axis_];
+  }
+  (*top_shapes)[0] = top_shape;
+}
+
 REGISTER_OPERATOR(Concat, ConcatOp);
 
 namespace Vision {
@@ -14,6 +14,8 @@ class ConcatOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
 
  private:
   int concat_axis_;
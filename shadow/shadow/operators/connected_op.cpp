@@ -1,16 +1,14 @@
 #include "connected_op.hpp"
 
+#include "activate_op.hpp"
+
 namespace Shadow {
 
 void ConnectedOp::Forward() {
-  if (bias_term_) {
-    CHECK_EQ(bottoms_size(), 3);
-  } else {
-    CHECK_EQ(bottoms_size(), 2);
-  }
+  CHECK_EQ(bottoms_size(), 2 + bias_term_ + (activate_type_ == 0) +
+                               scale_term_ + residual_term_);
 
   const auto *bottom = bottoms<float>(0);
-  const auto *weight = bottoms<float>(1);
   auto *top = mutable_tops<float>(0);
 
   int batch = bottom->shape(0), bottom_num = bottom->num();
@@ -18,29 +16,97 @@ void ConnectedOp::Forward() {
   VecInt top_shape{batch, num_output_};
   top->reshape(top_shape);
 
-  if (batch == 1) {
-    Blas::BlasSgemv(0, num_output_, bottom_num, 1, weight->data(), 0,
-                    bottom->data(), 0, 0, top->mutable_data(), 0,
-                    op_ws_->Ctx()->blas_handle());
-    if (bias_term_) {
-      Blas::BlasSaxpy(num_output_, 1, bottoms<float>(2)->data(), 0,
-                      top->mutable_data(), 0, op_ws_->Ctx()->blas_handle());
+  int index = 2;
+  const float *bias_data = nullptr, *slope_data = nullptr,
+              *scale_data = nullptr, *residual_data = nullptr;
+  if (bias_term_) {
+    bias_data = bottoms<float>(index++)->data();
+  }
+  if (activate_type_ == 0) {
+    const auto *slope = bottoms<float>(index++);
+    CHECK_EQ(slope->count(), channel_shared_ ? 1 : num_output_);
+    slope_data = slope->data();
+  }
+  if (scale_term_) {
+    const auto *scale = bottoms<float>(index++);
+    CHECK_EQ(scale->count(), num_output_);
+    scale_data = scale->data();
+  }
+  if (residual_term_) {
+    const auto *residual = bottoms<float>(index++);
+    CHECK_NE(residual, top);
+    CHECK(residual->shape() == top->shape());
+    residual_data = residual->data();
+  }
+
+#if !defined(USE_CUDA)
+  SetupSparseWeight();
+  if (has_sparse_weight_ && batch != sparse_batch_) {
+    if (sparse_weight_.rows == 0) {
+      Blas::DenseToSparse(!transpose_, num_output_, bottom_num,
+                          mutable_bottoms<float>(1)->cpu_data(),
+                          &sparse_weight_);
     }
-  } else {
-    Blas::BlasSgemm(0, transpose_, batch, num_output_, bottom_num, 1,
-                    bottom->data(), 0, weight->data(), 0, 0,
-                    top->mutable_data(), 0, op_ws_->Ctx()->blas_handle());
-    if (bias_term_) {
-      op_ws_->GrowTempBuffer(batch, sizeof(float));
-      biases_multiplier_ = op_ws_->CreateTempBlob<float>(
-          {batch}, op_name_ + "_biases_multiplier");
-      Blas::Set(batch, 1, biases_multiplier_->mutable_data(), 0);
-      Blas::BlasSgemm(0, 0, batch, num_output_, 1, 1,
-                      biases_multiplier_->data(), 0, bottoms<float>(2)->data(),
-                      0, 1, top->mutable_data(), 0,
-                      op_ws_->Ctx()->blas_handle());
+    // Each kernel runs once to warm up and is then timed
+    double times[2];
+    for (int sparse = 0; sparse < 2; ++sparse) {
+      RunGemm(sparse, bottom->data(), batch, bottom_num, top->mutable_data());
+      Timer timer;
+      for (int n = 0; n < 3; ++n) {
+        RunGemm(sparse, bottom->data(), batch, bottom_num,
+                top->mutable_data());
+      }
+      times[sparse] = timer.get_microsecond();
+    }
+    use_sparse_ = times[1] < times[0];
+    sparse_batch_ = batch;
+    if (!use_sparse_) {
+      sparse_weight_ = Blas::SparseMatrix();
     }
+    DLOG(INFO) << op_name_ << " uses the " << (use_sparse_ ? "sparse" : "dense")
+               << " weight for batch " << batch;
   }
+#endif
+
+  RunGemm(use_sparse_, bottom->data(), batch, bottom_num, top->mutable_data());
+
+  if (bias_term_ || scale_term_ || residual_term_ || activate_type_ != -1) {
+    Vision::Epilogue(top->mutable_data(), batch, num_output_, 1, scale_data,
+                     bias_data, residual_data, activate_type_, slope_,
+                     slope_data, channel_shared_);
+  }
+}
+
+// A written weight is checked again and timed again at the next forward
+void ConnectedOp::SetupSparseWeight() {
+  auto *weight = mutable_bottoms<float>(1);
+  if (weight->version() != sparse_version_) {
+    sparse_version_ = weight->version();
+    sparse_weight_ = Blas::SparseMatrix();
+    use_sparse_ = false, sparse_batch_ = 0;
+    has_sparse_weight_ = Blas::Density(weight->count(), weight->cpu_data()) <=
+                         Blas::kSparseDensity;
+  }
+}
+
+void ConnectedOp::RunGemm(bool sparse, const float *in_data, int batch,
+                          int bottom_num, float *out_data) {
+  const auto *weight = bottoms<float>(1);
+  if (sparse) {
+    Blas::SparseSgemv(sparse_weight_, batch, in_data, out_data);
+  } else if (batch == 1) {
+    Blas::BlasSgemv(0, num_output_, bottom_num, 1, weight->data(), 0, in_data,
+                    0, 0, out_data, 0, op_ws_->Ctx()->blas_handle());
+  } else {
+    Blas::BlasSgemm(0, transpose_, batch, num_output_, bottom_num, 1, in_data,
+                    0, weight->data(), 0, 0, out_data, 0,
+                    op_ws_->Ctx()->blas_handle());
+  }
+}
+
+void ConnectedOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                              std::vector<VecInt> *top_shapes) const {
+  (*top_shapes)[0] = {bottom_shapes[0][0], num_output_};
 }
 
 REGISTER_OPERATOR(Connected, ConnectedOp);
@@ -2,6 +2,7 @@
 #define SHADOW_OPERATORS_CONNECTED_OP_HPP
 
 #include "core/operator.hpp"
+#include "core/sparse.hpp"
 
 namespace Shadow {
 
@@ -13,15 +14,38 @@ class ConnectedOp : public Operator {
     num_output_ = get_single_argument<int>("num_output", 0);
     bias_term_ = get_single_argument<bool>("bias_term", true);
     transpose_ = get_single_argument<bool>("transpose", true);
+    activate_type_ = get_single_argument<int>("type", -1);
+    CHECK_GE(activate_type_, -1);
+    CHECK_LE(activate_type_, 5);
+    slope_ = get_single_argument<float>("slope", 0.1);
+    channel_shared_ = get_single_argument<bool>("channel_shared", false);
+    scale_term_ = get_single_argument<bool>("scale_term", false);
+    residual_term_ = get_single_argument<bool>("residual_term", false);
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
 
- private:
-  int num_output_;
-  bool bias_term_, transpose_;
+  double flops() const override {
+    return 2.0 * tops<float>(0)->count() * bottoms<float>(0)->num();
+  }
 
-  BlobF *biases_multiplier_ = nullptr;
+ private:
+  void SetupSparseWeight();
+  void RunGemm(bool sparse, const float *in_data, int batch, int bottom_num,
+               float *out_data);
+
+  int num_output_, activate_type_;
+  float slope_;
+  bool bias_term_, transpose_, channel_shared_, scale_term_, residual_term_;
+
+  // Compressed weight rows of a pruned weight, used for the batch sizes where
+  // they measured faster than the dense product and only kept while they do
+  Blas::SparseMatrix sparse_weight_;
+  bool has_sparse_weight_ = false, use_sparse_ = false;
+  int sparse_batch_ = 0;
+  size_t sparse_version_ = SIZE_MAX;
 };
 
 }  // namespace Shadow
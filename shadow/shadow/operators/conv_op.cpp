@@ -2,17 +2,17 @@
 
 #include "activate_op.hpp"
 
+#include "core/cpu_features.hpp"
+
+#include <climits>
+
 namespace Shadow {
 
 void ConvOp::Forward() {
-  if (bias_term_) {
-    CHECK_EQ(bottoms_size(), 3);
-  } else {
-    CHECK_EQ(bottoms_size(), 2);
-  }
+  CHECK_EQ(bottoms_size(), 2 + bias_term_ + (activate_type_ == 0) +
+                               scale_term_ + residual_term_);
 
   const auto *bottom = bottoms<float>(0);
-  const auto *weight = bottoms<float>(1);
   auto *top = mutable_tops<float>(0);
 
   CHECK_NE(bottom, top);
@@ -28,42 +28,33 @@ void ConvOp::Forward() {
   top_shape[3] = conv_out_size(in_w, kernel_size_, stride_, pad_, dilation_);
   top->reshape(top_shape);
 
-  out_spatial_dim_ = top->count(2);
   kernel_dim_ = kernel_size_ * kernel_size_ * in_c / group_;
 
-  weight_offset_ = num_output_ * kernel_dim_ / group_;
-  col_offset_ = kernel_dim_ * out_spatial_dim_;
-  output_offset_ = num_output_ * out_spatial_dim_ / group_;
-
-#if defined(USE_NNPACK)
-  use_nnpack_ = batch == 1 && group_ == 1 && dilation_ == 1 && bias_term_;
-  if (use_nnpack_) {
-    nnp_algorithm_ = nnp_convolution_algorithm_auto;
-    nnp_transform_ = nnp_convolution_transform_strategy_compute;
-    nnp_activation_ =
-        activate_type_ == 1 ? nnp_activation_relu : nnp_activation_identity;
-    nnp_input_size_.height = static_cast<size_t>(in_h);
-    nnp_input_size_.width = static_cast<size_t>(in_w);
-    nnp_pad_.top = nnp_pad_.bottom = nnp_pad_.left = nnp_pad_.right =
-        static_cast<size_t>(pad_);
-    nnp_kernel_size_.height = nnp_kernel_size_.width =
-        static_cast<size_t>(kernel_size_);
-    nnp_stride_.height = nnp_stride_.width = static_cast<size_t>(stride_);
-
-    int out_c = top->shape(1);
-    auto status = nnp_convolution_inference(
-        nnp_algorithm_, nnp_transform_, in_c, out_c, nnp_input_size_, nnp_pad_,
-        nnp_kernel_size_, nnp_stride_, bottom->data(), weight->data(),
-        bottoms<float>(2)->data(), top->mutable_data(), nullptr, nullptr,
-        nnp_activation_, nullptr, pthreadpool_t(op_ws_->Ctx()->nnpack_handle()),
-        nullptr);
-    CHECK_EQ(nnp_status_success, status);
-    return;
+  int index = 2;
+  bias_data_ = bias_term_ ? bottoms<float>(index++)->data() : nullptr;
+  slope_data_ = nullptr, scale_data_ = nullptr;
+  if (activate_type_ == 0) {
+    const auto *slope = bottoms<float>(index++);
+    CHECK_EQ(slope->count(), channel_shared_ ? 1 : num_output_);
+    slope_data_ = slope->data();
+  }
+  if (scale_term_) {
+    const auto *scale = bottoms<float>(index++);
+    CHECK_EQ(scale->count(), num_output_);
+    scale_data_ = scale->data();
+  }
+  const float *residual_data = nullptr;
+  if (residual_term_) {
+    const auto *residual = bottoms<float>(index++);
+    CHECK_NE(residual, top);
+    CHECK(residual->shape() == top->shape());
+    residual_data = residual->data();
   }
-#endif
 
 #if defined(USE_CUDNN)
   if (use_cudnn_) {
+    const auto *weight = bottoms<float>(1);
+
     cudnn::setConvolution2dDesc<float>(&conv_desc_, pad_, pad_, stride_,
                                        stride_, dilation_, dilation_, group_);
     cudnn::setTensor4dDesc<float>(&bottom_desc_, batch, in_c, in_h, in_w);
@@ -71,11 +62,10 @@ void ConvOp::Forward() {
                                   top_shape[3]);
     cudnn::setFilter4dDesc<float>(&filter_desc_, num_output_, in_c / group_,
                                   kernel_size_, kernel_size_);
-    if (bias_term_) {
-      cudnn::setTensor4dDesc<float>(&bias_desc_, 1, num_output_, 1, 1);
-    }
 
-    size_t workspace_limit_bytes = group_ == 1 ? 64 * 1024 * 1024 : 0;
+    size_t workspace_limit_bytes =
+        group_ == 1 ? std::min<size_t>(64 * 1024 * 1024, op_ws_->TempBudget())
+                    : 0;
 
     CUDNN_CHECK(cudnnGetConvolutionForwardAlgorithm(
         cudnnHandle_t(op_ws_->Ctx()->cudnn_handle()), bottom_desc_,
@@ -90,8 +80,8 @@ void ConvOp::Forward() {
     if (workspace_fwd_size_ > 0) {
       op_ws_->GrowTempBuffer(static_cast<int>(workspace_fwd_size_),
                              sizeof(unsigned char));
-      workspace_ = op_ws_->CreateTempBlob<unsigned char>(
-          {static_cast<int>(workspace_fwd_size_)}, op_name_ + "_workspace");
+      op_ws_->CreateTempBlob<unsigned char>(
+          {static_cast<int>(workspace_fwd_size_)}, &workspace_);
     }
 
     auto *workspace_ptr =
@@ -102,66 +92,542 @@ void ConvOp::Forward() {
         weight->data(), conv_desc_, fwd_algo_, workspace_ptr,
         workspace_fwd_size_, cudnn::dataType<float>::zero, top_desc_,
         top->mutable_data()));
-    if (bias_term_) {
-      CUDNN_CHECK(cudnnAddTensor(
-          cudnnHandle_t(op_ws_->Ctx()->cudnn_handle()),
-          cudnn::dataType<float>::one, bias_desc_, bottoms<float>(2)->data(),
-          cudnn::dataType<float>::one, top_desc_, top->mutable_data()));
+    if (bias_term_ || scale_term_ || residual_term_ || activate_type_ != -1) {
+      Vision::Epilogue(top->mutable_data(), batch, num_output_, top->count(2),
+                       scale_data_, bias_data_, residual_data, activate_type_,
+                       slope_, slope_data_, channel_shared_);
     }
-    if (activate_type_ == 1) {
-      Vision::Activate(top->mutable_data(), top->count(), activate_type_);
+    return;
+  }
+#endif
+
+  // Dilated convs are run as a dense conv over the dilation x dilation
+  // phases of the padded input stacked along batch, see SpaceToBatch
+  use_space_batch_ = dilation_ > 1 && stride_ == 1;
+  if (use_space_batch_) {
+    int block = dilation_;
+    VecInt batch_in_shape, batch_out_shape;
+    SpaceBatchShapes(bottom->shape(), &batch_in_shape, &batch_out_shape);
+
+    int batch_in_count = count_of(batch_in_shape);
+    int batch_out_count = count_of(batch_out_shape);
+
+    // The residual is laid out like top, so it and the activation after it
+    // are applied once the phases are scattered back
+    int dense_activate_type = residual_term_ ? -1 : activate_type_;
+    auto temp_budget = op_ws_->TempBudget();
+    if (temp_budget != SIZE_MAX) {
+      temp_budget -= std::min(
+          temp_budget, (batch_in_count + batch_out_count) * sizeof(float));
     }
+    SetupAlgorithm(batch_in_shape, batch_out_shape, 0, 1, dense_activate_type,
+                   false, temp_budget);
+    op_ws_->GrowTempBuffer(
+        batch_in_count + batch_out_count + dense_temp_count_, sizeof(float));
+    op_ws_->CreateTempBlob<float>(batch_in_shape, &space_batch_in_);
+    op_ws_->CreateTempBlob<float>(batch_out_shape, &space_batch_out_);
+
+    Vision::SpaceToBatch(bottom->data(), bottom->shape(), pad_, block,
+                         batch_in_shape, space_batch_in_->mutable_data());
+    ForwardDense(space_batch_in_->data(), batch_in_shape, 0, 1, nullptr,
+                 dense_activate_type, space_batch_out_->mutable_data(),
+                 batch_out_shape);
+    Vision::BatchToSpace(space_batch_out_->data(), batch_out_shape, block,
+                         top->shape(), top->mutable_data());
+    if (residual_term_) {
+      Vision::Epilogue(top->mutable_data(), batch, num_output_, top->count(2),
+                       static_cast<const float *>(nullptr),
+                       static_cast<const float *>(nullptr), residual_data,
+                       activate_type_, slope_, slope_data_, channel_shared_);
+    }
+  } else {
+    SetupAlgorithm(bottom->shape(), top->shape(), pad_, dilation_,
+                   activate_type_, residual_term_, op_ws_->TempBudget());
+    if (dense_temp_count_ > 0) {
+      op_ws_->GrowTempBuffer(dense_temp_count_, sizeof(float));
+    }
+    ForwardDense(bottom->data(), bottom->shape(), pad_, dilation_,
+                 residual_data, activate_type_, top->mutable_data(),
+                 top->shape());
+  }
+}
+
+// Shapes like Forward and stacks the temporaries of the algorithm the fixed
+// rules pick under the current budget, a tuned or benchmarked choice may
+// take other ones. Under cuDNN the workspace of the last forward is taken
+void ConvOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                         std::vector<VecInt> *top_shapes) const {
+  const auto &in_shape = bottom_shapes[0];
+  CHECK_EQ(static_cast<int>(in_shape.size()), 4);
+
+  auto out_shape = in_shape;
+  out_shape[1] = num_output_;
+  out_shape[2] =
+      conv_out_size(in_shape[2], kernel_size_, stride_, pad_, dilation_);
+  out_shape[3] =
+      conv_out_size(in_shape[3], kernel_size_, stride_, pad_, dilation_);
+  (*top_shapes)[0] = out_shape;
+
+#if defined(USE_CUDNN)
+  if (use_cudnn_) {
+    op_ws_->PlanTemp(workspace_fwd_size_, sizeof(unsigned char));
     return;
   }
 #endif
 
-  use_depthwise_ = dilation_ == 1 && group_ == in_c && group_ == num_output_;
-  if (use_depthwise_) {
-    if (bias_term_) {
-      Vision::Depthwise(bottom->data(), bottom->shape(), weight->data(),
-                        bottoms<float>(2)->data(), kernel_size_, stride_, pad_,
-                        bias_term_, top->shape(), top->mutable_data());
-    } else {
-      Vision::Depthwise(bottom->data(), bottom->shape(), weight->data(),
-                        static_cast<decltype(weight->data())>(nullptr),
-                        kernel_size_, stride_, pad_, bias_term_, top->shape(),
-                        top->mutable_data());
+  int tile_limit, algorithm;
+  if (dilation_ > 1 && stride_ == 1) {
+    VecInt batch_in_shape, batch_out_shape;
+    SpaceBatchShapes(in_shape, &batch_in_shape, &batch_out_shape);
+    op_ws_->PlanTemp(count_of(batch_in_shape), sizeof(float));
+    op_ws_->PlanTemp(count_of(batch_out_shape), sizeof(float));
+    auto temp_budget = op_ws_->TempBudget();
+    if (temp_budget != SIZE_MAX) {
+      temp_budget -= std::min(
+          temp_budget, (count_of(batch_in_shape) + count_of(batch_out_shape)) *
+                           sizeof(float));
     }
+    const auto &algorithms = FitAlgorithms(
+        batch_in_shape, batch_out_shape, 0, 1,
+        residual_term_ ? -1 : activate_type_, false, temp_budget, &tile_limit);
+    algorithm = RuleAlgorithm(algorithms, batch_in_shape, batch_out_shape);
+    op_ws_->PlanTemp(DenseTempCount(batch_in_shape, batch_out_shape,
+                                    algorithm, tile_limit),
+                     sizeof(float));
   } else {
-    int temp_count = kernel_dim_ * group_ * out_spatial_dim_;
-    if (bias_term_) {
-      temp_count += out_spatial_dim_;
+    const auto &algorithms =
+        FitAlgorithms(in_shape, out_shape, pad_, dilation_, activate_type_,
+                      residual_term_, op_ws_->TempBudget(), &tile_limit);
+    algorithm = RuleAlgorithm(algorithms, in_shape, out_shape);
+    op_ws_->PlanTemp(
+        DenseTempCount(in_shape, out_shape, algorithm, tile_limit),
+        sizeof(float));
+  }
+}
+
+// Shapes of the stacked phases of a dilated conv and of their outputs
+void ConvOp::SpaceBatchShapes(const VecInt &in_shape, VecInt *batch_in_shape,
+                              VecInt *batch_out_shape) const {
+  int block = dilation_;
+  int batch_in_h = (in_shape[2] + 2 * pad_ + block - 1) / block;
+  int batch_in_w = (in_shape[3] + 2 * pad_ + block - 1) / block;
+  *batch_in_shape = {in_shape[0] * block * block, in_shape[1], batch_in_h,
+                     batch_in_w};
+  *batch_out_shape = {in_shape[0] * block * block, num_output_,
+                      conv_out_size(batch_in_h, kernel_size_, 1, 0, 1),
+                      conv_out_size(batch_in_w, kernel_size_, 1, 0, 1)};
+}
+
+// The large per image im2col buffer is kept for a single image whose buffer
+// stays small, everything else goes through column tiles
+static inline int tile_elems() {
+#if defined(USE_CUDA)
+  return 8 * 1024 * 1024;
+#else
+  return 256 * 1024;
+#endif
+}
+
+// Picks the dense conv algorithm for this shape by the fixed rules, by the
+// tuning cache, or leaves all candidates to be benchmarked by the next
+// ForwardDense, in which case the temp count covers every one of them.
+// Only candidates whose temporaries fit in temp_budget bytes take part
+void ConvOp::SetupAlgorithm(const VecInt &in_shape, const VecInt &out_shape,
+                            int pad, int dilation, int activate_type,
+                            bool has_residual, size_t temp_budget) {
+  auto key = in_shape;
+  key.insert(key.end(), out_shape.begin(), out_shape.end());
+  key.push_back(pad), key.push_back(dilation);
+#if !defined(USE_CUDA)
+  const auto *tuner = op_ws_->GetTuner();
+  // Tuning may be enabled after the dry run at load time picked an algorithm
+  bool tuning = tuner->enabled();
+#else
+  bool tuning = false;
+#endif
+  if (key != algorithm_key_ || tuning != algorithm_tuning_ ||
+      temp_budget != algorithm_budget_) {
+    algorithm_key_ = key, algorithm_tuning_ = tuning;
+    algorithm_budget_ = temp_budget;
+
+#if !defined(USE_CUDA)
+    SetupSparseWeight();
+#endif
+    auto algorithms =
+        FitAlgorithms(in_shape, out_shape, pad, dilation, activate_type,
+                      has_residual, temp_budget, &tile_limit_);
+    algorithm_ = RuleAlgorithm(algorithms, in_shape, out_shape);
+
+    tune_algorithms_.clear();
+#if !defined(USE_CUDA)
+    if (tuning) {
+      std::stringstream ss;
+      ss << "Conv:" << op_name_;
+      for (const auto dim : key) ss << "_" << dim;
+      tune_key_ = ss.str();
+      std::replace(tune_key_.begin(), tune_key_.end(), ' ', '_');
+      int choice;
+      if (tuner->Lookup(tune_key_, &choice) &&
+          std::count(algorithms.begin(), algorithms.end(), choice)) {
+        algorithm_ = choice;
+      } else {
+        tune_algorithms_ = algorithms;
+      }
+    } else if (algorithm_ != kSparse &&
+               std::count(algorithms.begin(), algorithms.end(), kSparse)) {
+      // Pruned weights only pay off when the sparse kernel measures faster
+      tune_algorithms_ = {algorithm_, kSparse};
     }
-    op_ws_->GrowTempBuffer(temp_count, sizeof(float));
-    col_image_ = op_ws_->CreateTempBlob<float>(
-        {kernel_dim_ * group_, out_spatial_dim_}, op_name_ + "_col_image");
-    if (bias_term_) {
-      biases_multiplier_ = op_ws_->CreateTempBlob<float>(
-          {out_spatial_dim_}, op_name_ + "_biases_multiplier");
-      Blas::Set(out_spatial_dim_, 1, biases_multiplier_->mutable_data(), 0);
+#endif
+  }
+
+  dense_temp_count_ =
+      DenseTempCount(in_shape, out_shape, algorithm_, tile_limit_);
+  for (const auto algorithm : tune_algorithms_) {
+    int temp_count =
+        DenseTempCount(in_shape, out_shape, algorithm, tile_limit_);
+    dense_temp_count_ = std::max(dense_temp_count_, temp_count);
+  }
+  if (tune_algorithms_.empty()) {
+    DropUnusedWeight();
+  }
+}
+
+// Candidates of the dense conv for this shape, kSparse when the weight was
+// last found pruned. Under a budget the column tiles shrink to fit in it,
+// tile_limit caps their columns and algorithms still needing more drop out,
+// down to the one needing least
+VecInt ConvOp::FitAlgorithms(const VecInt &in_shape, const VecInt &out_shape,
+                             int pad, int dilation, int activate_type,
+                             bool has_residual, size_t temp_budget,
+                             int *tile_limit) const {
+  int in_c = in_shape[1];
+  VecInt algorithms;
+#if defined(USE_NNPACK)
+  if ((in_shape[0] == 1 || (dilation_ > 1 && stride_ == 1)) && group_ == 1 &&
+      dilation == 1 && bias_term_ && !scale_term_ && !has_residual &&
+      (activate_type == -1 || activate_type == 1)) {
+    algorithms.push_back(kNNPACK);
+  }
+#else
+  // Only NNPACK has to know what the output stage fuses
+  (void)activate_type, (void)has_residual;
+#endif
+  if (dilation == 1 && group_ == in_c && group_ == num_output_) {
+    algorithms.push_back(kDepthwise);
+  }
+  if (kernel_size_ == 1 && stride_ == 1 && pad == 0) {
+    algorithms.push_back(kDirect);
+  }
+  algorithms.push_back(kTiled);
+  algorithms.push_back(kIm2Col);
+#if !defined(USE_CUDA)
+  if (has_sparse_weight_ && algorithms.front() != kDepthwise) {
+    algorithms.push_back(kSparse);
+  }
+#endif
+
+  *tile_limit = 0;
+  if (temp_budget == SIZE_MAX) return algorithms;
+
+  int col_rows = kernel_size_ * kernel_size_ * in_c;
+  auto tile_bytes = (col_rows + num_output_) * sizeof(float);
+  *tile_limit =
+      static_cast<int>(std::min<size_t>(temp_budget / tile_bytes, INT_MAX)) /
+      16 * 16;
+  *tile_limit = std::max(*tile_limit, 16);
+  auto temp_bytes = [&](int algorithm) {
+    return DenseTempCount(in_shape, out_shape, algorithm, *tile_limit) *
+           sizeof(float);
+  };
+  VecInt fitting;
+  for (const auto algorithm : algorithms) {
+    if (temp_bytes(algorithm) <= temp_budget) {
+      fitting.push_back(algorithm);
     }
-    int top_num = top->num(), bottom_num = bottom->num();
-    for (int b = 0; b < batch; ++b) {
-      Vision::Im2Col(bottom->data(), bottom->shape(), b * bottom_num,
-                     kernel_size_, stride_, pad_, dilation_, 0, top->shape(),
-                     col_image_->mutable_data());
-      for (int g = 0; g < group_; ++g) {
-        Blas::BlasSgemm(0, 0, num_output_ / group_, out_spatial_dim_,
-                        kernel_dim_, 1, weight->data(), weight_offset_ * g,
-                        col_image_->data(), col_offset_ * g, 0,
-                        top->mutable_data(), b * top_num + output_offset_ * g,
-                        op_ws_->Ctx()->blas_handle());
+  }
+  if (fitting.empty()) {
+    fitting.push_back(*std::min_element(
+        algorithms.begin(), algorithms.end(),
+        [&](int a, int b) { return temp_bytes(a) < temp_bytes(b); }));
+    LOG(WARNING) << op_name_ << " needs " << temp_bytes(fitting[0])
+                 << " temp bytes, over the budget of " << temp_budget;
+  }
+  return fitting;
+}
+
+// The first candidate, except that a single image whose im2col buffer stays
+// small is unrolled at once rather than in tiles
+int ConvOp::RuleAlgorithm(const VecInt &algorithms, const VecInt &in_shape,
+                          const VecInt &out_shape) const {
+  int col_rows = kernel_size_ * kernel_size_ * in_shape[1];
+  if (algorithms.front() == kTiled && in_shape[0] == 1 &&
+      static_cast<size_t>(col_rows) * out_shape[2] * out_shape[3] <=
+          4 * static_cast<size_t>(tile_elems()) &&
+      std::count(algorithms.begin(), algorithms.end(), kIm2Col)) {
+    return kIm2Col;
+  }
+  return algorithms.front();
+}
+
+// The compressed rows are rebuilt here after DropUnusedWeight released them
+void ConvOp::SetupSparseWeight() {
+  auto *weight = mutable_bottoms<float>(1);
+  if (weight->version() != sparse_version_) {
+    sparse_version_ = weight->version();
+    sparse_weight_ = Blas::SparseMatrix();
+    has_sparse_weight_ = Blas::Density(weight->count(), weight->cpu_data()) <=
+                         Blas::kSparseDensity;
+  }
+  if (has_sparse_weight_ && sparse_weight_.rows == 0) {
+    Blas::DenseToSparse(0, num_output_, weight->count() / num_output_,
+                        weight->cpu_data(), &sparse_weight_);
+  }
+}
+
+// Once the algorithm is settled only the weight form it reads is kept, the
+// other one is built again if a later shape or tuning run needs it
+void ConvOp::DropUnusedWeight() {
+  if (algorithm_ == kSparse) {
+    if (!packed_weight_.data.empty()) {
+      packed_weight_ = Blas::SgemmPackedA();
+      packed_version_ = SIZE_MAX;
+    }
+  } else if (sparse_weight_.rows > 0) {
+    sparse_weight_ = Blas::SparseMatrix();
+  }
+}
+
+int ConvOp::DenseTempCount(const VecInt &in_shape, const VecInt &out_shape,
+                           int algorithm, int tile_limit) const {
+  int col_rows = kernel_size_ * kernel_size_ * in_shape[1];
+  int out_spatial_dim = out_shape[2] * out_shape[3];
+  bool direct_cols = kernel_size_ == 1 && stride_ == 1 &&
+                     in_shape[2] == out_shape[2] && in_shape[3] == out_shape[3];
+  if (algorithm == kTiled || (algorithm == kSparse && !direct_cols)) {
+    return (col_rows + num_output_) *
+           TileColumns(in_shape, out_shape, tile_limit);
+  } else if (algorithm == kIm2Col) {
+    return col_rows * out_spatial_dim;
+  }
+  return 0;
+}
+
+int ConvOp::TileColumns(const VecInt &in_shape, const VecInt &out_shape,
+                        int tile_limit) const {
+  int num_cols = in_shape[0] * out_shape[2] * out_shape[3];
+  int col_rows = kernel_size_ * kernel_size_ * in_shape[1];
+  int tile_cols = std::max(tile_elems() / col_rows, 64) / 16 * 16;
+  if (tile_limit > 0) {
+    tile_cols = std::min(tile_cols, tile_limit);
+  }
+  return std::min(tile_cols, num_cols);
+}
+
+void ConvOp::SetupTileRows(const VecInt &in_shape, int pad, int dilation) {
+  VecInt key(in_shape.begin() + 1, in_shape.end());
+  key.push_back(pad), key.push_back(dilation);
+  if (key == tile_key_) return;
+  tile_key_ = key;
+
+  int in_c = in_shape[1], in_h = in_shape[2], in_w = in_shape[3];
+
+  int num_rows = in_c * kernel_size_ * kernel_size_;
+  VecInt rows(3 * num_rows);
+  for (int c = 0, r = 0; c < in_c; ++c) {
+    for (int k_h = 0; k_h < kernel_size_; ++k_h) {
+      for (int k_w = 0; k_w < kernel_size_; ++k_w, ++r) {
+        rows[3 * r] = c * in_h * in_w;
+        rows[3 * r + 1] = k_h * dilation - pad;
+        rows[3 * r + 2] = k_w * dilation - pad;
+      }
+    }
+  }
+
+  tile_rows_ = op_ws_->CreateBlob<int>(op_name_ + "_tile_rows");
+  tile_rows_->reshape({num_rows, 3});
+  tile_rows_->set_data(rows.data(), 3 * num_rows);
+}
+
+void ConvOp::SetupPackedWeight() {
+  const auto *weight = bottoms<float>(1);
+  auto isa = CPU::ActiveISA();
+  if (packed_version_ == weight->version() && packed_weight_.isa == isa) {
+    return;
+  }
+  packed_version_ = weight->version();
+  Blas::SgemmPackA(isa, 0, num_output_ / group_, kernel_dim_, weight->data(),
+                   weight_offset_, group_, &packed_weight_);
+}
+
+void ConvOp::ForwardDense(const float *in_data, const VecInt &in_shape,
+                          int pad, int dilation, const float *residual_data,
+                          int activate_type, float *out_data,
+                          const VecInt &out_shape) {
+  out_spatial_dim_ = out_shape[2] * out_shape[3];
+
+  weight_offset_ = num_output_ * kernel_dim_ / group_;
+  col_offset_ = kernel_dim_ * out_spatial_dim_;
+  output_offset_ = num_output_ * out_spatial_dim_ / group_;
+
+  float *temp_data = nullptr;
+  if (dense_temp_count_ > 0) {
+    op_ws_->CreateTempBlob<float>({dense_temp_count_}, &dense_temp_);
+    temp_data = dense_temp_->mutable_data();
+  }
+
+  if (!tune_algorithms_.empty()) {
+    // Each candidate runs once to warm up and is then timed, every run
+    // fully rewrites the output so the data does not depend on the order
+    double best_time = -1;
+    for (const auto algorithm : tune_algorithms_) {
+      RunDense(algorithm, in_data, in_shape, pad, dilation, residual_data,
+               activate_type, temp_data, out_data, out_shape);
+      Timer timer;
+      for (int n = 0; n < 3; ++n) {
+        RunDense(algorithm, in_data, in_shape, pad, dilation, residual_data,
+                 activate_type, temp_data, out_data, out_shape);
       }
-      if (bias_term_) {
-        Blas::BlasSgemm(0, 0, num_output_, out_spatial_dim_, 1, 1,
-                        bottoms<float>(2)->data(), 0,
-                        biases_multiplier_->data(), 0, 1, top->mutable_data(),
-                        b * top_num, op_ws_->Ctx()->blas_handle());
+      double time = timer.get_microsecond();
+      if (best_time < 0 || time < best_time) {
+        best_time = time;
+        algorithm_ = algorithm;
       }
     }
+    tune_algorithms_.clear();
+    DropUnusedWeight();
+    if (op_ws_->GetTuner()->enabled()) {
+      op_ws_->GetTuner()->Insert(tune_key_, algorithm_);
+    }
+    DLOG(INFO) << op_name_ << " tuned to algorithm " << algorithm_;
+  }
+
+  RunDense(algorithm_, in_data, in_shape, pad, dilation, residual_data,
+           activate_type, temp_data, out_data, out_shape);
+}
+
+void ConvOp::RunDense(int algorithm, const float *in_data,
+                      const VecInt &in_shape, int pad, int dilation,
+                      const float *residual_data, int activate_type,
+                      float *temp_data, float *out_data,
+                      const VecInt &out_shape) {
+  const auto *weight = bottoms<float>(1);
+
+  int batch = in_shape[0], in_c = in_shape[1], in_h = in_shape[2],
+      in_w = in_shape[3];
+  int top_num = num_output_ * out_spatial_dim_;
+  int bottom_num = in_c * in_h * in_w;
+
+#if defined(USE_NNPACK)
+  if (algorithm == kNNPACK) {
+    nnp_algorithm_ = nnp_convolution_algorithm_auto;
+    nnp_transform_ = nnp_convolution_transform_strategy_compute;
+    nnp_activation_ =
+        activate_type == 1 ? nnp_activation_relu : nnp_activation_identity;
+    nnp_input_size_.height = static_cast<size_t>(in_h);
+    nnp_input_size_.width = static_cast<size_t>(in_w);
+    nnp_pad_.top = nnp_pad_.bottom = nnp_pad_.left = nnp_pad_.right =
+        static_cast<size_t>(pad);
+    nnp_kernel_size_.height = nnp_kernel_size_.width =
+        static_cast<size_t>(kernel_size_);
+    nnp_stride_.height = nnp_stride_.width = static_cast<size_t>(stride_);
+
+    for (int b = 0; b < batch; ++b) {
+      auto status = nnp_convolution_inference(
+          nnp_algorithm_, nnp_transform_, in_c, num_output_, nnp_input_size_,
+          nnp_pad_, nnp_kernel_size_, nnp_stride_, in_data + b * bottom_num,
+          weight->data(), bias_data_, out_data + b * top_num, nullptr,
+          nullptr, nnp_activation_, nullptr,
+          pthreadpool_t(op_ws_->Ctx()->nnpack_handle()), nullptr);
+      CHECK_EQ(nnp_status_success, status);
+    }
+    return;
   }
-  if (activate_type_ == 1) {
-    Vision::Activate(top->mutable_data(), top->count(), activate_type_);
+#endif
+
+  bool has_epilogue = bias_term_ || scale_term_ || residual_data != nullptr ||
+                      activate_type != -1;
+
+  if (algorithm == kDepthwise) {
+    // The bias is summed in the kernel unless it has to follow the scale
+    const auto *depthwise_bias = scale_term_ ? nullptr : bias_data_;
+    Vision::Depthwise(in_data, in_shape, weight->data(), depthwise_bias,
+                      kernel_size_, stride_, pad, depthwise_bias != nullptr,
+                      out_shape, out_data);
+    if (scale_term_ || residual_data != nullptr || activate_type != -1) {
+      Vision::Epilogue(out_data, batch, num_output_, out_spatial_dim_,
+                       scale_data_, scale_term_ ? bias_data_ : nullptr,
+                       residual_data, activate_type, slope_, slope_data_,
+                       channel_shared_);
+    }
+  } else if (algorithm == kTiled ||
+             (algorithm == kSparse &&
+              !(kernel_size_ == 1 && stride_ == 1 && pad == 0))) {
+    SetupTileRows(in_shape, pad, dilation);
+    if (algorithm == kTiled) SetupPackedWeight();
+    int tile_cols = TileColumns(in_shape, out_shape, tile_limit_);
+    int col_rows = kernel_dim_ * group_, num_cols = batch * out_spatial_dim_;
+    int group_output = num_output_ / group_;
+    float *col_tile = temp_data, *out_tile = temp_data + col_rows * tile_cols;
+    for (int col_start = 0; col_start < num_cols; col_start += tile_cols) {
+      int n = std::min(tile_cols, num_cols - col_start);
+      Vision::Im2ColTile(in_data, in_shape, tile_rows_->data(), col_rows,
+                         stride_, out_shape, col_start, n, col_tile);
+      if (algorithm == kSparse) {
+        // Only the nonzeros of the pruned weight rows are multiplied
+        for (int g = 0; g < group_; ++g) {
+          Blas::SparseSgemm(sparse_weight_, g * group_output, group_output, n,
+                            col_tile + g * kernel_dim_ * n,
+                            out_tile + g * group_output * n);
+        }
+      } else {
+        Blas::BlasSgemmBatched(0, 0, group_output, n, kernel_dim_, 1,
+                               weight->data(), 0, weight_offset_, col_tile, 0,
+                               kernel_dim_ * n, 0, out_tile, 0,
+                               group_output * n, group_,
+                               op_ws_->Ctx()->blas_handle(), &packed_weight_);
+      }
+      Vision::ColTileToTop(out_tile, num_output_, col_start, n,
+                           out_spatial_dim_, scale_data_, bias_data_,
+                           residual_data, activate_type, slope_, slope_data_,
+                           channel_shared_, out_data);
+    }
+  } else {
+    // A 1x1 stride 1 conv without padding reads its columns straight from
+    // the input, otherwise they are unrolled into the im2col buffer. The
+    // sparse one only gets here for the former
+    bool direct = algorithm == kDirect || algorithm == kSparse;
+    if (algorithm != kSparse) SetupPackedWeight();
+    for (int b = 0; b < batch; ++b) {
+      if (!direct) {
+        Vision::Im2Col(in_data, in_shape, b * bottom_num, kernel_size_,
+                       stride_, pad, dilation, 0, out_shape, temp_data);
+      }
+      if (algorithm == kSparse) {
+        int group_output = num_output_ / group_;
+        for (int g = 0; g < group_; ++g) {
+          Blas::SparseSgemm(sparse_weight_, g * group_output, group_output,
+                            out_spatial_dim_,
+                            in_data + b * bottom_num + g * col_offset_,
+                            out_data + b * top_num + g * output_offset_);
+        }
+      } else {
+        Blas::BlasSgemmBatched(
+            0, 0, num_output_ / group_, out_spatial_dim_, kernel_dim_, 1,
+            weight->data(), 0, weight_offset_, direct ? in_data : temp_data,
+            direct ? b * bottom_num : 0, col_offset_, 0, out_data,
+            b * top_num, output_offset_, group_, op_ws_->Ctx()->blas_handle(),
+            &packed_weight_);
+      }
+      // Finish each image while its output is still warm in cache
+      if (has_epilogue) {
+        Vision::Epilogue(out_data + b * top_num, 1, num_output_,
+                         out_spatial_dim_, scale_data_, bias_data_,
+                         residual_data != nullptr ? residual_data + b * top_num
+                                                  : nullptr,
+                         activate_type, slope_, slope_data_, channel_shared_);
+      }
+    }
   }
 }
 
@@ -217,43 +683,209 @@ template void Im2Col(const unsigned char *in_data, const VecInt &in_shape,
                      unsigned char *col_data);
 
 template <typename T>
-void Depthwise(const T *in_data, const VecInt &in_shape, const T *weight_data,
-               const T *bias_data, int kernel_size, int stride, int pad,
-               int bias_term, const VecInt &out_shape, T *out_data) {
-  int batch = in_shape[0];
-  int in_c = in_shape[1], in_h = in_shape[2], in_w = in_shape[3];
+void Im2ColTile(const T *in_data, const VecInt &in_shape, const int *row_table,
+                int num_rows, int stride, const VecInt &out_shape,
+                int col_start, int num_cols, T *col_data) {
+  int in_h = in_shape[2], in_w = in_shape[3];
+  int in_num = in_shape[1] * in_h * in_w;
+  int out_h = out_shape[2], out_w = out_shape[3];
+  int col_end = col_start + num_cols;
+  for (int r = 0; r < num_rows; ++r, row_table += 3) {
+    int d_h = row_table[1], d_w = row_table[2];
+    // Columns are output pixels, taken one output row segment at a time
+    for (int col = col_start; col < col_end;) {
+      int b = col / (out_h * out_w), h = col / out_w % out_h,
+          w = col % out_w;
+      int n = std::min(out_w - w, col_end - col);
+      int h_in = h * stride + d_h;
+      if (check_border(h_in, in_h)) {
+        const T *in_offset_data =
+            in_data + b * in_num + row_table[0] + h_in * in_w;
+        for (int i = 0, w_in = w * stride + d_w; i < n; ++i, w_in += stride) {
+          *(col_data++) =
+              check_border(w_in, in_w) ? in_offset_data[w_in] : T(0);
+        }
+      } else {
+        for (int i = 0; i < n; ++i) {
+          *(col_data++) = T(0);
+        }
+      }
+      col += n;
+    }
+  }
+}
+
+template void Im2ColTile(const float *in_data, const VecInt &in_shape,
+                         const int *row_table, int num_rows, int stride,
+                         const VecInt &out_shape, int col_start, int num_cols,
+                         float *col_data);
+
+template <typename T>
+struct ColTileToTopKernel {
+  static CPU_KERNEL void Run(const T *tile_data, int num_output, int col_start,
+                             int num_cols, int out_spatial_dim,
+                             const T *scale_data, const T *bias_data,
+                             const T *residual_data, int type, float slope,
+                             const T *slope_data, bool channel_shared,
+                             T *out_data) {
+    // Transcendental activations run over each contiguous run with VMath
+    bool row_activate = type == 3 || type == 4 || type == 5;
+    int value_type = row_activate ? -1 : type;
+    for (int c = 0; c < num_output; ++c) {
+      auto scale = scale_data != nullptr ? scale_data[c] : T(1);
+      auto bias = bias_data != nullptr ? bias_data[c] : T(0);
+      float c_slope = type == 0 ? slope_data[channel_shared ? 0 : c] : slope;
+      int b = col_start / out_spatial_dim, s = col_start % out_spatial_dim;
+      int offset = (b * num_output + c) * out_spatial_dim;
+      for (int n = 0; n < num_cols; ++n) {
+        auto value = *(tile_data++) * scale + bias;
+        if (residual_data != nullptr) {
+          value += residual_data[offset + s];
+        }
+        out_data[offset + s] = ActivateValue(value, value_type, c_slope);
+        if (++s == out_spatial_dim) {
+          s = 0;
+          offset += num_output * out_spatial_dim;
+        }
+      }
+      for (int n = 0, col = col_start; row_activate && n < num_cols;) {
+        b = col / out_spatial_dim, s = col % out_spatial_dim;
+        int run = std::min(num_cols - n, out_spatial_dim - s);
+        Activate(out_data + (b * num_output + c) * out_spatial_dim + s, run,
+                 type);
+        n += run, col += run;
+      }
+    }
+  }
+};
+
+template <typename T>
+void ColTileToTop(const T *tile_data, int num_output, int col_start,
+                  int num_cols, int out_spatial_dim, const T *scale_data,
+                  const T *bias_data, const T *residual_data, int type,
+                  float slope, const T *slope_data, bool channel_shared,
+                  T *out_data) {
+  CPU::Dispatch<ColTileToTopKernel<T>>(tile_data, num_output, col_start,
+                                       num_cols, out_spatial_dim, scale_data,
+                                       bias_data, residual_data, type, slope,
+                                       slope_data, channel_shared, out_data);
+}
+
+template void ColTileToTop(const float *tile_data, int num_output,
+                           int col_start, int num_cols, int out_spatial_dim,
+                           const float *scale_data, const float *bias_data,
+                           const float *residual_data, int type, float slope,
+                           const float *slope_data, bool channel_shared,
+                           float *out_data);
+
+template <typename T>
+void SpaceToBatch(const T *in_data, const VecInt &in_shape, int pad,
+                  int block_size, const VecInt &out_shape, T *out_data) {
+  int batch = in_shape[0], in_c = in_shape[1], in_h = in_shape[2],
+      in_w = in_shape[3];
   int out_h = out_shape[2], out_w = out_shape[3];
+  for (int p_h = 0; p_h < block_size; ++p_h) {
+    for (int p_w = 0; p_w < block_size; ++p_w) {
+      for (int b = 0; b < batch; ++b) {
+        for (int c = 0; c < in_c; ++c) {
+          const T *in_offset_data = in_data + (b * in_c + c) * in_h * in_w;
+          for (int h = 0; h < out_h; ++h) {
+            int h_in = h * block_size + p_h - pad;
+            bool h_valid = check_border(h_in, in_h);
+            for (int w = 0; w < out_w; ++w) {
+              int w_in = w * block_size + p_w - pad;
+              *(out_data++) = (h_valid && check_border(w_in, in_w))
+                                  ? in_offset_data[h_in * in_w + w_in]
+                                  : T(0);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template void SpaceToBatch(const float *in_data, const VecInt &in_shape,
+                           int pad, int block_size, const VecInt &out_shape,
+                           float *out_data);
+
+template <typename T>
+void BatchToSpace(const T *in_data, const VecInt &in_shape, int block_size,
+                  const VecInt &out_shape, T *out_data) {
+  int in_h = in_shape[2], in_w = in_shape[3];
+  int batch = out_shape[0], out_c = out_shape[1], out_h = out_shape[2],
+      out_w = out_shape[3];
   for (int b = 0; b < batch; ++b) {
-    for (int c = 0; c < in_c; ++c) {
-      const T *in_offset_data = in_data + (b * in_c + c) * in_h * in_w;
-      const T *weight_offset_data = weight_data + c * kernel_size * kernel_size;
-      T *out_offset_data = out_data + (b * in_c + c) * out_h * out_w;
+    for (int c = 0; c < out_c; ++c) {
       for (int h = 0; h < out_h; ++h) {
+        int p_h = h % block_size, h_in = h / block_size;
         for (int w = 0; w < out_w; ++w) {
-          int hstart = h * stride - pad, wstart = w * stride - pad;
-          int hend = std::min(hstart + kernel_size, in_h + pad);
-          int wend = std::min(wstart + kernel_size, in_w + pad);
-          hstart = std::max(hstart, 0), wstart = std::max(wstart, 0);
-          hend = std::min(hend, in_h), wend = std::min(wend, in_w);
-          int khstart = hend < kernel_size ? (kernel_size - hend) : 0;
-          int kwstart = wend < kernel_size ? (kernel_size - wend) : 0;
-          auto sum_val = T(0);
-          for (int kh = hstart; kh < hend; ++kh) {
-            for (int kw = wstart; kw < wend; ++kw) {
-              sum_val +=
-                  in_offset_data[kh * in_w + kw] *
-                  weight_offset_data[(khstart + kh - hstart) * kernel_size +
-                                     kwstart + kw - wstart];
+          int p_w = w % block_size, w_in = w / block_size;
+          int b_in = (p_h * block_size + p_w) * batch + b;
+          *(out_data++) =
+              in_data[((b_in * out_c + c) * in_h + h_in) * in_w + w_in];
+        }
+      }
+    }
+  }
+}
+
+template void BatchToSpace(const float *in_data, const VecInt &in_shape,
+                           int block_size, const VecInt &out_shape,
+                           float *out_data);
+
+template <typename T>
+struct DepthwiseKernel {
+  static CPU_KERNEL void Run(const T *in_data, const VecInt &in_shape,
+                             const T *weight_data, const T *bias_data,
+                             int kernel_size, int stride, int pad,
+                             int bias_term, const VecInt &out_shape,
+                             T *out_data) {
+    int batch = in_shape[0];
+    int in_c = in_shape[1], in_h = in_shape[2], in_w = in_shape[3];
+    int out_h = out_shape[2], out_w = out_shape[3];
+    for (int b = 0; b < batch; ++b) {
+      for (int c = 0; c < in_c; ++c) {
+        const T *in_offset_data = in_data + (b * in_c + c) * in_h * in_w;
+        const T *weight_offset_data =
+            weight_data + c * kernel_size * kernel_size;
+        T *out_offset_data = out_data + (b * in_c + c) * out_h * out_w;
+        for (int h = 0; h < out_h; ++h) {
+          for (int w = 0; w < out_w; ++w) {
+            int hstart = h * stride - pad, wstart = w * stride - pad;
+            int hend = std::min(hstart + kernel_size, in_h + pad);
+            int wend = std::min(wstart + kernel_size, in_w + pad);
+            hstart = std::max(hstart, 0), wstart = std::max(wstart, 0);
+            hend = std::min(hend, in_h), wend = std::min(wend, in_w);
+            int khstart = hend < kernel_size ? (kernel_size - hend) : 0;
+            int kwstart = wend < kernel_size ? (kernel_size - wend) : 0;
+            auto sum_val = T(0);
+            for (int kh = hstart; kh < hend; ++kh) {
+              for (int kw = wstart; kw < wend; ++kw) {
+                sum_val +=
+                    in_offset_data[kh * in_w + kw] *
+                    weight_offset_data[(khstart + kh - hstart) * kernel_size +
+                                       kwstart + kw - wstart];
+              }
             }
+            if (bias_term) {
+              sum_val += bias_data[c];
+            }
+            out_offset_data[h * out_w + w] = sum_val;
           }
-          if (bias_term) {
-            sum_val += bias_data[c];
-          }
-          out_offset_data[h * out_w + w] = sum_val;
         }
       }
     }
   }
+};
+
+template <typename T>
+void Depthwise(const T *in_data, const VecInt &in_shape, const T *weight_data,
+               const T *bias_data, int kernel_size, int stride, int pad,
+               int bias_term, const VecInt &out_shape, T *out_data) {
+  CPU::Dispatch<DepthwiseKernel<T>>(in_data, in_shape, weight_data, bias_data,
+                                    kernel_size, stride, pad, bias_term,
+                                    out_shape, out_data);
 }
 
 template void Depthwise(const float *in_data, const VecInt &in_shape,
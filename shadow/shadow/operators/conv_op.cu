@@ -50,6 +50,176 @@ template void Im2Col(const float *in_data, const VecInt &in_shape, int offset,
                      int kernel_size, int stride, int pad, int dilation,
                      int zero_point, const VecInt &out_shape, float *col_data);
 
+template <typename T>
+__global__ void KernelIm2ColTile(const T *in_data, int count, int in_num,
+                                 int in_h, int in_w, const int *row_table,
+                                 int stride, int out_h, int out_w,
+                                 int col_start, int num_cols, T *col_data) {
+  CUDA_KERNEL_LOOP(globalid, count) {
+    const int *row_offset_table = row_table + 3 * (globalid / num_cols);
+    int col = col_start + globalid % num_cols;
+    int b = col / (out_h * out_w), h = col / out_w % out_h, w = col % out_w;
+    int h_in = h * stride + row_offset_table[1];
+    int w_in = w * stride + row_offset_table[2];
+    col_data[globalid] =
+        (h_in >= 0 && w_in >= 0 && h_in < in_h && w_in < in_w)
+            ? in_data[b * in_num + row_offset_table[0] + h_in * in_w + w_in]
+            : T(0);
+  }
+}
+
+template <typename T>
+void Im2ColTile(const T *in_data, const VecInt &in_shape, const int *row_table,
+                int num_rows, int stride, const VecInt &out_shape,
+                int col_start, int num_cols, T *col_data) {
+  int count = num_rows * num_cols;
+  int in_num = in_shape[1] * in_shape[2] * in_shape[3];
+  KernelIm2ColTile<T><<<GetBlocks(count), NumThreads>>>(
+      in_data, count, in_num, in_shape[2], in_shape[3], row_table, stride,
+      out_shape[2], out_shape[3], col_start, num_cols, col_data);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+template void Im2ColTile(const float *in_data, const VecInt &in_shape,
+                         const int *row_table, int num_rows, int stride,
+                         const VecInt &out_shape, int col_start, int num_cols,
+                         float *col_data);
+
+template <typename T>
+__device__ float ActivateValue(T x, int type, float slope) {
+  // PRelu: 0, Relu: 1, Leaky: 2, Sigmoid: 3, SoftPlus: 4, Tanh: 5
+  switch (type) {
+    case 0:
+    case 2:
+      return x > 0 ? x : T(slope * x);
+    case 1:
+      return x * (x > 0);
+    case 3:
+      return 1 / (1 + expf(-x));
+    case 4:
+      return logf(1 + expf(x));
+    case 5: {
+      T exp_2x = expf(2 * x);
+      return (exp_2x - 1) / (exp_2x + 1);
+    }
+    default:
+      return x;
+  }
+}
+
+template <typename T>
+__global__ void KernelColTileToTop(const T *tile_data, int count,
+                                   int num_output, int col_start, int num_cols,
+                                   int out_spatial_dim, const T *scale_data,
+                                   const T *bias_data, const T *residual_data,
+                                   int type, float slope, const T *slope_data,
+                                   bool channel_shared, T *out_data) {
+  CUDA_KERNEL_LOOP(globalid, count) {
+    int c = globalid / num_cols;
+    int j = col_start + globalid % num_cols;
+    int b = j / out_spatial_dim, s = j % out_spatial_dim;
+    int out_index = (b * num_output + c) * out_spatial_dim + s;
+    T value = tile_data[globalid];
+    if (scale_data != nullptr) value *= scale_data[c];
+    if (bias_data != nullptr) value += bias_data[c];
+    if (residual_data != nullptr) value += residual_data[out_index];
+    if (type == 0) slope = slope_data[channel_shared ? 0 : c];
+    out_data[out_index] = ActivateValue(value, type, slope);
+  }
+}
+
+template <typename T>
+void ColTileToTop(const T *tile_data, int num_output, int col_start,
+                  int num_cols, int out_spatial_dim, const T *scale_data,
+                  const T *bias_data, const T *residual_data, int type,
+                  float slope, const T *slope_data, bool channel_shared,
+                  T *out_data) {
+  int count = num_output * num_cols;
+  KernelColTileToTop<T><<<GetBlocks(count), NumThreads>>>(
+      tile_data, count, num_output, col_start, num_cols, out_spatial_dim,
+      scale_data, bias_data, residual_data, type, slope, slope_data,
+      channel_shared, out_data);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+template void ColTileToTop(const float *tile_data, int num_output,
+                           int col_start, int num_cols, int out_spatial_dim,
+                           const float *scale_data, const float *bias_data,
+                           const float *residual_data, int type, float slope,
+                           const float *slope_data, bool channel_shared,
+                           float *out_data);
+
+template <typename T>
+__global__ void KernelSpaceToBatch(const T *in_data, int count, int batch,
+                                   int in_c, int in_h, int in_w, int pad,
+                                   int block_size, int out_h, int out_w,
+                                   T *out_data) {
+  CUDA_KERNEL_LOOP(globalid, count) {
+    int w = globalid % out_w;
+    int h = (globalid / out_w) % out_h;
+    int c = (globalid / out_w / out_h) % in_c;
+    int b_out = globalid / out_w / out_h / in_c;
+    int b = b_out % batch, p = b_out / batch;
+    int h_in = h * block_size + p / block_size - pad;
+    int w_in = w * block_size + p % block_size - pad;
+    out_data[globalid] =
+        (h_in >= 0 && w_in >= 0 && h_in < in_h && w_in < in_w)
+            ? in_data[((b * in_c + c) * in_h + h_in) * in_w + w_in]
+            : T(0);
+  }
+}
+
+template <typename T>
+void SpaceToBatch(const T *in_data, const VecInt &in_shape, int pad,
+                  int block_size, const VecInt &out_shape, T *out_data) {
+  int batch = in_shape[0], in_c = in_shape[1], in_h = in_shape[2],
+      in_w = in_shape[3];
+  int out_h = out_shape[2], out_w = out_shape[3];
+  int count = out_shape[0] * in_c * out_h * out_w;
+  KernelSpaceToBatch<T><<<GetBlocks(count), NumThreads>>>(
+      in_data, count, batch, in_c, in_h, in_w, pad, block_size, out_h, out_w,
+      out_data);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+template void SpaceToBatch(const float *in_data, const VecInt &in_shape,
+                           int pad, int block_size, const VecInt &out_shape,
+                           float *out_data);
+
+template <typename T>
+__global__ void KernelBatchToSpace(const T *in_data, int count, int in_h,
+                                   int in_w, int block_size, int batch,
+                                   int out_c, int out_h, int out_w,
+                                   T *out_data) {
+  CUDA_KERNEL_LOOP(globalid, count) {
+    int w = globalid % out_w;
+    int h = (globalid / out_w) % out_h;
+    int c = (globalid / out_w / out_h) % out_c;
+    int b = globalid / out_w / out_h / out_c;
+    int b_in = ((h % block_size) * block_size + w % block_size) * batch + b;
+    out_data[globalid] =
+        in_data[((b_in * out_c + c) * in_h + h / block_size) * in_w +
+                w / block_size];
+  }
+}
+
+template <typename T>
+void BatchToSpace(const T *in_data, const VecInt &in_shape, int block_size,
+                  const VecInt &out_shape, T *out_data) {
+  int in_h = in_shape[2], in_w = in_shape[3];
+  int batch = out_shape[0], out_c = out_shape[1], out_h = out_shape[2],
+      out_w = out_shape[3];
+  int count = batch * out_c * out_h * out_w;
+  KernelBatchToSpace<T><<<GetBlocks(count), NumThreads>>>(
+      in_data, count, in_h, in_w, block_size, batch, out_c, out_h, out_w,
+      out_data);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+template void BatchToSpace(const float *in_data, const VecInt &in_shape,
+                           int block_size, const VecInt &out_shape,
+                           float *out_data);
+
 template <typename T>
 __global__ void KernelDepthwise(const T *in_data, int count,
                                 const T *weight_data, const T *bias_data,
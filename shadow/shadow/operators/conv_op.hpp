@@ -2,6 +2,8 @@
 #define SHADOW_OPERATORS_CONV_OP_HPP
 
 #include "core/operator.hpp"
+#include "core/sgemm.hpp"
+#include "core/sparse.hpp"
 
 namespace Shadow {
 
@@ -19,8 +21,12 @@ class ConvOp : public Operator {
     CHECK_EQ(num_output_ % group_, 0);
     bias_term_ = get_single_argument<bool>("bias_term", true);
     activate_type_ = get_single_argument<int>("type", -1);
-    CHECK((activate_type_ == -1 || activate_type_ == 1))
-        << "Build in activate only support Relu";
+    CHECK_GE(activate_type_, -1);
+    CHECK_LE(activate_type_, 5);
+    slope_ = get_single_argument<float>("slope", 0.1);
+    channel_shared_ = get_single_argument<bool>("channel_shared", false);
+    scale_term_ = get_single_argument<bool>("scale_term", false);
+    residual_term_ = get_single_argument<bool>("residual_term", false);
 
 #if defined(USE_CUDNN)
 #if CUDNN_VERSION_MIN(7, 0, 1)
@@ -33,9 +39,6 @@ class ConvOp : public Operator {
       cudnn::createTensorDesc<float>(&bottom_desc_);
       cudnn::createTensorDesc<float>(&top_desc_);
       cudnn::createFilterDesc<float>(&filter_desc_);
-      if (bias_term_) {
-        cudnn::createTensorDesc<float>(&bias_desc_);
-      }
     }
 #endif
   }
@@ -57,23 +60,99 @@ class ConvOp : public Operator {
       cudnnDestroyFilterDescriptor(filter_desc_);
       filter_desc_ = nullptr;
     }
-    if (bias_desc_ != nullptr) {
-      cudnnDestroyTensorDescriptor(bias_desc_);
-      bias_desc_ = nullptr;
-    }
 #endif
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
+
+  double flops() const override {
+    return 2.0 * tops<float>(0)->count() * kernel_dim_;
+  }
 
  private:
+  // CPU algorithms of the dense conv, picked per shape by SetupAlgorithm,
+  // kSparse only competes when the weight is pruned
+  enum {
+    kIm2Col = 0,
+    kTiled = 1,
+    kDirect = 2,
+    kDepthwise = 3,
+    kNNPACK = 4,
+    kSparse = 5
+  };
+
+  void SetupAlgorithm(const VecInt &in_shape, const VecInt &out_shape,
+                      int pad, int dilation, int activate_type,
+                      bool has_residual, size_t temp_budget);
+  VecInt FitAlgorithms(const VecInt &in_shape, const VecInt &out_shape,
+                       int pad, int dilation, int activate_type,
+                       bool has_residual, size_t temp_budget,
+                       int *tile_limit) const;
+  int RuleAlgorithm(const VecInt &algorithms, const VecInt &in_shape,
+                    const VecInt &out_shape) const;
+  void SpaceBatchShapes(const VecInt &in_shape, VecInt *batch_in_shape,
+                        VecInt *batch_out_shape) const;
+  void SetupSparseWeight();
+  void SetupPackedWeight();
+  void DropUnusedWeight();
+  int DenseTempCount(const VecInt &in_shape, const VecInt &out_shape,
+                     int algorithm, int tile_limit) const;
+  int TileColumns(const VecInt &in_shape, const VecInt &out_shape,
+                  int tile_limit) const;
+  void SetupTileRows(const VecInt &in_shape, int pad, int dilation);
+  void ForwardDense(const float *in_data, const VecInt &in_shape, int pad,
+                    int dilation, const float *residual_data,
+                    int activate_type, float *out_data,
+                    const VecInt &out_shape);
+  void RunDense(int algorithm, const float *in_data, const VecInt &in_shape,
+                int pad, int dilation, const float *residual_data,
+                int activate_type, float *temp_data, float *out_data,
+                const VecInt &out_shape);
+
   int num_output_, kernel_size_, stride_, pad_, dilation_, group_,
       activate_type_, out_spatial_dim_, kernel_dim_;
   int weight_offset_, col_offset_, output_offset_;
-  bool bias_term_, use_cudnn_ = false, use_nnpack_ = false,
-                   use_depthwise_ = false;
-
-  BlobF *biases_multiplier_ = nullptr, *col_image_ = nullptr;
+  float slope_;
+  bool bias_term_, channel_shared_, scale_term_, residual_term_,
+      use_cudnn_ = false, use_space_batch_ = false;
+
+  // Optional bottoms read by the fused output stage, see Vision::Epilogue
+  const float *bias_data_ = nullptr, *slope_data_ = nullptr,
+              *scale_data_ = nullptr;
+
+  BlobF *space_batch_in_ = nullptr, *space_batch_out_ = nullptr;
+
+  // Chosen algorithm for algorithm_key_, the candidates still to benchmark
+  // when tuning is enabled and tune_key_ is not in the cache
+  int algorithm_ = kIm2Col, dense_temp_count_ = 0;
+  bool algorithm_tuning_ = false;
+  size_t algorithm_budget_ = SIZE_MAX;
+  VecInt algorithm_key_, tune_algorithms_;
+  std::string tune_key_;
+
+  // Implicit GEMM over column tiles of all batch items, the index table maps
+  // each column row to its input tap while the input window of a column is
+  // derived from its output pixel, tile_limit_ caps the columns of a tile
+  // under a memory budget
+  VecInt tile_key_;
+  int tile_limit_ = 0;
+  BlobI *tile_rows_ = nullptr;
+
+  // Column tiles, output tiles or the im2col buffer of the chosen algorithm
+  BlobF *dense_temp_ = nullptr;
+
+  // Compressed weight rows when the density of the weight is at most
+  // kSparseDensity, checked again when the weight blob is written
+  Blas::SparseMatrix sparse_weight_;
+  bool has_sparse_weight_ = false;
+  size_t sparse_version_ = SIZE_MAX;
+
+  // Weight packed for the gemm kernel of the running cpu, repacked when the
+  // weight blob is written or the instruction set changes
+  Blas::SgemmPackedA packed_weight_;
+  size_t packed_version_ = SIZE_MAX;
 
 #if defined(USE_CUDNN)
   cudnnConvolutionFwdAlgo_t fwd_algo_ =
@@ -82,7 +161,6 @@ class ConvOp : public Operator {
   cudnnConvolutionDescriptor_t conv_desc_ = nullptr;
   cudnnTensorDescriptor_t bottom_desc_ = nullptr, top_desc_ = nullptr;
   cudnnFilterDescriptor_t filter_desc_ = nullptr;
-  cudnnTensorDescriptor_t bias_desc_ = nullptr;
 
   size_t workspace_fwd_size_ = 0;
   BlobUC *workspace_ = nullptr;
@@ -111,6 +189,26 @@ void Im2Col(const T *in_data, const VecInt &in_shape, int offset,
             int kernel_size, int stride, int pad, int dilation, int zero_point,
             const VecInt &out_shape, T *col_data);
 
+template <typename T>
+void Im2ColTile(const T *in_data, const VecInt &in_shape, const int *row_table,
+                int num_rows, int stride, const VecInt &out_shape,
+                int col_start, int num_cols, T *col_data);
+
+template <typename T>
+void ColTileToTop(const T *tile_data, int num_output, int col_start,
+                  int num_cols, int out_spatial_dim, const T *scale_data,
+                  const T *bias_data, const T *residual_data, int type,
+                  float slope, const T *slope_data, bool channel_shared,
+                  T *out_data);
+
+template <typename T>
+void SpaceToBatch(const T *in_data, const VecInt &in_shape, int pad,
+                  int block_size, const VecInt &out_shape, T *out_data);
+
+template <typename T>
+void BatchToSpace(const T *in_data, const VecInt &in_shape, int block_size,
+                  const VecInt &out_shape, T *out_data);
+
 template <typename T>
 void Depthwise(const T *in_data, const VecInt &in_shape, const T *weight_data,
                const T *bias_data, int kernel_size, int stride, int pad,
@@ -2,14 +2,13 @@
 
 #include "activate_op.hpp"
 
+#include "core/cpu_features.hpp"
+
 namespace Shadow {
 
 void DeconvOp::Forward() {
-  if (bias_term_) {
-    CHECK_EQ(bottoms_size(), 3);
-  } else {
-    CHECK_EQ(bottoms_size(), 2);
-  }
+  CHECK_EQ(bottoms_size(), 2 + bias_term_ + (activate_type_ == 0) +
+                               scale_term_ + residual_term_);
 
   const auto *bottom = bottoms<float>(0);
   const auto *weight = bottoms<float>(1);
@@ -28,6 +27,31 @@ void DeconvOp::Forward() {
   top_shape[3] = deconv_out_size(in_w, kernel_size_, stride_, pad_, dilation_);
   top->reshape(top_shape);
 
+  int index = 2;
+  const float *bias_data = nullptr, *slope_data = nullptr,
+              *scale_data = nullptr, *residual_data = nullptr;
+  if (bias_term_) {
+    bias_data = bottoms<float>(index++)->data();
+  }
+  if (activate_type_ == 0) {
+    const auto *slope = bottoms<float>(index++);
+    CHECK_EQ(slope->count(), channel_shared_ ? 1 : num_output_);
+    slope_data = slope->data();
+  }
+  if (scale_term_) {
+    const auto *scale = bottoms<float>(index++);
+    CHECK_EQ(scale->count(), num_output_);
+    scale_data = scale->data();
+  }
+  if (residual_term_) {
+    const auto *residual = bottoms<float>(index++);
+    CHECK_NE(residual, top);
+    CHECK(residual->shape() == top->shape());
+    residual_data = residual->data();
+  }
+  bool has_epilogue =
+      bias_term_ || scale_term_ || residual_term_ || activate_type_ != -1;
+
   conv_in_c = num_output_, conv_out_c = in_c;
 
   conv_out_spatial_dim_ = bottom->count(2);
@@ -38,8 +62,6 @@ void DeconvOp::Forward() {
   col_offset_ = kernel_dim_ * conv_out_spatial_dim_;
   output_offset_ = conv_out_c * conv_out_spatial_dim_ / group_;
 
-  Blas::Set(top->count(), 0, top->mutable_data(), 0);
-
 #if defined(USE_CUDNN)
   if (use_cudnn_) {
     cudnn::setConvolution2dDesc<float>(&conv_desc_, pad_, pad_, stride_,
@@ -49,11 +71,10 @@ void DeconvOp::Forward() {
                                   top_shape[3]);
     cudnn::setFilter4dDesc<float>(&filter_desc_, conv_out_c, conv_in_c / group_,
                                   kernel_size_, kernel_size_);
-    if (bias_term_) {
-      cudnn::setTensor4dDesc<float>(&bias_desc_, 1, num_output_, 1, 1);
-    }
 
-    size_t workspace_limit_bytes = group_ == 1 ? 64 * 1024 * 1024 : 0;
+    size_t workspace_limit_bytes =
+        group_ == 1 ? std::min<size_t>(64 * 1024 * 1024, op_ws_->TempBudget())
+                    : 0;
 
     CUDNN_CHECK(cudnnGetConvolutionBackwardDataAlgorithm(
         cudnnHandle_t(op_ws_->Ctx()->cudnn_handle()), filter_desc_,
@@ -69,8 +90,8 @@ void DeconvOp::Forward() {
     if (workspace_bwd_size_ > 0) {
       op_ws_->GrowTempBuffer(static_cast<int>(workspace_bwd_size_),
                              sizeof(unsigned char));
-      workspace_ = op_ws_->CreateTempBlob<unsigned char>(
-          {static_cast<int>(workspace_bwd_size_)}, op_name_ + "_workspace");
+      op_ws_->CreateTempBlob<unsigned char>(
+          {static_cast<int>(workspace_bwd_size_)}, &workspace_);
     }
 
     auto *workspace_ptr =
@@ -81,52 +102,294 @@ void DeconvOp::Forward() {
         bottom->data(), conv_desc_, bwd_data_algo_, workspace_ptr,
         workspace_bwd_size_, cudnn::dataType<float>::zero, top_desc_,
         top->mutable_data()));
-    if (bias_term_) {
-      CUDNN_CHECK(cudnnAddTensor(
-          cudnnHandle_t(op_ws_->Ctx()->cudnn_handle()),
-          cudnn::dataType<float>::one, bias_desc_, bottoms<float>(2)->data(),
-          cudnn::dataType<float>::one, top_desc_, top->mutable_data()));
-    }
-    if (activate_type_ == 1) {
-      Vision::Activate(top->mutable_data(), top->count(), activate_type_);
+    if (has_epilogue) {
+      Vision::Epilogue(top->mutable_data(), batch, num_output_,
+                       out_spatial_dim_, scale_data, bias_data, residual_data,
+                       activate_type_, slope_, slope_data, channel_shared_);
     }
     return;
   }
 #endif
 
-  int temp_count = kernel_dim_ * group_ * conv_out_spatial_dim_;
-  if (bias_term_) {
-    temp_count += out_spatial_dim_;
+  if (weight->version() != weight_version_) {
+    weight_version_ = weight->version();
+    SetupBilinear(weight);
+    phase_weight_ = nullptr;
   }
-  op_ws_->GrowTempBuffer(temp_count, sizeof(float));
-  col_image_ = op_ws_->CreateTempBlob<float>(
-      {kernel_dim_ * group_, conv_out_spatial_dim_}, op_name_ + "_col_image");
-  if (bias_term_) {
-    biases_multiplier_ = op_ws_->CreateTempBlob<float>(
-        {out_spatial_dim_}, op_name_ + "_biases_multiplier");
-    Blas::Set(out_spatial_dim_, 1, biases_multiplier_->mutable_data(), 0);
+
+  if (use_bilinear_ || (stride_ > 1 && dilation_ == 1)) {
+    if (use_bilinear_) {
+      ForwardBilinear(bottom, top);
+    } else {
+      ForwardPhase(bottom, top);
+    }
+    if (has_epilogue) {
+      Vision::Epilogue(top->mutable_data(), batch, num_output_,
+                       out_spatial_dim_, scale_data, bias_data, residual_data,
+                       activate_type_, slope_, slope_data, channel_shared_);
+    }
+    return;
   }
+
+  op_ws_->GrowTempBuffer(kernel_dim_ * group_ * conv_out_spatial_dim_,
+                         sizeof(float));
+  op_ws_->CreateTempBlob<float>({kernel_dim_ * group_, conv_out_spatial_dim_},
+                                &col_image_);
   int top_num = top->num(), bottom_num = bottom->num();
   for (int b = 0; b < batch; ++b) {
-    for (int g = 0; g < group_; ++g) {
-      Blas::BlasSgemm(
-          1, 0, kernel_dim_, conv_out_spatial_dim_, conv_out_c / group_, 1,
-          weight->data(), weight_offset_ * g, bottom->data(),
-          b * bottom_num + output_offset_ * g, 0, col_image_->mutable_data(),
-          col_offset_ * g, op_ws_->Ctx()->blas_handle());
-    }
+    Blas::BlasSgemmBatched(1, 0, kernel_dim_, conv_out_spatial_dim_,
+                           conv_out_c / group_, 1, weight->data(), 0,
+                           weight_offset_, bottom->data(), b * bottom_num,
+                           output_offset_, 0, col_image_->mutable_data(), 0,
+                           col_offset_, group_, op_ws_->Ctx()->blas_handle());
     Vision::Col2Im(col_image_->data(), top->shape(), b * top_num, kernel_size_,
                    stride_, pad_, dilation_, bottom->shape(),
                    top->mutable_data());
-    if (bias_term_) {
-      Blas::BlasSgemm(0, 0, num_output_, out_spatial_dim_, 1, 1,
-                      bottoms<float>(2)->data(), 0, biases_multiplier_->data(),
-                      0, 1, top->mutable_data(), b * top_num,
-                      op_ws_->Ctx()->blas_handle());
+    if (has_epilogue) {
+      Vision::Epilogue(top->mutable_data() + b * top_num, 1, num_output_,
+                       out_spatial_dim_, scale_data, bias_data,
+                       residual_data != nullptr ? residual_data + b * top_num
+                                                : nullptr,
+                       activate_type_, slope_, slope_data, channel_shared_);
+    }
+  }
+}
+
+// Number of kernel taps phase + stride * t of one sub-pixel phase
+static inline int phase_taps(int phase, int kernel_size, int stride) {
+  return phase < kernel_size ? (kernel_size - phase + stride - 1) / stride : 0;
+}
+
+// Output index o = stride * m + phase - pad of one sub-pixel phase, gets the
+// kernel taps of the phase and the range of m landing inside the output
+static inline void phase_range(int phase, int kernel_size, int stride, int pad,
+                               int out_dim, int *taps, int *start, int *num) {
+  *taps = phase_taps(phase, kernel_size, stride);
+  *start = phase >= pad ? 0 : (pad - phase + stride - 1) / stride;
+  int last = out_dim - 1 + pad - phase;
+  *num = last >= 0 ? std::max(last / stride - *start + 1, 0) : 0;
+}
+
+// Input taps and weights of each output index for a separable kernel
+static inline void bilinear_table(int in_dim, int out_dim, int kernel_size,
+                                  int stride, int pad, int taps,
+                                  const VecFloat &kernel, VecInt *index,
+                                  VecFloat *weight) {
+  index->assign(out_dim * taps, 0), weight->assign(out_dim * taps, 0);
+  for (int o = 0; o < out_dim; ++o) {
+    int q = o + pad;
+    for (int t = 0; t < taps; ++t) {
+      int k = q % stride + t * stride, i = q / stride - t;
+      if (k < kernel_size && i >= 0 && i < in_dim) {
+        (*index)[o * taps + t] = i;
+        (*weight)[o * taps + t] = kernel[k];
+      }
+    }
+  }
+}
+
+void DeconvOp::SetupBilinear(const BlobF *weight) {
+  use_bilinear_ = false;
+  if (dilation_ != 1 || group_ != num_output_ || weight->shape(0) != group_ ||
+      weight->shape(1) != 1) {
+    return;
+  }
+
+  // Same filler as caffe's bilinear weight filler
+  int f = (kernel_size_ + 1) / 2;
+  float c = (2 * f - 1 - f % 2) / (2.f * f);
+  bilinear_kernel_.resize(kernel_size_);
+  for (int k = 0; k < kernel_size_; ++k) {
+    bilinear_kernel_[k] = 1 - std::abs(k / static_cast<float>(f) - c);
+  }
+
+  VecFloat weight_data(weight->count());
+  weight->read_data(weight_data.data(), weight->count());
+  int spatial_dim = kernel_size_ * kernel_size_;
+  for (int i = 0; i < weight->count(); ++i) {
+    int k_h = (i % spatial_dim) / kernel_size_, k_w = i % kernel_size_;
+    float value = bilinear_kernel_[k_h] * bilinear_kernel_[k_w];
+    if (std::abs(weight_data[i] - value) > 1e-5f) return;
+  }
+  use_bilinear_ = true;
+}
+
+void DeconvOp::ForwardBilinear(const BlobF *bottom, BlobF *top) {
+  int taps = (kernel_size_ + stride_ - 1) / stride_;
+
+  auto key = bottom->shape();
+  key.insert(key.end(), top->shape().begin(), top->shape().end());
+  if (key != bilinear_key_) {
+    bilinear_key_ = key;
+    int in_h = bottom->shape(2), in_w = bottom->shape(3);
+    int out_h = top->shape(2), out_w = top->shape(3);
+    VecInt h_index, w_index;
+    VecFloat h_weight, w_weight;
+    bilinear_table(in_h, out_h, kernel_size_, stride_, pad_, taps,
+                   bilinear_kernel_, &h_index, &h_weight);
+    bilinear_table(in_w, out_w, kernel_size_, stride_, pad_, taps,
+                   bilinear_kernel_, &w_index, &w_weight);
+    bilinear_h_index_ = op_ws_->CreateBlob<int>(op_name_ + "_bilinear_h_index");
+    bilinear_w_index_ = op_ws_->CreateBlob<int>(op_name_ + "_bilinear_w_index");
+    bilinear_h_weight_ =
+        op_ws_->CreateBlob<float>(op_name_ + "_bilinear_h_weight");
+    bilinear_w_weight_ =
+        op_ws_->CreateBlob<float>(op_name_ + "_bilinear_w_weight");
+    bilinear_h_index_->reshape({out_h, taps});
+    bilinear_w_index_->reshape({out_w, taps});
+    bilinear_h_weight_->reshape({out_h, taps});
+    bilinear_w_weight_->reshape({out_w, taps});
+    bilinear_h_index_->set_data(h_index.data(), out_h * taps);
+    bilinear_w_index_->set_data(w_index.data(), out_w * taps);
+    bilinear_h_weight_->set_data(h_weight.data(), out_h * taps);
+    bilinear_w_weight_->set_data(w_weight.data(), out_w * taps);
+  }
+
+  Vision::BilinearUpsample(bottom->data(), bottom->shape(),
+                           bilinear_h_index_->data(),
+                           bilinear_h_weight_->data(),
+                           bilinear_w_index_->data(),
+                           bilinear_w_weight_->data(), taps, top->shape(),
+                           top->mutable_data());
+}
+
+void DeconvOp::SetupPhaseWeight(const BlobF *weight) {
+  int in_c = weight->shape(0), out_c = weight->shape(1);
+  int group_in_c = in_c / group_;
+  VecFloat weight_data(weight->count());
+  weight->read_data(weight_data.data(), weight->count());
+
+  // Phase (p_h, p_w) of group g is a [out_c, group_in_c * taps_h * taps_w]
+  // matrix holding the kernel taps p + stride * t
+  VecFloat phase_data;
+  phase_weight_offset_.clear();
+  for (int p_h = 0; p_h < stride_; ++p_h) {
+    for (int p_w = 0; p_w < stride_; ++p_w) {
+      phase_weight_offset_.push_back(static_cast<int>(phase_data.size()));
+      int taps_h = phase_taps(p_h, kernel_size_, stride_);
+      int taps_w = phase_taps(p_w, kernel_size_, stride_);
+      for (int g = 0; g < group_; ++g) {
+        for (int o = 0; o < out_c; ++o) {
+          for (int c = g * group_in_c; c < (g + 1) * group_in_c; ++c) {
+            for (int t = 0; t < taps_h; ++t) {
+              for (int u = 0; u < taps_w; ++u) {
+                int k_h = p_h + t * stride_, k_w = p_w + u * stride_;
+                phase_data.push_back(
+                    weight_data[((c * out_c + o) * kernel_size_ + k_h) *
+                                    kernel_size_ +
+                                k_w]);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  phase_weight_ = op_ws_->CreateBlob<float>(op_name_ + "_phase_weight");
+  phase_weight_->reshape({static_cast<int>(phase_data.size())});
+  phase_weight_->set_data(phase_data.data(),
+                          static_cast<int>(phase_data.size()));
+}
+
+// Largest column and output buffers over the phases
+void DeconvOp::PhaseTempCounts(int in_c, int out_h, int out_w, int *col_count,
+                               int *out_count) const {
+  *col_count = 0, *out_count = 0;
+  for (int p_h = 0; p_h < stride_; ++p_h) {
+    for (int p_w = 0; p_w < stride_; ++p_w) {
+      int taps_h, start_h, num_h, taps_w, start_w, num_w;
+      phase_range(p_h, kernel_size_, stride_, pad_, out_h, &taps_h, &start_h,
+                  &num_h);
+      phase_range(p_w, kernel_size_, stride_, pad_, out_w, &taps_w, &start_w,
+                  &num_w);
+      *col_count = std::max(*col_count, in_c * taps_h * taps_w * num_h * num_w);
+      *out_count = std::max(*out_count, num_output_ * num_h * num_w);
+    }
+  }
+}
+
+void DeconvOp::ForwardPhase(const BlobF *bottom, BlobF *top) {
+  if (phase_weight_ == nullptr) {
+    SetupPhaseWeight(bottoms<float>(1));
+  }
+
+  int batch = bottom->shape(0), in_c = bottom->shape(1);
+  int out_h = top->shape(2), out_w = top->shape(3);
+  int group_in_c = in_c / group_, group_out_c = num_output_ / group_;
+
+  int col_count, out_count;
+  PhaseTempCounts(in_c, out_h, out_w, &col_count, &out_count);
+  op_ws_->GrowTempBuffer(col_count + out_count, sizeof(float));
+  op_ws_->CreateTempBlob<float>({col_count}, &phase_col_);
+  op_ws_->CreateTempBlob<float>({out_count}, &phase_out_);
+
+  int top_num = top->num(), bottom_num = bottom->num();
+  for (int b = 0; b < batch; ++b) {
+    for (int p_h = 0; p_h < stride_; ++p_h) {
+      for (int p_w = 0; p_w < stride_; ++p_w) {
+        int taps_h, start_h, num_h, taps_w, start_w, num_w;
+        phase_range(p_h, kernel_size_, stride_, pad_, out_h, &taps_h,
+                    &start_h, &num_h);
+        phase_range(p_w, kernel_size_, stride_, pad_, out_w, &taps_w,
+                    &start_w, &num_w);
+        int phase_dim = num_h * num_w, phase_k = group_in_c * taps_h * taps_w;
+        if (phase_dim == 0) continue;
+        if (phase_k > 0) {
+          Vision::PhaseIm2Col(bottom->data(), bottom->shape(), b * bottom_num,
+                              taps_h, taps_w, start_h, start_w, num_h, num_w,
+                              phase_col_->mutable_data());
+          Blas::BlasSgemmBatched(
+              0, 0, group_out_c, phase_dim, phase_k, 1, phase_weight_->data(),
+              phase_weight_offset_[p_h * stride_ + p_w],
+              group_out_c * phase_k, phase_col_->data(), 0,
+              phase_k * phase_dim, 0, phase_out_->mutable_data(), 0,
+              group_out_c * phase_dim, group_, op_ws_->Ctx()->blas_handle());
+        } else {
+          Blas::Set(num_output_ * phase_dim, 0, phase_out_->mutable_data(), 0);
+        }
+        Vision::PhaseToTop(phase_out_->data(), num_output_, num_h, num_w,
+                           stride_ * start_h + p_h - pad_,
+                           stride_ * start_w + p_w - pad_, stride_,
+                           top->shape(), b * top_num, top->mutable_data());
+      }
     }
   }
-  if (activate_type_ == 1) {
-    Vision::Activate(top->mutable_data(), top->count(), activate_type_);
+}
+
+// Plans the temporaries of the path the last forward took for this weight,
+// under cuDNN its last workspace
+void DeconvOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                           std::vector<VecInt> *top_shapes) const {
+  const auto &in_shape = bottom_shapes[0];
+  CHECK_EQ(static_cast<int>(in_shape.size()), 4);
+
+  auto out_shape = in_shape;
+  out_shape[1] = num_output_;
+  out_shape[2] =
+      deconv_out_size(in_shape[2], kernel_size_, stride_, pad_, dilation_);
+  out_shape[3] =
+      deconv_out_size(in_shape[3], kernel_size_, stride_, pad_, dilation_);
+  (*top_shapes)[0] = out_shape;
+
+#if defined(USE_CUDNN)
+  if (use_cudnn_) {
+    op_ws_->PlanTemp(workspace_bwd_size_, sizeof(unsigned char));
+    return;
+  }
+#endif
+
+  if (use_bilinear_) return;
+  if (stride_ > 1 && dilation_ == 1) {
+    int col_count, out_count;
+    PhaseTempCounts(in_shape[1], out_shape[2], out_shape[3], &col_count,
+                    &out_count);
+    op_ws_->PlanTemp(col_count, sizeof(float));
+    op_ws_->PlanTemp(out_count, sizeof(float));
+  } else {
+    op_ws_->PlanTemp(kernel_size_ * kernel_size_ * num_output_ *
+                         count_of(in_shape, 2),
+                     sizeof(float));
   }
 }
 
@@ -140,6 +403,23 @@ inline bool check_border(int a, int b) {
   return static_cast<unsigned>(a) < static_cast<unsigned>(b);
 }
 
+// Column offsets of the (kernel tap, column position) entries landing on each
+// image index, h and w offsets add up to the full column index
+inline void col2im_taps(int im_dim, int col_dim, int kernel_size, int stride,
+                        int pad, int dilation, int k_step, int col_step,
+                        VecInt *num, VecInt *index) {
+  num->assign(im_dim, 0), index->assign(im_dim * kernel_size, 0);
+  for (int i = 0; i < im_dim; ++i) {
+    for (int k = 0; k < kernel_size; ++k) {
+      int o = i + pad - k * dilation;
+      if (o >= 0 && o % stride == 0 && o / stride < col_dim) {
+        (*index)[i * kernel_size + (*num)[i]++] =
+            k * k_step + o / stride * col_step;
+      }
+    }
+  }
+}
+
 template <typename T>
 void Col2Im(const T *col_data, const VecInt &in_shape, int offset,
             int kernel_size, int stride, int pad, int dilation,
@@ -147,23 +427,29 @@ void Col2Im(const T *col_data, const VecInt &in_shape, int offset,
   in_data += offset;
   int in_c = in_shape[1], in_h = in_shape[2], in_w = in_shape[3];
   int out_h = out_shape[2], out_w = out_shape[3];
-  int spatial_dim = in_h * in_w;
-  for (int k_c = 0; k_c < in_c; ++k_c, in_data += spatial_dim) {
-    for (int k_s = 0; k_s < kernel_size * kernel_size; ++k_s) {
-      int k_h = k_s / kernel_size;
-      int k_w = k_s % kernel_size;
-      int im_row = -pad + k_h * dilation;
-      for (int h = 0; h < out_h; ++h, im_row += stride) {
-        if (check_border(im_row, in_h)) {
-          int im_col = -pad + k_w * dilation;
-          for (int w = 0; w < out_w; ++w, ++col_data, im_col += stride) {
-            if (check_border(im_col, in_w)) {
-              in_data[im_row * in_w + im_col] += *(col_data);
-            }
+  int col_spatial_dim = out_h * out_w;
+  // Gather form, every image pixel sums the column entries of its taps and
+  // is written once, so the image needs no zero fill
+  VecInt h_num, h_index, w_num, w_index;
+  col2im_taps(in_h, out_h, kernel_size, stride, pad, dilation,
+              kernel_size * col_spatial_dim, out_w, &h_num, &h_index);
+  col2im_taps(in_w, out_w, kernel_size, stride, pad, dilation,
+              col_spatial_dim, 1, &w_num, &w_index);
+  for (int c = 0; c < in_c; ++c) {
+    const T *col_offset_data =
+        col_data + c * kernel_size * kernel_size * col_spatial_dim;
+    for (int h = 0; h < in_h; ++h) {
+      const int *h_offset_index = h_index.data() + h * kernel_size;
+      for (int w = 0; w < in_w; ++w) {
+        const int *w_offset_index = w_index.data() + w * kernel_size;
+        auto sum_val = T(0);
+        for (int a = 0; a < h_num[h]; ++a) {
+          const T *col_row_data = col_offset_data + h_offset_index[a];
+          for (int b = 0; b < w_num[w]; ++b) {
+            sum_val += col_row_data[w_offset_index[b]];
           }
-        } else {
-          col_data += out_w;
         }
+        *(in_data++) = sum_val;
       }
     }
   }
@@ -172,6 +458,123 @@ void Col2Im(const T *col_data, const VecInt &in_shape, int offset,
 template void Col2Im(const float *col_data, const VecInt &in_shape, int offset,
                      int kernel_size, int stride, int pad, int dilation,
                      const VecInt &out_shape, float *in_data);
+
+// kTaps fixes the tap count at compile time, the 2 taps of every standard
+// bilinear upsampling kernel get fully unrolled inner loops
+template <typename T, int kTaps>
+struct BilinearPlaneKernel {
+  static CPU_KERNEL void Run(const T *in_data, int in_w, const int *h_index,
+                             const T *h_weight, const int *w_index,
+                             const T *w_weight, int num_taps, int out_h,
+                             int out_w, T *out_data) {
+    const int taps = kTaps > 0 ? kTaps : num_taps;
+    std::vector<T> row(in_w);
+    for (int h = 0; h < out_h; ++h) {
+      // Blend the input rows first, then interpolate along the row
+      std::fill(row.begin(), row.end(), T(0));
+      for (int t = 0; t < taps; ++t) {
+        auto weight = h_weight[h * taps + t];
+        if (weight == T(0)) continue;
+        const T *in_row = in_data + h_index[h * taps + t] * in_w;
+        for (int w = 0; w < in_w; ++w) {
+          row[w] += weight * in_row[w];
+        }
+      }
+      for (int w = 0; w < out_w; ++w) {
+        auto sum_val = T(0);
+        for (int t = 0; t < taps; ++t) {
+          sum_val += w_weight[w * taps + t] * row[w_index[w * taps + t]];
+        }
+        *(out_data++) = sum_val;
+      }
+    }
+  }
+};
+
+template <typename T>
+void BilinearUpsample(const T *in_data, const VecInt &in_shape,
+                      const int *h_index, const T *h_weight,
+                      const int *w_index, const T *w_weight, int taps,
+                      const VecInt &out_shape, T *out_data) {
+  int num_planes = in_shape[0] * in_shape[1];
+  int in_h = in_shape[2], in_w = in_shape[3];
+  int out_h = out_shape[2], out_w = out_shape[3];
+#if defined(USE_OpenMP)
+#pragma omp parallel for
+#endif
+  for (int n = 0; n < num_planes; ++n) {
+    const T *in_plane = in_data + n * in_h * in_w;
+    T *out_plane = out_data + n * out_h * out_w;
+    if (taps == 2) {
+      CPU::Dispatch<BilinearPlaneKernel<T, 2>>(
+          in_plane, in_w, h_index, h_weight, w_index, w_weight, taps, out_h,
+          out_w, out_plane);
+    } else {
+      CPU::Dispatch<BilinearPlaneKernel<T, 0>>(
+          in_plane, in_w, h_index, h_weight, w_index, w_weight, taps, out_h,
+          out_w, out_plane);
+    }
+  }
+}
+
+template void BilinearUpsample(const float *in_data, const VecInt &in_shape,
+                               const int *h_index, const float *h_weight,
+                               const int *w_index, const float *w_weight,
+                               int taps, const VecInt &out_shape,
+                               float *out_data);
+
+template <typename T>
+void PhaseIm2Col(const T *in_data, const VecInt &in_shape, int offset,
+                 int taps_h, int taps_w, int start_h, int start_w, int num_h,
+                 int num_w, T *col_data) {
+  in_data += offset;
+  int in_c = in_shape[1], in_h = in_shape[2], in_w = in_shape[3];
+  for (int c = 0; c < in_c; ++c, in_data += in_h * in_w) {
+    for (int t = 0; t < taps_h; ++t) {
+      for (int u = 0; u < taps_w; ++u) {
+        for (int i = 0; i < num_h; ++i) {
+          int h_in = start_h + i - t;
+          if (check_border(h_in, in_h)) {
+            const T *in_row = in_data + h_in * in_w;
+            int w_in = start_w - u;
+            for (int j = 0; j < num_w; ++j, ++w_in) {
+              *(col_data++) = check_border(w_in, in_w) ? in_row[w_in] : T(0);
+            }
+          } else {
+            for (int j = 0; j < num_w; ++j) {
+              *(col_data++) = T(0);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template void PhaseIm2Col(const float *in_data, const VecInt &in_shape,
+                          int offset, int taps_h, int taps_w, int start_h,
+                          int start_w, int num_h, int num_w, float *col_data);
+
+template <typename T>
+void PhaseToTop(const T *phase_data, int num_output, int num_h, int num_w,
+                int out_h_start, int out_w_start, int stride,
+                const VecInt &out_shape, int offset, T *out_data) {
+  out_data += offset;
+  int out_h = out_shape[2], out_w = out_shape[3];
+  for (int c = 0; c < num_output; ++c, out_data += out_h * out_w) {
+    for (int i = 0; i < num_h; ++i) {
+      T *out_row = out_data + (out_h_start + i * stride) * out_w + out_w_start;
+      for (int j = 0; j < num_w; ++j) {
+        out_row[j * stride] = *(phase_data++);
+      }
+    }
+  }
+}
+
+template void PhaseToTop(const float *phase_data, int num_output, int num_h,
+                         int num_w, int out_h_start, int out_w_start,
+                         int stride, const VecInt &out_shape, int offset,
+                         float *out_data);
 #endif
 
 }  // namespace Vision
@@ -57,6 +57,116 @@ void Col2Im(const T *col_data, const VecInt &in_shape, int offset,
 template void Col2Im(const float *col_data, const VecInt &in_shape, int offset,
                      int kernel_size, int stride, int pad, int dilation,
                      const VecInt &out_shape, float *in_data);
+
+template <typename T>
+__global__ void KernelBilinearUpsample(const T *in_data, int count, int in_h,
+                                       int in_w, const int *h_index,
+                                       const T *h_weight, const int *w_index,
+                                       const T *w_weight, int taps, int out_h,
+                                       int out_w, T *out_data) {
+  CUDA_KERNEL_LOOP(globalid, count) {
+    int w = globalid % out_w;
+    int h = (globalid / out_w) % out_h;
+    int n = globalid / out_w / out_h;
+    const T *in_offset_data = in_data + n * in_h * in_w;
+    T sum_val = T(0);
+    for (int t = 0; t < taps; ++t) {
+      const T *in_row = in_offset_data + h_index[h * taps + t] * in_w;
+      T row_val = T(0);
+      for (int u = 0; u < taps; ++u) {
+        row_val += w_weight[w * taps + u] * in_row[w_index[w * taps + u]];
+      }
+      sum_val += h_weight[h * taps + t] * row_val;
+    }
+    out_data[globalid] = sum_val;
+  }
+}
+
+template <typename T>
+void BilinearUpsample(const T *in_data, const VecInt &in_shape,
+                      const int *h_index, const T *h_weight,
+                      const int *w_index, const T *w_weight, int taps,
+                      const VecInt &out_shape, T *out_data) {
+  int in_h = in_shape[2], in_w = in_shape[3];
+  int out_h = out_shape[2], out_w = out_shape[3];
+  int count = in_shape[0] * in_shape[1] * out_h * out_w;
+  KernelBilinearUpsample<T><<<GetBlocks(count), NumThreads>>>(
+      in_data, count, in_h, in_w, h_index, h_weight, w_index, w_weight, taps,
+      out_h, out_w, out_data);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+template void BilinearUpsample(const float *in_data, const VecInt &in_shape,
+                               const int *h_index, const float *h_weight,
+                               const int *w_index, const float *w_weight,
+                               int taps, const VecInt &out_shape,
+                               float *out_data);
+
+template <typename T>
+__global__ void KernelPhaseIm2Col(const T *in_data, int count, int in_h,
+                                  int in_w, int taps_h, int taps_w,
+                                  int start_h, int start_w, int num_h,
+                                  int num_w, T *col_data) {
+  CUDA_KERNEL_LOOP(globalid, count) {
+    int j = globalid % num_w;
+    int i = (globalid / num_w) % num_h;
+    int u = (globalid / num_w / num_h) % taps_w;
+    int t = (globalid / num_w / num_h / taps_w) % taps_h;
+    int c = globalid / num_w / num_h / taps_w / taps_h;
+    int h_in = start_h + i - t, w_in = start_w + j - u;
+    col_data[globalid] =
+        (h_in >= 0 && w_in >= 0 && h_in < in_h && w_in < in_w)
+            ? in_data[(c * in_h + h_in) * in_w + w_in]
+            : T(0);
+  }
+}
+
+template <typename T>
+void PhaseIm2Col(const T *in_data, const VecInt &in_shape, int offset,
+                 int taps_h, int taps_w, int start_h, int start_w, int num_h,
+                 int num_w, T *col_data) {
+  int in_c = in_shape[1], in_h = in_shape[2], in_w = in_shape[3];
+  int count = in_c * taps_h * taps_w * num_h * num_w;
+  KernelPhaseIm2Col<T><<<GetBlocks(count), NumThreads>>>(
+      in_data + offset, count, in_h, in_w, taps_h, taps_w, start_h, start_w,
+      num_h, num_w, col_data);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+template void PhaseIm2Col(const float *in_data, const VecInt &in_shape,
+                          int offset, int taps_h, int taps_w, int start_h,
+                          int start_w, int num_h, int num_w, float *col_data);
+
+template <typename T>
+__global__ void KernelPhaseToTop(const T *phase_data, int count, int num_h,
+                                 int num_w, int out_h_start, int out_w_start,
+                                 int stride, int out_h, int out_w,
+                                 T *out_data) {
+  CUDA_KERNEL_LOOP(globalid, count) {
+    int j = globalid % num_w;
+    int i = (globalid / num_w) % num_h;
+    int c = globalid / num_w / num_h;
+    int h = out_h_start + i * stride, w = out_w_start + j * stride;
+    out_data[(c * out_h + h) * out_w + w] = phase_data[globalid];
+  }
+}
+
+template <typename T>
+void PhaseToTop(const T *phase_data, int num_output, int num_h, int num_w,
+                int out_h_start, int out_w_start, int stride,
+                const VecInt &out_shape, int offset, T *out_data) {
+  int out_h = out_shape[2], out_w = out_shape[3];
+  int count = num_output * num_h * num_w;
+  KernelPhaseToTop<T><<<GetBlocks(count), NumThreads>>>(
+      phase_data, count, num_h, num_w, out_h_start, out_w_start, stride,
+      out_h, out_w, out_data + offset);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+template void PhaseToTop(const float *phase_data, int num_output, int num_h,
+                         int num_w, int out_h_start, int out_w_start,
+                         int stride, const VecInt &out_shape, int offset,
+                         float *out_data);
 #endif
 
 }  // namespace Vision
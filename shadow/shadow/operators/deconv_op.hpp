@@ -19,8 +19,12 @@ class DeconvOp : public Operator {
     CHECK_EQ(num_output_ % group_, 0);
     bias_term_ = get_single_argument<bool>("bias_term", true);
     activate_type_ = get_single_argument<int>("type", -1);
-    CHECK((activate_type_ == -1 || activate_type_ == 1))
-        << "Build in activate only support Relu";
+    CHECK_GE(activate_type_, -1);
+    CHECK_LE(activate_type_, 5);
+    slope_ = get_single_argument<float>("slope", 0.1);
+    channel_shared_ = get_single_argument<bool>("channel_shared", false);
+    scale_term_ = get_single_argument<bool>("scale_term", false);
+    residual_term_ = get_single_argument<bool>("residual_term", false);
 
 #if defined(USE_CUDNN)
 #if CUDNN_VERSION_MIN(7, 0, 1)
@@ -33,9 +37,6 @@ class DeconvOp : public Operator {
       cudnn::createTensorDesc<float>(&bottom_desc_);
       cudnn::createTensorDesc<float>(&top_desc_);
       cudnn::createFilterDesc<float>(&filter_desc_);
-      if (bias_term_) {
-        cudnn::createTensorDesc<float>(&bias_desc_);
-      }
     }
 #endif
   }
@@ -57,22 +58,53 @@ class DeconvOp : public Operator {
       cudnnDestroyFilterDescriptor(filter_desc_);
       filter_desc_ = nullptr;
     }
-    if (bias_desc_ != nullptr) {
-      cudnnDestroyTensorDescriptor(bias_desc_);
-      bias_desc_ = nullptr;
-    }
 #endif
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
+
+  // Each input element is scattered over a kernel of every output channel
+  // of its group
+  double flops() const override {
+    return 2.0 * bottoms<float>(0)->count() * num_output_ / group_ *
+           kernel_size_ * kernel_size_;
+  }
 
  private:
+  void SetupBilinear(const BlobF *weight);
+  void SetupPhaseWeight(const BlobF *weight);
+  void ForwardBilinear(const BlobF *bottom, BlobF *top);
+  void PhaseTempCounts(int in_c, int out_h, int out_w, int *col_count,
+                       int *out_count) const;
+  void ForwardPhase(const BlobF *bottom, BlobF *top);
+
   int num_output_, kernel_size_, stride_, pad_, dilation_, group_,
       activate_type_, conv_out_spatial_dim_, out_spatial_dim_, kernel_dim_;
   int conv_in_c, conv_out_c, weight_offset_, col_offset_, output_offset_;
-  bool bias_term_, use_cudnn_ = false, use_nnpack_ = false;
-
-  BlobF *biases_multiplier_ = nullptr, *col_image_ = nullptr;
+  float slope_;
+  bool bias_term_, channel_shared_, scale_term_, residual_term_,
+      use_cudnn_ = false, use_nnpack_ = false;
+
+  BlobF *col_image_ = nullptr;
+
+  // Depthwise deconvs whose filters are the bilinear upsampling kernel run
+  // as a separable interpolation, the tables hold the input taps and the
+  // weights of every output row and column
+  bool use_bilinear_ = false;
+  VecFloat bilinear_kernel_;
+  VecInt bilinear_key_;
+  BlobI *bilinear_h_index_ = nullptr, *bilinear_w_index_ = nullptr;
+  BlobF *bilinear_h_weight_ = nullptr, *bilinear_w_weight_ = nullptr;
+
+  // Strided deconvs are split into stride x stride sub-pixel phases, each
+  // one a dense conv of the input with the phase taps of the kernel
+  VecInt phase_weight_offset_;
+  // Version of the weight the bilinear check and the phase weight were
+  // derived from, both are redone when the weight blob is written
+  size_t weight_version_ = SIZE_MAX;
+  BlobF *phase_weight_ = nullptr, *phase_col_ = nullptr, *phase_out_ = nullptr;
 
 #if defined(USE_CUDNN)
   cudnnConvolutionBwdDataAlgo_t bwd_data_algo_ =
@@ -81,7 +113,6 @@ class DeconvOp : public Operator {
   cudnnConvolutionDescriptor_t conv_desc_ = nullptr;
   cudnnTensorDescriptor_t bottom_desc_ = nullptr, top_desc_ = nullptr;
   cudnnFilterDescriptor_t filter_desc_ = nullptr;
-  cudnnTensorDescriptor_t bias_desc_ = nullptr;
 
   size_t workspace_bwd_size_ = 0;
   BlobUC *workspace_ = nullptr;
@@ -101,6 +132,22 @@ void Col2Im(const T *col_data, const VecInt &in_shape, int offset,
             int kernel_size, int stride, int pad, int dilation,
             const VecInt &out_shape, T *in_data);
 
+template <typename T>
+void BilinearUpsample(const T *in_data, const VecInt &in_shape,
+                      const int *h_index, const T *h_weight,
+                      const int *w_index, const T *w_weight, int taps,
+                      const VecInt &out_shape, T *out_data);
+
+template <typename T>
+void PhaseIm2Col(const T *in_data, const VecInt &in_shape, int offset,
+                 int taps_h, int taps_w, int start_h, int start_w, int num_h,
+                 int num_w, T *col_data);
+
+template <typename T>
+void PhaseToTop(const T *phase_data, int num_output, int num_h, int num_w,
+                int out_h_start, int out_w_start, int stride,
+                const VecInt &out_shape, int offset, T *out_data);
+
 }  // namespace Vision
 
 }  // namespace Shadow
@@ -39,31 +39,39 @@ void DeformConvOp::Forward() {
   col_offset_ = kernel_dim_ * out_spatial_dim_;
   output_offset_ = num_output_ * out_spatial_dim_ / group_;
 
-  int temp_count = kernel_dim_ * group_ * out_spatial_dim_;
+  int num_samples = deform_group_ * kernel_size_ * kernel_size_ * 4;
+  int temp_count = kernel_dim_ * group_ * out_spatial_dim_ +
+                   2 * num_samples * out_spatial_dim_;
   if (bias_term_) {
     temp_count += out_spatial_dim_;
   }
   op_ws_->GrowTempBuffer(temp_count, sizeof(float));
-  col_image_ = op_ws_->CreateTempBlob<float>(
-      {kernel_dim_ * group_, out_spatial_dim_}, op_name_ + "_col_image");
+  op_ws_->CreateTempBlob<float>({kernel_dim_ * group_, out_spatial_dim_},
+                                &col_image_);
+  op_ws_->CreateTempBlob<int>({num_samples, out_spatial_dim_}, &sample_index_);
+  op_ws_->CreateTempBlob<float>({num_samples, out_spatial_dim_},
+                                &sample_weight_);
   if (bias_term_) {
-    biases_multiplier_ = op_ws_->CreateTempBlob<float>(
-        {out_spatial_dim_}, op_name_ + "_biases_multiplier");
+    op_ws_->CreateTempBlob<float>({out_spatial_dim_}, &biases_multiplier_);
     Blas::Set(out_spatial_dim_, 1, biases_multiplier_->mutable_data(), 0);
   }
   int top_num = top->num(), bottom_num = bottom->num();
+  int offset_num = offset_blob->num();
   for (int b = 0; b < batch; ++b) {
-    Vision::DeformIm2Col(bottom->data(), bottom->shape(), offset_blob->data(),
-                         b * bottom_num, deform_group_, kernel_size_, stride_,
-                         pad_, dilation_, 0, top->shape(),
+    Vision::DeformSampleTable(offset_blob->data() + b * offset_num,
+                              bottom->shape(), deform_group_, kernel_size_,
+                              stride_, pad_, dilation_, top->shape(),
+                              sample_index_->mutable_data(),
+                              sample_weight_->mutable_data());
+    Vision::DeformIm2Col(bottom->data(), bottom->shape(), b * bottom_num,
+                         deform_group_, kernel_size_, sample_index_->data(),
+                         sample_weight_->data(), top->shape(),
                          col_image_->mutable_data());
-    for (int g = 0; g < group_; ++g) {
-      Blas::BlasSgemm(0, 0, num_output_ / group_, out_spatial_dim_, kernel_dim_,
-                      1, weight->data(), weight_offset_ * g, col_image_->data(),
-                      col_offset_ * g, 0, top->mutable_data(),
-                      b * top_num + output_offset_ * g,
-                      op_ws_->Ctx()->blas_handle());
-    }
+    Blas::BlasSgemmBatched(0, 0, num_output_ / group_, out_spatial_dim_,
+                           kernel_dim_, 1, weight->data(), 0, weight_offset_,
+                           col_image_->data(), 0, col_offset_, 0,
+                           top->mutable_data(), b * top_num, output_offset_,
+                           group_, op_ws_->Ctx()->blas_handle());
     if (bias_term_) {
       Blas::BlasSgemm(0, 0, num_output_, out_spatial_dim_, 1, 1,
                       bottoms<float>(3)->data(), 0, biases_multiplier_->data(),
@@ -76,96 +84,120 @@ void DeformConvOp::Forward() {
   }
 }
 
+void DeformConvOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                               std::vector<VecInt> *top_shapes) const {
+  const auto &in_shape = bottom_shapes[0];
+  CHECK_EQ(static_cast<int>(in_shape.size()), 4);
+
+  auto out_shape = in_shape;
+  out_shape[1] = num_output_;
+  out_shape[2] =
+      deform_conv_out_size(in_shape[2], kernel_size_, stride_, pad_, dilation_);
+  out_shape[3] =
+      deform_conv_out_size(in_shape[3], kernel_size_, stride_, pad_, dilation_);
+  (*top_shapes)[0] = out_shape;
+
+  int out_spatial_dim = count_of(out_shape, 2);
+  int num_samples = deform_group_ * kernel_size_ * kernel_size_ * 4;
+  op_ws_->PlanTemp(kernel_size_ * kernel_size_ * in_shape[1] * out_spatial_dim,
+                   sizeof(float));
+  op_ws_->PlanTemp(num_samples * out_spatial_dim, sizeof(int));
+  op_ws_->PlanTemp(num_samples * out_spatial_dim, sizeof(float));
+  if (bias_term_) {
+    op_ws_->PlanTemp(out_spatial_dim, sizeof(float));
+  }
+}
+
 REGISTER_OPERATOR(DeformConv, DeformConvOp);
 
 namespace Vision {
 
 #if !defined(USE_CUDA)
-inline float deform_im2col_bilinear(const float *bottom_data, int data_width,
-                                    int height, int width, float h, float w) {
-  auto h_low = static_cast<int>(std::floor(h));
-  auto w_low = static_cast<int>(std::floor(w));
-  int h_high;
-  int w_high;
-  if (h_low >= height - 1) {
-    h_high = h_low = height - 1;
-    h = (float)h_low;
-  } else {
-    h_high = h_low + 1;
-  }
-  if (w_low >= width - 1) {
-    w_high = w_low = width - 1;
-    w = (float)w_low;
-  } else {
-    w_high = w_low + 1;
+template <typename T>
+void DeformSampleTable(const T *offset_data, const VecInt &in_shape,
+                       int deform_group, int kernel_size, int stride, int pad,
+                       int dilation, const VecInt &out_shape, int *index_data,
+                       T *weight_data) {
+  int in_h = in_shape[2], in_w = in_shape[3];
+  int out_h = out_shape[2], out_w = out_shape[3];
+  int spatial_dim = out_h * out_w, num_taps = kernel_size * kernel_size;
+#if defined(USE_OpenMP)
+#pragma omp parallel for
+#endif
+  for (int n = 0; n < deform_group * num_taps; ++n) {
+    int k_h = (n % num_taps) / kernel_size, k_w = n % kernel_size;
+    const T *offset_h = offset_data + 2 * n * spatial_dim;
+    const T *offset_w = offset_h + spatial_dim;
+    int *index = index_data + 4 * n * spatial_dim;
+    T *weight = weight_data + 4 * n * spatial_dim;
+    for (int h = 0, s = 0; h < out_h; ++h) {
+      for (int w = 0; w < out_w; ++w, ++s) {
+        T h_im = h * stride - pad + k_h * dilation + offset_h[s];
+        T w_im = w * stride - pad + k_w * dilation + offset_w[s];
+        int h_low = 0, w_low = 0, h_high = 0, w_high = 0;
+        T l_h = 0, l_w = 0, valid = 0;
+        if (h_im >= 0 && w_im >= 0 && h_im < in_h && w_im < in_w) {
+          h_low = static_cast<int>(h_im), w_low = static_cast<int>(w_im);
+          h_high = std::min(h_low + 1, in_h - 1);
+          w_high = std::min(w_low + 1, in_w - 1);
+          l_h = h_low < in_h - 1 ? h_im - h_low : T(0);
+          l_w = w_low < in_w - 1 ? w_im - w_low : T(0);
+          valid = 1;
+        }
+        index[s] = h_low * in_w + w_low;
+        index[spatial_dim + s] = h_low * in_w + w_high;
+        index[2 * spatial_dim + s] = h_high * in_w + w_low;
+        index[3 * spatial_dim + s] = h_high * in_w + w_high;
+        weight[s] = valid * (1 - l_h) * (1 - l_w);
+        weight[spatial_dim + s] = valid * (1 - l_h) * l_w;
+        weight[2 * spatial_dim + s] = valid * l_h * (1 - l_w);
+        weight[3 * spatial_dim + s] = valid * l_h * l_w;
+      }
+    }
   }
-  float lh = h - h_low;
-  float lw = w - w_low;
-  float hh = 1 - lh, hw = 1 - lw;
-  float v1 = bottom_data[h_low * data_width + w_low];
-  float v2 = bottom_data[h_low * data_width + w_high];
-  float v3 = bottom_data[h_high * data_width + w_low];
-  float v4 = bottom_data[h_high * data_width + w_high];
-  float w1 = hh * hw, w2 = hh * lw, w3 = lh * hw, w4 = lh * lw;
-  float val = (w1 * v1 + w2 * v2 + w3 * v3 + w4 * v4);
-  return val;
 }
 
+template void DeformSampleTable(const float *offset_data,
+                                const VecInt &in_shape, int deform_group,
+                                int kernel_size, int stride, int pad,
+                                int dilation, const VecInt &out_shape,
+                                int *index_data, float *weight_data);
+
 template <typename T>
-void DeformIm2Col(const T *in_data, const VecInt &in_shape,
-                  const T *offset_data, int offset, int deform_group,
-                  int kernel_size, int stride, int pad, int dilation,
-                  int zero_point, const VecInt &out_shape, T *out_data) {
+void DeformIm2Col(const T *in_data, const VecInt &in_shape, int offset,
+                  int deform_group, int kernel_size, const int *index_data,
+                  const T *weight_data, const VecInt &out_shape, T *col_data) {
   int in_c = in_shape[1], in_h = in_shape[2], in_w = in_shape[3];
-  int out_h = out_shape[2], out_w = out_shape[3];
+  int spatial_dim = out_shape[2] * out_shape[3];
+  int num_taps = kernel_size * kernel_size;
   int channel_per_deform_group = in_c / deform_group;
-  for (int c_im = 0; c_im < in_c; ++c_im) {
-    for (int h_col = 0; h_col < out_h; ++h_col) {
-      for (int w_col = 0; w_col < out_w; ++w_col) {
-        int c_col = c_im * kernel_size * kernel_size;
-        int deform_group_index = c_im / channel_per_deform_group;
-        int h_in = h_col * stride - pad;
-        int w_in = w_col * stride - pad;
-        T *data_col_ptr = out_data + (c_col * out_h + h_col) * out_w + w_col;
-        const T *data_im_ptr =
-            in_data + offset + (c_im * in_h + h_in) * in_w + w_in;
-        const T *data_offset_ptr = offset_data + deform_group_index * 2 *
-                                                     kernel_size * kernel_size *
-                                                     out_h * out_w;
-        for (int i = 0; i < kernel_size; ++i) {
-          for (int j = 0; j < kernel_size; ++j) {
-            int data_offset_h_ptr =
-                ((2 * (i * kernel_size + j)) * out_h + h_col) * out_w + w_col;
-            int data_offset_w_ptr =
-                ((2 * (i * kernel_size + j) + 1) * out_h + h_col) * out_w +
-                w_col;
-            T offset_h = data_offset_ptr[data_offset_h_ptr];
-            T offset_w = data_offset_ptr[data_offset_w_ptr];
-            auto val = static_cast<T>(zero_point);
-            T h_im = h_in + i * dilation + offset_h;
-            T w_im = w_in + j * dilation + offset_w;
-            if (h_im >= 0 && w_im >= 0 && h_im < in_h && w_im < in_w) {
-              T map_h = i * dilation + offset_h;
-              T map_w = j * dilation + offset_w;
-              int cur_height = in_h - h_in;
-              int cur_width = in_w - w_in;
-              val = deform_im2col_bilinear(data_im_ptr, in_w, cur_height,
-                                           cur_width, map_h, map_w);
-            }
-            *data_col_ptr = val;
-            data_col_ptr += out_h * out_w;
-          }
-        }
+#if defined(USE_OpenMP)
+#pragma omp parallel for
+#endif
+  for (int c = 0; c < in_c; ++c) {
+    const T *in_offset_data = in_data + offset + c * in_h * in_w;
+    int n = c / channel_per_deform_group * num_taps;
+    for (int k = 0; k < num_taps; ++k, ++n) {
+      const int *index = index_data + 4 * n * spatial_dim;
+      const T *weight = weight_data + 4 * n * spatial_dim;
+      T *col_offset_data = col_data + (c * num_taps + k) * spatial_dim;
+      for (int s = 0; s < spatial_dim; ++s) {
+        col_offset_data[s] =
+            weight[s] * in_offset_data[index[s]] +
+            weight[spatial_dim + s] * in_offset_data[index[spatial_dim + s]] +
+            weight[2 * spatial_dim + s] *
+                in_offset_data[index[2 * spatial_dim + s]] +
+            weight[3 * spatial_dim + s] *
+                in_offset_data[index[3 * spatial_dim + s]];
       }
     }
   }
 }
 
 template void DeformIm2Col(const float *in_data, const VecInt &in_shape,
-                           const float *offset_data, int offset,
-                           int deform_group, int kernel_size, int stride,
-                           int pad, int dilation, int zero_point,
-                           const VecInt &out_shape, float *out_data);
+                           int offset, int deform_group, int kernel_size,
+                           const int *index_data, const float *weight_data,
+                           const VecInt &out_shape, float *col_data);
 #endif
 
 }  // namespace Vision
@@ -26,6 +26,12 @@ class DeformConvOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
+
+  double flops() const override {
+    return 2.0 * tops<float>(0)->count() * kernel_dim_;
+  }
 
  private:
   int num_output_, kernel_size_, stride_, pad_, dilation_, group_,
@@ -34,6 +40,11 @@ class DeformConvOp : public Operator {
   bool bias_term_;
 
   BlobF *biases_multiplier_ = nullptr, *col_image_ = nullptr;
+
+  // Bilinear sampling of every deform group, kernel tap and output position,
+  // shared by all the channels of the deform group
+  BlobI *sample_index_ = nullptr;
+  BlobF *sample_weight_ = nullptr;
 };
 
 static inline int deform_conv_out_size(int dim, int kernel_size, int stride,
@@ -44,11 +55,19 @@ static inline int deform_conv_out_size(int dim, int kernel_size, int stride,
 
 namespace Vision {
 
+// For each deform group, kernel tap and output position, gets the indices of
+// the four sampled input pixels and their bilinear weights, samples falling
+// outside the input get zero weights
+template <typename T>
+void DeformSampleTable(const T *offset_data, const VecInt &in_shape,
+                       int deform_group, int kernel_size, int stride, int pad,
+                       int dilation, const VecInt &out_shape, int *index_data,
+                       T *weight_data);
+
 template <typename T>
-void DeformIm2Col(const T *in_data, const VecInt &in_shape,
-                  const T *offset_data, int offset, int deform_group,
-                  int kernel_size, int stride, int pad, int dilation,
-                  int zero_point, const VecInt &out_shape, T *out_data);
+void DeformIm2Col(const T *in_data, const VecInt &in_shape, int offset,
+                  int deform_group, int kernel_size, const int *index_data,
+                  const T *weight_data, const VecInt &out_shape, T *col_data);
 
 }  // namespace Vision
 
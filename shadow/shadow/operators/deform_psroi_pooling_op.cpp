@@ -3,7 +3,7 @@
 namespace Shadow {
 
 void DeformPSROIPoolingOp::Forward() {
-  CHECK_EQ(bottoms_size(), 2);
+  CHECK_GE(bottoms_size(), 2);
 
   const auto *bottom_fea = bottoms<float>(0);
   const auto *bottom_roi = bottoms<float>(1);
@@ -33,29 +33,17 @@ void DeformPSROIPoolingOp::Forward() {
   }
 }
 
+void DeformPSROIPoolingOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                                       std::vector<VecInt> *top_shapes) const {
+  (*top_shapes)[0] = {bottom_shapes[1][0], output_dim_, pooled_size_,
+                      pooled_size_};
+}
+
 REGISTER_OPERATOR(DeformPSROIPooling, DeformPSROIPoolingOp);
 
 namespace Vision {
 
 #if !defined(USE_CUDA)
-inline float bilinear_interp(const float *data, float x, float y, int width,
-                             int height) {
-  auto x1 = static_cast<int>(std::floor(x));
-  auto x2 = static_cast<int>(std::ceil(x));
-  auto y1 = static_cast<int>(std::floor(y));
-  auto y2 = static_cast<int>(std::ceil(y));
-  float dist_x = x - x1;
-  float dist_y = y - y1;
-  float value11 = data[y1 * width + x1];
-  float value12 = data[y2 * width + x1];
-  float value21 = data[y1 * width + x2];
-  float value22 = data[y2 * width + x2];
-  float value = (1 - dist_x) * (1 - dist_y) * value11 +
-                (1 - dist_x) * dist_y * value12 +
-                dist_x * (1 - dist_y) * value21 + dist_x * dist_y * value22;
-  return value;
-}
-
 template <typename T>
 void DeformPSROIPooling(const T *in_data, const VecInt &in_shape,
                         const T *roi_data, const T *trans_data,
@@ -65,81 +53,114 @@ void DeformPSROIPooling(const T *in_data, const VecInt &in_shape,
                         float trans_std, bool no_trans, T *out_data) {
   int batch = in_shape[0];
   int in_c = in_shape[1], in_h = in_shape[2], in_w = in_shape[3];
-  int in_num = in_c * in_h * in_w,
-      out_num = output_dim * pooled_size * pooled_size;
+  int spatial_dim = in_h * in_w, pooled_dim = pooled_size * pooled_size;
   int num_classes = no_trans ? 1 : trans_shape[1] / 2;
   int channels_each_class = no_trans ? output_dim : output_dim / num_classes;
+  int num_samples = sample_per_part * sample_per_part;
   for (int n = 0; n < num_rois; ++n) {
-    int roi_offset = 5 * n;
-    int roi_batch_id = roi_data[roi_offset];
-    float roi_start_w =
-        Util::round(roi_data[roi_offset + 1]) * spatial_scale - 0.5f;
-    float roi_start_h =
-        Util::round(roi_data[roi_offset + 2]) * spatial_scale - 0.5f;
-    float roi_end_w =
-        (Util::round(roi_data[roi_offset + 3]) + 1) * spatial_scale - 0.5f;
-    float roi_end_h =
-        (Util::round(roi_data[roi_offset + 4]) + 1) * spatial_scale - 0.5f;
+    int roi_batch_id = roi_data[5 * n];
     CHECK_GE(roi_batch_id, 0);
     CHECK_LT(roi_batch_id, batch);
+  }
+  // The sampling grid of a bin only depends on the roi and its class offset,
+  // so the four bilinear taps of every sample are built once per (roi, class)
+  // with weights already divided by the number of valid samples in the bin,
+  // then reused by all channels of that class
+#if defined(USE_OpenMP)
+#pragma omp parallel for
+#endif
+  for (int n = 0; n < num_rois; ++n) {
+    VecInt sample_index(4 * pooled_dim * num_samples);
+    std::vector<T> sample_weight(4 * pooled_dim * num_samples);
+    const T *roi = roi_data + 5 * n;
+    int roi_batch_id = roi[0];
+    float roi_start_w = Util::round(roi[1]) * spatial_scale - 0.5f;
+    float roi_start_h = Util::round(roi[2]) * spatial_scale - 0.5f;
+    float roi_end_w = (Util::round(roi[3]) + 1) * spatial_scale - 0.5f;
+    float roi_end_h = (Util::round(roi[4]) + 1) * spatial_scale - 0.5f;
     float roi_height = std::max(roi_end_h - roi_start_h, 0.1f);
     float roi_width = std::max(roi_end_w - roi_start_w, 0.1f);
     float bin_size_h = roi_height / static_cast<float>(pooled_size);
     float bin_size_w = roi_width / static_cast<float>(pooled_size);
     float sub_bin_size_h = bin_size_h / static_cast<float>(sample_per_part);
     float sub_bin_size_w = bin_size_w / static_cast<float>(sample_per_part);
-    const T *batch_in_data = in_data + roi_batch_id * in_num;
-    T *batch_out_data = out_data + n * out_num;
-    for (int c = 0; c < output_dim; ++c) {
+    const T *batch_in_data = in_data + roi_batch_id * in_c * spatial_dim;
+    for (int class_id = 0; class_id < num_classes; ++class_id) {
       for (int ph = 0; ph < pooled_size; ++ph) {
         for (int pw = 0; pw < pooled_size; ++pw) {
           auto part_h = static_cast<int>(
               std::floor(static_cast<float>(ph) / pooled_size * part_size));
           auto part_w = static_cast<int>(
               std::floor(static_cast<float>(pw) / pooled_size * part_size));
-          int class_id = c / channels_each_class;
-          T trans_x =
-              no_trans
-                  ? static_cast<T>(0)
-                  : trans_data[(((n * num_classes + class_id) * 2) * part_size +
-                                part_h) *
-                                   part_size +
-                               part_w] *
-                        trans_std;
-          T trans_y = no_trans
-                          ? static_cast<T>(0)
-                          : trans_data[(((n * num_classes + class_id) * 2 + 1) *
-                                            part_size +
-                                        part_h) *
-                                           part_size +
-                                       part_w] *
-                                trans_std;
+          T trans_x = 0, trans_y = 0;
+          if (!no_trans) {
+            int trans_offset = (n * num_classes + class_id) * 2 * part_size;
+            trans_x = trans_data[(trans_offset + part_h) * part_size +
+                                 part_w] *
+                      trans_std;
+            trans_y = trans_data[(trans_offset + part_size + part_h) *
+                                     part_size +
+                                 part_w] *
+                      trans_std;
+          }
           float hstart = ph * bin_size_h + roi_start_h + trans_y * roi_height;
           float wstart = pw * bin_size_w + roi_start_w + trans_x * roi_width;
-          int gh = ph * group_size / pooled_size;
-          int gw = pw * group_size / pooled_size;
-          gh = std::min(std::max(gh, 0), group_size - 1);
-          gw = std::min(std::max(gw, 0), group_size - 1);
+          int bin_offset = 4 * (ph * pooled_size + pw) * num_samples;
+          int *index = sample_index.data() + bin_offset;
+          T *weight = sample_weight.data() + bin_offset;
           int count = 0;
-          int c_in = (c * group_size + gh) * group_size + gw;
-          auto sum_val = static_cast<T>(0);
-          for (int ih = 0; ih < sample_per_part; ++ih) {
-            for (int iw = 0; iw < sample_per_part; ++iw) {
-              float w = wstart + iw * sub_bin_size_w;
-              float h = hstart + ih * sub_bin_size_h;
-              if (w < -0.5f || w > in_w - 0.5f || h < -0.5f ||
-                  h > in_h - 0.5f) {
-                continue;
-              }
-              w = std::min(std::max(w, 0.f), in_w - 1.f);
-              h = std::min(std::max(h, 0.f), in_h - 1.f);
-              sum_val += bilinear_interp(batch_in_data + c_in * in_h * in_w, w,
-                                         h, in_w, in_h);
-              count++;
+          for (int s = 0; s < num_samples; ++s, index += 4, weight += 4) {
+            float w = wstart + (s % sample_per_part) * sub_bin_size_w;
+            float h = hstart + (s / sample_per_part) * sub_bin_size_h;
+            if (w < -0.5f || w > in_w - 0.5f || h < -0.5f ||
+                h > in_h - 0.5f) {
+              std::fill(index, index + 4, 0);
+              std::fill(weight, weight + 4, T(0));
+              continue;
+            }
+            w = std::min(std::max(w, 0.f), in_w - 1.f);
+            h = std::min(std::max(h, 0.f), in_h - 1.f);
+            auto x1 = static_cast<int>(std::floor(w));
+            auto x2 = static_cast<int>(std::ceil(w));
+            auto y1 = static_cast<int>(std::floor(h));
+            auto y2 = static_cast<int>(std::ceil(h));
+            float dist_x = w - x1, dist_y = h - y1;
+            index[0] = y1 * in_w + x1, index[1] = y2 * in_w + x1;
+            index[2] = y1 * in_w + x2, index[3] = y2 * in_w + x2;
+            weight[0] = (1 - dist_x) * (1 - dist_y);
+            weight[1] = (1 - dist_x) * dist_y;
+            weight[2] = dist_x * (1 - dist_y);
+            weight[3] = dist_x * dist_y;
+            count++;
+          }
+          if (count > 1) {
+            weight = sample_weight.data() + bin_offset;
+            for (int i = 0; i < 4 * num_samples; ++i) {
+              weight[i] /= count;
+            }
+          }
+        }
+      }
+      int c_start = class_id * channels_each_class;
+      for (int c = c_start; c < c_start + channels_each_class; ++c) {
+        T *out_offset = out_data + (n * output_dim + c) * pooled_dim;
+        for (int ph = 0; ph < pooled_size; ++ph) {
+          int gh = std::min(std::max(ph * group_size / pooled_size, 0),
+                            group_size - 1);
+          for (int pw = 0; pw < pooled_size; ++pw) {
+            int gw = std::min(std::max(pw * group_size / pooled_size, 0),
+                              group_size - 1);
+            int c_in = (c * group_size + gh) * group_size + gw;
+            const T *in_offset = batch_in_data + c_in * spatial_dim;
+            int bin_offset = 4 * (ph * pooled_size + pw) * num_samples;
+            const int *index = sample_index.data() + bin_offset;
+            const T *weight = sample_weight.data() + bin_offset;
+            auto sum_val = T(0);
+            for (int i = 0; i < 4 * num_samples; ++i) {
+              sum_val += weight[i] * in_offset[index[i]];
             }
+            out_offset[ph * pooled_size + pw] = sum_val;
           }
-          int pool_index = (c * pooled_size + ph) * pooled_size + pw;
-          batch_out_data[pool_index] = count == 0 ? T(0) : sum_val / count;
         }
       }
     }
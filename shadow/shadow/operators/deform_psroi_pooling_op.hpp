@@ -26,6 +26,8 @@ class DeformPSROIPoolingOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
 
  private:
   int output_dim_, group_size_, pooled_size_, part_size_, sample_per_part_;
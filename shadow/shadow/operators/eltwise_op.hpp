@@ -15,6 +15,10 @@ class EltwiseOp : public Operator {
 
   void Forward() override;
 
+  double flops() const override {
+    return (bottoms_size() - 1.0) * tops<float>(0)->count();
+  }
+
  private:
   enum { kProd = 0, kSum = 1, kMax = 2, kMin = 3 };
 
@@ -8,29 +8,31 @@ void FlattenOp::Forward() {
 
   CHECK_NE(bottom, top);
 
-  int num_axes = bottom->num_axes();
-  if (end_axis_ == -1) {
-    end_axis_ = num_axes - 1;
-  }
-  CHECK_LT(end_axis_, num_axes);
-  CHECK_LE(axis_, end_axis_);
-
-  VecInt top_shape;
-  for (int d = 0; d < axis_; ++d) {
-    top_shape.push_back(bottom->shape(d));
-  }
-  top_shape.push_back(bottom->count(axis_, end_axis_ + 1));
-  for (int d = end_axis_ + 1; d < bottom->num_axes(); ++d) {
-    top_shape.push_back(bottom->shape(d));
-  }
-
   top->clear();
-  top->set_shape(top_shape);
+  top->set_shape(TopShape(bottom->shape()));
   CHECK_EQ(top->count(), bottom->count());
 
   top->share_data(*bottom);
 }
 
+void FlattenOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                            std::vector<VecInt> *top_shapes) const {
+  (*top_shapes)[0] = TopShape(bottom_shapes[0]);
+}
+
+VecInt FlattenOp::TopShape(const VecInt &bottom_shape) const {
+  int num_axes = static_cast<int>(bottom_shape.size());
+  int end_axis = end_axis_ == -1 ? num_axes - 1 : end_axis_;
+  CHECK_LT(end_axis, num_axes);
+  CHECK_LE(axis_, end_axis);
+
+  VecInt top_shape(bottom_shape.begin(), bottom_shape.begin() + axis_);
+  top_shape.push_back(count_of(bottom_shape, axis_, end_axis + 1));
+  top_shape.insert(top_shape.end(), bottom_shape.begin() + end_axis + 1,
+                   bottom_shape.end());
+  return top_shape;
+}
+
 REGISTER_OPERATOR(Flatten, FlattenOp);
 
 }  // namespace Shadow
@@ -15,8 +15,12 @@ class FlattenOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
 
  private:
+  VecInt TopShape(const VecInt &bottom_shape) const;
+
   int axis_, end_axis_;
 };
 
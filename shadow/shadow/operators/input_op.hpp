@@ -10,10 +10,17 @@ class InputOp : public Operator {
   explicit InputOp(const shadow::OpParam &op_param, Workspace *ws)
       : Operator(op_param, ws) {
     for (int n = 0; n < tops_size(); ++n) {
-      auto *top = mutable_tops<float>(n);
-      const auto &top_name = top->name();
-      if (has_argument(top_name)) {
-        top->reshape(get_repeated_argument<int>(top_name, VecInt{}));
+      const auto &top_name = tops_name(n);
+      if (!has_argument(top_name)) continue;
+      const auto &shape = get_repeated_argument<int>(top_name, VecInt{});
+      // Image inputs may be fed as raw bytes, see PreprocessOp
+      const auto &top_type = tops_type(n);
+      if (top_type == uchar_id) {
+        mutable_tops<unsigned char>(n)->reshape(shape);
+      } else if (top_type == int_id) {
+        mutable_tops<int>(n)->reshape(shape);
+      } else {
+        mutable_tops<float>(n)->reshape(shape);
       }
     }
   }
@@ -11,12 +11,18 @@ void LRNOp::Forward() {
   }
 
   op_ws_->GrowTempBuffer(bottom->count(), sizeof(float));
-  scale_ = op_ws_->CreateTempBlob<float>(bottom->shape(), op_name_ + "_scale");
+  op_ws_->CreateTempBlob<float>(bottom->shape(), &scale_);
 
   Vision::LRN(bottom->data(), bottom->shape(), size_, alpha_, beta_, k_,
               scale_->mutable_data(), top->mutable_data());
 }
 
+void LRNOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                        std::vector<VecInt> *top_shapes) const {
+  (*top_shapes)[0] = bottom_shapes[0];
+  op_ws_->PlanTemp(count_of(bottom_shapes[0]), sizeof(float));
+}
+
 REGISTER_OPERATOR(LRN, LRNOp);
 
 namespace Vision {
@@ -20,6 +20,13 @@ class LRNOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
+
+  // A multiply add per channel of the window
+  double flops() const override {
+    return 2.0 * size_ * tops<float>(0)->count();
+  }
 
  private:
   int size_, norm_region_;
@@ -9,78 +9,125 @@ void NormalizeOp::Forward() {
   const auto *scale = bottoms<float>(1);
   auto *top = mutable_tops<float>(0);
 
-  int batch = bottom->shape(0), in_c = bottom->shape(1),
-      in_h = bottom->shape(2), in_w = bottom->shape(3);
-  int num = bottom->num(), spatial_dim = in_h * in_w;
-
-  top->reshape(bottom->shape());
-
-  int temp_count = in_c * spatial_dim;
-  if (!across_spatial_) {
-    temp_count += spatial_dim;
-    temp_count += in_c;
+  CHECK_GE(bottom->num_axes(), 2);
+  if (channel_shared_) {
+    CHECK_EQ(scale->count(), 1);
+  } else {
+    CHECK_EQ(scale->count(), bottom->shape(1));
   }
-  if (!channel_shared_) {
-    temp_count += spatial_dim;
+
+  if (bottom != top) {
+    top->reshape(bottom->shape());
   }
-  op_ws_->GrowTempBuffer(temp_count, sizeof(float));
-
-  if (!across_spatial_) {
-    norm_ =
-        op_ws_->CreateTempBlob<float>({1, 1, in_h, in_w}, op_name_ + "_norm");
-    sum_channel_multiplier_ = op_ws_->CreateTempBlob<float>(
-        {1, in_c, 1, 1}, op_name_ + "_sum_channel_multiplier");
-    Blas::Set(in_c, 1, sum_channel_multiplier_->mutable_data(), 0);
+
+  int batch = bottom->shape(0), spatial_dim = bottom->count(2);
+  int norm_count = across_spatial_ ? batch : batch * spatial_dim;
+
+  op_ws_->GrowTempBuffer(norm_count, sizeof(float));
+
+  op_ws_->CreateTempBlob<float>({norm_count}, &norm_);
+
+  Vision::Normalize(bottom->data(), bottom->shape(), across_spatial_,
+                    channel_shared_, scale->data(), norm_->mutable_data(),
+                    top->mutable_data());
+}
+
+void NormalizeOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                              std::vector<VecInt> *top_shapes) const {
+  const auto &in_shape = bottom_shapes[0];
+  (*top_shapes)[0] = in_shape;
+
+  int batch = in_shape[0], spatial_dim = count_of(in_shape, 2);
+  int norm_count = across_spatial_ ? batch : batch * spatial_dim;
+  op_ws_->PlanTemp(norm_count, sizeof(float));
+}
+
+REGISTER_OPERATOR(Normalize, NormalizeOp);
+
+namespace Vision {
+
+#if !defined(USE_CUDA)
+// Eight partial sums the compiler keeps in one vector register
+template <typename T>
+inline T SumSquares(const T *data, int count) {
+  T partial[8] = {T(0)};
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    for (int k = 0; k < 8; ++k) {
+      partial[k] += data[i + k] * data[i + k];
+    }
   }
+  T sum = T(0);
+  for (; i < count; ++i) sum += data[i] * data[i];
+  for (int k = 0; k < 8; ++k) sum += partial[k];
+  return sum;
+}
 
-  if (!channel_shared_) {
-    sum_spatial_multiplier_ = op_ws_->CreateTempBlob<float>(
-        {1, 1, in_h, in_w}, op_name_ + "_sum_spatial_multiplier");
-    Blas::Set(spatial_dim, 1, sum_spatial_multiplier_->mutable_data(), 0);
+template <typename T>
+void Normalize(const T *in_data, const VecInt &in_shape, bool across_spatial,
+               bool channel_shared, const T *scale_data, T *norm_data,
+               T *out_data) {
+  int batch = in_shape[0], channels = in_shape[1], spatial_dim = 1;
+  for (int i = 2; i < static_cast<int>(in_shape.size()); ++i) {
+    spatial_dim *= in_shape[i];
   }
+  int num = channels * spatial_dim;
 
-  buffer_ = op_ws_->CreateTempBlob<float>({1, in_c, in_h, in_w},
-                                          op_name_ + "_buffer");
+  // Columns are normalized in blocks, so the scaling pass rereads the block
+  // of every channel from cache rather than from memory
+  const int block = 128;
+  int num_blocks = (spatial_dim + block - 1) / block;
 
   for (int b = 0; b < batch; ++b) {
-    int data_offset = b * num;
-    Blas::Square(num, bottom->data(), data_offset, buffer_->mutable_data(), 0);
-    if (across_spatial_) {
-      float sum = 0;
-      Blas::BlasSasum(num, buffer_->data(), 0, &sum,
-                      op_ws_->Ctx()->blas_handle());
-      float norm = std::sqrt(sum + EPS);
-      Blas::Mul(num, bottom->data(), data_offset, 1.f / norm,
-                top->mutable_data(), data_offset);
-    } else {
-      Blas::Set(norm_->count(), EPS, norm_->mutable_data(), 0);
-      Blas::BlasSgemv(1, in_c, spatial_dim, 1, buffer_->data(), 0,
-                      sum_channel_multiplier_->data(), 0, 1,
-                      norm_->mutable_data(), 0, op_ws_->Ctx()->blas_handle());
-      Blas::Pow(spatial_dim, norm_->data(), 0, 0.5f, norm_->mutable_data(), 0);
-      Blas::BlasSgemm(0, 0, in_c, spatial_dim, 1, 1,
-                      sum_channel_multiplier_->data(), 0, norm_->data(), 0, 0,
-                      buffer_->mutable_data(), 0, op_ws_->Ctx()->blas_handle());
-      Blas::Div(num, bottom->data(), data_offset, buffer_->data(), 0,
-                top->mutable_data(), data_offset);
-    }
-    if (channel_shared_) {
-      CHECK_EQ(scale->count(), 1);
-      float scale_data = 1;
-      scale->read_data(&scale_data, 1);
-      Blas::BlasSscal(num, scale_data, top->mutable_data(), data_offset,
-                      op_ws_->Ctx()->blas_handle());
+    const T *in_b = in_data + b * num;
+    T *out_b = out_data + b * num;
+    if (across_spatial) {
+      norm_data[b] = 1 / std::sqrt(SumSquares(in_b, num) + T(EPS));
+#if defined(USE_OpenMP)
+#pragma omp parallel for
+#endif
+      for (int c = 0; c < channels; ++c) {
+        T multiplier = norm_data[b] * scale_data[channel_shared ? 0 : c];
+        const T *in_c = in_b + c * spatial_dim;
+        T *out_c = out_b + c * spatial_dim;
+        for (int s = 0; s < spatial_dim; ++s) {
+          out_c[s] = in_c[s] * multiplier;
+        }
+      }
     } else {
-      CHECK_EQ(scale->count(), in_c);
-      Blas::BlasSgemm(0, 0, in_c, spatial_dim, 1, 1, scale->data(), 0,
-                      sum_spatial_multiplier_->data(), 0, 0,
-                      buffer_->mutable_data(), 0, op_ws_->Ctx()->blas_handle());
-      Blas::Mul(num, top->data(), data_offset, buffer_->data(), 0,
-                top->mutable_data(), data_offset);
+#if defined(USE_OpenMP)
+#pragma omp parallel for
+#endif
+      for (int n = 0; n < num_blocks; ++n) {
+        int s_start = n * block, s_len = std::min(block, spatial_dim - s_start);
+        T *norm = norm_data + b * spatial_dim + s_start;
+        for (int s = 0; s < s_len; ++s) norm[s] = T(EPS);
+        for (int c = 0; c < channels; ++c) {
+          const T *in_c = in_b + c * spatial_dim + s_start;
+          for (int s = 0; s < s_len; ++s) {
+            norm[s] += in_c[s] * in_c[s];
+          }
+        }
+        for (int s = 0; s < s_len; ++s) norm[s] = 1 / std::sqrt(norm[s]);
+        for (int c = 0; c < channels; ++c) {
+          T multiplier = scale_data[channel_shared ? 0 : c];
+          const T *in_c = in_b + c * spatial_dim + s_start;
+          T *out_c = out_b + c * spatial_dim + s_start;
+          for (int s = 0; s < s_len; ++s) {
+            out_c[s] = in_c[s] * norm[s] * multiplier;
+          }
+        }
+      }
     }
   }
 }
 
-REGISTER_OPERATOR(Normalize, NormalizeOp);
+template void Normalize(const float *in_data, const VecInt &in_shape,
+                        bool across_spatial, bool channel_shared,
+                        const float *scale_data, float *norm_data,
+                        float *out_data);
+#endif
+
+}  // namespace Vision
 
 }  // namespace Shadow
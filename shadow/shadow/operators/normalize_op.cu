@@ -0,0 +1,88 @@
+#include "normalize_op.hpp"
+
+namespace Shadow {
+
+namespace Vision {
+
+#if defined(USE_CUDA)
+template <typename T>
+__global__ void KernelChannelNorm(const T *in_data, int count, int channels,
+                                  int spatial_dim, float eps, T *norm_data) {
+  CUDA_KERNEL_LOOP(globalid, count) {
+    int b = globalid / spatial_dim, s = globalid % spatial_dim;
+    const T *in_offset_data = in_data + b * channels * spatial_dim + s;
+    auto sum = T(eps);
+    for (int c = 0; c < channels; ++c, in_offset_data += spatial_dim) {
+      sum += *in_offset_data * *in_offset_data;
+    }
+    norm_data[globalid] = rsqrt(sum);
+  }
+}
+
+// One block per sample, reducing the sum of squares in shared memory
+template <typename T>
+__global__ void KernelSpatialNorm(const T *in_data, int num, float eps,
+                                  T *norm_data) {
+  __shared__ T buffer[NumThreads];
+  const T *in_offset_data = in_data + blockIdx.x * num;
+  auto sum = T(0);
+  for (int i = threadIdx.x; i < num; i += blockDim.x) {
+    sum += in_offset_data[i] * in_offset_data[i];
+  }
+  buffer[threadIdx.x] = sum;
+  __syncthreads();
+  for (int stride = blockDim.x / 2; stride > 0; stride >>= 1) {
+    if (threadIdx.x < stride) {
+      buffer[threadIdx.x] += buffer[threadIdx.x + stride];
+    }
+    __syncthreads();
+  }
+  if (threadIdx.x == 0) {
+    norm_data[blockIdx.x] = rsqrt(buffer[0] + T(eps));
+  }
+}
+
+template <typename T>
+__global__ void KernelNormalizeScale(const T *in_data, int count, int channels,
+                                     int spatial_dim, bool across_spatial,
+                                     bool channel_shared, const T *scale_data,
+                                     const T *norm_data, T *out_data) {
+  CUDA_KERNEL_LOOP(globalid, count) {
+    int s = globalid % spatial_dim, temp = globalid / spatial_dim;
+    int c = temp % channels, b = temp / channels;
+    T norm = across_spatial ? norm_data[b] : norm_data[b * spatial_dim + s];
+    out_data[globalid] =
+        in_data[globalid] * norm * scale_data[channel_shared ? 0 : c];
+  }
+}
+
+template <typename T>
+void Normalize(const T *in_data, const VecInt &in_shape, bool across_spatial,
+               bool channel_shared, const T *scale_data, T *norm_data,
+               T *out_data) {
+  int batch = in_shape[0], channels = in_shape[1], spatial_dim = 1;
+  for (int i = 2; i < in_shape.size(); ++i) spatial_dim *= in_shape[i];
+  int count = batch * channels * spatial_dim;
+  if (across_spatial) {
+    KernelSpatialNorm<T><<<batch, NumThreads>>>(in_data, channels * spatial_dim,
+                                                EPS, norm_data);
+  } else {
+    int norm_count = batch * spatial_dim;
+    KernelChannelNorm<T><<<GetBlocks(norm_count), NumThreads>>>(
+        in_data, norm_count, channels, spatial_dim, EPS, norm_data);
+  }
+  KernelNormalizeScale<T><<<GetBlocks(count), NumThreads>>>(
+      in_data, count, channels, spatial_dim, across_spatial, channel_shared,
+      scale_data, norm_data, out_data);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+template void Normalize(const float *in_data, const VecInt &in_shape,
+                        bool across_spatial, bool channel_shared,
+                        const float *scale_data, float *norm_data,
+                        float *out_data);
+#endif
+
+}  // namespace Vision
+
+}  // namespace Shadow
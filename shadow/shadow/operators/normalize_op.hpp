@@ -14,14 +14,32 @@ class NormalizeOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
+
+  // Square, sum and scale
+  double flops() const override {
+    return 3.0 * tops<float>(0)->count();
+  }
 
  private:
   bool across_spatial_, channel_shared_;
 
-  BlobF *norm_ = nullptr, *buffer_ = nullptr;
-  BlobF *sum_channel_multiplier_ = nullptr, *sum_spatial_multiplier_ = nullptr;
+  BlobF *norm_ = nullptr;
 };
 
+namespace Vision {
+
+// Two passes over the input: the inverse l2 norm across channels of each
+// position (or of each whole sample when across_spatial) goes to norm_data,
+// then the input is scaled by it and by the learned scale
+template <typename T>
+void Normalize(const T *in_data, const VecInt &in_shape, bool across_spatial,
+               bool channel_shared, const T *scale_data, T *norm_data,
+               T *out_data);
+
+}  // namespace Vision
+
 }  // namespace Shadow
 
 #endif  // SHADOW_OPERATORS_NORMALIZE_OP_HPP
@@ -11,36 +11,116 @@ void PermuteOp::Forward() {
   int num_axes = static_cast<int>(permute_order_data_.size());
   CHECK_EQ(num_axes, bottom->num_axes());
 
-  VecInt top_shape, old_steps(num_axes), new_steps(num_axes);
+  VecInt top_shape;
   for (const auto &order : permute_order_data_) {
     top_shape.push_back(bottom->shape(order));
   }
   top->reshape(top_shape);
 
+  if (bottom->shape() != bottom_shape_) {
+    SetupPermute(bottom->shape());
+    bottom_shape_ = bottom->shape();
+  }
+
+  if (reduced_order_.size() <= 1) {
+    Blas::BlasScopy(bottom->count(), bottom->data(), 0, top->mutable_data(), 0,
+                    op_ws_->Ctx()->blas_handle());
+  } else if (transpose_batch_ > 0) {
+    Vision::PermuteTranspose(bottom->data(), transpose_batch_, transpose_rows_,
+                             transpose_cols_, top->mutable_data());
+  } else {
+    Vision::Permute(bottom->data(), bottom->count(),
+                    static_cast<int>(reduced_order_.size()),
+                    permute_order_->data(), old_steps_->data(),
+                    new_steps_->data(), top->mutable_data());
+  }
+}
+
+void PermuteOp::SetupPermute(const VecInt &bottom_shape) {
+  int num_axes = static_cast<int>(permute_order_data_.size());
+
+  // Drop unit axes, they never change the memory order
+  VecInt axis_map(num_axes, -1), dims, order;
   for (int d = 0; d < num_axes; ++d) {
-    if (d == num_axes - 1) {
-      old_steps[d] = 1;
-      new_steps[d] = 1;
+    if (bottom_shape[d] != 1) {
+      axis_map[d] = static_cast<int>(dims.size());
+      dims.push_back(bottom_shape[d]);
+    }
+  }
+  for (const auto axis : permute_order_data_) {
+    CHECK_GE(axis, 0);
+    CHECK_LT(axis, num_axes);
+    if (axis_map[axis] >= 0) {
+      order.push_back(axis_map[axis]);
+    }
+  }
+
+  // Merge output axes whose source axes are also adjacent in the input
+  std::vector<VecInt> runs;
+  for (int i = 0; i < static_cast<int>(order.size()); ++i) {
+    if (i > 0 && order[i] == order[i - 1] + 1) {
+      runs.back().push_back(order[i]);
     } else {
-      old_steps[d] = bottom->count(d + 1);
-      new_steps[d] = top->count(d + 1);
+      runs.push_back({order[i]});
+    }
+  }
+
+  int num_runs = static_cast<int>(runs.size());
+  reduced_shape_.assign(num_runs, 1);
+  reduced_order_.assign(num_runs, 0);
+  for (int i = 0; i < num_runs; ++i) {
+    int rank = 0;
+    for (const auto &run : runs) {
+      rank += run.front() < runs[i].front();
+    }
+    reduced_order_[i] = rank;
+    for (const auto axis : runs[i]) {
+      reduced_shape_[rank] *= dims[axis];
     }
   }
 
-  op_ws_->GrowTempBuffer(3 * num_axes, sizeof(int));
+  transpose_batch_ = 0, transpose_rows_ = 0, transpose_cols_ = 0;
+  if (reduced_order_ == VecInt{1, 0}) {
+    transpose_batch_ = 1;
+    transpose_rows_ = reduced_shape_[0];
+    transpose_cols_ = reduced_shape_[1];
+  } else if (reduced_order_ == VecInt{0, 2, 1}) {
+    transpose_batch_ = reduced_shape_[0];
+    transpose_rows_ = reduced_shape_[1];
+    transpose_cols_ = reduced_shape_[2];
+  }
+
+  if (num_runs <= 1 || transpose_batch_ > 0) return;
+
+  VecInt old_steps(num_runs, 1), new_steps(num_runs, 1);
+  for (int d = num_runs - 2; d >= 0; --d) {
+    old_steps[d] = old_steps[d + 1] * reduced_shape_[d + 1];
+    new_steps[d] = new_steps[d + 1] * reduced_shape_[reduced_order_[d + 1]];
+  }
+
+  permute_order_ = op_ws_->CreateBlob<int>(op_name_ + "_permute_order");
+  old_steps_ = op_ws_->CreateBlob<int>(op_name_ + "_old_steps");
+  new_steps_ = op_ws_->CreateBlob<int>(op_name_ + "_new_steps");
 
-  permute_order_ =
-      op_ws_->CreateTempBlob<int>({num_axes}, op_name_ + "_permute_order");
-  old_steps_ = op_ws_->CreateTempBlob<int>({num_axes}, op_name_ + "_old_steps");
-  new_steps_ = op_ws_->CreateTempBlob<int>({num_axes}, op_name_ + "_new_steps");
+  permute_order_->reshape({num_runs});
+  old_steps_->reshape({num_runs});
+  new_steps_->reshape({num_runs});
 
-  permute_order_->set_data(permute_order_data_.data(), num_axes);
-  old_steps_->set_data(old_steps.data(), num_axes);
-  new_steps_->set_data(new_steps.data(), num_axes);
+  permute_order_->set_data(reduced_order_.data(), num_runs);
+  old_steps_->set_data(old_steps.data(), num_runs);
+  new_steps_->set_data(new_steps.data(), num_runs);
+}
 
-  Vision::Permute(bottom->data(), bottom->count(), bottom->num_axes(),
-                  permute_order_->data(), old_steps_->data(),
-                  new_steps_->data(), top->mutable_data());
+void PermuteOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                            std::vector<VecInt> *top_shapes) const {
+  const auto &in_shape = bottom_shapes[0];
+  int num_axes = static_cast<int>(in_shape.size());
+  CHECK_EQ(static_cast<int>(permute_order_data_.size()), num_axes);
+  VecInt top_shape;
+  for (const auto order : permute_order_data_) {
+    top_shape.push_back(in_shape[order < 0 ? order + num_axes : order]);
+  }
+  (*top_shapes)[0] = top_shape;
 }
 
 REGISTER_OPERATOR(Permute, PermuteOp);
@@ -52,21 +132,55 @@ template <typename T, typename Dtype>
 void Permute(const T *in_data, int count, int num_axes,
              const Dtype *permute_order, const Dtype *old_steps,
              const Dtype *new_steps, T *out_data) {
-  for (int i = 0; i < count; ++i) {
+  // Resolve the source offset once per output row, the innermost output axis
+  // is then a constant stride walk over the input
+  int inner_num = num_axes > 1 ? new_steps[num_axes - 2] : count;
+  int inner_step = old_steps[permute_order[num_axes - 1]];
+  for (int i = 0; i < count; i += inner_num) {
     int old_idx = 0;
     int idx = i;
-    for (int j = 0; j < num_axes; ++j) {
+    for (int j = 0; j < num_axes - 1; ++j) {
       int order = permute_order[j];
       old_idx += (idx / new_steps[j]) * old_steps[order];
       idx %= new_steps[j];
     }
-    out_data[i] = in_data[old_idx];
+    const T *in_row = in_data + old_idx;
+    T *out_row = out_data + i;
+    for (int k = 0; k < inner_num; ++k) {
+      out_row[k] = in_row[k * inner_step];
+    }
+  }
+}
+
+template <typename T>
+void PermuteTranspose(const T *in_data, int batch, int rows, int cols,
+                      T *out_data) {
+  // Cache blocked transpose, one block of input rows and output rows both
+  // stay resident while it is moved
+  const int block = 32;
+  for (int b = 0; b < batch; ++b) {
+    const T *in_b = in_data + b * rows * cols;
+    T *out_b = out_data + b * rows * cols;
+    for (int r0 = 0; r0 < rows; r0 += block) {
+      int r1 = std::min(r0 + block, rows);
+      for (int c0 = 0; c0 < cols; c0 += block) {
+        int c1 = std::min(c0 + block, cols);
+        for (int r = r0; r < r1; ++r) {
+          const T *in_row = in_b + r * cols;
+          for (int c = c0; c < c1; ++c) {
+            out_b[c * rows + r] = in_row[c];
+          }
+        }
+      }
+    }
   }
 }
 
 template void Permute(const float *in_data, int count, int num_axes,
                       const int *permute_order, const int *old_steps,
                       const int *new_steps, float *out_data);
+template void PermuteTranspose(const float *in_data, int batch, int rows,
+                               int cols, float *out_data);
 #endif
 }  // namespace Vision
 
@@ -30,9 +30,51 @@ void Permute(const T *in_data, int count, int num_axes,
   CUDA_CHECK(cudaPeekAtLastError());
 }
 
+#define TILE_DIM 32
+#define BLOCK_ROWS 8
+
+template <typename T>
+__global__ void KernelPermuteTranspose(const T *in_data, int batch, int rows,
+                                       int cols, T *out_data) {
+  __shared__ T tile[TILE_DIM][TILE_DIM + 1];
+  for (int b = blockIdx.z; b < batch; b += gridDim.z) {
+    const T *in_b = in_data + b * rows * cols;
+    T *out_b = out_data + b * rows * cols;
+    int x = blockIdx.x * TILE_DIM + threadIdx.x;
+    int y = blockIdx.y * TILE_DIM + threadIdx.y;
+    for (int j = 0; j < TILE_DIM; j += BLOCK_ROWS) {
+      if (x < cols && y + j < rows) {
+        tile[threadIdx.y + j][threadIdx.x] = in_b[(y + j) * cols + x];
+      }
+    }
+    __syncthreads();
+    x = blockIdx.y * TILE_DIM + threadIdx.x;
+    y = blockIdx.x * TILE_DIM + threadIdx.y;
+    for (int j = 0; j < TILE_DIM; j += BLOCK_ROWS) {
+      if (x < rows && y + j < cols) {
+        out_b[(y + j) * rows + x] = tile[threadIdx.x][threadIdx.y + j];
+      }
+    }
+    __syncthreads();
+  }
+}
+
+template <typename T>
+void PermuteTranspose(const T *in_data, int batch, int rows, int cols,
+                      T *out_data) {
+  dim3 grid((cols + TILE_DIM - 1) / TILE_DIM, (rows + TILE_DIM - 1) / TILE_DIM,
+            std::min(batch, 65535));
+  dim3 block(TILE_DIM, BLOCK_ROWS);
+  KernelPermuteTranspose<T><<<grid, block>>>(in_data, batch, rows, cols,
+                                             out_data);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
 template void Permute(const float *in_data, int count, int num_axes,
                       const int *permute_order, const int *old_steps,
                       const int *new_steps, float *out_data);
+template void PermuteTranspose(const float *in_data, int batch, int rows,
+                               int cols, float *out_data);
 #endif
 
 }  // namespace Vision
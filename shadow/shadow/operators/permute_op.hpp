@@ -13,9 +13,18 @@ class PermuteOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
 
  private:
-  VecInt permute_order_data_;
+  void SetupPermute(const VecInt &bottom_shape);
+
+  VecInt permute_order_data_, bottom_shape_;
+
+  // Permutation after dropping unit axes and merging axes that stay
+  // adjacent, the common layout changes reduce to a (batched) transpose
+  VecInt reduced_shape_, reduced_order_;
+  int transpose_batch_ = 0, transpose_rows_ = 0, transpose_cols_ = 0;
 
   BlobI *permute_order_ = nullptr, *old_steps_ = nullptr, *new_steps_ = nullptr;
 };
@@ -27,6 +36,10 @@ void Permute(const T *in_data, int count, int num_axes,
              const Dtype *permute_order, const Dtype *old_steps,
              const Dtype *new_steps, T *out_data);
 
+template <typename T>
+void PermuteTranspose(const T *in_data, int batch, int rows, int cols,
+                      T *out_data);
+
 }  // namespace Vision
 
 }  // namespace Shadow
@@ -60,8 +60,17 @@ class PoolingOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
+
+  double flops() const override {
+    return static_cast<double>(tops<float>(0)->count()) * kernel_size_h_ *
+           kernel_size_w_;
+  }
 
  private:
+  VecInt TopShape(const VecInt &bottom_shape) const;
+
   int pool_type_, kernel_size_h_, kernel_size_w_, stride_h_, stride_w_, pad_h_,
       pad_w_;
   bool global_pooling_, full_pooling_;
@@ -0,0 +1,178 @@
+#include "preprocess_op.hpp"
+
+namespace Shadow {
+
+void PreprocessOp::Forward() {
+  const auto *bottom = bottoms<unsigned char>(0);
+  auto *top = mutable_tops<float>(0);
+
+  CHECK_EQ(bottom->num_axes(), 4)
+      << op_name_ << ": expects a batch of images, got "
+      << Util::format_vector(bottom->shape(), ",", "(", ")");
+
+  int batch = bottom->shape(0);
+  int in_c = bottom->shape(channel_last_ ? 3 : 1);
+  int in_h = bottom->shape(channel_last_ ? 1 : 2);
+  int in_w = bottom->shape(channel_last_ ? 2 : 3);
+
+  if (in_c != in_channels_) {
+    SetupTransform(in_c);
+    in_channels_ = in_c;
+  }
+
+  top->reshape({batch, out_channels_, in_h, in_w});
+
+  Vision::Preprocess(bottom->data(), bottom->shape(), channel_last_,
+                     channel_order_->data(), channel_transform_->data(),
+                     out_channels_, top->mutable_data());
+}
+
+void PreprocessOp::SetupTransform(int in_channels) {
+  VecInt order = channel_order_data_;
+  if (order.empty()) {
+    for (int c = 0; c < in_channels; ++c) order.push_back(c);
+  }
+  for (const auto c : order) {
+    CHECK_GE(c, 0);
+    CHECK_LT(c, in_channels) << op_name_ << ": channel order out of range";
+  }
+  out_channels_ = static_cast<int>(order.size());
+
+  auto per_channel = [&](const VecFloat &values, float default_value) {
+    if (values.empty()) return VecFloat(out_channels_, default_value);
+    if (values.size() == 1) return VecFloat(out_channels_, values[0]);
+    CHECK_EQ(static_cast<int>(values.size()), out_channels_);
+    return values;
+  };
+  const auto &mean = per_channel(mean_value_, 0);
+  const auto &scale = per_channel(scale_value_, 1);
+
+  VecFloat transform(2 * out_channels_);
+  for (int c = 0; c < out_channels_; ++c) {
+    transform[c] = scale[c];
+    transform[out_channels_ + c] = -mean[c] * scale[c];
+  }
+
+  channel_order_ = op_ws_->CreateBlob<int>(op_name_ + "_channel_order");
+  channel_transform_ =
+      op_ws_->CreateBlob<float>(op_name_ + "_channel_transform");
+  channel_order_->reshape({out_channels_});
+  channel_transform_->reshape({2 * out_channels_});
+  channel_order_->set_data(order.data(), out_channels_);
+  channel_transform_->set_data(transform.data(), 2 * out_channels_);
+}
+
+void PreprocessOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                               std::vector<VecInt> *top_shapes) const {
+  const auto &in_shape = bottom_shapes[0];
+  CHECK_EQ(static_cast<int>(in_shape.size()), 4);
+  int in_c = in_shape[channel_last_ ? 3 : 1];
+  int out_c = channel_order_data_.empty()
+                  ? in_c
+                  : static_cast<int>(channel_order_data_.size());
+  (*top_shapes)[0] = {in_shape[0], out_c, in_shape[channel_last_ ? 1 : 2],
+                      in_shape[channel_last_ ? 2 : 3]};
+}
+
+REGISTER_OPERATOR(Preprocess, PreprocessOp);
+
+namespace Vision {
+
+#if !defined(USE_CUDA)
+// Pixel major over interleaved channels, the loads at fixed channel offsets
+// are deinterleaved by the vectorizer and each top plane is a plain stream.
+// Source channel c goes to plane out_planes[c], so the order must be a
+// permutation
+template <typename T, int kChannels>
+inline void PreprocessPixels(const unsigned char *in_data, int count,
+                             T *const *out_planes, const float *scale,
+                             const float *bias) {
+  for (int i = 0; i < count; ++i) {
+    const auto *pixel = in_data + i * kChannels;
+    for (int c = 0; c < kChannels; ++c) {
+      out_planes[c][i] = pixel[c] * scale[c] + bias[c];
+    }
+  }
+}
+
+template <typename T, int kChannels>
+inline bool PreprocessPermuted(const unsigned char *in_data, int count,
+                               const int *channel_order, const float *scale,
+                               const float *bias, int plane, T *out_data) {
+  T *out_planes[kChannels] = {nullptr};
+  float a[kChannels], b[kChannels];
+  for (int c = 0; c < kChannels; ++c) {
+    int src = channel_order[c];
+    if (out_planes[src] != nullptr) return false;
+    out_planes[src] = out_data + c * plane, a[src] = scale[c], b[src] = bias[c];
+  }
+  PreprocessPixels<T, kChannels>(in_data, count, out_planes, a, b);
+  return true;
+}
+
+template <typename T>
+void Preprocess(const unsigned char *in_data, const VecInt &in_shape,
+                bool channel_last, const int *channel_order,
+                const float *channel_transform, int out_channels,
+                T *out_data) {
+  int batch = in_shape[0], in_c = in_shape[channel_last ? 3 : 1];
+  int in_h = in_shape[channel_last ? 1 : 2];
+  int in_w = in_shape[channel_last ? 2 : 3], spatial_dim = in_h * in_w;
+  const auto *scale = channel_transform;
+  const auto *bias = channel_transform + out_channels;
+
+  if (!channel_last) {
+#if defined(USE_OpenMP)
+#pragma omp parallel for
+#endif
+    for (int nc = 0; nc < batch * out_channels; ++nc) {
+      int b = nc / out_channels, c = nc % out_channels;
+      const auto *in_plane =
+          in_data + (b * in_c + channel_order[c]) * spatial_dim;
+      auto *out_plane = out_data + nc * spatial_dim;
+      float a_c = scale[c], b_c = bias[c];
+      for (int i = 0; i < spatial_dim; ++i) {
+        out_plane[i] = in_plane[i] * a_c + b_c;
+      }
+    }
+    return;
+  }
+
+  // Rows of pixels, so a single image still spreads over the threads
+#if defined(USE_OpenMP)
+#pragma omp parallel for
+#endif
+  for (int row = 0; row < batch * in_h; ++row) {
+    int b = row / in_h, h = row % in_h;
+    const auto *in_row = in_data + row * in_w * in_c;
+    auto *out_row = out_data + b * out_channels * spatial_dim + h * in_w;
+    bool done = false;
+    if (in_c == 3 && out_channels == 3) {
+      done = PreprocessPermuted<T, 3>(in_row, in_w, channel_order, scale,
+                                      bias, spatial_dim, out_row);
+    } else if (in_c == 4 && out_channels == 4) {
+      done = PreprocessPermuted<T, 4>(in_row, in_w, channel_order, scale,
+                                      bias, spatial_dim, out_row);
+    }
+    if (!done) {
+      for (int c = 0; c < out_channels; ++c) {
+        const auto *in_col = in_row + channel_order[c];
+        auto *out_col = out_row + c * spatial_dim;
+        float a_c = scale[c], b_c = bias[c];
+        for (int w = 0; w < in_w; ++w) {
+          out_col[w] = in_col[w * in_c] * a_c + b_c;
+        }
+      }
+    }
+  }
+}
+
+template void Preprocess(const unsigned char *in_data, const VecInt &in_shape,
+                         bool channel_last, const int *channel_order,
+                         const float *channel_transform, int out_channels,
+                         float *out_data);
+#endif
+
+}  // namespace Vision
+
+}  // namespace Shadow
@@ -0,0 +1,49 @@
+#include "preprocess_op.hpp"
+
+namespace Shadow {
+
+namespace Vision {
+
+#if defined(USE_CUDA)
+template <typename T>
+__global__ void KernelPreprocess(const unsigned char *in_data, int count,
+                                 int in_c, int spatial_dim, bool channel_last,
+                                 const int *channel_order,
+                                 const float *channel_transform,
+                                 int out_channels, T *out_data) {
+  CUDA_KERNEL_LOOP(globalid, count) {
+    int i = globalid % spatial_dim;
+    int c = (globalid / spatial_dim) % out_channels;
+    int b = globalid / spatial_dim / out_channels;
+    int src_c = channel_order[c];
+    int in_index = channel_last ? (b * spatial_dim + i) * in_c + src_c
+                                : (b * in_c + src_c) * spatial_dim + i;
+    out_data[globalid] = in_data[in_index] * channel_transform[c] +
+                         channel_transform[out_channels + c];
+  }
+}
+
+template <typename T>
+void Preprocess(const unsigned char *in_data, const VecInt &in_shape,
+                bool channel_last, const int *channel_order,
+                const float *channel_transform, int out_channels,
+                T *out_data) {
+  int batch = in_shape[0], in_c = in_shape[channel_last ? 3 : 1];
+  int in_h = in_shape[channel_last ? 1 : 2];
+  int in_w = in_shape[channel_last ? 2 : 3], spatial_dim = in_h * in_w;
+  int count = batch * out_channels * spatial_dim;
+  KernelPreprocess<T><<<GetBlocks(count), NumThreads>>>(
+      in_data, count, in_c, spatial_dim, channel_last, channel_order,
+      channel_transform, out_channels, out_data);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+template void Preprocess(const unsigned char *in_data, const VecInt &in_shape,
+                         bool channel_last, const int *channel_order,
+                         const float *channel_transform, int out_channels,
+                         float *out_data);
+#endif
+
+}  // namespace Vision
+
+}  // namespace Shadow
@@ -0,0 +1,55 @@
+#ifndef SHADOW_OPERATORS_PREPROCESS_OP_HPP
+#define SHADOW_OPERATORS_PREPROCESS_OP_HPP
+
+#include "core/operator.hpp"
+
+namespace Shadow {
+
+// Turns packed unsigned char images (NHWC or NCHW) into float NCHW in one
+// pass: top channel c is (bottom channel order[c] - mean[c]) * scale[c]
+class PreprocessOp : public Operator {
+ public:
+  explicit PreprocessOp(const shadow::OpParam &op_param, Workspace *ws)
+      : Operator(op_param, ws) {
+    channel_last_ = get_single_argument<bool>("channel_last", true);
+    channel_order_data_ = get_repeated_argument<int>("channel_order");
+    mean_value_ = get_repeated_argument<float>("mean_value");
+    scale_value_ = get_repeated_argument<float>("scale_value");
+  }
+
+  void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
+
+  // Scale and shift
+  double flops() const override {
+    return 2.0 * tops<float>(0)->count();
+  }
+
+ private:
+  void SetupTransform(int in_channels);
+
+  bool channel_last_;
+  int in_channels_ = 0, out_channels_ = 0;
+  VecInt channel_order_data_;
+  VecFloat mean_value_, scale_value_;
+
+  // Per top channel source channel, and the mean and scale folded into
+  // scale, bias pairs so each value costs one multiply add
+  BlobI *channel_order_ = nullptr;
+  BlobF *channel_transform_ = nullptr;
+};
+
+namespace Vision {
+
+template <typename T>
+void Preprocess(const unsigned char *in_data, const VecInt &in_shape,
+                bool channel_last, const int *channel_order,
+                const float *channel_transform, int out_channels,
+                T *out_data);
+
+}  // namespace Vision
+
+}  // namespace Shadow
+
+#endif  // SHADOW_OPERATORS_PREPROCESS_OP_HPP
@@ -7,10 +7,6 @@ void PriorBoxOp::Forward() {
   const auto *bottom_im = bottoms<float>(1);
   auto *top = mutable_tops<float>(0);
 
-  if (is_initial_) {
-    return;
-  }
-
   int in_h = bottom->shape(2), in_w = bottom->shape(3);
   int im_h = bottom_im->shape(2), im_w = bottom_im->shape(3);
 
@@ -92,7 +88,12 @@ void PriorBoxOp::Forward() {
     }
   }
   top->set_data(top_data_.data(), top_data_.size());
-  is_initial_ = true;
+}
+
+void PriorBoxOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                             std::vector<VecInt> *top_shapes) const {
+  const auto &in_shape = bottom_shapes[0];
+  (*top_shapes)[0] = {1, 2, in_shape[2] * in_shape[3] * num_priors_ * 4};
 }
 
 REGISTER_OPERATOR(PriorBox, PriorBoxOp);
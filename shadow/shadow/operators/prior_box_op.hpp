@@ -60,11 +60,13 @@ class PriorBoxOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
 
  private:
   int num_priors_;
   float step_, offset_;
-  bool flip_, clip_, is_initial_ = false;
+  bool flip_, clip_;
   VecFloat min_sizes_, max_sizes_, aspect_ratios_, variance_, top_data_;
 };
 
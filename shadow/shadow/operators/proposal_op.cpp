@@ -2,49 +2,39 @@
 
 namespace Shadow {
 
-struct RectInfo {
-  float xmin, ymin, xmax, ymax, score;
-};
-
-inline bool compare_descend(const RectInfo &rect_a, const RectInfo &rect_b) {
-  return rect_a.score > rect_b.score;
-}
-
-inline float intersection_area(const RectInfo &a, const RectInfo &b) {
-  if (a.xmin > b.xmax || a.xmax < b.xmin || a.ymin > b.ymax ||
-      a.ymax < b.ymin) {
-    return 0.f;
-  }
-  float inter_width = std::min(a.xmax, b.xmax) - std::max(a.xmin, b.xmin);
-  float inter_height = std::min(a.ymax, b.ymax) - std::max(a.ymin, b.ymin);
-  return inter_width * inter_height;
-}
-
-inline VecInt nms_sorted(const std::vector<RectInfo> &rects,
-                         float nms_threshold) {
-  const auto num_rects = rects.size();
-  VecFloat areas(num_rects, 0);
-  for (int n = 0; n < num_rects; ++n) {
-    const auto &rect = rects[n];
-    areas[n] = (rect.xmax - rect.xmin + 1) * (rect.ymax - rect.ymin + 1);
-  }
-  VecInt picked;
-  for (int n = 0; n < num_rects; ++n) {
+// Greedy nms over boxes already sorted by descending score, the boxes are
+// stored as planes of xmin, ymin, xmax, ymax and area, each of num_boxes.
+// Stops as soon as max_picked boxes are kept
+inline int nms_sorted(const float *boxes, int num_boxes, float nms_threshold,
+                      int max_picked, int *picked) {
+  const float *xmin = boxes, *ymin = boxes + num_boxes;
+  const float *xmax = boxes + 2 * num_boxes, *ymax = boxes + 3 * num_boxes;
+  const float *areas = boxes + 4 * num_boxes;
+  int num_picked = 0;
+  for (int n = 0; n < num_boxes && num_picked < max_picked; ++n) {
     bool keep = true;
-    const auto &rect_n = rects[n];
-    for (const auto &p : picked) {
-      const auto &rect_p = rects[p];
-      float inter_area = intersection_area(rect_n, rect_p);
+    for (int i = 0; i < num_picked; ++i) {
+      int p = picked[i];
+      if (xmin[n] > xmax[p] || xmax[n] < xmin[p] || ymin[n] > ymax[p] ||
+          ymax[n] < ymin[p]) {
+        continue;
+      }
+      float inter_width =
+          std::min(xmax[n], xmax[p]) - std::max(xmin[n], xmin[p]);
+      float inter_height =
+          std::min(ymax[n], ymax[p]) - std::max(ymin[n], ymin[p]);
+      float inter_area = inter_width * inter_height;
       float union_area = areas[n] + areas[p] - inter_area;
-      if (inter_area / union_area > nms_threshold) {
+      if (inter_area > nms_threshold * union_area) {
         keep = false;
+        break;
       }
     }
     if (keep) {
-      picked.push_back(n);
+      picked[num_picked++] = n;
     }
   }
-  return picked;
+  return num_picked;
 }
 
 void ProposalOp::Forward() {
@@ -58,20 +48,23 @@ void ProposalOp::Forward() {
   int num_scores = bottom_score->shape(1), num_regs = bottom_delta->shape(1),
       num_info = bottom_info->shape(1);
 
-  CHECK_EQ(batch, 1) << "Only single item batches are supported";
+  CHECK_EQ(bottom_delta->shape(0), batch);
+  CHECK_EQ(bottom_info->shape(0), batch);
   CHECK_EQ(num_scores, 2 * num_anchors_);
   CHECK_EQ(num_regs, 4 * num_anchors_);
   CHECK_EQ(num_info, 3);
 
-  int temp_count = num_anchors_ * 4 + in_h * in_w * num_anchors_ * 6;
+  int num_proposals = in_h * in_w * num_anchors_;
+
+  int temp_count = num_anchors_ * 4 + batch * num_proposals * 6;
   op_ws_->GrowTempBuffer(temp_count, sizeof(float));
 
   auto *anchors =
-      op_ws_->CreateTempBlob<float>({num_anchors_, 4}, op_name_ + "_anchors");
+      op_ws_->CreateTempBlob<float>({num_anchors_, 4}, &anchors_temp_);
   anchors->set_data(anchors_.data(), anchors->count());
 
-  auto *proposals = op_ws_->CreateTempBlob<float>(
-      {in_h * in_w * num_anchors_, 6}, op_name_ + "_proposals");
+  auto *proposals = op_ws_->CreateTempBlob<float>({batch, num_proposals, 6},
+                                                  &proposals_temp_);
 
   Vision::Proposal(anchors->data(), bottom_score->data(), bottom_delta->data(),
                    bottom_info->data(), bottom_score->shape(), num_anchors_,
@@ -79,45 +72,82 @@ void ProposalOp::Forward() {
 
   const auto *proposal_data = proposals->cpu_data();
 
-  std::vector<RectInfo> rectangles;
-  for (int n = 0; n < proposals->shape(0); ++n) {
-    const auto *proposal_ptr = proposal_data + n * 6;
-    if (proposal_ptr[5] > 0) {
-      RectInfo rect = {};
-      rect.xmin = proposal_ptr[0];
-      rect.ymin = proposal_ptr[1];
-      rect.xmax = proposal_ptr[2];
-      rect.ymax = proposal_ptr[3];
-      rect.score = proposal_ptr[4];
-      rectangles.push_back(rect);
-    }
-  }
-
-  std::stable_sort(rectangles.begin(), rectangles.end(), compare_descend);
+  int max_picked = post_nms_top_n_ > 0 ? post_nms_top_n_ : num_proposals;
 
-  if (pre_nms_top_n_ > 0 && pre_nms_top_n_ < rectangles.size()) {
-    rectangles.resize(pre_nms_top_n_);
-  }
+  selected_rois_.clear();
+  for (int b = 0; b < batch; ++b) {
+    const auto *batch_proposal = proposal_data + b * num_proposals * 6;
 
-  const auto &picked = nms_sorted(rectangles, nms_thresh_);
+    proposal_order_.clear();
+    for (int n = 0; n < num_proposals; ++n) {
+      if (batch_proposal[n * 6 + 5] > 0) {
+        proposal_order_.push_back(n);
+      }
+    }
 
-  int picked_count = std::min(static_cast<int>(picked.size()), post_nms_top_n_);
+    // Ties keep the anchor order, which matches a stable sort on score
+    const auto compare_descend = [batch_proposal](int a, int b) {
+      float score_a = batch_proposal[a * 6 + 4];
+      float score_b = batch_proposal[b * 6 + 4];
+      return score_a > score_b || (score_a == score_b && a < b);
+    };
+    auto num_boxes = static_cast<int>(proposal_order_.size());
+    if (pre_nms_top_n_ > 0 && pre_nms_top_n_ < num_boxes) {
+      std::nth_element(proposal_order_.begin(),
+                       proposal_order_.begin() + pre_nms_top_n_,
+                       proposal_order_.end(), compare_descend);
+      num_boxes = pre_nms_top_n_;
+    }
+    std::sort(proposal_order_.begin(), proposal_order_.begin() + num_boxes,
+              compare_descend);
+
+    nms_boxes_.resize(5 * num_boxes);
+    for (int n = 0; n < num_boxes; ++n) {
+      const auto *proposal_ptr = batch_proposal + proposal_order_[n] * 6;
+      float xmin = proposal_ptr[0], ymin = proposal_ptr[1];
+      float xmax = proposal_ptr[2], ymax = proposal_ptr[3];
+      nms_boxes_[n] = xmin;
+      nms_boxes_[num_boxes + n] = ymin;
+      nms_boxes_[2 * num_boxes + n] = xmax;
+      nms_boxes_[3 * num_boxes + n] = ymax;
+      nms_boxes_[4 * num_boxes + n] = (xmax - xmin + 1) * (ymax - ymin + 1);
+    }
 
-  selected_rois_.resize(picked_count * 5, 0);
-  for (int n = 0; n < picked_count; ++n) {
-    int selected_offset = n * 5;
-    const auto &rect = rectangles[picked[n]];
-    selected_rois_[selected_offset + 0] = 0;
-    selected_rois_[selected_offset + 1] = rect.xmin;
-    selected_rois_[selected_offset + 2] = rect.ymin;
-    selected_rois_[selected_offset + 3] = rect.xmax;
-    selected_rois_[selected_offset + 4] = rect.ymax;
+    nms_picked_.resize(std::min(num_boxes, max_picked));
+    int picked_count = nms_sorted(nms_boxes_.data(), num_boxes, nms_thresh_,
+                                  max_picked, nms_picked_.data());
+
+    for (int n = 0; n < picked_count; ++n) {
+      int p = nms_picked_[n];
+      selected_rois_.push_back(b);
+      selected_rois_.push_back(nms_boxes_[p]);
+      selected_rois_.push_back(nms_boxes_[num_boxes + p]);
+      selected_rois_.push_back(nms_boxes_[2 * num_boxes + p]);
+      selected_rois_.push_back(nms_boxes_[3 * num_boxes + p]);
+    }
   }
 
-  top->reshape({picked_count, 5});
+  top->reshape({static_cast<int>(selected_rois_.size()) / 5, 5});
   top->set_data(selected_rois_.data(), selected_rois_.size());
 }
 
+// The rois kept depend on the scores, the top is shaped for the most NMS
+// may keep
+void ProposalOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                             std::vector<VecInt> *top_shapes) const {
+  const auto &score_shape = bottom_shapes[0];
+  int batch = score_shape[0];
+  int num_proposals = score_shape[2] * score_shape[3] * num_anchors_;
+
+  op_ws_->PlanTemp(num_anchors_ * 4, sizeof(float));
+  op_ws_->PlanTemp(batch * num_proposals * 6, sizeof(float));
+
+  int max_boxes = num_proposals;
+  if (pre_nms_top_n_ > 0) max_boxes = std::min(max_boxes, pre_nms_top_n_);
+  if (post_nms_top_n_ > 0) max_boxes = std::min(max_boxes, post_nms_top_n_);
+  (*top_shapes)[0] = {batch * max_boxes, 5};
+}
+
 REGISTER_OPERATOR(Proposal, ProposalOp);
 
 namespace Vision {
@@ -127,44 +157,51 @@ template <typename T>
 void Proposal(const T *anchor_data, const T *score_data, const T *delta_data,
               const T *info_data, const VecInt &in_shape, int num_anchors,
               int feat_stride, int min_size, T *proposal_data) {
-  int in_h = in_shape[2], in_w = in_shape[3], spatial_dim = in_h * in_w;
-  int num_proposals = spatial_dim * num_anchors;
-  T im_h = info_data[0], im_w = info_data[1], im_scale = info_data[2];
-  T min_box_size = min_size * im_scale;
-  for (int n = 0; n < num_anchors; ++n) {
-    const auto *anchor_ptr = anchor_data + n * 4;
-    const auto *score_ptr = score_data + num_proposals + n * spatial_dim;
-    const auto *dx_ptr = delta_data + (n * 4 + 0) * spatial_dim;
-    const auto *dy_ptr = delta_data + (n * 4 + 1) * spatial_dim;
-    const auto *dw_ptr = delta_data + (n * 4 + 2) * spatial_dim;
-    const auto *dh_ptr = delta_data + (n * 4 + 3) * spatial_dim;
-    T anchor_w = anchor_ptr[2] - anchor_ptr[0] + 1;
-    T anchor_h = anchor_ptr[3] - anchor_ptr[1] + 1;
-    for (int h = 0; h < in_h; ++h) {
-      for (int w = 0; w < in_w; ++w) {
-        int spatial_offset = h * in_w + w;
-        T anchor_x = anchor_ptr[0] + w * feat_stride;
-        T anchor_y = anchor_ptr[1] + h * feat_stride;
-        T anchor_cx = anchor_x + (anchor_w - 1) * T(0.5);
-        T anchor_cy = anchor_y + (anchor_h - 1) * T(0.5);
-        T dx = dx_ptr[spatial_offset], dy = dy_ptr[spatial_offset];
-        T dw = dw_ptr[spatial_offset], dh = dh_ptr[spatial_offset];
-        T pb_cx = anchor_cx + anchor_w * dx;
-        T pb_cy = anchor_cy + anchor_h * dy;
-        T pb_w = anchor_w * std::exp(dw), pb_h = anchor_h * std::exp(dh);
-        T pb_xmin = pb_cx - (pb_w - 1) * T(0.5);
-        T pb_ymin = pb_cy - (pb_h - 1) * T(0.5);
-        T pb_xmax = pb_cx + (pb_w - 1) * T(0.5);
-        T pb_ymax = pb_cy + (pb_h - 1) * T(0.5);
-        auto *prop_ptr = proposal_data + (spatial_offset * num_anchors + n) * 6;
-        prop_ptr[0] = std::min(std::max(pb_xmin, T(0)), im_w - 1);
-        prop_ptr[1] = std::min(std::max(pb_ymin, T(0)), im_h - 1);
-        prop_ptr[2] = std::min(std::max(pb_xmax, T(0)), im_w - 1);
-        prop_ptr[3] = std::min(std::max(pb_ymax, T(0)), im_h - 1);
-        prop_ptr[4] = score_ptr[spatial_offset];
-        pb_w = prop_ptr[2] - prop_ptr[0] + 1;
-        pb_h = prop_ptr[3] - prop_ptr[1] + 1;
-        prop_ptr[5] = (pb_w >= min_box_size) && (pb_h >= min_box_size);
+  int batch = in_shape[0], in_h = in_shape[2], in_w = in_shape[3];
+  int spatial_dim = in_h * in_w, num_proposals = spatial_dim * num_anchors;
+  for (int b = 0; b < batch; ++b) {
+    const T *batch_score = score_data + b * 2 * num_proposals;
+    const T *batch_delta = delta_data + b * 4 * num_proposals;
+    const T *batch_info = info_data + b * 3;
+    T *batch_proposal = proposal_data + b * num_proposals * 6;
+    T im_h = batch_info[0], im_w = batch_info[1], im_scale = batch_info[2];
+    T min_box_size = min_size * im_scale;
+    for (int n = 0; n < num_anchors; ++n) {
+      const auto *anchor_ptr = anchor_data + n * 4;
+      const auto *score_ptr = batch_score + num_proposals + n * spatial_dim;
+      const auto *dx_ptr = batch_delta + (n * 4 + 0) * spatial_dim;
+      const auto *dy_ptr = batch_delta + (n * 4 + 1) * spatial_dim;
+      const auto *dw_ptr = batch_delta + (n * 4 + 2) * spatial_dim;
+      const auto *dh_ptr = batch_delta + (n * 4 + 3) * spatial_dim;
+      T anchor_w = anchor_ptr[2] - anchor_ptr[0] + 1;
+      T anchor_h = anchor_ptr[3] - anchor_ptr[1] + 1;
+      for (int h = 0; h < in_h; ++h) {
+        for (int w = 0; w < in_w; ++w) {
+          int spatial_offset = h * in_w + w;
+          T anchor_x = anchor_ptr[0] + w * feat_stride;
+          T anchor_y = anchor_ptr[1] + h * feat_stride;
+          T anchor_cx = anchor_x + (anchor_w - 1) * T(0.5);
+          T anchor_cy = anchor_y + (anchor_h - 1) * T(0.5);
+          T dx = dx_ptr[spatial_offset], dy = dy_ptr[spatial_offset];
+          T dw = dw_ptr[spatial_offset], dh = dh_ptr[spatial_offset];
+          T pb_cx = anchor_cx + anchor_w * dx;
+          T pb_cy = anchor_cy + anchor_h * dy;
+          T pb_w = anchor_w * std::exp(dw), pb_h = anchor_h * std::exp(dh);
+          T pb_xmin = pb_cx - (pb_w - 1) * T(0.5);
+          T pb_ymin = pb_cy - (pb_h - 1) * T(0.5);
+          T pb_xmax = pb_cx + (pb_w - 1) * T(0.5);
+          T pb_ymax = pb_cy + (pb_h - 1) * T(0.5);
+          auto *prop_ptr =
+              batch_proposal + (spatial_offset * num_anchors + n) * 6;
+          prop_ptr[0] = std::min(std::max(pb_xmin, T(0)), im_w - 1);
+          prop_ptr[1] = std::min(std::max(pb_ymin, T(0)), im_h - 1);
+          prop_ptr[2] = std::min(std::max(pb_xmax, T(0)), im_w - 1);
+          prop_ptr[3] = std::min(std::max(pb_ymax, T(0)), im_h - 1);
+          prop_ptr[4] = score_ptr[spatial_offset];
+          pb_w = prop_ptr[2] - prop_ptr[0] + 1;
+          pb_h = prop_ptr[3] - prop_ptr[1] + 1;
+          prop_ptr[5] = (pb_w >= min_box_size) && (pb_h >= min_box_size);
+        }
       }
     }
   }
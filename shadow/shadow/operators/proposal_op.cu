@@ -14,11 +14,16 @@ __global__ void KernelProposal(int count, const T *anchor_data,
   CUDA_KERNEL_LOOP(globalid, count) {
     int n_out = globalid % num_anchors;
     int w_out = (globalid / num_anchors) % in_w;
-    int h_out = globalid / num_anchors / in_w;
+    int h_out = (globalid / num_anchors / in_w) % in_h;
+    int b_out = globalid / num_anchors / in_w / in_h;
 
     int spatial_dim = in_h * in_w;
     int spatial_offset = h_out * in_w + w_out;
     int delta_offset = n_out * 4 * spatial_dim + spatial_offset;
+
+    score_data += b_out * 2 * num_anchors * spatial_dim;
+    delta_data += b_out * 4 * num_anchors * spatial_dim;
+    info_data += b_out * 3;
     T min_box_size = min_size * info_data[2];
 
     anchor_data += n_out * 4;
@@ -61,8 +66,8 @@ template <typename T>
 void Proposal(const T *anchor_data, const T *score_data, const T *delta_data,
               const T *info_data, const VecInt &in_shape, int num_anchors,
               int feat_stride, int min_size, T *proposal_data) {
-  int in_h = in_shape[2], in_w = in_shape[3];
-  int count = in_h * in_w * num_anchors;
+  int batch = in_shape[0], in_h = in_shape[2], in_w = in_shape[3];
+  int count = batch * in_h * in_w * num_anchors;
   KernelProposal<T><<<GetBlocks(count), NumThreads>>>(
       count, anchor_data, score_data, delta_data, info_data, in_h, in_w,
       num_anchors, feat_stride, min_size, proposal_data);
@@ -44,11 +44,16 @@ class ProposalOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
 
  private:
   int feat_stride_, pre_nms_top_n_, post_nms_top_n_, min_size_, num_anchors_;
   float nms_thresh_;
-  VecFloat ratios_, scales_, anchors_, selected_rois_;
+  VecFloat ratios_, scales_, anchors_, nms_boxes_, selected_rois_;
+  VecInt proposal_order_, nms_picked_;
+
+  BlobF *anchors_temp_ = nullptr, *proposals_temp_ = nullptr;
 };
 
 namespace Vision {
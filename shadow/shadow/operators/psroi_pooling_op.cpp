@@ -21,6 +21,11 @@ void PSROIPoolingOp::Forward() {
                        top->mutable_data());
 }
 
+void PSROIPoolingOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                                 std::vector<VecInt> *top_shapes) const {
+  (*top_shapes)[0] = {bottom_shapes[1][0], output_dim_, pooled_h_, pooled_w_};
+}
+
 REGISTER_OPERATOR(PSROIPooling, PSROIPoolingOp);
 
 namespace Vision {
@@ -32,55 +37,71 @@ void PSROIPooling(const T *in_data, const VecInt &in_shape, const T *roi_data,
                   int pooled_w, float spatial_scale, T *out_data) {
   int batch = in_shape[0];
   int in_c = in_shape[1], in_h = in_shape[2], in_w = in_shape[3];
-  int in_num = in_c * in_h * in_w, out_num = output_dim * pooled_h * pooled_w;
+  int spatial_dim = in_h * in_w, pooled_dim = pooled_h * pooled_w;
+  // Per roi bin table: [hstart, hend] for every ph, then [wstart, wend] for
+  // every pw, shared by all output_dim channels of that roi
+  int table_size = 2 * (pooled_h + pooled_w);
+  VecInt batch_ids(num_rois), bin_table(num_rois * table_size);
   for (int n = 0; n < num_rois; ++n) {
-    int roi_offset = 5 * n;
-    int roi_batch_id = roi_data[roi_offset];
-    float roi_start_w = Util::round(roi_data[roi_offset + 1]) * spatial_scale;
-    float roi_start_h = Util::round(roi_data[roi_offset + 2]) * spatial_scale;
-    float roi_end_w =
-        (Util::round(roi_data[roi_offset + 3]) + 1) * spatial_scale;
-    float roi_end_h =
-        (Util::round(roi_data[roi_offset + 4]) + 1) * spatial_scale;
+    const T *roi = roi_data + 5 * n;
+    int roi_batch_id = roi[0];
+    float roi_start_w = Util::round(roi[1]) * spatial_scale;
+    float roi_start_h = Util::round(roi[2]) * spatial_scale;
+    float roi_end_w = (Util::round(roi[3]) + 1) * spatial_scale;
+    float roi_end_h = (Util::round(roi[4]) + 1) * spatial_scale;
     CHECK_GE(roi_batch_id, 0);
     CHECK_LT(roi_batch_id, batch);
     float roi_height = std::max(roi_end_h - roi_start_h, 0.1f);
     float roi_width = std::max(roi_end_w - roi_start_w, 0.1f);
     float bin_size_h = roi_height / static_cast<float>(pooled_h);
     float bin_size_w = roi_width / static_cast<float>(pooled_w);
-    const T *batch_in_data = in_data + roi_batch_id * in_num;
-    T *batch_out_data = out_data + n * out_num;
-    for (int c = 0; c < output_dim; ++c) {
-      for (int ph = 0; ph < pooled_h; ++ph) {
-        for (int pw = 0; pw < pooled_w; ++pw) {
-          auto hstart =
-              static_cast<int>(std::floor(ph * bin_size_h + roi_start_h));
-          auto wstart =
-              static_cast<int>(std::floor(pw * bin_size_w + roi_start_w));
-          auto hend =
-              static_cast<int>(std::ceil((ph + 1) * bin_size_h + roi_start_h));
-          auto wend =
-              static_cast<int>(std::ceil((pw + 1) * bin_size_w) + roi_start_w);
-          hstart = std::min(std::max(hstart, 0), in_h);
-          hend = std::min(std::max(hend, 0), in_h);
-          wstart = std::min(std::max(wstart, 0), in_w);
-          wend = std::min(std::max(wend, 0), in_w);
-          bool is_empty = (hend <= hstart) || (wend <= wstart);
-          int gh = ph * group_size / pooled_h;
-          int gw = pw * group_size / pooled_w;
-          gh = std::min(std::max(gh, 0), group_size - 1);
-          gw = std::min(std::max(gw, 0), group_size - 1);
-          int c_in = (c * group_size + gh) * group_size + gw;
-          auto sum_val = static_cast<T>(0);
-          for (int h = hstart; h < hend; ++h) {
-            for (int w = wstart; w < wend; ++w) {
-              sum_val += batch_in_data[(c_in * in_h + h) * in_w + w];
-            }
+    int *h_bin = bin_table.data() + n * table_size;
+    int *w_bin = h_bin + 2 * pooled_h;
+    for (int ph = 0; ph < pooled_h; ++ph) {
+      auto hstart = static_cast<int>(std::floor(ph * bin_size_h + roi_start_h));
+      auto hend =
+          static_cast<int>(std::ceil((ph + 1) * bin_size_h + roi_start_h));
+      h_bin[2 * ph] = std::min(std::max(hstart, 0), in_h);
+      h_bin[2 * ph + 1] = std::min(std::max(hend, 0), in_h);
+    }
+    for (int pw = 0; pw < pooled_w; ++pw) {
+      auto wstart = static_cast<int>(std::floor(pw * bin_size_w + roi_start_w));
+      auto wend =
+          static_cast<int>(std::ceil((pw + 1) * bin_size_w + roi_start_w));
+      w_bin[2 * pw] = std::min(std::max(wstart, 0), in_w);
+      w_bin[2 * pw + 1] = std::min(std::max(wend, 0), in_w);
+    }
+    batch_ids[n] = roi_batch_id;
+  }
+#if defined(USE_OpenMP)
+#pragma omp parallel for
+#endif
+  for (int i = 0; i < num_rois * output_dim; ++i) {
+    int n = i / output_dim, c = i % output_dim;
+    const int *h_bin = bin_table.data() + n * table_size;
+    const int *w_bin = h_bin + 2 * pooled_h;
+    const T *batch_in_data = in_data + batch_ids[n] * in_c * spatial_dim;
+    T *out_offset = out_data + i * pooled_dim;
+    for (int ph = 0; ph < pooled_h; ++ph) {
+      int hstart = h_bin[2 * ph], hend = h_bin[2 * ph + 1];
+      int gh =
+          std::min(std::max(ph * group_size / pooled_h, 0), group_size - 1);
+      for (int pw = 0; pw < pooled_w; ++pw) {
+        int wstart = w_bin[2 * pw], wend = w_bin[2 * pw + 1];
+        int gw =
+            std::min(std::max(pw * group_size / pooled_w, 0), group_size - 1);
+        int c_in = (c * group_size + gh) * group_size + gw;
+        const T *in_offset = batch_in_data + c_in * spatial_dim;
+        auto sum_val = T(0);
+        for (int h = hstart; h < hend; ++h) {
+          const T *in_row = in_offset + h * in_w;
+          for (int w = wstart; w < wend; ++w) {
+            sum_val += in_row[w];
           }
-          float bin_area = (hend - hstart) * (wend - wstart);
-          int pool_index = (c * pooled_h + ph) * pooled_w + pw;
-          batch_out_data[pool_index] = is_empty ? T(0) : sum_val / bin_area;
         }
+        bool is_empty = (hend <= hstart) || (wend <= wstart);
+        T bin_area = (hend - hstart) * (wend - wstart);
+        out_offset[ph * pooled_w + pw] = is_empty ? T(0) : sum_val / bin_area;
       }
     }
   }
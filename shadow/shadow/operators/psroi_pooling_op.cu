@@ -45,8 +45,8 @@ __global__ void KernelPSROIPooling(const T *in_data, int count,
 
     bool is_empty = (hend <= hstart) || (wend <= wstart);
 
-    int gh = static_cast<int>(floor(static_cast<T>(ph) * group_size / in_h));
-    int gw = static_cast<int>(floor(static_cast<T>(pw) * group_size / in_w));
+    int gh = ph * group_size / pooled_h;
+    int gw = pw * group_size / pooled_w;
     gh = min(max(gh, 0), group_size - 1);
     gw = min(max(gw, 0), group_size - 1);
     int c_in = (c_out * group_size + gh) * group_size + gw;
@@ -18,6 +18,8 @@ class PSROIPoolingOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
 
  private:
   int output_dim_, group_size_, pooled_h_, pooled_w_;
@@ -22,6 +22,15 @@ void ReorgOp::Forward() {
   Vision::Reorg(bottom->data(), bottom->shape(), stride_, top->mutable_data());
 }
 
+void ReorgOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                          std::vector<VecInt> *top_shapes) const {
+  auto top_shape = bottom_shapes[0];
+  top_shape[1] *= stride_ * stride_;
+  top_shape[2] /= stride_;
+  top_shape[3] /= stride_;
+  (*top_shapes)[0] = top_shape;
+}
+
 REGISTER_OPERATOR(Reorg, ReorgOp);
 
 namespace Vision {
@@ -16,8 +16,12 @@ class ReshapeOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
 
  private:
+  VecInt TopShape(const VecInt &bottom_shape) const;
+
   int axis_, num_axes_;
   VecInt shape_;
 };
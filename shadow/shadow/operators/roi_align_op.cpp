@@ -0,0 +1,139 @@
+#include "roi_align_op.hpp"
+
+namespace Shadow {
+
+void ROIAlignOp::Forward() {
+  CHECK_EQ(bottoms_size(), 2);
+
+  const auto *bottom_fea = bottoms<float>(0);
+  const auto *bottom_roi = bottoms<float>(1);
+  auto *top = mutable_tops<float>(0);
+
+  CHECK_NE(bottom_fea, top);
+
+  int in_c = bottom_fea->shape(1), num_rois = bottom_roi->shape(0);
+  top->reshape({num_rois, in_c, pooled_h_, pooled_w_});
+
+  Vision::ROIAlign(bottom_fea->data(), bottom_fea->shape(), bottom_roi->data(),
+                   num_rois, pooled_h_, pooled_w_, spatial_scale_,
+                   sampling_ratio_, aligned_, top->mutable_data());
+}
+
+void ROIAlignOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                             std::vector<VecInt> *top_shapes) const {
+  (*top_shapes)[0] = {bottom_shapes[1][0], bottom_shapes[0][1], pooled_h_,
+                      pooled_w_};
+}
+
+REGISTER_OPERATOR(ROIAlign, ROIAlignOp);
+
+namespace Vision {
+
+#if !defined(USE_CUDA)
+template <typename T>
+void ROIAlign(const T *in_data, const VecInt &in_shape, const T *roi_data,
+              int num_rois, int pooled_h, int pooled_w, float spatial_scale,
+              int sampling_ratio, bool aligned, T *out_data) {
+  int batch = in_shape[0];
+  int in_c = in_shape[1], in_h = in_shape[2], in_w = in_shape[3];
+  int spatial_dim = in_h * in_w, pooled_dim = pooled_h * pooled_w;
+  float roi_offset = aligned ? 0.5f : 0.f;
+  for (int n = 0; n < num_rois; ++n) {
+    int roi_batch_id = roi_data[5 * n];
+    CHECK_GE(roi_batch_id, 0);
+    CHECK_LT(roi_batch_id, batch);
+  }
+  // Sample positions only depend on the roi, so the four bilinear taps of
+  // every sample are built once per roi, with weights already divided by the
+  // sample count, and reused by all channels
+#if defined(USE_OpenMP)
+#pragma omp parallel for
+#endif
+  for (int n = 0; n < num_rois; ++n) {
+    const T *roi = roi_data + 5 * n;
+    int roi_batch_id = roi[0];
+    float roi_start_w = roi[1] * spatial_scale - roi_offset;
+    float roi_start_h = roi[2] * spatial_scale - roi_offset;
+    float roi_end_w = roi[3] * spatial_scale - roi_offset;
+    float roi_end_h = roi[4] * spatial_scale - roi_offset;
+    float roi_width = roi_end_w - roi_start_w;
+    float roi_height = roi_end_h - roi_start_h;
+    if (!aligned) {
+      roi_width = std::max(roi_width, 1.f);
+      roi_height = std::max(roi_height, 1.f);
+    }
+    float bin_size_h = roi_height / static_cast<float>(pooled_h);
+    float bin_size_w = roi_width / static_cast<float>(pooled_w);
+    int grid_h = sampling_ratio > 0
+                     ? sampling_ratio
+                     : static_cast<int>(std::ceil(roi_height / pooled_h));
+    int grid_w = sampling_ratio > 0
+                     ? sampling_ratio
+                     : static_cast<int>(std::ceil(roi_width / pooled_w));
+    grid_h = std::max(grid_h, 1), grid_w = std::max(grid_w, 1);
+    int num_samples = grid_h * grid_w;
+    T norm = T(1) / num_samples;
+
+    VecInt sample_index(4 * pooled_dim * num_samples);
+    std::vector<T> sample_weight(4 * pooled_dim * num_samples);
+    int *index = sample_index.data();
+    T *weight = sample_weight.data();
+    for (int ph = 0; ph < pooled_h; ++ph) {
+      for (int pw = 0; pw < pooled_w; ++pw) {
+        for (int iy = 0; iy < grid_h; ++iy) {
+          float y = roi_start_h + ph * bin_size_h +
+                    (iy + 0.5f) * bin_size_h / grid_h;
+          for (int ix = 0; ix < grid_w; ++ix, index += 4, weight += 4) {
+            float x = roi_start_w + pw * bin_size_w +
+                      (ix + 0.5f) * bin_size_w / grid_w;
+            if (y < -1.f || y > in_h || x < -1.f || x > in_w) {
+              std::fill(index, index + 4, 0);
+              std::fill(weight, weight + 4, T(0));
+              continue;
+            }
+            float h = std::max(y, 0.f), w = std::max(x, 0.f);
+            auto h_low = static_cast<int>(h), w_low = static_cast<int>(w);
+            int h_high = h_low + 1, w_high = w_low + 1;
+            if (h_low >= in_h - 1) {
+              h_high = h_low = in_h - 1, h = h_low;
+            }
+            if (w_low >= in_w - 1) {
+              w_high = w_low = in_w - 1, w = w_low;
+            }
+            float lh = h - h_low, lw = w - w_low;
+            float hh = 1 - lh, hw = 1 - lw;
+            index[0] = h_low * in_w + w_low, index[1] = h_low * in_w + w_high;
+            index[2] = h_high * in_w + w_low, index[3] = h_high * in_w + w_high;
+            weight[0] = hh * hw * norm, weight[1] = hh * lw * norm;
+            weight[2] = lh * hw * norm, weight[3] = lh * lw * norm;
+          }
+        }
+      }
+    }
+
+    const T *batch_in_data = in_data + roi_batch_id * in_c * spatial_dim;
+    T *roi_out_data = out_data + n * in_c * pooled_dim;
+    for (int c = 0; c < in_c; ++c) {
+      const T *in_offset = batch_in_data + c * spatial_dim;
+      index = sample_index.data(), weight = sample_weight.data();
+      for (int p = 0; p < pooled_dim; ++p) {
+        auto sum_val = T(0);
+        for (int i = 0; i < 4 * num_samples; ++i) {
+          sum_val += weight[i] * in_offset[index[i]];
+        }
+        roi_out_data[c * pooled_dim + p] = sum_val;
+        index += 4 * num_samples, weight += 4 * num_samples;
+      }
+    }
+  }
+}
+
+template void ROIAlign(const float *in_data, const VecInt &in_shape,
+                       const float *roi_data, int num_rois, int pooled_h,
+                       int pooled_w, float spatial_scale, int sampling_ratio,
+                       bool aligned, float *out_data);
+#endif
+
+}  // namespace Vision
+
+}  // namespace Shadow
@@ -0,0 +1,100 @@
+#include "roi_align_op.hpp"
+
+namespace Shadow {
+
+namespace Vision {
+
+#if defined(USE_CUDA)
+template <typename T>
+__device__ T BilinearSample(const T *data, int height, int width, T y, T x) {
+  if (y < -1 || y > height || x < -1 || x > width) {
+    return T(0);
+  }
+  y = max(y, T(0)), x = max(x, T(0));
+  int y_low = static_cast<int>(y), x_low = static_cast<int>(x);
+  int y_high = y_low + 1, x_high = x_low + 1;
+  if (y_low >= height - 1) {
+    y_high = y_low = height - 1, y = static_cast<T>(y_low);
+  }
+  if (x_low >= width - 1) {
+    x_high = x_low = width - 1, x = static_cast<T>(x_low);
+  }
+  T ly = y - y_low, lx = x - x_low;
+  T hy = 1 - ly, hx = 1 - lx;
+  return hy * hx * data[y_low * width + x_low] +
+         hy * lx * data[y_low * width + x_high] +
+         ly * hx * data[y_high * width + x_low] +
+         ly * lx * data[y_high * width + x_high];
+}
+
+template <typename T>
+__global__ void KernelROIAlign(const T *in_data, int count, const T *roi_data,
+                               int in_c, int in_h, int in_w, int pooled_h,
+                               int pooled_w, float spatial_scale,
+                               int sampling_ratio, bool aligned, T *out_data) {
+  CUDA_KERNEL_LOOP(globalid, count) {
+    int pw = globalid % pooled_w;
+    int ph = (globalid / pooled_w) % pooled_h;
+    int c = (globalid / pooled_w / pooled_h) % in_c;
+    int n = globalid / pooled_w / pooled_h / in_c;
+
+    roi_data += n * 5;
+    T roi_offset = aligned ? T(0.5) : T(0);
+    int roi_batch_id = static_cast<int>(roi_data[0]);
+    T roi_start_w = roi_data[1] * spatial_scale - roi_offset;
+    T roi_start_h = roi_data[2] * spatial_scale - roi_offset;
+    T roi_end_w = roi_data[3] * spatial_scale - roi_offset;
+    T roi_end_h = roi_data[4] * spatial_scale - roi_offset;
+
+    T roi_width = roi_end_w - roi_start_w;
+    T roi_height = roi_end_h - roi_start_h;
+    if (!aligned) {
+      roi_width = max(roi_width, T(1)), roi_height = max(roi_height, T(1));
+    }
+    T bin_size_h = roi_height / static_cast<T>(pooled_h);
+    T bin_size_w = roi_width / static_cast<T>(pooled_w);
+
+    int grid_h = sampling_ratio > 0
+                     ? sampling_ratio
+                     : static_cast<int>(ceil(roi_height / pooled_h));
+    int grid_w = sampling_ratio > 0
+                     ? sampling_ratio
+                     : static_cast<int>(ceil(roi_width / pooled_w));
+    grid_h = max(grid_h, 1), grid_w = max(grid_w, 1);
+
+    in_data += (roi_batch_id * in_c + c) * in_h * in_w;
+
+    T sum_val = T(0);
+    for (int iy = 0; iy < grid_h; ++iy) {
+      T y = roi_start_h + ph * bin_size_h + (iy + T(0.5)) * bin_size_h / grid_h;
+      for (int ix = 0; ix < grid_w; ++ix) {
+        T x =
+            roi_start_w + pw * bin_size_w + (ix + T(0.5)) * bin_size_w / grid_w;
+        sum_val += BilinearSample(in_data, in_h, in_w, y, x);
+      }
+    }
+    out_data[globalid] = sum_val / (grid_h * grid_w);
+  }
+}
+
+template <typename T>
+void ROIAlign(const T *in_data, const VecInt &in_shape, const T *roi_data,
+              int num_rois, int pooled_h, int pooled_w, float spatial_scale,
+              int sampling_ratio, bool aligned, T *out_data) {
+  int in_c = in_shape[1], in_h = in_shape[2], in_w = in_shape[3];
+  int count = num_rois * in_c * pooled_h * pooled_w;
+  KernelROIAlign<T><<<GetBlocks(count), NumThreads>>>(
+      in_data, count, roi_data, in_c, in_h, in_w, pooled_h, pooled_w,
+      spatial_scale, sampling_ratio, aligned, out_data);
+  CUDA_CHECK(cudaPeekAtLastError());
+}
+
+template void ROIAlign(const float *in_data, const VecInt &in_shape,
+                       const float *roi_data, int num_rois, int pooled_h,
+                       int pooled_w, float spatial_scale, int sampling_ratio,
+                       bool aligned, float *out_data);
+#endif
+
+}  // namespace Vision
+
+}  // namespace Shadow
@@ -0,0 +1,43 @@
+#ifndef SHADOW_OPERATORS_ROI_ALIGN_OP_HPP
+#define SHADOW_OPERATORS_ROI_ALIGN_OP_HPP
+
+#include "core/operator.hpp"
+
+namespace Shadow {
+
+class ROIAlignOp : public Operator {
+ public:
+  explicit ROIAlignOp(const shadow::OpParam &op_param, Workspace *ws)
+      : Operator(op_param, ws) {
+    pooled_h_ = get_single_argument<int>("pooled_h", 0);
+    pooled_w_ = get_single_argument<int>("pooled_w", 0);
+    CHECK_GT(pooled_h_, 0) << "pooled_h must be > 0";
+    CHECK_GT(pooled_w_, 0) << "pooled_w must be > 0";
+    spatial_scale_ = get_single_argument<float>("spatial_scale", 1.f / 16);
+    sampling_ratio_ = get_single_argument<int>("sampling_ratio", -1);
+    aligned_ = get_single_argument<bool>("aligned", false);
+  }
+
+  void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
+
+ private:
+  int pooled_h_, pooled_w_, sampling_ratio_;
+  float spatial_scale_;
+  bool aligned_;
+};
+
+namespace Vision {
+
+// sampling_ratio <= 0 samples ceil(roi_size / pooled_size) points per bin
+template <typename T>
+void ROIAlign(const T *in_data, const VecInt &in_shape, const T *roi_data,
+              int num_rois, int pooled_h, int pooled_w, float spatial_scale,
+              int sampling_ratio, bool aligned, T *out_data);
+
+}  // namespace Vision
+
+}  // namespace Shadow
+
+#endif  // SHADOW_OPERATORS_ROI_ALIGN_OP_HPP
@@ -19,6 +19,12 @@ void ROIPoolingOp::Forward() {
                      spatial_scale_, top->mutable_data());
 }
 
+void ROIPoolingOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                               std::vector<VecInt> *top_shapes) const {
+  (*top_shapes)[0] = {bottom_shapes[1][0], bottom_shapes[0][1], pooled_h_,
+                      pooled_w_};
+}
+
 REGISTER_OPERATOR(ROIPooling, ROIPoolingOp);
 
 namespace Vision {
@@ -30,46 +36,62 @@ void ROIPooling(const T *in_data, const VecInt &in_shape, const T *roi_data,
                 T *out_data) {
   int batch = in_shape[0];
   int in_c = in_shape[1], in_h = in_shape[2], in_w = in_shape[3];
-  int in_num = in_c * in_h * in_w, out_num = in_c * pooled_h * pooled_w;
+  int spatial_dim = in_h * in_w, pooled_dim = pooled_h * pooled_w;
+  // Bin boundaries only depend on the roi, so they are built once per roi as
+  // [hstart, hend] pairs for every ph followed by [wstart, wend] for every pw
+  int table_size = 2 * (pooled_h + pooled_w);
+  VecInt batch_ids(num_rois), bin_table(num_rois * table_size);
   for (int n = 0; n < num_rois; ++n) {
-    int roi_offset = 5 * n;
-    int roi_batch_id = roi_data[roi_offset];
-    int roi_start_w = Util::round(roi_data[roi_offset + 1] * spatial_scale);
-    int roi_start_h = Util::round(roi_data[roi_offset + 2] * spatial_scale);
-    int roi_end_w = Util::round(roi_data[roi_offset + 3] * spatial_scale);
-    int roi_end_h = Util::round(roi_data[roi_offset + 4] * spatial_scale);
-    assert(roi_batch_id >= 0);
-    assert(roi_batch_id < batch);
+    const T *roi = roi_data + 5 * n;
+    int roi_batch_id = roi[0];
+    int roi_start_w = Util::round(roi[1] * spatial_scale);
+    int roi_start_h = Util::round(roi[2] * spatial_scale);
+    int roi_end_w = Util::round(roi[3] * spatial_scale);
+    int roi_end_h = Util::round(roi[4] * spatial_scale);
+    CHECK_GE(roi_batch_id, 0);
+    CHECK_LT(roi_batch_id, batch);
     int roi_height = std::max(roi_end_h - roi_start_h + 1, 1);
     int roi_width = std::max(roi_end_w - roi_start_w + 1, 1);
     float bin_size_h = roi_height / static_cast<float>(pooled_h);
     float bin_size_w = roi_width / static_cast<float>(pooled_w);
-    const T *batch_in_data = in_data + roi_batch_id * in_num;
-    T *batch_out_data = out_data + n * out_num;
-    for (int c = 0; c < in_c; ++c) {
-      for (int ph = 0; ph < pooled_h; ++ph) {
-        for (int pw = 0; pw < pooled_w; ++pw) {
-          auto hstart = static_cast<int>(std::floor(ph * bin_size_h));
-          auto wstart = static_cast<int>(std::floor(pw * bin_size_w));
-          auto hend = static_cast<int>(std::ceil((ph + 1) * bin_size_h));
-          auto wend = static_cast<int>(std::ceil((pw + 1) * bin_size_w));
-          hstart = std::min(std::max(hstart + roi_start_h, 0), in_h);
-          hend = std::min(std::max(hend + roi_start_h, 0), in_h);
-          wstart = std::min(std::max(wstart + roi_start_w, 0), in_w);
-          wend = std::min(std::max(wend + roi_start_w, 0), in_w);
-          bool is_empty = (hend <= hstart) || (wend <= wstart);
-          T max_val = is_empty
-                          ? T(0)
-                          : batch_in_data[(c * in_h + hstart) * in_w + wstart];
-          for (int h = hstart; h < hend; ++h) {
-            for (int w = wstart; w < wend; ++w) {
-              max_val =
-                  std::max(max_val, batch_in_data[(c * in_h + h) * in_w + w]);
-            }
+    int *h_bin = bin_table.data() + n * table_size;
+    int *w_bin = h_bin + 2 * pooled_h;
+    for (int ph = 0; ph < pooled_h; ++ph) {
+      auto hstart = static_cast<int>(std::floor(ph * bin_size_h));
+      auto hend = static_cast<int>(std::ceil((ph + 1) * bin_size_h));
+      h_bin[2 * ph] = std::min(std::max(hstart + roi_start_h, 0), in_h);
+      h_bin[2 * ph + 1] = std::min(std::max(hend + roi_start_h, 0), in_h);
+    }
+    for (int pw = 0; pw < pooled_w; ++pw) {
+      auto wstart = static_cast<int>(std::floor(pw * bin_size_w));
+      auto wend = static_cast<int>(std::ceil((pw + 1) * bin_size_w));
+      w_bin[2 * pw] = std::min(std::max(wstart + roi_start_w, 0), in_w);
+      w_bin[2 * pw + 1] = std::min(std::max(wend + roi_start_w, 0), in_w);
+    }
+    batch_ids[n] = roi_batch_id;
+  }
+#if defined(USE_OpenMP)
+#pragma omp parallel for
+#endif
+  for (int i = 0; i < num_rois * in_c; ++i) {
+    int n = i / in_c, c = i % in_c;
+    const int *h_bin = bin_table.data() + n * table_size;
+    const int *w_bin = h_bin + 2 * pooled_h;
+    const T *in_offset = in_data + (batch_ids[n] * in_c + c) * spatial_dim;
+    T *out_offset = out_data + i * pooled_dim;
+    for (int ph = 0; ph < pooled_h; ++ph) {
+      int hstart = h_bin[2 * ph], hend = h_bin[2 * ph + 1];
+      for (int pw = 0; pw < pooled_w; ++pw) {
+        int wstart = w_bin[2 * pw], wend = w_bin[2 * pw + 1];
+        bool is_empty = (hend <= hstart) || (wend <= wstart);
+        T max_val = is_empty ? T(0) : in_offset[hstart * in_w + wstart];
+        for (int h = hstart; h < hend; ++h) {
+          const T *in_row = in_offset + h * in_w;
+          for (int w = wstart; w < wend; ++w) {
+            max_val = std::max(max_val, in_row[w]);
           }
-          int pool_index = (c * pooled_h + ph) * pooled_w + pw;
-          batch_out_data[pool_index] = max_val;
         }
+        out_offset[ph * pooled_w + pw] = max_val;
       }
     }
   }
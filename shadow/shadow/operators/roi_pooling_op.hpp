@@ -17,6 +17,8 @@ class ROIPoolingOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
 
  private:
   int pooled_h_, pooled_w_;
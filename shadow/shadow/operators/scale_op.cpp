@@ -1,5 +1,7 @@
 #include "scale_op.hpp"
 
+#include "core/cpu_features.hpp"
+
 namespace Shadow {
 
 void ScaleOp::Forward() {
@@ -19,14 +21,12 @@ void ScaleOp::Forward() {
     } else if (has_scale_) {
       scale_ = const_cast<BlobF *>(bottoms<float>(1));
       op_ws_->GrowTempBuffer(scale_->count(), sizeof(float));
-      bias_ = op_ws_->CreateTempBlob<float>(scale_->shape(),
-                                            op_name_ + "_bias_value");
+      bias_ = op_ws_->CreateTempBlob<float>(scale_->shape(), &bias_temp_);
       Blas::Set(bias_->count(), 0, bias_->mutable_data(), 0);
     } else {
       bias_ = const_cast<BlobF *>(bottoms<float>(1));
       op_ws_->GrowTempBuffer(bias_->count(), sizeof(float));
-      scale_ = op_ws_->CreateTempBlob<float>(bias_->shape(),
-                                             op_name_ + "_scale_value");
+      scale_ = op_ws_->CreateTempBlob<float>(bias_->shape(), &scale_temp_);
       Blas::Set(scale_->count(), 1, scale_->mutable_data(), 0);
     }
   } else {
@@ -46,8 +46,8 @@ void ScaleOp::Forward() {
       bias_value_ = VecFloat(dim, 0);
     }
     op_ws_->GrowTempBuffer(2 * dim, sizeof(float));
-    scale_ = op_ws_->CreateTempBlob<float>({dim}, op_name_ + "_scale_value");
-    bias_ = op_ws_->CreateTempBlob<float>({dim}, op_name_ + "_bias_value");
+    scale_ = op_ws_->CreateTempBlob<float>({dim}, &scale_temp_);
+    bias_ = op_ws_->CreateTempBlob<float>({dim}, &bias_temp_);
     scale_->set_data(scale_value_.data(), dim);
     bias_->set_data(bias_value_.data(), dim);
   }
@@ -73,18 +73,44 @@ void ScaleOp::Forward() {
                 scale_dim_, inner_dim_, top->mutable_data());
 }
 
+void ScaleOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                          std::vector<VecInt> *top_shapes) const {
+  const auto &in_shape = bottom_shapes[0];
+  (*top_shapes)[0] = in_shape;
+
+  if (scale_value_.empty() && bias_value_.empty()) {
+    if (!has_scale_ || !has_bias_) {
+      op_ws_->PlanTemp(count_of(bottom_shapes[1]), sizeof(float));
+    }
+  } else {
+    int axis = axis_ < 0 ? axis_ + static_cast<int>(in_shape.size()) : axis_;
+    op_ws_->PlanTemp(in_shape[axis], sizeof(float));
+    op_ws_->PlanTemp(in_shape[axis], sizeof(float));
+  }
+}
+
 REGISTER_OPERATOR(Scale, ScaleOp);
 
 namespace Vision {
 
 #if !defined(USE_CUDA)
+template <typename T>
+struct ScaleKernel {
+  static CPU_KERNEL void Run(const T *in_data, int count, const T *scale_data,
+                             const T *bias_data, int scale_dim, int inner_dim,
+                             T *out_data) {
+    for (int i = 0; i < count; ++i) {
+      int index = (i / inner_dim) % scale_dim;
+      out_data[i] = in_data[i] * scale_data[index] + bias_data[index];
+    }
+  }
+};
+
 template <typename T>
 void Scale(const T *in_data, int count, const T *scale_data, const T *bias_data,
            int scale_dim, int inner_dim, T *out_data) {
-  for (int i = 0; i < count; ++i) {
-    int index = (i / inner_dim) % scale_dim;
-    out_data[i] = in_data[i] * scale_data[index] + bias_data[index];
-  }
+  CPU::Dispatch<ScaleKernel<T>>(in_data, count, scale_data, bias_data,
+                                scale_dim, inner_dim, out_data);
 }
 
 template void Scale(const float *in_data, int count, const float *scale_data,
@@ -17,6 +17,12 @@ class ScaleOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
+
+  double flops() const override {
+    return 2.0 * tops<float>(0)->count();
+  }
 
  private:
   int axis_, scale_dim_, inner_dim_;
@@ -24,6 +30,8 @@ class ScaleOp : public Operator {
   VecFloat scale_value_, bias_value_;
 
   BlobF *scale_ = nullptr, *bias_ = nullptr;
+  // Slots of the temp blobs standing in for missing bottoms
+  BlobF *scale_temp_ = nullptr, *bias_temp_ = nullptr;
 };
 
 namespace Vision {
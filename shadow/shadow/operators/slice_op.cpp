@@ -8,34 +8,37 @@ void SliceOp::Forward() {
   int num_tops = tops_size();
   auto top_shape = bottom->shape();
   if (num_tops > 1) {
-    VecInt slices;
     int bottom_slice_axis = bottom->shape(slice_axis_);
-    if (slice_point_.empty()) {
-      CHECK_EQ(bottom_slice_axis % num_tops, 0);
-      slices.resize(num_tops, bottom_slice_axis / num_tops);
-    } else {
-      CHECK_EQ(slice_point_.size(), num_tops - 1);
-      int prev = 0;
-      for (auto point : slice_point_) {
-        CHECK_GT(point, prev);
-        slices.push_back(point - prev);
-        prev = point;
+    const auto &slices = Slices(bottom_slice_axis, num_tops);
+    int num_slices = bottom->count(0, slice_axis_);
+    int slice_size = bottom->count(slice_axis_ + 1);
+
+    // Each top is a contiguous range of the bottom, slicing is metadata only
+    if (num_slices == 1 && view_) {
+      int offset = 0;
+      for (int n = 0; n < num_tops; ++n) {
+        auto *top = mutable_tops<float>(n);
+        top_shape[slice_axis_] = slices[n];
+        top->set_view(bottom->data() + offset, top_shape);
+        offset += top->count();
       }
-      CHECK_GT(bottom_slice_axis, prev);
-      slices.push_back(bottom_slice_axis - prev);
+      CHECK_EQ(offset, bottom->count());
+      return;
     }
+
     int count = 0;
     for (int n = 0; n < num_tops; ++n) {
       auto *top = mutable_tops<float>(n);
       top_shape[slice_axis_] = slices[n];
+      if (top->is_view()) {
+        top->clear();
+      }
       top->reshape(top_shape);
       count += top->count();
     }
     CHECK_EQ(count, bottom->count());
 
     int offset_slice_axis = 0;
-    int num_slices = bottom->count(0, slice_axis_);
-    int slice_size = bottom->count(slice_axis_ + 1);
     for (int n = 0; n < tops_size(); ++n) {
       auto *top = mutable_tops<float>(n);
       int top_slice_axis = top->shape(slice_axis_);
@@ -46,11 +49,47 @@ void SliceOp::Forward() {
     }
   } else {
     auto *top = mutable_tops<float>(0);
+    top->clear();
     top->set_shape(top_shape);
     top->share_data(*bottom);
   }
 }
 
+void SliceOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                          std::vector<VecInt> *top_shapes) const {
+  auto top_shape = bottom_shapes[0];
+  int num_tops = static_cast<int>(top_shapes->size());
+  if (num_tops > 1) {
+    const auto &slices = Slices(top_shape[slice_axis_], num_tops);
+    for (int n = 0; n < num_tops; ++n) {
+      top_shape[slice_axis_] = slices[n];
+      (*top_shapes)[n] = top_shape;
+    }
+  } else {
+    (*top_shapes)[0] = top_shape;
+  }
+}
+
+// Sizes of the tops along the slice axis
+VecInt SliceOp::Slices(int bottom_slice_axis, int num_tops) const {
+  VecInt slices;
+  if (slice_point_.empty()) {
+    CHECK_EQ(bottom_slice_axis % num_tops, 0);
+    slices.resize(num_tops, bottom_slice_axis / num_tops);
+  } else {
+    CHECK_EQ(static_cast<int>(slice_point_.size()), num_tops - 1);
+    int prev = 0;
+    for (auto point : slice_point_) {
+      CHECK_GT(point, prev);
+      slices.push_back(point - prev);
+      prev = point;
+    }
+    CHECK_GT(bottom_slice_axis, prev);
+    slices.push_back(bottom_slice_axis - prev);
+  }
+  return slices;
+}
+
 REGISTER_OPERATOR(Slice, SliceOp);
 
 namespace Vision {
@@ -11,14 +11,21 @@ class SliceOp : public Operator {
       : Operator(op_param, ws) {
     slice_axis_ = get_single_argument<int>("axis", 0);
     slice_point_ = get_repeated_argument<int>("slice_point");
+    // Set by the network when no top is written in place
+    view_ = get_single_argument<bool>("view", false);
     CHECK_GE(slice_axis_, 0);
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
 
  private:
+  VecInt Slices(int bottom_slice_axis, int num_tops) const;
+
   int slice_axis_;
   VecInt slice_point_;
+  bool view_;
 };
 
 namespace Vision {
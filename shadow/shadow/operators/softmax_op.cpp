@@ -38,7 +38,7 @@ void SoftmaxOp::Forward() {
   for (auto dim : scale_shape) temp_count *= dim;
   op_ws_->GrowTempBuffer(temp_count, sizeof(float));
 
-  scale_ = op_ws_->CreateTempBlob<float>(scale_shape, op_name_ + "_scale");
+  op_ws_->CreateTempBlob<float>(scale_shape, &scale_);
 
   int count = bottom->count(), channels = bottom->shape(axis_);
 
@@ -54,6 +54,17 @@ void SoftmaxOp::Forward() {
 #endif
 }
 
+void SoftmaxOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                            std::vector<VecInt> *top_shapes) const {
+  const auto &in_shape = bottom_shapes[0];
+  (*top_shapes)[0] = in_shape;
+
+#if !defined(USE_CUDNN)
+  int axis = axis_ < 0 ? axis_ + static_cast<int>(in_shape.size()) : axis_;
+  op_ws_->PlanTemp(count_of(in_shape) / in_shape[axis], sizeof(float));
+#endif
+}
+
 REGISTER_OPERATOR(Softmax, SoftmaxOp);
 
 }  // namespace Shadow
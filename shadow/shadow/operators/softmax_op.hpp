@@ -30,6 +30,13 @@ class SoftmaxOp : public Operator {
   }
 
   void Forward() override;
+  void InferShapes(const std::vector<VecInt> &bottom_shapes,
+                   std::vector<VecInt> *top_shapes) const override;
+
+  // Max, subtract, exp, sum and divide
+  double flops() const override {
+    return 5.0 * tops<float>(0)->count();
+  }
 
  private:
   int axis_, outer_num_, inner_num_;
@@ -27,6 +27,15 @@ void StackOp::Forward() {
   }
 }
 
+void StackOp::InferShapes(const std::vector<VecInt> &bottom_shapes,
+                          std::vector<VecInt> *top_shapes) const {
+  auto top_shape = bottom_shapes[0];
+  int axis = axis_ < 0 ? axis_ + static_cast<int>(top_shape.size()) + 1 : axis_;
+  top_shape.insert(top_shape.begin() + axis,
+                   static_cast<int>(bottom_shapes.size()));
+  (*top_shapes)[0] = top_shape;
+}
+
 REGISTER_OPERATOR(Stack, StackOp);
 
 namespace Vision {
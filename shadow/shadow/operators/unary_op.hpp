@@ -16,6 +16,10 @@ class UnaryOp : public Operator {
 
   void Forward() override;
 
+  double flops() const override {
+    return tops<float>(0)->count();
+  }
+
  private:
   enum {
     kAbs = 0,
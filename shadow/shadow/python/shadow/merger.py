@@ -115,19 +115,61 @@ def convert_batch_norm(o, ori_net, merged_net, copy_params):
     merge_bias_blob.data_f.extend(bias)
 
 
-def convert_activate(conv_op, ac_op, merged_net):
+def convert_activate(conv_op, residual, ac_op, merged_net):
     merged_op = merged_net.add_op()
     merged_op.name = conv_op.name
     merged_op.type = conv_op.type
-    merged_op.top.extend(ac_op.top)
     merged_op.bottom.extend(conv_op.bottom)
 
     for arg in conv_op.arg:
         merged_op.arg.add().CopyFrom(arg)
 
-    bias_arg = merged_op.arg.add()
-    bias_arg.name = 'type'
-    bias_arg.s_i = 1
+    if ac_op is not None:
+        ac_type = get_arg(ac_op, 'type', 's_i', 1)
+        type_arg = merged_op.arg.add()
+        type_arg.name = 'type'
+        type_arg.s_i = ac_type
+        if ac_type == 0:
+            shared_arg = merged_op.arg.add()
+            shared_arg.name = 'channel_shared'
+            shared_arg.s_i = get_arg(ac_op, 'channel_shared', 's_i', 0)
+            merged_op.bottom.append(ac_op.bottom[1])
+        elif ac_type == 2:
+            slope_arg = merged_op.arg.add()
+            slope_arg.name = 'slope'
+            slope_arg.s_f = get_arg(ac_op, 'slope', 's_f', 0.1)
+        merged_op.top.extend(ac_op.top)
+
+    if residual is not None:
+        eltwise_op, residual_name = residual
+        residual_arg = merged_op.arg.add()
+        residual_arg.name = 'residual_term'
+        residual_arg.s_i = 1
+        merged_op.bottom.append(residual_name)
+        if ac_op is None:
+            merged_op.top.extend(eltwise_op.top)
+
+
+def get_num_use(ori_net, blob_name):
+    return sum(list(op.bottom).count(blob_name) for op in ori_net.op)
+
+
+def get_residual(conv_op, eltwise_op, ori_net):
+    if eltwise_op.type != 'Eltwise' or len(eltwise_op.bottom) != 2:
+        return None
+    if get_arg(eltwise_op, 'operation', 's_i', 1) != 1:
+        return None
+    if any(c != 1 for c in get_arg(eltwise_op, 'coeff', 'v_f', [])):
+        return None
+    conv_top = conv_op.top[0]
+    if conv_top not in eltwise_op.bottom:
+        return None
+    residual_name = eltwise_op.bottom[1 - list(eltwise_op.bottom).index(conv_top)]
+    if residual_name == conv_top or residual_name in eltwise_op.top:
+        return None
+    if get_num_use(ori_net, conv_top) != 1:
+        return None
+    return eltwise_op, residual_name
 
 
 def merge_batchnorm(shadow_net, copy_params):
@@ -171,15 +213,23 @@ def merge_activate(shadow_net):
         o = 0
         while o < op_size:
             op = ori_net.op[o]
-            if op.type == 'Conv' or op.type == 'Deconv':
-                ac_index = o + 1
-                has_ac = False
+            if op.type == 'Conv' or op.type == 'Deconv' or op.type == 'Connected':
+                ac_index, residual = o + 1, None
                 if ac_index < op_size:
-                    ac_op = ori_net.op[ac_index]
-                    has_ac = ac_op.type == 'Activate' and get_arg(ac_op, 'type', 's_i', -1) == 1
-                if has_ac:
-                    convert_activate(op, ori_net.op[ac_index], merged_net)
-                    o += 2
+                    residual = get_residual(op, ori_net.op[ac_index], ori_net)
+                    if residual is not None:
+                        ac_index += 1
+                ac_op = None
+                if ac_index < op_size and ori_net.op[ac_index].type == 'Activate':
+                    ac_bottom = residual[0].top[0] if residual is not None else op.top[0]
+                    # The merged op only writes the Activate top, so no
+                    # other op may read the blob it consumes
+                    if ori_net.op[ac_index].bottom[0] == ac_bottom:
+                        if get_num_use(ori_net, ac_bottom) == 1:
+                            ac_op = ori_net.op[ac_index]
+                if ac_op is not None or residual is not None:
+                    convert_activate(op, residual, ac_op, merged_net)
+                    o = ac_index + 1 if ac_op is not None else ac_index
                     continue
             merged_net.add_op().CopyFrom(op)
             o += 1
@@ -174,18 +174,25 @@ def convert_binary(mxnet_nodes, index, param_dict, shadow_net):
     bottom_names, param_names = find_inputs(mxnet_nodes, json_name, json_inputs)
 
     json_op = json_node['op']
-    if json_op == '_plus_scalar':
+    if json_op in ('_plus_scalar', 'broadcast_add'):
         operation_type = 'Add'
-    elif json_op == '_minus_scalar':
+    elif json_op in ('_minus_scalar', 'elemwise_sub', 'broadcast_sub'):
         operation_type = 'Sub'
-    elif json_op == '_mul_scalar':
+    elif json_op in ('_mul_scalar', 'elemwise_mul', 'broadcast_mul'):
         operation_type = 'Mul'
-    elif json_op == '_div_scalar':
+    elif json_op in ('_div_scalar', 'elemwise_div', 'broadcast_div'):
         operation_type = 'Div'
+    elif json_op == 'broadcast_maximum':
+        operation_type = 'Max'
+    elif json_op == 'broadcast_minimum':
+        operation_type = 'Min'
     else:
         raise ValueError('Unsupported binary type', json_op)
 
-    scalar = parse_param(json_attr, 'scalar', 's_f', 1)
+    if json_op.endswith('_scalar'):
+        scalar = parse_param(json_attr, 'scalar', 's_f', 1)
+    else:
+        scalar = None
 
     shadow_net.add_binary(json_name, bottom_names, [json_name], operation_type, scalar)
 
@@ -401,6 +408,24 @@ def convert_reshape(mxnet_nodes, index, param_dict, shadow_net):
     shadow_net.add_reshape(json_name, bottom_names, [json_name], shape)
 
 
+def convert_roi_align(mxnet_nodes, index, param_dict, shadow_net):
+    json_node = mxnet_nodes[index]
+    json_name = json_node['name']
+    json_inputs = json_node['inputs']
+    if params_str in json_node:
+        json_attr = json_node[params_str]
+    else:
+        json_attr = {}
+    bottom_names, param_names = find_inputs(mxnet_nodes, json_name, json_inputs)
+
+    pooled_size = parse_param(json_attr, 'pooled_size', 'v_i', [14, 14])
+    spatial_scale = parse_param(json_attr, 'spatial_scale', 's_f', 0.0625)
+    sample_ratio = parse_param(json_attr, 'sample_ratio', 's_i', -1)
+    aligned = parse_param(json_attr, 'aligned', 's_s', 'False') == 'True'
+
+    shadow_net.add_roi_align(json_name, bottom_names, [json_name], pooled_size[0], pooled_size[1], spatial_scale, sample_ratio, aligned)
+
+
 def convert_roi_pooling(mxnet_nodes, index, param_dict, shadow_net):
     json_node = mxnet_nodes[index]
     json_name = json_node['name']
@@ -460,6 +485,8 @@ def mxnet2shadow(model_root, meta_net_info, copy_params=False):
                 convert_batch_norm(mxnet_nodes, index, param_dict, arg_params, shadow_net)
             elif json_op == '_plus_scalar' or json_op == '_minus_scalar' or json_op == '_mul_scalar' or json_op == '_div_scalar':
                 convert_binary(mxnet_nodes, index, param_dict, shadow_net)
+            elif json_op in ('elemwise_sub', 'elemwise_mul', 'elemwise_div', 'broadcast_add', 'broadcast_sub', 'broadcast_mul', 'broadcast_div', 'broadcast_maximum', 'broadcast_minimum'):
+                convert_binary(mxnet_nodes, index, param_dict, shadow_net)
             elif json_op == 'Concat':
                 convert_concat(mxnet_nodes, index, param_dict, shadow_net)
             elif json_op == 'FullyConnected':
@@ -470,7 +497,7 @@ def mxnet2shadow(model_root, meta_net_info, copy_params=False):
                 convert_deform_conv(mxnet_nodes, index, param_dict, shadow_net)
             elif json_op == '_contrib_DeformablePSROIPooling':
                 convert_deform_psroi_pooling(mxnet_nodes, index, param_dict, shadow_net)
-            elif json_op == 'elemwise_add' or json_op == 'broadcast_add':
+            elif json_op == 'elemwise_add':
                 convert_eltwise(mxnet_nodes, index, param_dict, shadow_net, 'Sum')
             elif json_op == 'LeakyReLU':
                 convert_leakyrelu(mxnet_nodes, index, param_dict, shadow_net)
@@ -480,6 +507,8 @@ def mxnet2shadow(model_root, meta_net_info, copy_params=False):
                 convert_proposal(mxnet_nodes, index, param_dict, shadow_net)
             elif json_op == 'Reshape':
                 convert_reshape(mxnet_nodes, index, param_dict, shadow_net)
+            elif json_op == '_contrib_ROIAlign':
+                convert_roi_align(mxnet_nodes, index, param_dict, shadow_net)
             elif json_op == 'ROIPooling':
                 convert_roi_pooling(mxnet_nodes, index, param_dict, shadow_net)
             elif json_op == 'SoftmaxOutput' or json_op == 'SoftmaxActivation' or json_op == 'softmax':
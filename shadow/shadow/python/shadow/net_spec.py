@@ -104,10 +104,14 @@ class Shadow(object):
     def add_op(self):
         return self.get_net(self.net_index).op.add()
 
-    def add_input(self, name, bottoms, tops, shapes):
+    def add_input(self, name, bottoms, tops, shapes, input_type=None):
         op_param = self.net_param.op.add()
         self.add_common(op_param, name, 'Input', bottoms, tops)
 
+        if input_type is not None:
+            for top in tops:
+                self.set_arg(op_param, top + '_type', input_type, 's_s')
+
         if len(tops) == len(shapes):
             for n in range(0, len(tops)):
                 self.set_arg(op_param, tops[n], shapes[n], 'v_i')
@@ -301,6 +305,18 @@ class Shadow(object):
         self.set_arg(op_param, 'global_pooling', global_pooling, 's_i')
         self.set_arg(op_param, 'full_pooling', full_pooling, 's_i')
 
+    def add_preprocess(self, name, bottoms, tops, channel_last=True, channel_order=None, mean_value=None, scale_value=None):
+        op_param = self.net_param.op.add()
+        self.add_common(op_param, name, 'Preprocess', bottoms, tops)
+
+        self.set_arg(op_param, 'channel_last', channel_last, 's_i')
+        if channel_order is not None:
+            self.set_arg(op_param, 'channel_order', channel_order, 'v_i')
+        if mean_value is not None:
+            self.set_arg(op_param, 'mean_value', mean_value, 'v_f')
+        if scale_value is not None:
+            self.set_arg(op_param, 'scale_value', scale_value, 'v_f')
+
     def add_prior_box(self, name, bottoms, tops, min_size=None, max_size=None, aspect_ratio=None, flip=True, clip=True, variance=None, step=0, offset=0.5):
         op_param = self.net_param.op.add()
         self.add_common(op_param, name, 'PriorBox', bottoms, tops)
@@ -353,6 +369,16 @@ class Shadow(object):
         self.set_arg(op_param, 'axis', axis, 's_i')
         self.set_arg(op_param, 'num_axes', num_axes, 's_i')
 
+    def add_roi_align(self, name, bottoms, tops, pooled_h, pooled_w, spatial_scale, sampling_ratio=-1, aligned=False):
+        op_param = self.net_param.op.add()
+        self.add_common(op_param, name, 'ROIAlign', bottoms, tops)
+
+        self.set_arg(op_param, 'pooled_h', pooled_h, 's_i')
+        self.set_arg(op_param, 'pooled_w', pooled_w, 's_i')
+        self.set_arg(op_param, 'spatial_scale', spatial_scale, 's_f')
+        self.set_arg(op_param, 'sampling_ratio', sampling_ratio, 's_i')
+        self.set_arg(op_param, 'aligned', aligned, 's_i')
+
     def add_roi_pooling(self, name, bottoms, tops, pooled_h, pooled_w, spatial_scale):
         op_param = self.net_param.op.add()
         self.add_common(op_param, name, 'ROIPooling', bottoms, tops)
@@ -399,7 +425,7 @@ class Shadow(object):
 
     def add_unary(self, name, bottoms, tops, operation):
         op_param = self.net_param.op.add()
-        self.add_common(op_param, name, 'Binary', bottoms, tops)
+        self.add_common(op_param, name, 'Unary', bottoms, tops)
 
         if operation == 'Abs':
             self.set_arg(op_param, 'operation', 0, 's_i')
@@ -0,0 +1,175 @@
+#include "core/network.hpp"
+#include "core/perf_counters.hpp"
+#include "util/type.hpp"
+
+#include <gtest/gtest.h>
+
+namespace Shadow {
+
+namespace {
+
+void AddBlob(shadow::NetParam *net_param, const std::string &name,
+             const VecInt &shape, float value) {
+  auto *blob = net_param->add_blob();
+  blob->set_name(name);
+  int count = 1;
+  for (const auto dim : shape) {
+    blob->add_shape(dim);
+    count *= dim;
+  }
+  for (int i = 0; i < count; ++i) blob->add_data_f(value);
+}
+
+shadow::OpParam *AddOp(shadow::NetParam *net_param, const std::string &type,
+                       const std::string &name, const VecString &bottoms,
+                       const VecString &tops) {
+  auto *op_param = net_param->add_op();
+  op_param->set_type(type);
+  op_param->set_name(name);
+  for (const auto &bottom : bottoms) op_param->add_bottom(bottom);
+  for (const auto &top : tops) op_param->add_top(top);
+  return op_param;
+}
+
+// data -> 3x3 conv of ones with 4 outputs -> relu, the input shape is given
+// by the Input op
+shadow::NetParam ConvNet(const VecInt &in_shape) {
+  shadow::NetParam net_param;
+  AddBlob(&net_param, "weight", {4, in_shape[1], 3, 3}, 1.f);
+  AddBlob(&net_param, "bias", {4}, 0.f);
+  auto *input = AddOp(&net_param, "Input", "input", {}, {"data"});
+  set_v_i(input, "data", in_shape);
+  auto *conv =
+      AddOp(&net_param, "Conv", "conv", {"data", "weight", "bias"}, {"conv"});
+  set_s_i(conv, "num_output", 4);
+  set_s_i(conv, "kernel_size", 3);
+  set_s_i(conv, "pad", 1);
+  AddOp(&net_param, "Activate", "relu", {"conv"}, {"conv"});
+  set_v_s(&net_param, "out_blob", VecString{"conv"});
+  return net_param;
+}
+
+TEST(DryRunTest, ShapesTheOutputsOnLoad) {
+  Network network;
+  network.Setup();
+  network.LoadModel(ConvNet({1, 3, 8, 8}));
+  EXPECT_EQ(network.GetBlobShapeByName<float>("conv"), VecInt({1, 4, 8, 8}));
+}
+
+TEST(DryRunTest, LeavesTheForwardExact) {
+  Network network;
+  network.Setup();
+  network.LoadModel(ConvNet({1, 3, 8, 8}));
+
+  std::vector<float> in_data(3 * 8 * 8, 1.f);
+  network.Forward({{"data", in_data.data()}});
+  const auto *out_data = network.GetBlobDataByName<float>("conv");
+  // Corners see 2x2 taps of the 3 channels, inner pixels 3x3
+  EXPECT_FLOAT_EQ(out_data[0], 12.f);
+  EXPECT_FLOAT_EQ(out_data[8 + 1], 27.f);
+  EXPECT_FLOAT_EQ(out_data[3 * 64 + 63], 12.f);
+}
+
+TEST(DryRunTest, FollowsLaterInputShapes) {
+  Network network;
+  network.Setup();
+  network.LoadModel(ConvNet({1, 3, 8, 8}));
+
+  std::vector<float> in_data(2 * 3 * 5 * 6, 1.f);
+  network.Forward({{"data", in_data.data()}}, {{"data", {2, 3, 5, 6}}});
+  EXPECT_EQ(network.GetBlobShapeByName<float>("conv"), VecInt({2, 4, 5, 6}));
+  const auto *out_data = network.GetBlobDataByName<float>("conv");
+  EXPECT_FLOAT_EQ(out_data[4 * 30 + 6 + 1], 27.f);
+}
+
+TEST(QueryMemoryTest, LeavesTheNetUnchanged) {
+  Network network;
+  network.Setup();
+  network.LoadModel(ConvNet({1, 3, 8, 8}));
+
+  std::vector<float> in_data(3 * 8 * 8, 1.f);
+  network.Forward({{"data", in_data.data()}});
+  network.QueryMemory({{"data", {2, 3, 16, 16}}});
+  EXPECT_EQ(network.GetBlobShapeByName<float>("data"), VecInt({1, 3, 8, 8}));
+  EXPECT_EQ(network.GetBlobShapeByName<float>("conv"), VecInt({1, 4, 8, 8}));
+  const auto *out_data = network.GetBlobDataByName<float>("conv");
+  EXPECT_FLOAT_EQ(out_data[0], 12.f);
+  EXPECT_FLOAT_EQ(out_data[8 + 1], 27.f);
+}
+
+TEST(QueryMemoryTest, CountsTheQueriedShapes) {
+  Network network;
+  network.Setup();
+  network.LoadModel(ConvNet({1, 3, 8, 8}));
+
+  const auto &memory_info = network.QueryMemory({{"data", {2, 3, 16, 16}}});
+  ASSERT_EQ(memory_info.ops.size(), 3u);
+  const auto &input = memory_info.ops[0], &conv = memory_info.ops[1],
+             &relu = memory_info.ops[2];
+  EXPECT_EQ(input.activation_bytes, 2 * 3 * 16 * 16 * sizeof(float));
+  EXPECT_EQ(conv.activation_bytes, 2 * 4 * 16 * 16 * sizeof(float));
+  EXPECT_EQ(conv.weight_bytes, (4 * 3 * 3 * 3 + 4) * sizeof(float));
+  EXPECT_EQ(memory_info.weight_bytes, conv.weight_bytes);
+  EXPECT_GE(memory_info.activation_bytes,
+            input.activation_bytes + conv.activation_bytes);
+}
+
+TEST(QueryMemoryTest, ReportsTheTempPeakOfEachOp) {
+  Network network;
+  network.Setup();
+  network.LoadModel(ConvNet({1, 3, 8, 8}));
+
+  const auto &memory_info = network.QueryMemory({{"data", {1, 3, 16, 16}}});
+  ASSERT_EQ(memory_info.ops.size(), 3u);
+  // The 3x3 conv unrolls its input, the relu stacks nothing
+  EXPECT_GT(memory_info.ops[1].temp_bytes, 0u);
+  EXPECT_EQ(memory_info.ops[2].temp_bytes, 0u);
+  EXPECT_EQ(memory_info.temp_bytes, memory_info.ops[1].temp_bytes);
+}
+
+TEST(ProfileTest, ClosedCountersReadZero) {
+  PerfCounters perf_counters;
+  EXPECT_FALSE(perf_counters.opened());
+  const auto sample = perf_counters.Read();
+  EXPECT_EQ(sample.cycles, 0u);
+  EXPECT_EQ(sample.instructions, 0u);
+  EXPECT_EQ(sample.cache_misses, 0u);
+  EXPECT_EQ(sample.branch_misses, 0u);
+}
+
+TEST(ProfileTest, TimesOpsWithOrWithoutCounters) {
+  Network network;
+  network.Setup();
+  network.LoadModel(ConvNet({1, 3, 8, 8}));
+  network.EnableProfiling();
+
+  std::vector<float> in_data(3 * 8 * 8, 1.f);
+  network.Forward({{"data", in_data.data()}});
+  network.Forward({{"data", in_data.data()}});
+
+  // Without counters, e.g. where perf_event_open is not permitted, only
+  // the timing and the work of each op are filled in
+  PerfCounters perf_counters;
+  bool has_counters = perf_counters.Open();
+
+  const auto &profile = network.GetProfile();
+  ASSERT_EQ(profile.size(), 3u);
+  for (const auto &op_profile : profile) {
+    EXPECT_EQ(op_profile.forwards, 2);
+    EXPECT_GE(op_profile.milliseconds, 0);
+    if (!has_counters) {
+      EXPECT_EQ(op_profile.cycles, 0u);
+      EXPECT_EQ(op_profile.instructions, 0u);
+    }
+  }
+  // The input does no arithmetic, the conv a multiply add per tap and
+  // output, the relu one per output
+  EXPECT_EQ(profile[0].flops, 0);
+  EXPECT_EQ(profile[1].flops, 2 * 2.0 * 4 * 8 * 8 * 3 * 3 * 3);
+  EXPECT_EQ(profile[2].flops, 2 * 4 * 8 * 8);
+  EXPECT_GT(profile[1].bytes, 0);
+}
+
+}  // namespace
+
+}  // namespace Shadow
@@ -0,0 +1,60 @@
+#include "util/util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace Shadow {
+
+namespace {
+
+TEST(ProfilerTest, TimesByNameAndByStage) {
+  Profiler profiler;
+  auto *stage = profiler.stage("forward");
+  profiler.tic("forward");
+  profiler.toc("forward");
+  profiler.tic(stage);
+  profiler.toc(stage);
+  // A tic by stage pairs with a toc by name on the same thread
+  profiler.tic(stage);
+  profiler.toc("forward");
+  EXPECT_EQ(stage->snapshot().count(), 3u);
+}
+
+TEST(ProfilerTest, IgnoresATocWithoutATic) {
+  Profiler profiler;
+  profiler.toc("forward");
+  profiler.tic("forward");
+  profiler.toc("forward");
+  profiler.toc("forward");
+  EXPECT_EQ(profiler.stage("forward")->snapshot().count(), 1u);
+}
+
+TEST(ProfilerTest, MergesTheThreads) {
+  Profiler profiler;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&profiler]() {
+      for (int i = 0; i < 100; ++i) {
+        profiler.tic("forward");
+        profiler.toc("forward");
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  EXPECT_EQ(profiler.stage("forward")->snapshot().count(), 400u);
+}
+
+TEST(ProfilerTest, StartsFreshAfterADestroyedProfiler) {
+  {
+    Profiler profiler;
+    profiler.tic("forward");
+  }
+  Profiler profiler;
+  profiler.toc("forward");
+  EXPECT_EQ(profiler.stage("forward")->snapshot().count(), 0u);
+}
+
+}  // namespace
+
+}  // namespace Shadow
@@ -0,0 +1,130 @@
+#include "core/workspace.hpp"
+
+#include <gtest/gtest.h>
+
+namespace Shadow {
+
+namespace {
+
+// Temp sizes are multiples of the temp blob alignment, so the bytes a temp
+// takes on the stack are its size
+const int kSmall = 16, kLarge = 1024;
+const size_t kSmallBytes = kSmall * sizeof(float),
+             kLargeBytes = kLarge * sizeof(float);
+
+TEST(TempScopeTest, ReleasesItsTemporaries) {
+  Workspace ws;
+  BlobF *temp = nullptr;
+  {
+    TempScope scope(&ws);
+    ws.CreateTempBlob<float>({kLarge}, &temp);
+    EXPECT_EQ(ws.TempMark(), kLargeBytes);
+    EXPECT_EQ(scope.peak(), kLargeBytes);
+  }
+  EXPECT_EQ(ws.TempMark(), 0u);
+}
+
+TEST(TempScopeTest, NestedScopesMeasureTheirOwnPeak) {
+  Workspace ws;
+  BlobF *outer_temp = nullptr, *inner_temp = nullptr, *late_temp = nullptr;
+  TempScope outer(&ws);
+  ws.CreateTempBlob<float>({kSmall}, &outer_temp);
+  auto mark = ws.TempMark();
+  {
+    TempScope inner(&ws);
+    ws.CreateTempBlob<float>({kLarge}, &inner_temp);
+    EXPECT_EQ(inner.peak(), kLargeBytes);
+  }
+  EXPECT_EQ(ws.TempMark(), mark);
+  EXPECT_EQ(outer.peak(), kSmallBytes + kLargeBytes);
+
+  // Temporaries below the inner peak leave it unchanged
+  ws.CreateTempBlob<float>({kSmall}, &late_temp);
+  EXPECT_EQ(outer.peak(), kSmallBytes + kLargeBytes);
+}
+
+TEST(TempScopeTest, KeepsThePeakAfterRelease) {
+  Workspace ws;
+  BlobF *large = nullptr, *small = nullptr;
+  {
+    TempScope scope(&ws);
+    ws.CreateTempBlob<float>({kLarge}, &large);
+  }
+  EXPECT_EQ(ws.TempPeak(), kLargeBytes);
+  {
+    // A later scope starts from zero but does not lower the total peak
+    TempScope scope(&ws);
+    ws.CreateTempBlob<float>({kSmall}, &small);
+    EXPECT_EQ(scope.peak(), kSmallBytes);
+  }
+  EXPECT_EQ(ws.TempPeak(), kLargeBytes);
+  ws.ResetTempPeak();
+  EXPECT_EQ(ws.TempPeak(), 0u);
+}
+
+TEST(TempScopeTest, SlotKeepsItsBlob) {
+  Workspace ws;
+  BlobF *temp = nullptr;
+  BlobF *first = nullptr;
+  {
+    TempScope scope(&ws);
+    first = ws.CreateTempBlob<float>({kSmall}, &temp);
+  }
+  {
+    TempScope scope(&ws);
+    EXPECT_EQ(ws.CreateTempBlob<float>({2, kLarge}, &temp), first);
+    EXPECT_EQ(temp->shape(), VecInt({2, kLarge}));
+    EXPECT_EQ(temp->count(), 2 * kLarge);
+  }
+}
+
+TEST(TempScopeTest, RetiresAnOutgrownBufferWhileTempsAreLive) {
+  Workspace ws;
+  BlobF *small = nullptr, *large = nullptr;
+  {
+    TempScope scope(&ws);
+    ws.CreateTempBlob<float>({kSmall}, &small);
+    auto *small_data = small->mutable_data();
+    for (int i = 0; i < kSmall; ++i) small_data[i] = static_cast<float>(i);
+
+    // Does not fit the buffer sized for the first temp, the old one stays
+    // alive for small until the scope ends
+    ws.CreateTempBlob<float>({64 * kLarge}, &large);
+    EXPECT_GE(ws.GetWorkspaceTempSize(), kSmallBytes + 64 * kLargeBytes);
+    auto *large_data = large->mutable_data();
+    for (int i = 0; i < 64 * kLarge; ++i) large_data[i] = -1.f;
+    for (int i = 0; i < kSmall; ++i) {
+      EXPECT_EQ(small->data()[i], static_cast<float>(i));
+    }
+  }
+  EXPECT_EQ(ws.TempMark(), 0u);
+
+  // The grown buffer serves the same temporaries from now on
+  auto temp_size = ws.GetWorkspaceTempSize();
+  {
+    TempScope scope(&ws);
+    ws.CreateTempBlob<float>({kSmall}, &small);
+    ws.CreateTempBlob<float>({64 * kLarge}, &large);
+  }
+  EXPECT_EQ(ws.GetWorkspaceTempSize(), temp_size);
+}
+
+TEST(TempScopeTest, GrowTempBufferMakesRoomAhead) {
+  Workspace ws;
+  BlobF *temp = nullptr;
+  ws.GrowTempBuffer(kLarge, sizeof(float));
+  auto temp_size = ws.GetWorkspaceTempSize();
+  EXPECT_GE(temp_size, kLargeBytes);
+  {
+    TempScope scope(&ws);
+    ws.CreateTempBlob<float>({kLarge}, &temp);
+  }
+  EXPECT_EQ(ws.GetWorkspaceTempSize(), temp_size);
+
+  ws.ReleaseTempBuffer();
+  EXPECT_EQ(ws.GetWorkspaceTempSize(), 0u);
+}
+
+}  // namespace
+
+}  // namespace Shadow
@@ -1,16 +1,52 @@
 #include "transformer.hpp"
 
+#include "util/model_pack.hpp"
+
 using namespace Shadow;
 
 int main(int argc, char const* argv[]) {
   std::string save_path("models/mtcnn");
   std::string model("models/mtcnn/mtcnn_merged.shadowmodel");
 
+  // --aot also writes ahead of time forward code for the fixed size nets,
+  // cmake -DShadow_AOT_DIR=models/mtcnn builds it into test_aot. --pack
+  // writes the nets as model packs instead of code, compressed by zstd when
+  // it is compiled in, --half also stores the float weights as half floats
+  bool write_aot = false, write_pack = false, write_half = false;
+  for (int n = 1; n < argc; ++n) {
+    const std::string arg(argv[n]);
+    if (arg == "--aot") write_aot = true;
+    if (arg == "--pack") write_pack = true;
+    if (arg == "--half") write_half = true;
+  }
+
   shadow::MetaNetParam meta_net_param;
   IO::ReadProtoFromBinaryFile(model, &meta_net_param);
+
+  if (write_pack) {
+    int codec = write_half ? IO::kPackHalf : IO::kPackRaw;
+#if defined(USE_Zstd)
+    codec |= IO::kPackZstd;
+#endif
+    Util::make_directory(save_path);
+    const std::vector<std::string> net_names{"mtcnn_merged_p", "mtcnn_merged_r",
+                                             "mtcnn_merged_o"};
+    for (int n = 0; n < static_cast<int>(net_names.size()); ++n) {
+      IO::WriteModelPack(meta_net_param.network(n),
+                         save_path + "/" + net_names[n] + ".shadowpack", codec);
+    }
+    return 0;
+  }
+
   WriteProtoToFiles(meta_net_param.network(0), save_path, "mtcnn_merged_p");
-  WriteProtoToFiles(meta_net_param.network(1), save_path, "mtcnn_merged_r");
-  WriteProtoToFiles(meta_net_param.network(2), save_path, "mtcnn_merged_o");
+  if (write_aot) {
+    // The refine and output nets run on fixed size crops
+    WriteForwardToFiles(meta_net_param.network(1), save_path, "mtcnn_merged_r");
+    WriteForwardToFiles(meta_net_param.network(2), save_path, "mtcnn_merged_o");
+  } else {
+    WriteProtoToFiles(meta_net_param.network(1), save_path, "mtcnn_merged_r");
+    WriteProtoToFiles(meta_net_param.network(2), save_path, "mtcnn_merged_o");
+  }
 
   return 0;
 }
@@ -1,5 +1,7 @@
 #include "transformer.hpp"
 
+#include <set>
+
 namespace Shadow {
 
 const std::vector<shadow::Blob> get_blobs(const shadow::NetParam& shadow_net,
@@ -377,6 +379,789 @@ void WriteWeights(const shadow::NetParam& shadow_net, const std::string& root,
   }
 }
 
+const shadow::Argument* find_argument(const shadow::OpParam& op_param,
+                                      const std::string& name) {
+  for (const auto& arg : op_param.arg()) {
+    if (arg.name() == name) return &arg;
+  }
+  return nullptr;
+}
+
+int argument_i(const shadow::OpParam& op_param, const std::string& name,
+               int default_value) {
+  const auto* arg = find_argument(op_param, name);
+  return arg != nullptr && arg->has_s_i() ? arg->s_i() : default_value;
+}
+
+float argument_f(const shadow::OpParam& op_param, const std::string& name,
+                 float default_value) {
+  const auto* arg = find_argument(op_param, name);
+  return arg != nullptr && arg->has_s_f() ? arg->s_f() : default_value;
+}
+
+const std::vector<int> argument_v_i(const shadow::OpParam& op_param,
+                                    const std::string& name) {
+  std::vector<int> values;
+  const auto* arg = find_argument(op_param, name);
+  if (arg != nullptr) {
+    for (const auto v : arg->v_i()) values.push_back(v);
+  }
+  return values;
+}
+
+int shape_count(const std::vector<int>& shape, int start, int end) {
+  int count = 1;
+  for (int d = start; d < end; ++d) count *= shape[d];
+  return count;
+}
+
+int shape_count(const std::vector<int>& shape) {
+  return shape_count(shape, 0, static_cast<int>(shape.size()));
+}
+
+void pooling_window(const shadow::OpParam& op_param,
+                    const std::vector<int>& in_shape, int* kernel_h,
+                    int* kernel_w, int* stride_h, int* stride_w, int* pad_h,
+                    int* pad_w) {
+  if (argument_i(op_param, "global_pooling", 0)) {
+    *kernel_h = in_shape[2], *kernel_w = in_shape[3];
+    *stride_h = *stride_w = 1, *pad_h = *pad_w = 0;
+    return;
+  }
+  auto pair = [&op_param](const std::string& name, int* h, int* w) {
+    const auto& values = argument_v_i(op_param, name);
+    CHECK(values.size() == 1 || values.size() == 2) << op_param.name();
+    *h = values[0], *w = values.back();
+  };
+  pair("kernel_size", kernel_h, kernel_w);
+  pair("stride", stride_h, stride_w);
+  pair("pad", pad_h, pad_w);
+}
+
+const std::string float_literal(float value) {
+  std::stringstream ss;
+  ss << std::setprecision(9) << value;
+  auto literal = ss.str();
+  if (literal.find_first_of(".e") == std::string::npos) literal += ".";
+  return literal + "f";
+}
+
+// Blob shapes and buffers of a network for the fixed input shapes. Each
+// blob is backed by the weight array written by WriteWeights, by the input
+// pointer handed to Forward or by a range of the activation arena, blobs
+// of Flatten and Reshape share the buffer of their bottom
+class ForwardPlanner {
+ public:
+  ForwardPlanner(const shadow::NetParam& shadow_net,
+                 const std::string& weight_prefix)
+      : net_(shadow_net), weight_prefix_(weight_prefix) {
+    for (const auto& op_param : net_.op()) {
+      for (const auto& top : op_param.top()) writers_[top]++;
+    }
+    CHECK_GT(net_.op_size(), 0);
+    CHECK_EQ(net_.op(0).type(), "Input") << "AOT code needs an Input op";
+    for (const auto& blob : net_.blob()) {
+      if (!writers_.count(blob.name())) weights_.insert(blob.name());
+    }
+    for (const auto& arg : net_.arg()) {
+      if (arg.name() != "out_blob") continue;
+      for (const auto& name : arg.v_s()) out_blob_.push_back(name);
+    }
+    CHECK(!out_blob_.empty()) << "Network must have out_blob argument";
+  }
+
+  void Plan() {
+    temp_counts_.assign(net_.op_size(), 0);
+    for (int i = 0; i < net_.op_size(); ++i) InferShapes(i);
+    // Inputs are read in place unless an op writes over them or they are
+    // returned
+    std::set<std::string> out_roots;
+    for (const auto& name : out_blob_) {
+      CHECK(roots_.count(name)) << "Unknown out_blob " << name;
+      out_roots.insert(roots_.at(name));
+    }
+    const auto& input_op = net_.op(0);
+    for (int n = 0; n < input_op.top_size(); ++n) {
+      const auto& name = input_op.top(n);
+      inputs_.push_back(name);
+      if (writers_[name] > 1 || out_roots.count(name)) {
+        copied_inputs_.insert(name);
+      }
+    }
+    AllocateArena();
+  }
+
+  const std::string Expr(const std::string& name) const {
+    if (weights_.count(name)) return WeightSymbol(name);
+    const auto& root = roots_.at(name);
+    if (!offsets_.count(root)) return "in_" + Sanitize(root);
+    return ArenaExpr(offsets_.at(root));
+  }
+
+  const std::vector<int>& Shape(const std::string& name) const {
+    return shapes_.at(name);
+  }
+
+  const std::string Sanitize(const std::string& name) const {
+    return Util::find_replace(name, {"/", "-", ":", "."}, "_");
+  }
+
+  const std::string WeightSymbol(const std::string& name) const {
+    return weight_prefix_ + "_" +
+           Util::find_replace(name, {"/", "-", ":"}, "_") + "_";
+  }
+
+  const std::string ArenaExpr(int offset) const {
+    return offset == 0 ? "arena" : "arena + " + Util::to_string(offset);
+  }
+
+  int Offset(const std::string& name) const {
+    return offsets_.at(roots_.at(name));
+  }
+
+  const std::string TempExpr(int i) const {
+    return ArenaExpr(temp_offsets_.at(i));
+  }
+
+  bool IsWeight(const std::string& name) const {
+    return weights_.count(name) > 0;
+  }
+
+  const std::vector<std::string>& inputs() const { return inputs_; }
+  const std::set<std::string>& copied_inputs() const {
+    return copied_inputs_;
+  }
+  const std::vector<std::string>& out_blob() const { return out_blob_; }
+  int arena_count() const { return arena_count_; }
+
+ private:
+  void SetShape(const std::string& name, const std::vector<int>& shape,
+                const std::string& root) {
+    if (shapes_.count(name)) {
+      CHECK(shapes_[name] == shape)
+          << "Blob " << name << " is written with different shapes";
+    }
+    shapes_[name] = shape;
+    roots_[name] = root;
+  }
+
+  const std::vector<int>& BottomShape(const shadow::OpParam& op_param,
+                                      int n) const {
+    const auto& name = op_param.bottom(n);
+    CHECK(shapes_.count(name)) << op_param.name() << ": bottom " << name
+                               << " has no shape";
+    return shapes_.at(name);
+  }
+
+  void InferShapes(int i) {
+    const auto& op_param = net_.op(i);
+    const auto& type = op_param.type();
+    const auto& op_name = op_param.name();
+    std::vector<int> top_shape;
+    if (type == "Input") {
+      for (const auto& top : op_param.top()) {
+        const auto& shape = argument_v_i(op_param, top);
+        CHECK(!shape.empty()) << "AOT code needs a static shape for " << top;
+        SetShape(top, shape, top);
+      }
+      return;
+    }
+    CHECK_GT(op_param.bottom_size(), 0) << op_name;
+    const auto& in_shape = BottomShape(op_param, 0);
+    const auto& bottom_root = roots_.at(op_param.bottom(0));
+    if (type == "Conv") {
+      int num_output = argument_i(op_param, "num_output", 0);
+      int kernel_size = argument_i(op_param, "kernel_size", 0);
+      int stride = argument_i(op_param, "stride", 1);
+      int pad = argument_i(op_param, "pad", 0);
+      int dilation = argument_i(op_param, "dilation", 1);
+      int group = argument_i(op_param, "group", 1);
+      int kernel_extent = dilation * (kernel_size - 1) + 1;
+      top_shape = {in_shape[0], num_output,
+                   (in_shape[2] + 2 * pad - kernel_extent) / stride + 1,
+                   (in_shape[3] + 2 * pad - kernel_extent) / stride + 1};
+      bool depthwise =
+          dilation == 1 && group == in_shape[1] && group == num_output;
+      bool direct = kernel_size == 1 && stride == 1 && pad == 0;
+      if (!depthwise && !direct) {
+        temp_counts_[i] = kernel_size * kernel_size * in_shape[1] *
+                          top_shape[2] * top_shape[3];
+      }
+    } else if (type == "Pooling") {
+      top_shape = in_shape;
+      int kernel_h, kernel_w, stride_h, stride_w, pad_h, pad_w;
+      pooling_window(op_param, in_shape, &kernel_h, &kernel_w, &stride_h,
+                     &stride_w, &pad_h, &pad_w);
+      bool full = argument_i(op_param, "full_pooling", 1) != 0;
+      auto out_size = [full](int dim, int kernel, int stride, int pad) {
+        float size = (dim + 2.f * pad - kernel) / stride;
+        int out = static_cast<int>(full ? std::ceil(size) : std::floor(size));
+        out += 1;
+        if (pad && (out - 1) * stride >= dim + pad) out--;
+        return out;
+      };
+      top_shape[2] = out_size(in_shape[2], kernel_h, stride_h, pad_h);
+      top_shape[3] = out_size(in_shape[3], kernel_w, stride_w, pad_w);
+    } else if (type == "Activate" || type == "Eltwise") {
+      top_shape = in_shape;
+    } else if (type == "Softmax") {
+      top_shape = in_shape;
+      int axis = Canonical(argument_i(op_param, "axis", 1), in_shape);
+      temp_counts_[i] = shape_count(in_shape) / in_shape[axis];
+    } else if (type == "Connected") {
+      top_shape = {in_shape[0], argument_i(op_param, "num_output", 0)};
+    } else if (type == "Concat") {
+      top_shape = in_shape;
+      int axis = Canonical(argument_i(op_param, "axis", 1), in_shape);
+      CHECK(axis >= 0 && axis < static_cast<int>(in_shape.size())) << op_name;
+      for (int n = 1; n < op_param.bottom_size(); ++n) {
+        top_shape[axis] += BottomShape(op_param, n)[axis];
+      }
+      if (op_param.bottom_size() == 1) {
+        SetShape(op_param.top(0), top_shape, bottom_root);
+        return;
+      }
+    } else if (type == "Permute") {
+      for (const auto order : argument_v_i(op_param, "order")) {
+        top_shape.push_back(in_shape[order]);
+      }
+      CHECK_EQ(top_shape.size(), in_shape.size()) << op_name;
+    } else if (type == "Flatten") {
+      int num_axes = static_cast<int>(in_shape.size());
+      int axis = argument_i(op_param, "axis", 1);
+      int end_axis = argument_i(op_param, "end_axis", -1);
+      if (end_axis == -1) end_axis = num_axes - 1;
+      top_shape.assign(in_shape.begin(), in_shape.begin() + axis);
+      top_shape.push_back(shape_count(in_shape, axis, end_axis + 1));
+      top_shape.insert(top_shape.end(), in_shape.begin() + end_axis + 1,
+                       in_shape.end());
+      SetShape(op_param.top(0), top_shape, bottom_root);
+      return;
+    } else if (type == "Reshape") {
+      SetShape(op_param.top(0), ReshapeShape(op_param, in_shape),
+               bottom_root);
+      return;
+    } else {
+      LOG(FATAL) << "AOT code does not support " << type << " op " << op_name
+                 << ", load the model into a Network instead";
+    }
+    for (const auto& top : op_param.top()) {
+      // In place ops keep writing the buffer of their bottom
+      SetShape(top, top_shape, roots_.count(top) ? roots_[top] : top);
+    }
+  }
+
+  int Canonical(int axis, const std::vector<int>& shape) const {
+    return axis < 0 ? axis + static_cast<int>(shape.size()) : axis;
+  }
+
+  const std::vector<int> ReshapeShape(const shadow::OpParam& op_param,
+                                      const std::vector<int>& in_shape) const {
+    const auto& shape = argument_v_i(op_param, "shape");
+    int num_axes = static_cast<int>(in_shape.size());
+    int axis = argument_i(op_param, "axis", 0);
+    int reshape_axes = argument_i(op_param, "num_axes", -1);
+    int start_axis = axis >= 0 ? axis : num_axes + axis + 1;
+    int end_axis = reshape_axes == -1 ? num_axes : start_axis + reshape_axes;
+    std::vector<int> top_shape(in_shape.begin(), in_shape.begin() + start_axis);
+    int inferred = -1, known = shape_count(in_shape, 0, start_axis) *
+                               shape_count(in_shape, end_axis, num_axes);
+    for (int d = 0; d < static_cast<int>(shape.size()); ++d) {
+      int dim = shape[d];
+      if (dim == 0) dim = in_shape[start_axis + d];
+      if (dim == -1) inferred = static_cast<int>(top_shape.size());
+      if (dim != -1) known *= dim;
+      top_shape.push_back(dim);
+    }
+    top_shape.insert(top_shape.end(), in_shape.begin() + end_axis,
+                     in_shape.end());
+    if (inferred >= 0) top_shape[inferred] = shape_count(in_shape) / known;
+    CHECK_EQ(shape_count(top_shape), shape_count(in_shape))
+        << op_param.name();
+    return top_shape;
+  }
+
+  // First fit over the ranges live at each op, a buffer is released after
+  // the last op touching it or any blob sharing it, outputs are never
+  // released. Tops are placed before the bottoms are released, so no op
+  // reads and writes overlapping ranges
+  void AllocateArena() {
+    std::map<std::string, int> last_use;
+    for (int i = 0; i < net_.op_size(); ++i) {
+      const auto& op_param = net_.op(i);
+      for (const auto& name : op_param.bottom()) {
+        if (!weights_.count(name)) last_use[roots_.at(name)] = i;
+      }
+      for (const auto& name : op_param.top()) last_use[roots_.at(name)] = i;
+    }
+    for (const auto& name : out_blob_) last_use[roots_.at(name)] = INT_MAX;
+
+    std::map<int, int> live;
+    auto allocate = [&](int count) {
+      // Ranges are rounded up to whole cache lines
+      count = (count + 15) / 16 * 16;
+      int offset = 0;
+      for (const auto& range : live) {
+        if (range.first - offset >= count) break;
+        offset = std::max(offset, range.first + range.second);
+      }
+      live[offset] = count;
+      arena_count_ = std::max(arena_count_, offset + count);
+      return offset;
+    };
+
+    for (int i = 0; i < net_.op_size(); ++i) {
+      const auto& op_param = net_.op(i);
+      for (const auto& name : op_param.top()) {
+        const auto& root = roots_.at(name);
+        bool in_arena = i > 0 || copied_inputs_.count(root);
+        if (root == name && !offsets_.count(root) && in_arena) {
+          offsets_[root] = allocate(shape_count(shapes_.at(root)));
+        }
+      }
+      if (temp_counts_[i] > 0) {
+        temp_offsets_[i] = allocate(temp_counts_[i]);
+        live.erase(temp_offsets_[i]);
+      }
+      for (const auto& use : last_use) {
+        if (use.second == i && offsets_.count(use.first)) {
+          live.erase(offsets_.at(use.first));
+        }
+      }
+    }
+  }
+
+  const shadow::NetParam& net_;
+  std::string weight_prefix_;
+
+  std::map<std::string, int> writers_;
+  std::set<std::string> weights_, copied_inputs_;
+  std::vector<std::string> inputs_, out_blob_;
+
+  std::map<std::string, std::vector<int>> shapes_;
+  std::map<std::string, std::string> roots_;
+  std::map<std::string, int> offsets_;
+  std::vector<int> temp_counts_;
+  std::map<int, int> temp_offsets_;
+  int arena_count_ = 0;
+};
+
+// Emits func(args...); wrapped at 80 columns
+void write_call(std::stringstream* ss, const std::string& indent,
+                const std::string& func, const std::vector<std::string>& args) {
+  auto line = indent + func + "(";
+  int num_args = static_cast<int>(args.size());
+  for (int n = 0; n < num_args; ++n) {
+    auto arg = args[n] + (n + 1 < num_args ? "," : ");");
+    if (line.back() == '(') {
+      line += arg;
+    } else if (line.size() + 1 + arg.size() > 80) {
+      *ss << line << "\n";
+      line = indent + "    " + arg;
+    } else {
+      line += " " + arg;
+    }
+  }
+  *ss << line << "\n";
+}
+
+void WriteForward(const shadow::NetParam& shadow_net, const std::string& root,
+                  const std::string& model_name) {
+  auto class_name = model_name;
+  auto weight_prefix = model_name;
+  std::transform(model_name.begin(), model_name.end(), class_name.begin(),
+                 ::toupper);
+  std::transform(model_name.begin(), model_name.end(), weight_prefix.begin(),
+                 ::tolower);
+  class_name += "_AOT";
+  const auto& model_name_aot_cpp = model_name + "_aot.cpp";
+  const auto& model_name_aot_hpp = model_name + "_aot.hpp";
+  const auto& model_name_weights_hpp = model_name + "_weights.hpp";
+
+  ForwardPlanner planner(shadow_net, weight_prefix);
+  planner.Plan();
+
+  auto str = [](int value) { return Util::to_string(value); };
+  auto dims = [](const std::vector<int>& shape) {
+    return Util::format_vector(shape, "x");
+  };
+  auto plus = [](const std::string& expr, const std::string& offset) {
+    return offset.empty() ? expr : expr + " + " + offset;
+  };
+
+  // Shapes and index tables the kernels take by pointer or reference
+  std::stringstream statics, body;
+  std::map<std::vector<int>, std::string> shape_names;
+  auto shape_expr = [&](const std::vector<int>& shape) {
+    if (!shape_names.count(shape)) {
+      auto name = "shape_" + str(static_cast<int>(shape_names.size())) + "_";
+      statics << "static const VecInt " << name
+              << Util::format_vector(shape, ", ", "{", "}") << ";\n";
+      shape_names[shape] = name;
+    }
+    return shape_names[shape];
+  };
+  int num_tables = 0;
+  auto table_expr = [&](const std::vector<int>& values) {
+    auto name = "table_" + str(num_tables++) + "_";
+    statics << "static const int " << name << "[] = "
+            << Util::format_vector(values, ", ", "{", "}") << ";\n";
+    return name;
+  };
+
+  const std::string indent("  "), null_expr("nullptr");
+  for (int i = 1; i < shadow_net.op_size(); ++i) {
+    const auto& op_param = shadow_net.op(i);
+    const auto& type = op_param.type();
+    const auto& in_name = op_param.bottom(0);
+    const auto& in_shape = planner.Shape(in_name);
+    const auto& out_shape = planner.Shape(op_param.top(0));
+    const auto in = planner.Expr(in_name), out = planner.Expr(op_param.top(0));
+    int count = shape_count(out_shape);
+
+    body << indent << "// " << op_param.name() << ": " << type << ", "
+         << dims(in_shape) << " -> " << dims(out_shape) << "\n";
+
+    // Optional bottoms of the fused output stage, see Vision::Epilogue
+    int activate_type = argument_i(op_param, "type", -1);
+    float slope = argument_f(op_param, "slope", 0.1f);
+    auto channel_shared = str(argument_i(op_param, "channel_shared", 0));
+    std::string bias = null_expr, slope_data = null_expr, scale = null_expr,
+                residual = null_expr;
+    bool has_epilogue = false;
+    if (type == "Conv" || type == "Connected") {
+      int index = 2;
+      if (argument_i(op_param, "bias_term", 1)) {
+        bias = planner.Expr(op_param.bottom(index++));
+      }
+      if (activate_type == 0) {
+        slope_data = planner.Expr(op_param.bottom(index++));
+      }
+      if (argument_i(op_param, "scale_term", 0)) {
+        scale = planner.Expr(op_param.bottom(index++));
+      }
+      if (argument_i(op_param, "residual_term", 0)) {
+        residual = planner.Expr(op_param.bottom(index++));
+      }
+      CHECK_EQ(op_param.bottom_size(), index) << op_param.name();
+      has_epilogue = bias != null_expr || scale != null_expr ||
+                     residual != null_expr || activate_type != -1;
+    }
+
+    if (type == "Conv") {
+      const auto weight = planner.Expr(op_param.bottom(1));
+      int num_output = out_shape[1], batch = in_shape[0], in_c = in_shape[1];
+      int kernel_size = argument_i(op_param, "kernel_size", 0);
+      int stride = argument_i(op_param, "stride", 1);
+      int pad = argument_i(op_param, "pad", 0);
+      int dilation = argument_i(op_param, "dilation", 1);
+      int group = argument_i(op_param, "group", 1);
+      int spatial_dim = out_shape[2] * out_shape[3];
+      int kernel_dim = kernel_size * kernel_size * in_c / group;
+      if (dilation == 1 && group == in_c && group == num_output) {
+        // The bias is summed in the kernel unless it has to follow the scale
+        auto depthwise_bias = scale != null_expr ? null_expr : bias;
+        write_call(&body, indent, "Vision::Depthwise<float>",
+                   {in, shape_expr(in_shape), weight, depthwise_bias,
+                    str(kernel_size), str(stride), str(pad),
+                    str(depthwise_bias != null_expr), shape_expr(out_shape),
+                    out});
+        if (scale != null_expr || residual != null_expr ||
+            activate_type != -1) {
+          write_call(&body, indent, "Vision::Epilogue<float>",
+                     {out, str(batch), str(num_output), str(spatial_dim),
+                      scale, scale != null_expr ? bias : null_expr, residual,
+                      str(activate_type), float_literal(slope), slope_data,
+                      channel_shared});
+        }
+        continue;
+      }
+      bool direct = kernel_size == 1 && stride == 1 && pad == 0;
+      int bottom_num = shape_count(in_shape, 1, 4);
+      int top_num = num_output * spatial_dim;
+      auto loop_indent = indent;
+      std::string in_offset, out_offset;
+      if (batch > 1) {
+        body << indent << "for (int b = 0; b < " << batch << "; ++b) {\n";
+        loop_indent += "  ";
+        in_offset = "b * " + str(bottom_num);
+        out_offset = "b * " + str(top_num);
+      }
+      std::string col;
+      if (!direct) {
+        col = planner.TempExpr(i);
+        write_call(&body, loop_indent, "Vision::Im2Col<float>",
+                   {in, shape_expr(in_shape),
+                    in_offset.empty() ? "0" : in_offset, str(kernel_size),
+                    str(stride), str(pad), str(dilation), "0",
+                    shape_expr(out_shape), col});
+      }
+      write_call(&body, loop_indent, "Blas::BlasSgemmBatched<float>",
+                 {"0", "0", str(num_output / group), str(spatial_dim),
+                  str(kernel_dim), "1", weight, "0",
+                  str(num_output * kernel_dim / group), direct ? in : col,
+                  direct && !in_offset.empty() ? in_offset : "0",
+                  str(kernel_dim * spatial_dim), "0", out,
+                  out_offset.empty() ? "0" : out_offset,
+                  str(num_output * spatial_dim / group), str(group),
+                  null_expr});
+      if (has_epilogue) {
+        write_call(&body, loop_indent, "Vision::Epilogue<float>",
+                   {plus(out, out_offset), "1", str(num_output),
+                    str(spatial_dim), scale, bias,
+                    residual != null_expr ? plus(residual, out_offset)
+                                          : null_expr,
+                    str(activate_type), float_literal(slope), slope_data,
+                    channel_shared});
+      }
+      if (batch > 1) body << indent << "}\n";
+    } else if (type == "Pooling") {
+      int kernel_h, kernel_w, stride_h, stride_w, pad_h, pad_w;
+      pooling_window(op_param, in_shape, &kernel_h, &kernel_w, &stride_h,
+                     &stride_w, &pad_h, &pad_w);
+      write_call(&body, indent, "Vision::Pooling<float>",
+                 {in, shape_expr(in_shape), str(kernel_h), str(kernel_w),
+                  str(stride_h), str(stride_w), str(pad_h), str(pad_w),
+                  str(argument_i(op_param, "pool", 0)), shape_expr(out_shape),
+                  out});
+    } else if (type == "Activate") {
+      activate_type = argument_i(op_param, "type", 1);
+      if (in != out) {
+        write_call(&body, indent, "Blas::BlasScopy<float>",
+                   {str(count), in, "0", out, "0", null_expr});
+      }
+      if (activate_type == 0) {
+        write_call(&body, indent, "Vision::PRelu<float>",
+                   {out, shape_expr(out_shape), channel_shared,
+                    planner.Expr(op_param.bottom(1))});
+      } else {
+        write_call(&body, indent, "Vision::Activate<float>",
+                   {out, str(count), str(activate_type),
+                    float_literal(slope)});
+      }
+    } else if (type == "Connected") {
+      const auto weight = planner.Expr(op_param.bottom(1));
+      int batch = in_shape[0], num_output = out_shape[1];
+      int bottom_num = shape_count(in_shape) / batch;
+      if (batch == 1) {
+        write_call(&body, indent, "Blas::BlasSgemv<float>",
+                   {"0", str(num_output), str(bottom_num), "1", weight, "0",
+                    in, "0", "0", out, "0", null_expr});
+      } else {
+        write_call(&body, indent, "Blas::BlasSgemm<float>",
+                   {"0", str(argument_i(op_param, "transpose", 1)),
+                    str(batch), str(num_output), str(bottom_num), "1", in,
+                    "0", weight, "0", "0", out, "0", null_expr});
+      }
+      if (has_epilogue) {
+        write_call(&body, indent, "Vision::Epilogue<float>",
+                   {out, str(batch), str(num_output), "1", scale, bias,
+                    residual, str(activate_type), float_literal(slope),
+                    slope_data, channel_shared});
+      }
+    } else if (type == "Softmax") {
+      int axis = argument_i(op_param, "axis", 1);
+      if (axis < 0) axis += static_cast<int>(in_shape.size());
+      int num_axes = static_cast<int>(in_shape.size());
+      auto outer = str(shape_count(in_shape, 0, axis));
+      auto inner = str(shape_count(in_shape, axis + 1, num_axes));
+      auto channels = str(in_shape[axis]), temp = planner.TempExpr(i);
+      if (in != out) {
+        write_call(&body, indent, "Blas::BlasScopy<float>",
+                   {str(count), in, "0", out, "0", null_expr});
+      }
+      write_call(&body, indent, "Blas::ChannelMax<float>",
+                 {outer, channels, inner, out, temp});
+      write_call(&body, indent, "Blas::ChannelSub<float>",
+                 {str(count), outer, channels, inner, temp, out});
+      write_call(&body, indent, "Blas::Exp<float>",
+                 {str(count), out, "0", out, "0"});
+      write_call(&body, indent, "Blas::ChannelSum<float>",
+                 {outer, channels, inner, out, temp});
+      write_call(&body, indent, "Blas::ChannelDiv<float>",
+                 {str(count), outer, channels, inner, temp, out});
+    } else if (type == "Concat" && op_param.bottom_size() > 1) {
+      int num_axes = static_cast<int>(out_shape.size());
+      int axis = argument_i(op_param, "axis", 1);
+      if (axis < 0) axis += num_axes;
+      auto num_concats = str(shape_count(out_shape, 0, axis));
+      auto concat_size = str(shape_count(out_shape, axis + 1, num_axes));
+      int offset_concat_axis = 0;
+      for (const auto& bottom : op_param.bottom()) {
+        const auto& bottom_shape = planner.Shape(bottom);
+        write_call(&body, indent, "Vision::Concat<float>",
+                   {planner.Expr(bottom), str(shape_count(bottom_shape)),
+                    num_concats, concat_size, str(out_shape[axis]),
+                    str(bottom_shape[axis]), str(offset_concat_axis), out});
+        offset_concat_axis += bottom_shape[axis];
+      }
+    } else if (type == "Eltwise") {
+      int operation = argument_i(op_param, "operation", 1);
+      std::vector<std::string> coeff(op_param.bottom_size(), "1.f");
+      const auto* coeff_arg = find_argument(op_param, "coeff");
+      if (coeff_arg != nullptr && coeff_arg->v_f_size() > 0) {
+        CHECK_EQ(coeff_arg->v_f_size(), op_param.bottom_size());
+        for (int n = 0; n < op_param.bottom_size(); ++n) {
+          coeff[n] = float_literal(coeff_arg->v_f(n));
+        }
+      }
+      // Prod: 0, Sum: 1, Max: 2, Min: 3
+      if (operation == 1) {
+        write_call(&body, indent, "Blas::Set<float>",
+                   {str(count), "0", out, "0"});
+        for (int n = 0; n < op_param.bottom_size(); ++n) {
+          write_call(&body, indent, "Blas::BlasSaxpy<float>",
+                     {str(count), coeff[n], planner.Expr(op_param.bottom(n)),
+                      "0", out, "0", null_expr});
+        }
+      } else {
+        CHECK(operation == 0 || operation == 2 || operation == 3)
+            << "Unknown elementwise operation " << operation;
+        const std::string func = operation == 0
+                                     ? "Blas::Mul<float>"
+                                     : operation == 2 ? "Blas::Max<float>"
+                                                      : "Blas::Min<float>";
+        for (int n = 1; n < op_param.bottom_size(); ++n) {
+          write_call(&body, indent, func,
+                     {str(count), n == 1 ? in : out, "0",
+                      planner.Expr(op_param.bottom(n)), "0", out, "0"});
+        }
+      }
+    } else if (type == "Permute") {
+      const auto& order = argument_v_i(op_param, "order");
+      int num_axes = static_cast<int>(order.size());
+      std::vector<int> old_steps(num_axes, 1), new_steps(num_axes, 1);
+      for (int d = num_axes - 2; d >= 0; --d) {
+        old_steps[d] = old_steps[d + 1] * in_shape[d + 1];
+        new_steps[d] = new_steps[d + 1] * out_shape[d + 1];
+      }
+      write_call(&body, indent, "Vision::Permute<float, int>",
+                 {in, str(count), str(num_axes), table_expr(order),
+                  table_expr(old_steps), table_expr(new_steps), out});
+    } else {
+      // Flatten, Reshape and single bottom Concat
+      body << indent << "// shares the buffer of " << in_name << "\n";
+    }
+  }
+
+  //########## write ahead of time forward to cpp ##########//
+  std::ofstream cpp_file(root + "/" + model_name_aot_cpp);
+
+  cpp_file << "#include \"" << model_name_aot_hpp << "\"\n"
+           << "#include \"" << model_name_weights_hpp << "\"\n\n";
+
+  cpp_file << "#include \"core/blas.hpp\"\n"
+           << "#include \"operators/activate_op.hpp\"\n"
+           << "#include \"operators/concat_op.hpp\"\n"
+           << "#include \"operators/conv_op.hpp\"\n"
+           << "#include \"operators/permute_op.hpp\"\n"
+           << "#include \"operators/pooling_op.hpp\"\n\n";
+
+  cpp_file << "namespace Shadow {\n\n";
+
+  if (!statics.str().empty()) {
+    cpp_file << statics.str() << "\n";
+  }
+
+  std::vector<std::string> params;
+  for (const auto& name : planner.inputs()) {
+    params.push_back("const float *in_" + planner.Sanitize(name));
+  }
+  auto forward_decl = "void " + class_name + "::Forward(" +
+                      Util::format_vector(params, ", ") + ") {\n";
+  if (forward_decl.size() > 81) {
+    forward_decl = "void " + class_name + "::Forward(\n    " +
+                   Util::format_vector(params, ", ") + ") {\n";
+  }
+  cpp_file << forward_decl;
+  cpp_file << "  auto *arena = arena_.data();\n";
+  for (const auto& name : planner.copied_inputs()) {
+    cpp_file << "  memcpy(" << planner.Expr(name) << ", in_"
+             << planner.Sanitize(name) << ", "
+             << shape_count(planner.Shape(name)) << " * sizeof(float));\n";
+  }
+  cpp_file << "\n" << body.str() << "}\n\n";
+
+  cpp_file << "}  // namespace Shadow\n";
+
+  cpp_file.close();
+
+  //########## write ahead of time forward to hpp ##########//
+  std::ofstream hpp_file(root + "/" + model_name_aot_hpp);
+
+  hpp_file << "#ifndef SHADOW_" << class_name << "_HPP\n"
+           << "#define SHADOW_" << class_name << "_HPP\n\n";
+
+  hpp_file << "#include <vector>\n\n";
+
+  hpp_file << "namespace Shadow {\n\n";
+
+  hpp_file << "// Forward of " << model_name << " for fixed input shapes, "
+           << "the kernels are called\n"
+           << "// directly on one preallocated arena, so an instance must "
+           << "not run on two\n"
+           << "// threads at once\n";
+  hpp_file << "class " << class_name << " {\n"
+           << " public:\n";
+  hpp_file << "  " << class_name << "() : arena_(" << planner.arena_count()
+           << ") {}\n\n";
+
+  for (const auto& name : planner.inputs()) {
+    hpp_file << "  // in_" << planner.Sanitize(name) << ": "
+             << dims(planner.Shape(name)) << "\n";
+  }
+  hpp_file << "  void Forward(" << Util::format_vector(params, ", ")
+           << ");\n\n";
+
+  for (const auto& name : planner.out_blob()) {
+    CHECK(!planner.IsWeight(name)) << "out_blob " << name << " is a weight";
+    const auto& accessor = "out_" + planner.Sanitize(name);
+    hpp_file << "  // " << dims(planner.Shape(name)) << "\n";
+    hpp_file << "  const float *" << accessor << "() const {\n"
+             << "    return arena_.data() + " << planner.Offset(name)
+             << ";\n  }\n";
+    hpp_file << "  static int " << accessor << "_count() { return "
+             << shape_count(planner.Shape(name)) << "; }\n";
+  }
+
+  // The same by index, for code that runs any written model
+  std::vector<int> in_counts, out_offsets, out_counts;
+  for (const auto& name : planner.inputs()) {
+    in_counts.push_back(shape_count(planner.Shape(name)));
+  }
+  for (const auto& name : planner.out_blob()) {
+    out_offsets.push_back(planner.Offset(name));
+    out_counts.push_back(shape_count(planner.Shape(name)));
+  }
+  hpp_file << "\n  // Inputs in the order of Forward, outputs in the order "
+           << "of out_blob\n";
+  hpp_file << "  static int num_inputs() { return " << in_counts.size()
+           << "; }\n"
+           << "  static int input_count(int n) {\n"
+           << "    static const int counts[]{"
+           << Util::format_vector(in_counts, ", ") << "};\n"
+           << "    return counts[n];\n  }\n";
+  hpp_file << "  static int num_outputs() { return " << out_counts.size()
+           << "; }\n"
+           << "  const float *output(int n) const {\n"
+           << "    static const int offsets[]{"
+           << Util::format_vector(out_offsets, ", ") << "};\n"
+           << "    return arena_.data() + offsets[n];\n  }\n"
+           << "  static int output_count(int n) {\n"
+           << "    static const int counts[]{"
+           << Util::format_vector(out_counts, ", ") << "};\n"
+           << "    return counts[n];\n  }\n";
+  hpp_file << "\n private:\n";
+  hpp_file << "  std::vector<float> arena_;\n";
+  hpp_file << "};\n\n";
+
+  hpp_file << "}  // namespace Shadow\n\n";
+
+  hpp_file << "#endif  // SHADOW_" << class_name << "_HPP\n";
+
+  hpp_file.close();
+}
+
 void WriteProtoToFiles(const shadow::NetParam& shadow_net,
                        const std::string& root, const std::string& model_name) {
   Util::make_directory(root);
@@ -386,4 +1171,13 @@ void WriteProtoToFiles(const shadow::NetParam& shadow_net,
   WriteWeights(shadow_net, root, code_name);
 }
 
+void WriteForwardToFiles(const shadow::NetParam& shadow_net,
+                         const std::string& root,
+                         const std::string& model_name) {
+  WriteProtoToFiles(shadow_net, root, model_name);
+  const std::vector<std::string>& illegal_chars{".", "-"};
+  const auto& code_name = Util::find_replace(model_name, illegal_chars, "_");
+  WriteForward(shadow_net, root, code_name);
+}
+
 }  // namespace Shadow
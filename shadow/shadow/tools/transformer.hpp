@@ -18,6 +18,18 @@ void WriteWeights(const shadow::NetParam& shadow_net, const std::string& root,
 void WriteProtoToFiles(const shadow::NetParam& shadow_net,
                        const std::string& root, const std::string& model_name);
 
+// Ahead of time code: model_name_aot.hpp and .cpp hold a class whose Forward
+// calls the CPU kernels of each op in order, for the input shapes given in
+// the Input op. Shapes, buffer offsets and kernel choices are fixed when the
+// code is written and the weights are the arrays written by WriteWeights
+void WriteForward(const shadow::NetParam& shadow_net, const std::string& root,
+                  const std::string& model_name);
+
+// WriteProtoToFiles followed by WriteForward
+void WriteForwardToFiles(const shadow::NetParam& shadow_net,
+                         const std::string& root,
+                         const std::string& model_name);
+
 }  // namespace Shadow
 
 #endif  // SHADOW_TOOLS_TRANSFORMER_HPP
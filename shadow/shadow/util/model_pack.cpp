@@ -0,0 +1,389 @@
+#include "model_pack.hpp"
+#include "io.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#if defined(USE_Zstd)
+#include <zstd.h>
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define PACK_X86
+#include <immintrin.h>
+#endif
+
+namespace Shadow {
+
+namespace IO {
+
+// Layout, integers in host byte order:
+//   magic[8] version:u32 num_tensors:u32 graph_size:u64 graph
+//   per tensor: name_size:u32 name elem_size:u32 codec:u32 count:u64
+//               chunk_count:u32 num_chunks:u32 (offset:u64 size:u64)[]
+//   payloads, each starting on kPackAlign
+static const char kPackMagic[8] = {'S', 'H', 'A', 'D', 'O', 'W', 'P', 'K'};
+static const uint32_t kPackVersion = 1;
+
+// Elements per chunk, 1MB of floats
+static const int kPackChunk = 1 << 18;
+
+static const int kPackAlign = 64;
+
+bool IsModelPack(const void* pack_data, size_t pack_size) {
+  return pack_data != nullptr && pack_size >= sizeof(kPackMagic) &&
+         memcmp(pack_data, kPackMagic, sizeof(kPackMagic)) == 0;
+}
+
+bool IsModelPackFile(const std::string& pack_file) {
+  std::ifstream file(pack_file, std::ios::in | std::ios::binary);
+  char magic[sizeof(kPackMagic)];
+  return file.read(magic, sizeof(magic)) && IsModelPack(magic, sizeof(magic));
+}
+
+// Round to nearest even, overflow goes to infinity and NaN stays NaN
+static uint16_t FloatToHalf(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+  uint32_t abs = bits & 0x7fffffffu;
+  if (abs >= 0x7f800000u) {
+    return sign | 0x7c00u | (abs > 0x7f800000u ? 0x200u : 0u);
+  }
+  if (abs >= 0x477ff000u) return sign | 0x7c00u;
+  if (abs < 0x38800000u) {
+    // Subnormal halves count in steps of 2^-24
+    float a;
+    memcpy(&a, &abs, sizeof(a));
+    return sign | static_cast<uint16_t>(std::nearbyint(a * 16777216.f));
+  }
+  abs += 0xfffu + ((abs >> 13) & 1u);
+  return sign | static_cast<uint16_t>((abs - 0x38000000u) >> 13);
+}
+
+static float HalfToFloat(uint16_t h) {
+  uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+  uint32_t exp = (h >> 10) & 0x1fu, mant = h & 0x3ffu, bits;
+  if (exp == 0x1f) {
+    bits = sign | 0x7f800000u | (mant << 13);
+  } else if (exp != 0) {
+    bits = sign | ((exp + 112) << 23) | (mant << 13);
+  } else {
+    float f = mant * (1.f / 16777216.f);
+    memcpy(&bits, &f, sizeof(bits));
+    bits |= sign;
+  }
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+#if defined(PACK_X86)
+__attribute__((target("avx,f16c"))) static void HalfToFloatF16C(
+    int n, const uint16_t* h, float* f) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i));
+    _mm256_storeu_ps(f + i, _mm256_cvtph_ps(v));
+  }
+  for (; i < n; ++i) f[i] = HalfToFloat(h[i]);
+}
+#endif
+
+static void HalfToFloat(int n, const uint16_t* h, float* f) {
+#if defined(PACK_X86)
+  static const bool has_f16c = __builtin_cpu_supports("f16c");
+  if (has_f16c) return HalfToFloatF16C(n, h, f);
+#endif
+  for (int i = 0; i < n; ++i) f[i] = HalfToFloat(h[i]);
+}
+
+// Byte planes of the elements one after another: sign and exponent bytes of
+// weights repeat a lot and compress far better grouped
+static void ShuffleBytes(int n, int elem_size, const char* src, char* dst) {
+  for (int b = 0; b < elem_size; ++b) {
+    for (int i = 0; i < n; ++i) dst[b * n + i] = src[i * elem_size + b];
+  }
+}
+
+#if defined(USE_Zstd)
+static void UnshuffleBytes(int n, int elem_size, const char* src, char* dst) {
+  for (int b = 0; b < elem_size; ++b) {
+    for (int i = 0; i < n; ++i) dst[i * elem_size + b] = src[b * n + i];
+  }
+}
+#endif
+
+bool ModelPack::Open(const std::string& pack_file) {
+  std::ifstream file(pack_file, std::ios::in | std::ios::binary);
+  CHECK(file.is_open()) << "File not found: " << pack_file;
+  file.seekg(0, std::ios::end);
+  buffer_.resize(static_cast<size_t>(file.tellg()));
+  file.seekg(0, std::ios::beg);
+  if (!file.read(&buffer_[0], buffer_.size())) return false;
+  data_ = buffer_.data(), size_ = buffer_.size();
+  return Parse();
+}
+
+bool ModelPack::Open(const void* pack_data, size_t pack_size) {
+  buffer_.clear();
+  data_ = static_cast<const char*>(pack_data), size_ = pack_size;
+  return Parse();
+}
+
+bool ModelPack::Parse() {
+  size_t pos = sizeof(kPackMagic);
+  auto read = [this, &pos](void* dst, size_t n) {
+    if (n > size_ - pos) return false;
+    memcpy(dst, data_ + pos, n);
+    pos += n;
+    return true;
+  };
+
+  uint32_t version = 0, num_tensors = 0;
+  uint64_t graph_size = 0;
+  if (!IsModelPack(data_, size_) || !read(&version, 4) ||
+      version != kPackVersion || !read(&num_tensors, 4) ||
+      !read(&graph_size, 8) || graph_size > size_ - pos) {
+    return false;
+  }
+#if defined(USE_Protobuf)
+  if (!ReadProtoFromArray(data_ + pos, static_cast<int>(graph_size),
+                          &net_param_)) {
+    return false;
+  }
+#else
+  LOG(FATAL) << "Unsupported load model pack, recompiled with USE_Protobuf";
+#endif
+  pos += graph_size;
+
+  tensors_.assign(num_tensors, PackTensor());
+  for (auto& tensor : tensors_) {
+    uint32_t name_size = 0;
+    if (!read(&name_size, 4) || name_size > size_ - pos) return false;
+    tensor.name.assign(data_ + pos, name_size);
+    pos += name_size;
+    uint32_t elem_size = 0, codec = 0, chunk_count = 0, num_chunks = 0;
+    uint64_t count = 0;
+    if (!read(&elem_size, 4) || !read(&codec, 4) || !read(&count, 8) ||
+        !read(&chunk_count, 4) || !read(&num_chunks, 4)) {
+      return false;
+    }
+    if ((elem_size != 1 && elem_size != 4) || codec > 3 ||
+        ((codec & kPackHalf) && elem_size != 4) || chunk_count == 0 ||
+        num_chunks != (count + chunk_count - 1) / chunk_count) {
+      return false;
+    }
+    tensor.elem_size = elem_size, tensor.codec = codec;
+    tensor.count = count;
+    tensor.chunks.resize(num_chunks);
+    for (uint32_t c = 0; c < num_chunks; ++c) {
+      auto& chunk = tensor.chunks[c];
+      uint64_t offset = 0, size = 0;
+      if (!read(&offset, 8) || !read(&size, 8) || offset > size_ ||
+          size > size_ - offset) {
+        return false;
+      }
+      chunk.offset = offset, chunk.size = size;
+      chunk.begin = static_cast<int64_t>(c) * chunk_count;
+      chunk.count = static_cast<int>(
+          std::min<int64_t>(chunk_count, tensor.count - chunk.begin));
+    }
+  }
+  return true;
+}
+
+void ModelPack::DecodeChunk(int t, int c, void* dst) const {
+  const auto& tensor = tensors_[t];
+  const auto& chunk = tensor.chunks[c];
+  bool half = (tensor.codec & kPackHalf) != 0;
+  int stored_size = half ? 2 : tensor.elem_size;
+  auto stored_bytes = static_cast<size_t>(chunk.count) * stored_size;
+  auto* out = static_cast<char*>(dst) + chunk.begin * tensor.elem_size;
+
+  const char* src = data_ + chunk.offset;
+  std::vector<char> shuffled, stored;
+  if (tensor.codec & kPackZstd) {
+#if defined(USE_Zstd)
+    shuffled.resize(stored_bytes);
+    auto size =
+        ZSTD_decompress(shuffled.data(), stored_bytes, src, chunk.size);
+    CHECK(!ZSTD_isError(size) && size == stored_bytes)
+        << "Failed to decompress chunk " << c << " of " << tensor.name;
+    if (half) stored.resize(stored_bytes);
+    auto* plain = half ? stored.data() : out;
+    UnshuffleBytes(chunk.count, stored_size, shuffled.data(), plain);
+    src = plain;
+#else
+    LOG(FATAL) << "Unsupported zstd model pack, recompiled with USE_Zstd";
+#endif
+  } else {
+    CHECK_EQ(static_cast<size_t>(chunk.size), stored_bytes)
+        << "Chunk " << c << " of " << tensor.name << " has a wrong size";
+  }
+
+  if (half) {
+    HalfToFloat(chunk.count, reinterpret_cast<const uint16_t*>(src),
+                reinterpret_cast<float*>(out));
+  } else if (src != out) {
+    memcpy(out, src, stored_bytes);
+  }
+}
+
+static std::string EncodeChunk(const char* src, int count, int elem_size,
+                               int codec, int zstd_level) {
+  bool half = (codec & kPackHalf) != 0;
+  int stored_size = half ? 2 : elem_size;
+  std::string stored(static_cast<size_t>(count) * stored_size, 0);
+  if (half) {
+    for (int i = 0; i < count; ++i) {
+      float f;
+      memcpy(&f, src + i * 4, sizeof(f));
+      auto h = FloatToHalf(f);
+      memcpy(&stored[i * 2], &h, sizeof(h));
+    }
+  } else {
+    memcpy(&stored[0], src, stored.size());
+  }
+  if (!(codec & kPackZstd)) return stored;
+
+  std::string shuffled(stored.size(), 0), compressed;
+  ShuffleBytes(count, stored_size, stored.data(), &shuffled[0]);
+#if defined(USE_Zstd)
+  compressed.resize(ZSTD_compressBound(shuffled.size()));
+  auto size = ZSTD_compress(&compressed[0], compressed.size(), shuffled.data(),
+                            shuffled.size(), zstd_level);
+  CHECK(!ZSTD_isError(size)) << "Failed to compress chunk, "
+                             << ZSTD_getErrorName(size);
+  compressed.resize(size);
+#else
+  (void)zstd_level;
+#endif
+  return compressed;
+}
+
+template <typename T>
+static void Append(std::string* out, T value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void WriteModelPack(const shadow::NetParam& net_param,
+                    const std::string& pack_file, int codec, int zstd_level) {
+#if defined(USE_Protobuf)
+#if !defined(USE_Zstd)
+  CHECK(!(codec & kPackZstd))
+      << "Unsupported zstd model pack, recompiled with USE_Zstd";
+#endif
+  auto graph = net_param;
+  std::vector<PackTensor> tensors;
+  std::vector<const char*> sources;
+  for (int i = 0; i < net_param.blob_size(); ++i) {
+    const auto& blob = net_param.blob(i);
+    PackTensor tensor;
+    tensor.name = blob.name();
+    tensor.elem_size = 4;
+    if (blob.data_f_size() > 0) {
+      tensor.codec = codec, tensor.count = blob.data_f_size();
+      sources.push_back(reinterpret_cast<const char*>(blob.data_f().data()));
+    } else if (blob.data_i_size() > 0) {
+      tensor.codec = codec & ~kPackHalf, tensor.count = blob.data_i_size();
+      sources.push_back(reinterpret_cast<const char*>(blob.data_i().data()));
+    } else if (blob.data_b_size() > 0) {
+      CHECK_EQ(blob.data_b_size(), 1);
+      tensor.elem_size = 1;
+      tensor.codec = codec & ~kPackHalf, tensor.count = blob.data_b(0).size();
+      sources.push_back(blob.data_b(0).data());
+    } else {
+      continue;
+    }
+    for (int64_t begin = 0; begin < tensor.count; begin += kPackChunk) {
+      PackChunk chunk;
+      chunk.begin = begin;
+      chunk.count = static_cast<int>(
+          std::min<int64_t>(kPackChunk, tensor.count - begin));
+      tensor.chunks.push_back(chunk);
+    }
+    tensors.push_back(tensor);
+    auto* graph_blob = graph.mutable_blob(i);
+    graph_blob->clear_data_f(), graph_blob->clear_data_i();
+    graph_blob->clear_data_b();
+  }
+
+  std::vector<std::pair<int, int>> chunk_ids;
+  for (int t = 0; t < static_cast<int>(tensors.size()); ++t) {
+    for (int c = 0; c < static_cast<int>(tensors[t].chunks.size()); ++c) {
+      chunk_ids.emplace_back(t, c);
+    }
+  }
+  int num_chunks = static_cast<int>(chunk_ids.size());
+  std::vector<std::string> payloads(num_chunks);
+#if defined(USE_OpenMP)
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i = 0; i < num_chunks; ++i) {
+    const auto& tensor = tensors[chunk_ids[i].first];
+    const auto& chunk = tensor.chunks[chunk_ids[i].second];
+    payloads[i] = EncodeChunk(
+        sources[chunk_ids[i].first] + chunk.begin * tensor.elem_size,
+        chunk.count, tensor.elem_size, tensor.codec, zstd_level);
+  }
+
+  std::string graph_str;
+  CHECK(graph.SerializeToString(&graph_str)) << "Write graph error!";
+  size_t header_size = sizeof(kPackMagic) + 16 + graph_str.size();
+  for (const auto& tensor : tensors) {
+    header_size += 28 + tensor.name.size() + 16 * tensor.chunks.size();
+  }
+  auto align = [](size_t offset) {
+    return (offset + kPackAlign - 1) / kPackAlign * kPackAlign;
+  };
+  size_t offset = align(header_size);
+  for (int i = 0; i < num_chunks; ++i) {
+    auto& chunk = tensors[chunk_ids[i].first].chunks[chunk_ids[i].second];
+    chunk.offset = offset, chunk.size = payloads[i].size();
+    offset = align(offset + chunk.size);
+  }
+
+  std::string header(kPackMagic, sizeof(kPackMagic));
+  Append<uint32_t>(&header, kPackVersion);
+  Append<uint32_t>(&header, static_cast<uint32_t>(tensors.size()));
+  Append<uint64_t>(&header, graph_str.size());
+  header += graph_str;
+  for (const auto& tensor : tensors) {
+    Append<uint32_t>(&header, static_cast<uint32_t>(tensor.name.size()));
+    header += tensor.name;
+    Append<uint32_t>(&header, tensor.elem_size);
+    Append<uint32_t>(&header, tensor.codec);
+    Append<uint64_t>(&header, tensor.count);
+    Append<uint32_t>(&header, kPackChunk);
+    Append<uint32_t>(&header, static_cast<uint32_t>(tensor.chunks.size()));
+    for (const auto& chunk : tensor.chunks) {
+      Append<uint64_t>(&header, chunk.offset);
+      Append<uint64_t>(&header, chunk.size);
+    }
+  }
+  CHECK_EQ(header.size(), header_size);
+
+  std::ofstream file(pack_file,
+                     std::ios::out | std::ios::trunc | std::ios::binary);
+  CHECK(file.is_open()) << "Failed to open " << pack_file;
+  std::string padding(kPackAlign, 0);
+  file.write(header.data(), header.size());
+  file.write(padding.data(), align(header.size()) - header.size());
+  for (const auto& payload : payloads) {
+    file.write(payload.data(), payload.size());
+    file.write(padding.data(), align(payload.size()) - payload.size());
+  }
+  CHECK(file.good()) << "Write model pack error!";
+
+#else
+  LOG(FATAL) << "Unsupported write model pack, recompiled with USE_Protobuf";
+#endif
+}
+
+}  // namespace IO
+
+}  // namespace Shadow
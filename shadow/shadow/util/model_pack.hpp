@@ -0,0 +1,73 @@
+#ifndef SHADOW_UTIL_MODEL_PACK_HPP
+#define SHADOW_UTIL_MODEL_PACK_HPP
+
+#include "core/params.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Shadow {
+
+namespace IO {
+
+// A model pack keeps the graph and the weights apart in one file: a header,
+// the NetParam with its blob data stripped, an index of the tensors and their
+// payloads. Tensors are cut into chunks encoded on their own, so even a
+// single large tensor is decoded by several threads. A chunk is stored raw or
+// as half floats (float tensors only), then optionally byte shuffled and
+// compressed by zstd
+enum PackCodec { kPackRaw = 0, kPackHalf = 1, kPackZstd = 2 };
+
+struct PackChunk {
+  // Payload position in the pack and first element in the tensor
+  int64_t offset = 0, size = 0, begin = 0;
+  int count = 0;
+};
+
+struct PackTensor {
+  std::string name;
+  int elem_size = 0, codec = kPackRaw;
+  int64_t count = 0;
+  std::vector<PackChunk> chunks;
+};
+
+bool IsModelPack(const void* pack_data, size_t pack_size);
+bool IsModelPackFile(const std::string& pack_file);
+
+class ModelPack {
+ public:
+  // Reads the whole file, or refers to pack_data which must outlive the
+  // decoding
+  bool Open(const std::string& pack_file);
+  bool Open(const void* pack_data, size_t pack_size);
+
+  const shadow::NetParam& net_param() const { return net_param_; }
+  const std::vector<PackTensor>& tensors() const { return tensors_; }
+
+  // Writes chunk c of tensor t into its range of dst, which holds the count
+  // elements of the tensor. Chunks may be decoded concurrently
+  void DecodeChunk(int t, int c, void* dst) const;
+
+ private:
+  bool Parse();
+
+  std::string buffer_;
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+
+  shadow::NetParam net_param_;
+  std::vector<PackTensor> tensors_;
+};
+
+// Packs the blob data of net_param, codec is a combination of PackCodec
+// flags, kPackHalf only applies to float blobs
+void WriteModelPack(const shadow::NetParam& net_param,
+                    const std::string& pack_file, int codec = kPackZstd,
+                    int zstd_level = 3);
+
+}  // namespace IO
+
+}  // namespace Shadow
+
+#endif  // SHADOW_UTIL_MODEL_PACK_HPP
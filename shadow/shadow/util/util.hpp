@@ -2,17 +2,22 @@
 #define SHADOW_UTIL_UTIL_HPP
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cctype>
 #include <cerrno>
 #include <cfloat>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
 #include <cstring>
 #include <fstream>
 #include <functional>
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <random>
 #include <sstream>
 #include <stdexcept>
@@ -21,7 +26,6 @@
 
 #if defined(__linux__) || defined(__APPLE__)
 #include <unistd.h>
-#include <chrono>
 #include <climits>
 #elif defined(_WIN32)
 #pragma warning(disable : 4018 4244 4267 4305 4996)
@@ -530,7 +534,7 @@ class Timer {
  public:
   Timer() {
 #if defined(__linux__) || defined(__APPLE__)
-    tstart_ = std::chrono::system_clock::now();
+    tstart_ = std::chrono::steady_clock::now();
 #elif defined(_WIN32)
     QueryPerformanceFrequency(&tfrequency_);
     QueryPerformanceCounter(&tstart_);
@@ -539,7 +543,7 @@ class Timer {
 
   void start() {
 #if defined(__linux__) || defined(__APPLE__)
-    tstart_ = std::chrono::system_clock::now();
+    tstart_ = std::chrono::steady_clock::now();
 #elif defined(_WIN32)
     QueryPerformanceCounter(&tstart_);
 #endif
@@ -547,10 +551,8 @@ class Timer {
 
   double get_microsecond() {
 #if defined(__linux__) || defined(__APPLE__)
-    tend_ = std::chrono::system_clock::now();
-    return std::chrono::duration_cast<std::chrono::microseconds>(tend_ -
-                                                                 tstart_)
-        .count();
+    tend_ = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(tend_ - tstart_).count();
 #elif defined(_WIN32)
     QueryPerformanceCounter(&tend_);
     return 1000000.0 * (tend_.QuadPart - tstart_.QuadPart) /
@@ -606,54 +608,349 @@ class Timer {
 
  private:
 #if defined(__linux__) || defined(__APPLE__)
-  std::chrono::time_point<std::chrono::system_clock> tstart_, tend_;
+  std::chrono::time_point<std::chrono::steady_clock> tstart_, tend_;
 #elif defined(_WIN32)
   LARGE_INTEGER tstart_, tend_, tfrequency_;
 #endif
 };
 
+// Latencies in nanoseconds bucketed like HdrHistogram: values below
+// kSubBuckets get a bucket each and every higher power of two is split in
+// kSubBuckets linear buckets, so a bucket stays within 1 / kSubBuckets of
+// the values it holds over the whole range
+class LatencyHistogram {
+ public:
+  static const int kSubBits = 5, kSubBuckets = 1 << kSubBits;
+  static const int kNumBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+  LatencyHistogram() : counts_(kNumBuckets, 0) {}
+
+  static int bucket(uint64_t value) {
+    if (value < kSubBuckets) return static_cast<int>(value);
+#if defined(__GNUC__)
+    int msb = 63 - __builtin_clzll(value);
+#else
+    int msb = 63;
+    while (!(value >> msb)) --msb;
+#endif
+    int shift = msb - kSubBits;
+    return (shift + 1) * kSubBuckets + static_cast<int>(value >> shift) -
+           kSubBuckets;
+  }
+  // Largest value falling in bucket b
+  static uint64_t bucket_value(int b) {
+    if (b < kSubBuckets) return static_cast<uint64_t>(b);
+    int shift = b / kSubBuckets - 1;
+    auto base = static_cast<uint64_t>(b % kSubBuckets + kSubBuckets) << shift;
+    return base + ((uint64_t(1) << shift) - 1);
+  }
+
+  void add(int b, uint64_t count) { counts_[b] += count; }
+  void add_totals(uint64_t count, uint64_t sum, uint64_t min, uint64_t max) {
+    count_ += count, sum_ += sum;
+    min_ = std::min(min_, min), max_ = std::max(max_, max);
+  }
+
+  void record(uint64_t value) {
+    add(bucket(value), 1);
+    add_totals(1, value, value, value);
+  }
+  void merge(const LatencyHistogram &other) {
+    for (int b = 0; b < kNumBuckets; ++b) add(b, other.counts_[b]);
+    add_totals(other.count_, other.sum_, other.min_, other.max_);
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t min() const { return count_ > 0 ? min_ : 0; }
+  uint64_t max() const { return max_; }
+  double mean() const {
+    return count_ > 0 ? static_cast<double>(sum_) / count_ : 0;
+  }
+  // Smallest bucket bound with at least p percent of the values at or below
+  uint64_t percentile(double p) const {
+    auto target = static_cast<uint64_t>(std::ceil(p / 100 * count_));
+    target = std::max<uint64_t>(target, 1);
+    uint64_t seen = 0;
+    for (int b = 0; b < kNumBuckets; ++b) {
+      seen += counts_[b];
+      if (seen >= target) return std::min(bucket_value(b), max_);
+    }
+    return max_;
+  }
+
+ private:
+  std::vector<uint64_t> counts_;
+  uint64_t count_ = 0, sum_ = 0, min_ = UINT64_MAX, max_ = 0;
+};
+
+// Latencies of one stage recorded from any number of threads. Each thread
+// writes a histogram of its own without locks or shared cache lines, and a
+// snapshot sums them with plain atomic loads while recording goes on. The
+// stage has to outlive the threads recording to it. Defining
+// SHADOW_DISABLE_PROFILER compiles recording out
+class ProfileStage {
+ public:
+  explicit ProfileStage(const std::string &name)
+      : name_(name), id_(next_id()++) {}
+  ~ProfileStage() {
+    auto *slot = slots_.load(std::memory_order_acquire);
+    while (slot != nullptr) {
+      auto *next = slot->next;
+      delete slot;
+      slot = next;
+    }
+  }
+
+  const std::string &name() const { return name_; }
+
+  // Times the stage from a tic to the next toc of the calling thread, a toc
+  // without a pending tic on this thread has nothing to time
+  void tic() {
+#if !defined(SHADOW_DISABLE_PROFILER)
+    auto *slot = local_slot();
+    slot->pending = true;
+    slot->start = std::chrono::steady_clock::now();
+#endif
+  }
+  void toc() {
+#if !defined(SHADOW_DISABLE_PROFILER)
+    auto *slot = local_slot();
+    if (!slot->pending) return;
+    slot->pending = false;
+    auto elapsed = std::chrono::steady_clock::now() - slot->start;
+    record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+            .count()));
+#endif
+  }
+
+  void record(uint64_t nanoseconds) {
+#if !defined(SHADOW_DISABLE_PROFILER)
+    auto *slot = local_slot();
+    // Only the owning thread writes its slot, a load and a store are enough
+    auto bump = [](std::atomic<uint64_t> &value, uint64_t delta) {
+      value.store(value.load(std::memory_order_relaxed) + delta,
+                  std::memory_order_relaxed);
+    };
+    bump(slot->counts[LatencyHistogram::bucket(nanoseconds)], 1);
+    bump(slot->sum, nanoseconds);
+    if (nanoseconds < slot->min.load(std::memory_order_relaxed)) {
+      slot->min.store(nanoseconds, std::memory_order_relaxed);
+    }
+    if (nanoseconds > slot->max.load(std::memory_order_relaxed)) {
+      slot->max.store(nanoseconds, std::memory_order_relaxed);
+    }
+    bump(slot->count, 1);
+#endif
+  }
+
+  LatencyHistogram snapshot() const {
+    LatencyHistogram histogram;
+    auto *slot = slots_.load(std::memory_order_acquire);
+    for (; slot != nullptr; slot = slot->next) {
+      for (int b = 0; b < LatencyHistogram::kNumBuckets; ++b) {
+        histogram.add(b, slot->counts[b].load(std::memory_order_relaxed));
+      }
+      histogram.add_totals(slot->count.load(std::memory_order_relaxed),
+                           slot->sum.load(std::memory_order_relaxed),
+                           slot->min.load(std::memory_order_relaxed),
+                           slot->max.load(std::memory_order_relaxed));
+    }
+    return histogram;
+  }
+
+ private:
+  struct Slot {
+    Slot() {
+      for (auto &count : counts) count.store(0, std::memory_order_relaxed);
+    }
+    std::atomic<uint64_t> counts[LatencyHistogram::kNumBuckets];
+    std::atomic<uint64_t> count{0}, sum{0}, min{UINT64_MAX}, max{0};
+    // The pending tic, never read by a snapshot
+    bool pending = false;
+    std::chrono::steady_clock::time_point start;
+    Slot *next = nullptr;
+  };
+
+  // Slots of the calling thread indexed by stage id, ids are never reused
+  // so entries of destroyed stages are never looked at again
+  Slot *local_slot() {
+    thread_local std::vector<Slot *> local_slots;
+    if (id_ < local_slots.size() && local_slots[id_] != nullptr) {
+      return local_slots[id_];
+    }
+    auto *slot = new Slot();
+    slot->next = slots_.load(std::memory_order_relaxed);
+    while (!slots_.compare_exchange_weak(slot->next, slot,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed)) {
+    }
+    if (id_ >= local_slots.size()) local_slots.resize(id_ + 1, nullptr);
+    local_slots[id_] = slot;
+    return slot;
+  }
+
+  static std::atomic<size_t> &next_id() {
+    static std::atomic<size_t> id(0);
+    return id;
+  }
+
+  std::string name_;
+  size_t id_;
+  std::atomic<Slot *> slots_{nullptr};
+};
+
+// Records the steady time from construction to destruction in stage
+class ProfileScope {
+ public:
+  explicit ProfileScope(ProfileStage *stage) : stage_(stage) {
+#if !defined(SHADOW_DISABLE_PROFILER)
+    start_ = std::chrono::steady_clock::now();
+#endif
+  }
+  ~ProfileScope() {
+#if !defined(SHADOW_DISABLE_PROFILER)
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    stage_->record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+            .count()));
+#endif
+  }
+
+ private:
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+
+  ProfileStage *stage_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Stages by name. tic and toc time a stage on the calling thread, so
+// concurrent requests may profile the same stages, the name is looked up
+// under the lock only the first time a thread uses it. Hot paths can hold
+// on to stage(name) and time it by the stage overloads or ProfileScope. Like
+// the stages, the profiler has to outlive the threads timing with it
 class Profiler {
  public:
-  explicit Profiler(bool enable = true) : enable_(enable) {}
+  explicit Profiler(bool enable = true) : enable_(enable), id_(next_id()++) {}
+  ~Profiler() {
+    auto *local = locals_.load(std::memory_order_acquire);
+    while (local != nullptr) {
+      auto *next = local->next;
+      delete local;
+      local = next;
+    }
+    auto &thread_locals = local_table();
+    if (id_ < thread_locals.size()) thread_locals[id_] = nullptr;
+  }
 
   void set_enable(bool enable) { enable_ = enable; }
 
+  ProfileStage *stage(const std::string &profile_name) {
+    return find_stage(profile_name, true);
+  }
+
   void tic(const std::string &profile_name) {
+#if !defined(SHADOW_DISABLE_PROFILER)
     if (!enable_) return;
-    if (timers_.count(profile_name)) {
-      timers_.at(profile_name).start();
-    } else {
-      timers_[profile_name] = Timer();
-    }
+    local_stage(profile_name, true)->tic();
+#endif
   }
   void toc(const std::string &profile_name) {
+#if !defined(SHADOW_DISABLE_PROFILER)
     if (!enable_) return;
-    assert(timers_.count(profile_name));
-    auto time_cost = timers_.at(profile_name).get_millisecond();
-    if (stats_.count(profile_name)) {
-      auto &state = stats_.at(profile_name);
-      state.first++;
-      state.second += time_cost;
-    } else {
-      stats_[profile_name] = std::make_pair(1, time_cost);
-    }
+    auto *profile_stage = local_stage(profile_name, false);
+    if (profile_stage != nullptr) profile_stage->toc();
+#endif
+  }
+  void tic(ProfileStage *profile_stage) {
+#if !defined(SHADOW_DISABLE_PROFILER)
+    if (enable_) profile_stage->tic();
+#endif
+  }
+  void toc(ProfileStage *profile_stage) {
+#if !defined(SHADOW_DISABLE_PROFILER)
+    if (enable_) profile_stage->toc();
+#endif
   }
 
   const std::string get_stats_str() {
+    std::lock_guard<std::mutex> lock(mutex_);
     std::stringstream ss;
-    for (const auto &state : stats_) {
-      int sum_count = state.second.first;
-      double sum_cost = state.second.second;
-      ss << state.first << ": " << sum_cost << " / " << sum_count << " = "
-         << sum_cost / sum_count << " ms; ";
+    for (const auto &stage : stages_) {
+      const auto &histogram = stage.second->snapshot();
+      if (histogram.count() == 0) continue;
+      auto ms = [](double ns) { return ns / 1000000; };
+      ss << stage.first << ": " << histogram.count() << " x "
+         << ms(histogram.mean()) << " ms, p50 "
+         << ms(histogram.percentile(50)) << " p90 "
+         << ms(histogram.percentile(90)) << " p99 "
+         << ms(histogram.percentile(99)) << " max " << ms(histogram.max())
+         << " ms; ";
     }
     return ss.str();
   }
 
  private:
-  bool enable_ = true;
-  std::map<std::string, Timer> timers_;
-  std::map<std::string, std::pair<int, double>> stats_;
+  // Stages one thread has timed by name, owned by the profiler
+  struct Local {
+    std::map<std::string, ProfileStage *> stages;
+    Local *next = nullptr;
+  };
+
+  ProfileStage *find_stage(const std::string &profile_name, bool create) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = stages_.find(profile_name);
+    if (it != stages_.end()) return it->second.get();
+    if (!create) return nullptr;
+    auto &stage = stages_[profile_name];
+    stage = std::make_shared<ProfileStage>(profile_name);
+    return stage.get();
+  }
+
+  ProfileStage *local_stage(const std::string &profile_name, bool create) {
+    auto *local = local_stages();
+    auto it = local->stages.find(profile_name);
+    if (it != local->stages.end()) return it->second;
+    auto *profile_stage = find_stage(profile_name, create);
+    if (profile_stage != nullptr) local->stages[profile_name] = profile_stage;
+    return profile_stage;
+  }
+
+  // Same as the stage slots, the entries of destroyed profilers in other
+  // threads are left dangling but never looked at again
+  Local *local_stages() {
+    auto &thread_locals = local_table();
+    if (id_ < thread_locals.size() && thread_locals[id_] != nullptr) {
+      return thread_locals[id_];
+    }
+    auto *local = new Local();
+    local->next = locals_.load(std::memory_order_relaxed);
+    while (!locals_.compare_exchange_weak(local->next, local,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+    }
+    if (id_ >= thread_locals.size()) thread_locals.resize(id_ + 1, nullptr);
+    thread_locals[id_] = local;
+    return local;
+  }
+
+  // Caches of the calling thread indexed by profiler id
+  static std::vector<Local *> &local_table() {
+    thread_local std::vector<Local *> thread_locals;
+    return thread_locals;
+  }
+
+  static std::atomic<size_t> &next_id() {
+    static std::atomic<size_t> id(0);
+    return id;
+  }
+
+  std::atomic<bool> enable_;
+  size_t id_;
+  std::mutex mutex_;
+  std::map<std::string, std::shared_ptr<ProfileStage>> stages_;
+  std::atomic<Local *> locals_{nullptr};
 };
 
 class Process {